@@ -3194,6 +3194,42 @@ void hb_job_close( hb_job_t ** _j )
     }
 }
 
+/**********************************************************************
+ * hb_job_duration
+ **********************************************************************
+ * Expected duration of the job's output in 90kHz ticks, from its stop
+ * point or the chapters it covers.
+ *********************************************************************/
+int64_t hb_job_duration( hb_job_t * job )
+{
+    hb_chapter_t * chapter;
+    int64_t        duration = 0;
+    int            ii;
+
+    if( job->pts_to_stop )
+    {
+        return job->pts_to_stop;
+    }
+    if( job->frame_to_stop && job->vrate > 0 )
+    {
+        return (int64_t)job->frame_to_stop * 90000 *
+               job->vrate_base / job->vrate;
+    }
+    for( ii = job->chapter_start; ii <= job->chapter_end; ii++ )
+    {
+        chapter = hb_list_item( job->list_chapter, ii - 1 );
+        if( chapter != NULL )
+        {
+            duration += chapter->duration;
+        }
+    }
+    if( duration <= 0 )
+    {
+        duration = job->title->duration;
+    }
+    return duration;
+}
+
 void hb_job_set_encoder_preset(hb_job_t *job, const char *preset)
 {
     if (job != NULL)
@@ -98,9 +98,11 @@ typedef union  hb_esconfig_u     hb_esconfig_t;
 typedef struct hb_work_private_s hb_work_private_t;
 typedef struct hb_work_object_s  hb_work_object_t;
 typedef struct hb_filter_private_s hb_filter_private_t;
+typedef struct hb_filter_reorder_s hb_filter_reorder_t;
 typedef struct hb_filter_object_s  hb_filter_object_t;
 typedef struct hb_buffer_s hb_buffer_t;
 typedef struct hb_fifo_s hb_fifo_t;
+typedef struct hb_fifo_group_s hb_fifo_group_t;
 typedef struct hb_lock_s hb_lock_t;
 typedef enum
 {
@@ -607,6 +609,29 @@ struct hb_job_s
     int use_hwd;
     int use_decomb;
     int use_detelecine;
+    int filter_threads;                 // frames in flight per frame parallel
+                                        //  filter, 0 or 1 runs one instance
+    int reader_prefetch;                // KiB the reader may read ahead of
+                                        //  the demuxer, 0 for the default,
+                                        //  < 0 reads synchronously
+    int priority;                       // when several jobs may run at once
+                                        //  (see hb_set_job_concurrency),
+                                        //  higher priority jobs start first
+    int chunk_count;                    // encode the video in this many
+                                        //  segments at once, 0 or 1 for one
+    int fragment_duration;              // ms per moof/mdat fragment of
+                                        //  fragmented MP4 output, 0 writes
+                                        //  a single moov
+    int segment_duration;               // ms per output file of segmented
+                                        //  MP4 output (implies fragmented,
+                                        //  with 2 s fragments unless
+                                        //  fragment_duration is set), 0
+                                        //  writes a single file.  The .m4s
+                                        //  files after the first have no
+                                        //  styp, and their moofs carry
+                                        //  base_data_offsets counted from
+                                        //  the start of the first file, so
+                                        //  they only play concatenated
 
 #ifdef USE_QSV
     // QSV-specific settings
@@ -639,6 +664,13 @@ struct hb_job_s
     uint64_t        st_pause_date;
     uint64_t        st_paused;
 
+    struct hb_interjob_s * interjob; /* shared by the passes of an encode */
+    int             thread_count; /* encoder/decoder threads, 0 for their
+                                     default */
+    hb_list_t     * list_chunk;   /* segment jobs of a chunked encode */
+    hb_fifo_t     * fifo_chunk;   /* segment job: encoded video for the
+                                     parent job's encchunk */
+
     hb_fifo_t     * fifo_mpeg2;   /* MPEG-2 video ES */
     hb_fifo_t     * fifo_raw;     /* Raw pictures */
     hb_fifo_t     * fifo_sync;    /* Raw pictures, framerate corrected */
@@ -1142,6 +1174,8 @@ extern hb_work_object_t hb_encavcodec;
 extern hb_work_object_t hb_encqsv;
 extern hb_work_object_t hb_encx264;
 extern hb_work_object_t hb_enctheora;
+extern hb_work_object_t hb_encchunk;
+extern hb_work_object_t hb_chunktiming;
 extern hb_work_object_t hb_encx265;
 extern hb_work_object_t hb_decavcodeca;
 extern hb_work_object_t hb_decavcodecv;
@@ -1205,6 +1239,7 @@ struct hb_filter_object_s
     hb_subtitle_t     * subtitle;
 
     hb_filter_private_t * private_data;
+    int                 frame_parallel; // work() keeps no state between frames
 
     hb_thread_t       * thread;
     volatile int      * done;
@@ -1214,6 +1249,11 @@ struct hb_filter_object_s
     // These are used to bridge the chapter to the next buffer
     int                 chapter_val;
     int64_t             chapter_time;
+
+    // Frame parallel filters run extra copies of themselves on successive
+    // frames.  The reorder state they share restores output order.
+    hb_list_t           * instances;
+    hb_filter_reorder_t * reorder;
 #endif
 };
 
@@ -54,6 +54,7 @@ hb_filter_object_t hb_filter_crop_scale =
     .work          = hb_crop_scale_work,
     .close         = hb_crop_scale_close,
     .info          = hb_crop_scale_info,
+    .frame_parallel = 1,
 };
 
 static int hb_crop_scale_init( hb_filter_object_t * filter,
@@ -79,6 +80,8 @@ static int hb_crop_scale_init( hb_filter_object_t * filter,
     {
         pv->os = ( hb_oclscale_t * )malloc( sizeof( hb_oclscale_t ) );
         memset( pv->os, 0, sizeof( hb_oclscale_t ) );
+        // The OpenCL scaler shares one device context, keep it serial
+        filter->frame_parallel = 0;
     }
 
     memcpy( pv->crop, init->crop, sizeof( int[4] ) );
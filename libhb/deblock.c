@@ -18,6 +18,12 @@
 
 #include "hb.h"
 #include "hbffmpeg.h"
+#include "threadpool.h"
+
+#if ARCH_X86_64 || ARCH_X86_32
+#include <emmintrin.h>
+#define PP7_SSE2 1
+#endif
 
 #define PP7_QP_DEFAULT    5
 #define PP7_MODE_DEFAULT  2
@@ -40,13 +46,27 @@ static const uint8_t  __attribute__((aligned(8))) pp7_dither[8][8] =
     { 42,  26,  38,  22,  41,  25,  37,  21, },
 };
 
+typedef struct deblock_segment_s {
+    DCTELEM * temp;                  // dct_a output for one row
+    DCTELEM   block[16];
+} deblock_segment_t;
+
 struct hb_filter_private_s
 {
     int           pp7_qp;
     int           pp7_mode;
     int           pp7_mpeg2;
-    int           pp7_temp_stride;
-    uint8_t     * pp7_src;
+    int        (* pp7_requantize)( DCTELEM * src, int qp );
+    void       (* pp7_dct_b)( DCTELEM * dst, DCTELEM * src );
+
+    // Copies of the planes with an 8 pixel mirrored border
+    uint8_t     * pp7_src[3];
+    int           pp7_src_stride[3];
+
+    int           cpu_count;
+    deblock_segment_t * segments;    // Per segment scratch - one per CPU
+    hb_buffer_t * src;
+    hb_buffer_t * dst;
 };
 
 static int hb_deblock_init( hb_filter_object_t * filter,
@@ -157,6 +177,150 @@ static void pp7_init_threshold( void )
     }
 }
 
+#ifdef PP7_SSE2
+/*
+ * 16 bit copies of the factors and thresholds for the SSE2 code.
+ * Coefficient 0 is never thresholded; a threshold of 0 lets it through
+ * unmodified in all three modes (a zero coefficient adds nothing).
+ */
+static int16_t __attribute__((aligned(16))) pp7_factor16[16];
+static int16_t __attribute__((aligned(16))) pp7_threshold16[99][16];
+
+static void pp7_init_threshold16( void )
+{
+    int qp, i;
+
+    for( i = 0; i < 16; i++ )
+    {
+        pp7_factor16[i] = pp7_factor[i];
+    }
+    for( qp = 0; qp < 99; qp++ )
+    {
+        pp7_threshold16[qp][0] = 0;
+        for( i = 1; i < 16; i++ )
+        {
+            pp7_threshold16[qp][i] = pp7_threshold[qp][i];
+        }
+    }
+}
+
+/*
+ * All intermediate values of the transform and of the requantizers fit
+ * in 16 bits for 8 bit input, so the SSE2 versions give exactly the same
+ * results as the C versions.
+ */
+__attribute__((target("sse2")))
+static void pp7_dct_b_sse2( DCTELEM * dst, DCTELEM * src )
+{
+    __m128i r0 = _mm_loadl_epi64( (const __m128i*)( src + 0*4 ) );
+    __m128i r1 = _mm_loadl_epi64( (const __m128i*)( src + 1*4 ) );
+    __m128i r2 = _mm_loadl_epi64( (const __m128i*)( src + 2*4 ) );
+    __m128i r3 = _mm_loadl_epi64( (const __m128i*)( src + 3*4 ) );
+    __m128i r4 = _mm_loadl_epi64( (const __m128i*)( src + 4*4 ) );
+    __m128i r5 = _mm_loadl_epi64( (const __m128i*)( src + 5*4 ) );
+    __m128i r6 = _mm_loadl_epi64( (const __m128i*)( src + 6*4 ) );
+
+    __m128i s0 = _mm_add_epi16( r0, r6 );
+    __m128i s1 = _mm_add_epi16( r1, r5 );
+    __m128i s2 = _mm_add_epi16( r2, r4 );
+    __m128i s  = _mm_add_epi16( r3, r3 );
+    __m128i s3;
+
+    s3 = _mm_sub_epi16( s, s0 );
+    s0 = _mm_add_epi16( s, s0 );
+    s  = _mm_add_epi16( s2, s1 );
+    s2 = _mm_sub_epi16( s2, s1 );
+
+    _mm_storel_epi64( (__m128i*)( dst + 0*4 ), _mm_add_epi16( s0, s ) );
+    _mm_storel_epi64( (__m128i*)( dst + 2*4 ), _mm_sub_epi16( s0, s ) );
+    _mm_storel_epi64( (__m128i*)( dst + 1*4 ),
+                      _mm_add_epi16( _mm_add_epi16( s3, s3 ), s2 ) );
+    _mm_storel_epi64( (__m128i*)( dst + 3*4 ),
+                      _mm_sub_epi16( s3, _mm_add_epi16( s2, s2 ) ) );
+}
+
+// Sum of level[i] * pp7_factor[i], rounded like the C versions
+__attribute__((target("sse2")))
+static inline int pp7_weighted_sum_sse2( __m128i lo, __m128i hi )
+{
+    __m128i a;
+
+    a = _mm_add_epi32(
+            _mm_madd_epi16( lo, _mm_load_si128( (const __m128i*)pp7_factor16 ) ),
+            _mm_madd_epi16( hi, _mm_load_si128( (const __m128i*)( pp7_factor16 + 8 ) ) ) );
+    a = _mm_add_epi32( a, _mm_shuffle_epi32( a, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+    a = _mm_add_epi32( a, _mm_shuffle_epi32( a, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+    return ( _mm_cvtsi128_si32( a ) + (1<<11) ) >> 12;
+}
+
+// (unsigned)(level + t) > 2*t is the same as level > t || level < -t
+__attribute__((target("sse2")))
+static inline __m128i pp7_outside_sse2( __m128i level, __m128i t )
+{
+    return _mm_or_si128( _mm_cmpgt_epi16( level, t ),
+                         _mm_cmplt_epi16( level, _mm_sub_epi16( _mm_setzero_si128(), t ) ) );
+}
+
+__attribute__((target("sse2")))
+static int pp7_hard_threshold_sse2( DCTELEM * src, int qp )
+{
+    __m128i lo = _mm_loadu_si128( (const __m128i*)src );
+    __m128i hi = _mm_loadu_si128( (const __m128i*)( src + 8 ) );
+    __m128i tlo = _mm_load_si128( (const __m128i*)pp7_threshold16[qp] );
+    __m128i thi = _mm_load_si128( (const __m128i*)( pp7_threshold16[qp] + 8 ) );
+
+    lo = _mm_and_si128( lo, pp7_outside_sse2( lo, tlo ) );
+    hi = _mm_and_si128( hi, pp7_outside_sse2( hi, thi ) );
+    return pp7_weighted_sum_sse2( lo, hi );
+}
+
+__attribute__((target("sse2")))
+static inline __m128i pp7_soft_sse2( __m128i level, __m128i t )
+{
+    __m128i pos = _mm_cmpgt_epi16( level, t );
+    __m128i neg = _mm_cmplt_epi16( level, _mm_sub_epi16( _mm_setzero_si128(), t ) );
+
+    return _mm_or_si128( _mm_and_si128( pos, _mm_sub_epi16( level, t ) ),
+                         _mm_and_si128( neg, _mm_add_epi16( level, t ) ) );
+}
+
+__attribute__((target("sse2")))
+static int pp7_soft_threshold_sse2( DCTELEM * src, int qp )
+{
+    __m128i lo = _mm_loadu_si128( (const __m128i*)src );
+    __m128i hi = _mm_loadu_si128( (const __m128i*)( src + 8 ) );
+    __m128i tlo = _mm_load_si128( (const __m128i*)pp7_threshold16[qp] );
+    __m128i thi = _mm_load_si128( (const __m128i*)( pp7_threshold16[qp] + 8 ) );
+
+    return pp7_weighted_sum_sse2( pp7_soft_sse2( lo, tlo ),
+                                  pp7_soft_sse2( hi, thi ) );
+}
+
+__attribute__((target("sse2")))
+static inline __m128i pp7_medium_sse2( __m128i level, __m128i t )
+{
+    // Above 2*t the level is kept, between t and 2*t it is soft
+    // thresholded with twice the slope
+    __m128i keep = pp7_outside_sse2( level, _mm_add_epi16( t, t ) );
+    __m128i soft = pp7_soft_sse2( level, t );
+
+    return _mm_or_si128( _mm_and_si128( keep, level ),
+                         _mm_andnot_si128( keep, _mm_add_epi16( soft, soft ) ) );
+}
+
+__attribute__((target("sse2")))
+static int pp7_medium_threshold_sse2( DCTELEM * src, int qp )
+{
+    __m128i lo = _mm_loadu_si128( (const __m128i*)src );
+    __m128i hi = _mm_loadu_si128( (const __m128i*)( src + 8 ) );
+    __m128i tlo = _mm_load_si128( (const __m128i*)pp7_threshold16[qp] );
+    __m128i thi = _mm_load_si128( (const __m128i*)( pp7_threshold16[qp] + 8 ) );
+
+    return pp7_weighted_sum_sse2( pp7_medium_sse2( lo, tlo ),
+                                  pp7_medium_sse2( hi, thi ) );
+}
+#endif
+
 static int pp7_hard_threshold( DCTELEM * src, int qp )
 {
     int i;
@@ -235,50 +399,58 @@ static int pp7_soft_threshold( DCTELEM * src, int qp )
     return (a + (1<<11)) >> 12;
 }
 
-static int ( * pp7_requantize )( DCTELEM * src, int qp ) = pp7_hard_threshold;
-
-static void pp7_filter( hb_filter_private_t * pv,
-                        uint8_t * dst,
-                        uint8_t * src,
-                        int width,
-                        int height,
-                        uint8_t * qp_store,
-                        int qp_stride,
-                        int is_luma)
+/*
+ * Copy a plane into dst, adding an 8 pixel mirrored border all around.
+ */
+static void pp7_pad_plane( uint8_t * dst, uint8_t * src,
+                           int width, int height, int stride )
 {
     int x, y;
 
-    const int  stride = is_luma ? pv->pp7_temp_stride : ((width+16+15)&(~15));
-    uint8_t  * p_src  = pv->pp7_src + 8*stride;
-    DCTELEM  * block  = (DCTELEM *)(pv->pp7_src);
-    DCTELEM  * temp   = (DCTELEM *)(pv->pp7_src + 32);
-
-    if( !src || !dst )
-    {
-        return;
-    }
-
     for( y = 0; y < height; y++ )
     {
         int index = 8 + 8*stride + y*stride;
-        memcpy( p_src + index, src + y*width, width );
+        memcpy( dst + index, src + y*width, width );
 
         for( x = 0; x < 8; x++ )
         {
-            p_src[index         - x - 1] = p_src[index +         x    ];
-            p_src[index + width + x    ] = p_src[index + width - x - 1];
+            dst[index         - x - 1] = dst[index +         x    ];
+            dst[index + width + x    ] = dst[index + width - x - 1];
         }
     }
 
     for( y = 0; y < 8; y++ )
     {
-        memcpy( p_src + (     7-y)*stride,
-                p_src + (     y+8)*stride, stride );
-        memcpy( p_src + (height+8+y)*stride,
-                p_src + (height-y+7)*stride, stride );
+        memcpy( dst + (     7-y)*stride,
+                dst + (     y+8)*stride, stride );
+        memcpy( dst + (height+8+y)*stride,
+                dst + (height-y+7)*stride, stride );
     }
+}
 
-    for( y = 0; y < height; y++ )
+/*
+ * Filter rows y0..y1-1 of a plane. Every output row only depends on the
+ * padded source, so rows can be filtered in any order.
+ */
+static void pp7_filter( hb_filter_private_t * pv,
+                        deblock_segment_t * seg,
+                        uint8_t * dst,
+                        uint8_t * p_src,
+                        int stride,
+                        int width,
+                        int height,
+                        int y0,
+                        int y1,
+                        uint8_t * qp_store,
+                        int qp_stride,
+                        int is_luma)
+{
+    int x, y;
+
+    DCTELEM  * block  = seg->block;
+    DCTELEM  * temp   = seg->temp + 32;
+
+    for( y = y0; y < y1; y++ )
     {
         for( x = -8; x < 0; x += 4 )
         {
@@ -322,9 +494,9 @@ static void pp7_filter( hb_filter_private_t * pv,
                     pp7_dct_a( tp+4*8, src, stride );
                 }
 
-                pp7_dct_b( block, tp );
+                pv->pp7_dct_b( block, tp );
 
-                v = pp7_requantize( block, qp );
+                v = pv->pp7_requantize( block, qp );
                 v = (v + pp7_dither[y&7][x&7]) >> 6;
                 if( (unsigned)v > 255 )
                 {
@@ -336,6 +508,74 @@ static void pp7_filter( hb_filter_private_t * pv,
     }
 }
 
+/*
+ * deblock this segment of all three planes in a single thread.
+ */
+static void deblock_filter_segment( void * pv_v, int segment )
+{
+    hb_filter_private_t * pv = pv_v;
+    deblock_segment_t * seg = &pv->segments[segment];
+    int plane;
+
+    for( plane = 0; plane < 3; plane++ )
+    {
+        int width  = pv->src->plane[plane].stride;
+        int height = pv->src->plane[plane].height;
+        int y0 = ( height * segment ) / pv->cpu_count;
+        int y1 = ( height * ( segment + 1 ) ) / pv->cpu_count;
+
+        pp7_filter( pv, seg,
+                    pv->dst->plane[plane].data,
+                    pv->pp7_src[plane],
+                    pv->pp7_src_stride[plane],
+                    width, height, y0, y1,
+                    NULL, /* TODO: mpi->qscale*/
+                    0,    /* TODO: mpi->qstride*/
+                    plane == 0 );
+    }
+}
+
+/*
+ * threaded pp7 - each thread deblocks a single band of rows of all
+ * three planes.
+ *
+ * This function blocks until the frame is deblocked.
+ */
+static void deblock_filter( hb_filter_private_t * pv,
+                            hb_buffer_t * out,
+                            hb_buffer_t * in )
+{
+    int plane;
+
+    for( plane = 0; plane < 3; plane++ )
+    {
+        int width  = in->plane[plane].stride;
+        int height = in->plane[plane].height;
+        int stride = (width+16+15)&(~15);
+
+        if( pv->pp7_src[plane] == NULL || pv->pp7_src_stride[plane] != stride )
+        {
+            free( pv->pp7_src[plane] );
+            pv->pp7_src[plane] = malloc( stride * ( height + 16 ) );
+            pv->pp7_src_stride[plane] = stride;
+        }
+        pp7_pad_plane( pv->pp7_src[plane], in->plane[plane].data,
+                       width, height, stride );
+    }
+
+    pv->src = in;
+    pv->dst = out;
+
+    /*
+     * Let the thread pool make one pass over the data.
+     */
+    hb_parallel_for( pv->cpu_count, deblock_filter_segment, pv );
+
+    /*
+     * Entire frame is now deblocked.
+     */
+}
+
 static int hb_deblock_init( hb_filter_object_t * filter, 
                             hb_filter_init_t * init )
 {
@@ -358,24 +598,61 @@ static int hb_deblock_init( hb_filter_object_t * filter,
 
     pp7_init_threshold();
 
+    pv->pp7_dct_b = pp7_dct_b;
     switch( pv->pp7_mode )
     {
         case 0:
-            pp7_requantize = pp7_hard_threshold;
+        default:
+            pv->pp7_requantize = pp7_hard_threshold;
             break;
         case 1:
-            pp7_requantize = pp7_soft_threshold;
+            pv->pp7_requantize = pp7_soft_threshold;
             break;
         case 2:
-            pp7_requantize = pp7_medium_threshold;
+            pv->pp7_requantize = pp7_medium_threshold;
             break;
     }
 
-    int h = (init->height+16+15)&(~15);
+#ifdef PP7_SSE2
+    if( hb_get_cpu_flags() & AV_CPU_FLAG_SSE2 )
+    {
+        pp7_init_threshold16();
 
-    pv->pp7_temp_stride = (init->width+16+15)&(~15);
+        pv->pp7_dct_b = pp7_dct_b_sse2;
+        switch( pv->pp7_mode )
+        {
+            case 0:
+            default:
+                pv->pp7_requantize = pp7_hard_threshold_sse2;
+                break;
+            case 1:
+                pv->pp7_requantize = pp7_soft_threshold_sse2;
+                break;
+            case 2:
+                pv->pp7_requantize = pp7_medium_threshold_sse2;
+                break;
+        }
+    }
+#endif
 
-    pv->pp7_src = (uint8_t*)malloc( pv->pp7_temp_stride*(h+8)*sizeof(uint8_t) );
+    pv->cpu_count = hb_get_cpu_count();
+
+    pv->segments = calloc( pv->cpu_count, sizeof( deblock_segment_t ) );
+    if( pv->segments == NULL )
+    {
+        hb_error( "deblock could not allocate segments" );
+        return -1;
+    }
+
+    // Room for dct_a output of a row of the widest plane, plus the
+    // 8 columns of left border
+    int temp_width = MULTIPLE_MOD_UP( init->width, 32 ) + 32;
+
+    int ii;
+    for( ii = 0; ii < pv->cpu_count; ii++ )
+    {
+        pv->segments[ii].temp = malloc( 4 * temp_width * sizeof(DCTELEM) );
+    }
 
     return 0;
 }
@@ -389,6 +666,20 @@ static void hb_deblock_close( hb_filter_object_t * filter )
         return;
     }
 
+    if( pv->segments != NULL )
+    {
+        int ii;
+        for( ii = 0; ii < pv->cpu_count; ii++ )
+        {
+            free( pv->segments[ii].temp );
+        }
+        free( pv->segments );
+    }
+
+    free( pv->pp7_src[0] );
+    free( pv->pp7_src[1] );
+    free( pv->pp7_src[2] );
+
     free( pv );
     filter->private_data = NULL;
 }
@@ -411,32 +702,7 @@ static int hb_deblock_work( hb_filter_object_t * filter,
     {
         out = hb_video_buffer_init( in->f.width, in->f.height );
 
-        pp7_filter( pv,
-                out->plane[0].data,
-                in->plane[0].data,
-                in->plane[0].stride,
-                in->plane[0].height,
-                NULL, /* TODO: mpi->qscale*/
-                0,    /* TODO: mpi->qstride*/
-                1 );
-
-        pp7_filter( pv,
-                out->plane[1].data,
-                in->plane[1].data,
-                in->plane[1].stride,
-                in->plane[1].height,
-                NULL, /* TODO: mpi->qscale*/
-                0,    /* TODO: mpi->qstride*/
-                0 );
-
-        pp7_filter( pv,
-                out->plane[2].data,
-                in->plane[2].data,
-                in->plane[2].stride,
-                in->plane[2].height,
-                NULL, /* TODO: mpi->qscale*/
-                0,    /* TODO: mpi->qstride*/
-                0 );
+        deblock_filter( pv, out, in );
 
         out->s = in->s;
         hb_buffer_move_subs( out, in );
@@ -621,8 +621,7 @@ static int decavcodecaBSInfo( hb_work_object_t *w, const hb_buffer_t *buf,
         return -1;
     }
 
-    static char codec_name[64];
-    info->name =  strncpy( codec_name, codec->name, sizeof(codec_name)-1 );
+    info->name = codec->name;
 
     AVCodecContext *context      = avcodec_alloc_context3(codec);
     AVCodecParserContext *parser = NULL;
@@ -817,6 +816,128 @@ static uint8_t *copy_plane( uint8_t *dst, uint8_t* src, int dstride, int sstride
     return dst;
 }
 
+/*
+ * Direct rendering.
+ *
+ * When the decoder's output already has the layout of our video buffers
+ * we let libavcodec decode straight into buffers from the hb_buffer_t
+ * pools.  copy_frame() then only has to take a reference on the buffer
+ * instead of copying every plane.  The buffer goes back to its pool when
+ * both libavcodec (which may keep it as a reference picture) and the
+ * pipeline are done with it.
+ */
+static void dr_buffer_free( void *opaque, uint8_t *data )
+{
+    hb_buffer_t *buf = opaque;
+    hb_buffer_close( &buf );
+}
+
+// Checks that a picture of width x height (as padded by
+// avcodec_align_dimensions2) fits the planes of buf.
+static int dr_buffer_fits( AVCodecContext *context, hb_buffer_t *buf,
+                           int width, int height, int *linesize_align )
+{
+    // The H.264 decoder's optimized chroma MC reads one line past the
+    // end of the picture, so avcodec_align_dimensions2 pads the height
+    // by 2 lines for it.  These lines are only read, never written, so
+    // they may run into the next plane as long as they stay inside
+    // the allocation.
+    int overread = context->codec_id == AV_CODEC_ID_H264 ? 2 : 0;
+    int p;
+
+    for ( p = 0; p < 3; p++ )
+    {
+        int stride = buf->plane[p].stride;
+        int rows   = hb_image_height( buf->f.fmt, height, p );
+        int dirty  = hb_image_height( buf->f.fmt, height - overread, p );
+
+        if ( ( linesize_align[p] > 0 && stride % linesize_align[p] ) ||
+             stride < av_image_get_linesize( buf->f.fmt, width, p ) ||
+             buf->plane[p].height_stride < dirty ||
+             buf->plane[p].data + stride * rows > buf->data + buf->alloc )
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int get_frame_buf( AVCodecContext *context, AVFrame *frame, int flags )
+{
+    hb_work_private_t *pv = (hb_work_private_t*)context->opaque;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    hb_buffer_t *buf;
+    int w, h, p;
+
+    // Only frames that copy_frame() would copy verbatim are worth
+    // decoding into our buffers, everything else goes through sws_scale.
+    if ( !pv->direct_render || frame->format != AV_PIX_FMT_YUV420P ||
+         context->width  != pv->job->title->width ||
+         context->height != pv->job->title->height )
+    {
+        return avcodec_default_get_buffer2( context, frame, flags );
+    }
+
+    // frame->width/height are the coded dimensions here, which can be
+    // larger than the picture (e.g. 1088 lines for 1080p H.264).
+    w = frame->width;
+    h = frame->height;
+    avcodec_align_dimensions2( context, &w, &h, linesize_align );
+
+    buf = hb_video_buffer_init( context->width, context->height );
+    if ( buf == NULL )
+    {
+        return AVERROR(ENOMEM);
+    }
+    if ( !dr_buffer_fits( context, buf, w, h, linesize_align ) )
+    {
+        hb_log( "decavcodec: %dx%d frames don't fit our buffers, "
+                "disabling direct rendering", w, h );
+        hb_buffer_close( &buf );
+        pv->direct_render = 0;
+        return avcodec_default_get_buffer2( context, frame, flags );
+    }
+
+    frame->buf[0] = av_buffer_create( buf->data, buf->alloc,
+                                      dr_buffer_free, buf, 0 );
+    if ( frame->buf[0] == NULL )
+    {
+        hb_buffer_close( &buf );
+        return AVERROR(ENOMEM);
+    }
+    for ( p = 0; p < 3; p++ )
+    {
+        frame->data[p]     = buf->plane[p].data;
+        frame->linesize[p] = buf->plane[p].stride;
+    }
+    frame->extended_data = frame->data;
+    frame->opaque        = buf;
+
+    return 0;
+}
+
+static void setup_direct_render( hb_work_private_t *pv, AVCodec *codec )
+{
+    // Not during scan, and not when a hardware decoder owns the surfaces
+    if ( pv->job == NULL || !( codec->capabilities & CODEC_CAP_DR1 ) )
+        return;
+#ifdef USE_QSV
+    if ( pv->qsv.decode )
+        return;
+#endif
+#ifdef USE_HWD
+    if ( pv->dxva2 != NULL )
+        return;
+#endif
+
+    pv->direct_render = 1;
+    pv->context->opaque = pv;
+    pv->context->get_buffer2 = get_frame_buf;
+    // get_frame_buf only touches the (thread safe) buffer pools, so frame
+    // threads don't need to serialize their calls through the main thread.
+    pv->context->thread_safe_callbacks = 1;
+}
+
 // copy one video frame into an HB buf. If the frame isn't in our color space
 // or at least one of its dimensions is odd, use sws_scale to convert/rescale it.
 // Otherwise just copy the bits.
@@ -873,7 +994,22 @@ static hb_buffer_t *copy_frame( hb_work_private_t *pv )
     else
 #endif
     {
-        hb_buffer_t *buf = hb_video_buffer_init( w, h );
+        hb_buffer_t *buf = pv->frame->opaque;
+
+        // The frame was decoded into one of our buffers by get_frame_buf().
+        // Unless the decoder cropped it by offsetting the data pointers,
+        // it can be passed on as is.  libavcodec may still hold it as
+        // a reference picture, so what goes downstream is a reference.
+        if ( buf != NULL && pv->frame->buf[0] != NULL &&
+             pv->frame->data[0] == buf->plane[0].data &&
+             pv->frame->data[1] == buf->plane[1].data &&
+             pv->frame->data[2] == buf->plane[2].data &&
+             w == buf->f.width && h == buf->f.height )
+        {
+            return hb_buffer_ref( buf );
+        }
+
+        buf = hb_video_buffer_init( w, h );
 			
 #ifdef USE_QSV
     // no need to copy the frame data when decoding with QSV to opaque memory
@@ -1585,7 +1721,9 @@ static int decavcodecvInit( hb_work_object_t * w, hb_job_t * job )
 
     if( pv->job && pv->job->title && !pv->job->title->has_resolution_change )
     {
-        pv->threads = HB_FFMPEG_THREADS_AUTO;
+        // Stay within the job's share of the thread budget when it has one
+        pv->threads = pv->job->thread_count > 0 ? pv->job->thread_count :
+                                                  HB_FFMPEG_THREADS_AUTO;
     }
 
     AVCodec *codec = NULL;
@@ -1648,6 +1786,8 @@ static int decavcodecvInit( hb_work_object_t * w, hb_job_t * job )
         }
 #endif
 
+        setup_direct_render( pv, codec );
+
         // Set encoder opts...
         AVDictionary * av_opts = NULL;
         av_dict_set( &av_opts, "refcounted_frames", "1", 0 );
@@ -1867,6 +2007,8 @@ static int decavcodecvWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
         }
 #endif
 
+        setup_direct_render( pv, codec );
+
         AVDictionary * av_opts = NULL;
         av_dict_set( &av_opts, "refcounted_frames", "1", 0 );
 
@@ -69,7 +69,7 @@ which will feed EEDI2 interpolations to yadif.
 #include "hb.h"
 #include "hbffmpeg.h"
 #include "eedi2.h"
-#include "taskset.h"
+#include "threadpool.h"
 
 #define PARITY_DEFAULT   -1
 
@@ -98,24 +98,10 @@ struct yadif_arguments_s {
 
 typedef struct yadif_arguments_s yadif_arguments_t;
 
-typedef struct eedi2_thread_arg_s {
-    hb_filter_private_t *pv;
-    int plane;
-} eedi2_thread_arg_t;
-
-typedef struct decomb_thread_arg_s {
-    hb_filter_private_t *pv;
-    int segment;
-    int segment_start[3];
-    int segment_height[3];
-} decomb_thread_arg_t;
-
-typedef struct yadif_thread_arg_s {
-    hb_filter_private_t *pv;
-    int segment;
+typedef struct decomb_segment_s {
     int segment_start[3];
     int segment_height[3];
-} yadif_thread_arg_t;
+} decomb_segment_t;
 
 struct hb_filter_private_s
 {
@@ -176,16 +162,9 @@ struct hb_filter_private_s
     int              cpu_count;
     int              segment_height[3];
 
-    taskset_t        yadif_taskset;       // Threads for Yadif - one per CPU
-    yadif_arguments_t *yadif_arguments;   // Arguments to thread for work
-
-    taskset_t        decomb_filter_taskset; // Threads for comb detection
-    taskset_t        decomb_check_taskset;  // Threads for comb check
-    taskset_t        mask_filter_taskset; // Threads for decomb mask filter
-    taskset_t        mask_erode_taskset;  // Threads for decomb mask erode
-    taskset_t        mask_dilate_taskset; // Threads for decomb mask dilate
-
-    taskset_t        eedi2_taskset;       // Threads for eedi2 - one per plane
+    decomb_segment_t  * segments;         // Frame slices, one per CPU
+    decomb_segment_t  * check_segments;   // Comb check slices
+    yadif_arguments_t   yadif_arguments;  // Arguments to yadif segments
 };
 
 typedef struct
@@ -1020,48 +999,13 @@ static void eedi2_interpolate_plane( hb_filter_private_t * pv, int plane )
 /*
  *  eedi2 interpolate this plane in a single thread.
  */
-static void eedi2_filter_thread( void *thread_args_v )
+static void eedi2_filter_plane( void *pv_v, int plane )
 {
-    hb_filter_private_t * pv;
-    int plane;
-    eedi2_thread_arg_t *thread_args = thread_args_v;
-
-    pv = thread_args->pv;
-    plane = thread_args->plane;
-
-    hb_log("eedi2 thread started for plane %d", plane);
-
-    while (1)
-    {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->eedi2_taskset, plane );
-
-        if( taskset_thread_stop( &pv->eedi2_taskset, plane ) )
-        {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
-        }
-
-        /*
-         * Process plane
-         */
-        eedi2_interpolate_plane( pv, plane );
-
-        /*
-         * Finished this segment, let everyone know.
-         */
-        taskset_thread_complete( &pv->eedi2_taskset, plane );
-    }
-
-    taskset_thread_complete( &pv->eedi2_taskset, plane );
+    eedi2_interpolate_plane( pv_v, plane );
 }
 
 // Sets up the input field planes for EEDI2 in pv->eedi_half[SRCPF]
-// and then runs eedi2_filter_thread for each plane.
+// and then runs eedi2_filter_plane for each plane.
 static void eedi2_planer( hb_filter_private_t * pv )
 {
     /* Copy the first field from the source to a half-height frame. */
@@ -1078,440 +1022,300 @@ static void eedi2_planer( hb_filter_private_t * pv )
     }
 
     /*
-     * Now that all data is ready for our threads, fire them off
+     * Now that all data is ready, interpolate the planes in parallel
      * and wait for their completion.
      */
-    taskset_cycle( &pv->eedi2_taskset );
+    hb_parallel_for( 3, eedi2_filter_plane, pv );
 }
 
 
-static void mask_dilate_thread( void *thread_args_v )
+static void mask_dilate_segment( void *pv_v, int segment )
 {
-    hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
-    decomb_thread_arg_t *thread_args = thread_args_v;
+    hb_filter_private_t * pv = pv_v;
+    decomb_segment_t *seg = &pv->segments[segment];
+    int segment_start, segment_stop;
 
-    pv = thread_args->pv;
-    segment = thread_args->segment;
+    int xx, yy, pp;
 
-    hb_log("mask dilate thread started for segment %d", segment);
+    int count;
+    int dilation_threshold = 4;
 
-    while (1)
+    for( pp = 0; pp < 1; pp++ )
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->mask_dilate_taskset, segment );
+        int width = pv->mask_filtered->plane[pp].width;
+        int height = pv->mask_filtered->plane[pp].height;
+        int stride = pv->mask_filtered->plane[pp].stride;
 
-        if (taskset_thread_stop(&pv->mask_dilate_taskset, segment))
+        int start, stop, p, c, n;
+        segment_start = seg->segment_start[pp];
+        segment_stop = segment_start + seg->segment_height[pp];
+
+        if (segment_start == 0)
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            start = 1;
+            p = 0;
+            c = 1;
+            n = 2;
         }
-
-        int xx, yy, pp;
-
-        int count;
-        int dilation_threshold = 4;
-
-        for( pp = 0; pp < 1; pp++ )
+        else
         {
-            int width = pv->mask_filtered->plane[pp].width;
-            int height = pv->mask_filtered->plane[pp].height;
-            int stride = pv->mask_filtered->plane[pp].stride;
-
-            int start, stop, p, c, n;
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            if (segment_start == 0)
-            {
-                start = 1;
-                p = 0;
-                c = 1;
-                n = 2;
-            }
-            else
-            {
-                start = segment_start;
-                p = segment_start - 1;
-                c = segment_start;
-                n = segment_start + 1;
-            }
+            start = segment_start;
+            p = segment_start - 1;
+            c = segment_start;
+            n = segment_start + 1;
+        }
 
-            if (segment_stop == height)
-            {
-                stop = height -1;
-            }
-            else
-            {
-                stop = segment_stop;
-            }
+        if (segment_stop == height)
+        {
+            stop = height -1;
+        }
+        else
+        {
+            stop = segment_stop;
+        }
 
-            uint8_t *curp = &pv->mask_filtered->plane[pp].data[p * stride + 1];
-            uint8_t *cur  = &pv->mask_filtered->plane[pp].data[c * stride + 1];
-            uint8_t *curn = &pv->mask_filtered->plane[pp].data[n * stride + 1];
-            uint8_t *dst = &pv->mask_temp->plane[pp].data[c * stride + 1];
+        uint8_t *curp = &pv->mask_filtered->plane[pp].data[p * stride + 1];
+        uint8_t *cur  = &pv->mask_filtered->plane[pp].data[c * stride + 1];
+        uint8_t *curn = &pv->mask_filtered->plane[pp].data[n * stride + 1];
+        uint8_t *dst = &pv->mask_temp->plane[pp].data[c * stride + 1];
 
-            for( yy = start; yy < stop; yy++ )
+        for( yy = start; yy < stop; yy++ )
+        {
+            for( xx = 1; xx < width - 1; xx++ )
             {
-                for( xx = 1; xx < width - 1; xx++ )
+                if (cur[xx])
                 {
-                    if (cur[xx])
-                    {
-                        dst[xx] = 1;
-                        continue;
-                    }
+                    dst[xx] = 1;
+                    continue;
+                }
 
-                    count = curp[xx-1] + curp[xx] + curp[xx+1] +
-                            cur [xx-1] +            cur [xx+1] +
-                            curn[xx-1] + curn[xx] + curn[xx+1];
+                count = curp[xx-1] + curp[xx] + curp[xx+1] +
+                        cur [xx-1] +            cur [xx+1] +
+                        curn[xx-1] + curn[xx] + curn[xx+1];
 
-                    dst[xx] = count >= dilation_threshold;
-                }
-                curp += stride;
-                cur += stride;
-                curn += stride;
-                dst += stride;
+                dst[xx] = count >= dilation_threshold;
             }
+            curp += stride;
+            cur += stride;
+            curn += stride;
+            dst += stride;
         }
-
-        taskset_thread_complete( &pv->mask_dilate_taskset, segment );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->mask_dilate_taskset, segment );
 }
 
-static void mask_erode_thread( void *thread_args_v )
+static void mask_erode_segment( void *pv_v, int segment )
 {
-    hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
-    decomb_thread_arg_t *thread_args = thread_args_v;
+    hb_filter_private_t * pv = pv_v;
+    decomb_segment_t *seg = &pv->segments[segment];
+    int segment_start, segment_stop;
 
-    pv = thread_args->pv;
-    segment = thread_args->segment;
+    int xx, yy, pp;
 
-    hb_log("mask erode thread started for segment %d", segment);
+    int count;
+    int erosion_threshold = 2;
 
-    while (1)
+    for( pp = 0; pp < 1; pp++ )
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->mask_erode_taskset, segment );
+        int width = pv->mask_filtered->plane[pp].width;
+        int height = pv->mask_filtered->plane[pp].height;
+        int stride = pv->mask_filtered->plane[pp].stride;
 
-        if( taskset_thread_stop( &pv->mask_erode_taskset, segment ) )
+        int start, stop, p, c, n;
+        segment_start = seg->segment_start[pp];
+        segment_stop = segment_start + seg->segment_height[pp];
+
+        if (segment_start == 0)
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            start = 1;
+            p = 0;
+            c = 1;
+            n = 2;
         }
-
-        int xx, yy, pp;
-
-        int count;
-        int erosion_threshold = 2;
-
-        for( pp = 0; pp < 1; pp++ )
+        else
         {
-            int width = pv->mask_filtered->plane[pp].width;
-            int height = pv->mask_filtered->plane[pp].height;
-            int stride = pv->mask_filtered->plane[pp].stride;
-
-            int start, stop, p, c, n;
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            if (segment_start == 0)
-            {
-                start = 1;
-                p = 0;
-                c = 1;
-                n = 2;
-            }
-            else
-            {
-                start = segment_start;
-                p = segment_start - 1;
-                c = segment_start;
-                n = segment_start + 1;
-            }
+            start = segment_start;
+            p = segment_start - 1;
+            c = segment_start;
+            n = segment_start + 1;
+        }
 
-            if (segment_stop == height)
-            {
-                stop = height -1;
-            }
-            else
-            {
-                stop = segment_stop;
-            }
+        if (segment_stop == height)
+        {
+            stop = height -1;
+        }
+        else
+        {
+            stop = segment_stop;
+        }
 
-            uint8_t *curp = &pv->mask_temp->plane[pp].data[p * stride + 1];
-            uint8_t *cur  = &pv->mask_temp->plane[pp].data[c * stride + 1];
-            uint8_t *curn = &pv->mask_temp->plane[pp].data[n * stride + 1];
-            uint8_t *dst = &pv->mask_filtered->plane[pp].data[c * stride + 1];
+        uint8_t *curp = &pv->mask_temp->plane[pp].data[p * stride + 1];
+        uint8_t *cur  = &pv->mask_temp->plane[pp].data[c * stride + 1];
+        uint8_t *curn = &pv->mask_temp->plane[pp].data[n * stride + 1];
+        uint8_t *dst = &pv->mask_filtered->plane[pp].data[c * stride + 1];
 
-            for( yy = start; yy < stop; yy++ )
+        for( yy = start; yy < stop; yy++ )
+        {
+            for( xx = 1; xx < width - 1; xx++ )
             {
-                for( xx = 1; xx < width - 1; xx++ )
+                if( cur[xx] == 0 )
                 {
-                    if( cur[xx] == 0 )
-                    {
-                        dst[xx] = 0;
-                        continue;
-                    }
+                    dst[xx] = 0;
+                    continue;
+                }
 
-                    count = curp[xx-1] + curp[xx] + curp[xx+1] +
-                            cur [xx-1] +            cur [xx+1] +
-                            curn[xx-1] + curn[xx] + curn[xx+1];
+                count = curp[xx-1] + curp[xx] + curp[xx+1] +
+                        cur [xx-1] +            cur [xx+1] +
+                        curn[xx-1] + curn[xx] + curn[xx+1];
 
-                    dst[xx] = count >= erosion_threshold;
-                }
-                curp += stride;
-                cur += stride;
-                curn += stride;
-                dst += stride;
+                dst[xx] = count >= erosion_threshold;
             }
+            curp += stride;
+            cur += stride;
+            curn += stride;
+            dst += stride;
         }
-
-        taskset_thread_complete( &pv->mask_erode_taskset, segment );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->mask_erode_taskset, segment );
 }
 
-static void mask_filter_thread( void *thread_args_v )
+static void mask_filter_segment( void *pv_v, int segment )
 {
-    hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
-    decomb_thread_arg_t *thread_args = thread_args_v;
-
-    pv = thread_args->pv;
-    segment = thread_args->segment;
+    hb_filter_private_t * pv = pv_v;
+    decomb_segment_t *seg = &pv->segments[segment];
+    int segment_start, segment_stop;
 
-    hb_log("mask filter thread started for segment %d", segment);
+    int xx, yy, pp;
 
-    while (1)
+    for( pp = 0; pp < 1; pp++ )
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->mask_filter_taskset, segment );
+        int width = pv->mask->plane[pp].width;
+        int height = pv->mask->plane[pp].height;
+        int stride = pv->mask->plane[pp].stride;
+
+        int start, stop, p, c, n;
+        segment_start = seg->segment_start[pp];
+        segment_stop = segment_start + seg->segment_height[pp];
 
-        if( taskset_thread_stop( &pv->mask_filter_taskset, segment ) )
+        if (segment_start == 0)
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            start = 1;
+            p = 0;
+            c = 1;
+            n = 2;
         }
-
-        int xx, yy, pp;
-
-        for( pp = 0; pp < 1; pp++ )
+        else
         {
-            int width = pv->mask->plane[pp].width;
-            int height = pv->mask->plane[pp].height;
-            int stride = pv->mask->plane[pp].stride;
+            start = segment_start;
+            p = segment_start - 1;
+            c = segment_start;
+            n = segment_start + 1;
+        }
 
-            int start, stop, p, c, n;
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
+        if (segment_stop == height)
+        {
+            stop = height - 1;
+        }
+        else
+        {
+            stop = segment_stop;
+        }
 
-            if (segment_start == 0)
-            {
-                start = 1;
-                p = 0;
-                c = 1;
-                n = 2;
-            }
-            else
-            {
-                start = segment_start;
-                p = segment_start - 1;
-                c = segment_start;
-                n = segment_start + 1;
-            }
+        uint8_t *curp = &pv->mask->plane[pp].data[p * stride + 1];
+        uint8_t *cur = &pv->mask->plane[pp].data[c * stride + 1];
+        uint8_t *curn = &pv->mask->plane[pp].data[n * stride + 1];
+        uint8_t *dst = (pv->filter_mode == FILTER_CLASSIC ) ?
+            &pv->mask_filtered->plane[pp].data[c * stride + 1] :
+            &pv->mask_temp->plane[pp].data[c * stride + 1] ;
 
-            if (segment_stop == height)
-            {
-                stop = height - 1;
-            }
-            else
+        for( yy = start; yy < stop; yy++ )
+        {
+            for( xx = 1; xx < width - 1; xx++ )
             {
-                stop = segment_stop;
-            }
+                int h_count, v_count;
 
-            uint8_t *curp = &pv->mask->plane[pp].data[p * stride + 1];
-            uint8_t *cur = &pv->mask->plane[pp].data[c * stride + 1];
-            uint8_t *curn = &pv->mask->plane[pp].data[n * stride + 1];
-            uint8_t *dst = (pv->filter_mode == FILTER_CLASSIC ) ?
-                &pv->mask_filtered->plane[pp].data[c * stride + 1] :
-                &pv->mask_temp->plane[pp].data[c * stride + 1] ;
+                h_count = cur[xx-1] & cur[xx] & cur[xx+1];
+                v_count = curp[xx] & cur[xx] & curn[xx];
 
-            for( yy = start; yy < stop; yy++ )
-            {
-                for( xx = 1; xx < width - 1; xx++ )
+                if (pv->filter_mode == FILTER_CLASSIC)
                 {
-                    int h_count, v_count;
-
-                    h_count = cur[xx-1] & cur[xx] & cur[xx+1];
-                    v_count = curp[xx] & cur[xx] & curn[xx];
-
-                    if (pv->filter_mode == FILTER_CLASSIC)
-                    {
-                        dst[xx] = h_count;
-                    }
-                    else
-                    {
-                        dst[xx] = h_count & v_count;
-                    }
+                    dst[xx] = h_count;
+                }
+                else
+                {
+                    dst[xx] = h_count & v_count;
                 }
-                curp += stride;
-                cur += stride;
-                curn += stride;
-                dst += stride;
             }
+            curp += stride;
+            cur += stride;
+            curn += stride;
+            dst += stride;
         }
-
-        taskset_thread_complete( &pv->mask_filter_taskset, segment );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->mask_filter_taskset, segment );
 }
 
-static void decomb_check_thread( void *thread_args_v )
+static void decomb_check_segment( void *pv_v, int segment )
 {
-    hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
-    decomb_thread_arg_t *thread_args = thread_args_v;
-
-    pv = thread_args->pv;
-    segment = thread_args->segment;
+    hb_filter_private_t * pv = pv_v;
+    decomb_segment_t *seg = &pv->check_segments[segment];
+    int segment_start, segment_stop;
 
-    hb_log("decomb check thread started for segment %d", segment);
+    segment_start = seg->segment_start[0];
+    segment_stop = segment_start + seg->segment_height[0];
 
-    while (1)
+    if( pv->mode & MODE_FILTER )
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->decomb_check_taskset, segment );
-
-        if( taskset_thread_stop( &pv->decomb_check_taskset, segment ) )
-        {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
-        }
-
-        segment_start = thread_args->segment_start[0];
-        segment_stop = segment_start + thread_args->segment_height[0];
-
-        if( pv->mode & MODE_FILTER )
-        {
-            check_filtered_combing_mask(pv, segment, segment_start, segment_stop);
-        }
-        else
-        {
-            check_combing_mask(pv, segment, segment_start, segment_stop);
-        }
-
-        taskset_thread_complete( &pv->decomb_check_taskset, segment );
+        check_filtered_combing_mask(pv, segment, segment_start, segment_stop);
+    }
+    else
+    {
+        check_combing_mask(pv, segment, segment_start, segment_stop);
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->decomb_check_taskset, segment );
 }
 
 /*
  * comb detect this segment of all three planes in a single thread.
  */
-static void decomb_filter_thread( void *thread_args_v )
+static void decomb_filter_segment( void *pv_v, int segment )
 {
-    hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
-    decomb_thread_arg_t *thread_args = thread_args_v;
-
-    pv = thread_args->pv;
-    segment = thread_args->segment;
-
-    hb_log("decomb filter thread started for segment %d", segment);
+    hb_filter_private_t * pv = pv_v;
+    decomb_segment_t *seg = &pv->segments[segment];
+    int segment_start, segment_stop;
 
-    while (1)
+    /*
+     * Process segment (for now just from luma)
+     */
+    int pp;
+    for( pp = 0; pp < 1; pp++)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->decomb_filter_taskset, segment );
+        segment_start = seg->segment_start[pp];
+        segment_stop = segment_start + seg->segment_height[pp];
 
-        if( taskset_thread_stop( &pv->decomb_filter_taskset, segment ) )
+        if( pv->mode & MODE_GAMMA )
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            detect_gamma_combed_segment( pv, segment_start, segment_stop );
         }
-
-        /*
-         * Process segment (for now just from luma)
-         */
-        int pp;
-        for( pp = 0; pp < 1; pp++)
+        else
         {
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            if( pv->mode & MODE_GAMMA )
-            {
-                detect_gamma_combed_segment( pv, segment_start, segment_stop );
-            }
-            else
-            {
-                detect_combed_segment( pv, segment_start, segment_stop );
-            }
+            detect_combed_segment( pv, segment_start, segment_stop );
         }
-
-        taskset_thread_complete( &pv->decomb_filter_taskset, segment );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->decomb_filter_taskset, segment );
 }
 
 static int comb_segmenter( hb_filter_private_t * pv )
 {
     /*
-     * Now that all data for decomb detection is ready for
-     * our threads, fire them off and wait for their completion.
+     * Now that all data for decomb detection is ready, run it
+     * on the thread pool and wait for its completion.
      */
-    taskset_cycle( &pv->decomb_filter_taskset );
+    hb_parallel_for( pv->cpu_count, decomb_filter_segment, pv );
 
     if( pv->mode & MODE_FILTER )
     {
-         taskset_cycle( &pv->mask_filter_taskset );
+        hb_parallel_for( pv->cpu_count, mask_filter_segment, pv );
         if( pv->filter_mode == FILTER_ERODE_DILATE )
         {
-            taskset_cycle( &pv->mask_erode_taskset );
-            taskset_cycle( &pv->mask_dilate_taskset );
-            taskset_cycle( &pv->mask_erode_taskset );
+            hb_parallel_for( pv->cpu_count, mask_erode_segment, pv );
+            hb_parallel_for( pv->cpu_count, mask_dilate_segment, pv );
+            hb_parallel_for( pv->cpu_count, mask_erode_segment, pv );
         }
         //return check_filtered_combing_mask( pv );
     }
@@ -1520,7 +1324,7 @@ static int comb_segmenter( hb_filter_private_t * pv )
         //return check_combing_mask( pv );
     }
     reset_combing_results(pv);
-    taskset_cycle( &pv->decomb_check_taskset );
+    hb_parallel_for( pv->comb_check_nthreads, decomb_check_segment, pv );
     return check_combing_results(pv);
 }
 
@@ -1691,12 +1495,12 @@ static void yadif_filter_line(
 /*
  * deinterlace this segment of all three planes in a single thread.
  */
-static void yadif_decomb_filter_thread( void *thread_args_v )
+static void yadif_decomb_filter_segment( void *pv_v, int segment )
 {
-    yadif_arguments_t *yadif_work = NULL;
-    hb_filter_private_t * pv;
-    int segment, segment_start, segment_stop;
-    yadif_thread_arg_t *thread_args = thread_args_v;
+    yadif_arguments_t *yadif_work;
+    hb_filter_private_t * pv = pv_v;
+    decomb_segment_t *seg = &pv->segments[segment];
+    int segment_start, segment_stop;
     filter_param_t filter;
 
     filter.tap[0] = -1;
@@ -1706,123 +1510,89 @@ static void yadif_decomb_filter_thread( void *thread_args_v )
     filter.tap[4] = -1;
     filter.normalize = 3;
 
-    pv = thread_args->pv;
-    segment = thread_args->segment;
-
-    hb_log("yadif thread started for segment %d", segment);
+    yadif_work = &pv->yadif_arguments;
 
-    while (1)
-    {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->yadif_taskset, segment );
+    /*
+     * Process all three planes, but only this segment of it.
+     */
+    hb_buffer_t *dst;
+    int parity, tff, is_combed;
 
-        if( taskset_thread_stop( &pv->yadif_taskset, segment ) )
-        {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
-        }
+    is_combed = yadif_work->is_combed;
+    dst = yadif_work->dst;
+    tff = yadif_work->tff;
+    parity = yadif_work->parity;
 
-        yadif_work = &pv->yadif_arguments[segment];
+    int pp;
+    for (pp = 0; pp < 3; pp++)
+    {
+        int yy;
+        int width = dst->plane[pp].width;
+        int stride = dst->plane[pp].stride;
+        int height = dst->plane[pp].height;
+        int penultimate = height - 2;
 
-        /*
-         * Process all three planes, but only this segment of it.
-         */
-        hb_buffer_t *dst;
-        int parity, tff, is_combed;
+        segment_start = seg->segment_start[pp];
+        segment_stop = segment_start + seg->segment_height[pp];
 
-        is_combed = pv->yadif_arguments[segment].is_combed;
-        dst = yadif_work->dst;
-        tff = yadif_work->tff;
-        parity = yadif_work->parity;
+        // Filter parity lines
+        int start = parity ? (segment_start + 1) & ~1 : segment_start | 1;
+        uint8_t *dst2 = &dst->plane[pp].data[start * stride];
+        uint8_t *prev = &pv->ref[0]->plane[pp].data[start * stride];
+        uint8_t *cur  = &pv->ref[1]->plane[pp].data[start * stride];
+        uint8_t *next = &pv->ref[2]->plane[pp].data[start * stride];
 
-        int pp;
-        for (pp = 0; pp < 3; pp++)
+        if( is_combed == 2 )
         {
-            int yy;
-            int width = dst->plane[pp].width;
-            int stride = dst->plane[pp].stride;
-            int height = dst->plane[pp].height;
-            int penultimate = height - 2;
-
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            // Filter parity lines
-            int start = parity ? (segment_start + 1) & ~1 : segment_start | 1;
-            uint8_t *dst2 = &dst->plane[pp].data[start * stride];
-            uint8_t *prev = &pv->ref[0]->plane[pp].data[start * stride];
-            uint8_t *cur  = &pv->ref[1]->plane[pp].data[start * stride];
-            uint8_t *next = &pv->ref[2]->plane[pp].data[start * stride];
-
-            if( is_combed == 2 )
+            /* These will be useful if we ever do temporal blending. */
+            for( yy = start; yy < segment_stop; yy += 2 )
             {
-                /* These will be useful if we ever do temporal blending. */
-                for( yy = start; yy < segment_stop; yy += 2 )
-                {
-                    /* This line gets blend filtered, not yadif filtered. */
-                    blend_filter_line(&filter, dst2, cur, width, height, stride, yy);
-                    dst2 += stride * 2;
-                    cur += stride * 2;
-                }
+                /* This line gets blend filtered, not yadif filtered. */
+                blend_filter_line(&filter, dst2, cur, width, height, stride, yy);
+                dst2 += stride * 2;
+                cur += stride * 2;
             }
-            else if (pv->mode == MODE_CUBIC && is_combed)
+        }
+        else if (pv->mode == MODE_CUBIC && is_combed)
+        {
+            for( yy = start; yy < segment_stop; yy += 2 )
             {
-                for( yy = start; yy < segment_stop; yy += 2 )
-                {
-                    /* Just apply vertical cubic interpolation */
-                    cubic_interpolate_line(dst2, cur, width, height, stride, yy);
-                    dst2 += stride * 2;
-                    cur += stride * 2;
-                }
+                /* Just apply vertical cubic interpolation */
+                cubic_interpolate_line(dst2, cur, width, height, stride, yy);
+                dst2 += stride * 2;
+                cur += stride * 2;
             }
-            else if ((pv->mode & MODE_YADIF) && is_combed == 1)
+        }
+        else if ((pv->mode & MODE_YADIF) && is_combed == 1)
+        {
+            for( yy = start; yy < segment_stop; yy += 2 )
             {
-                for( yy = start; yy < segment_stop; yy += 2 )
+                if( yy > 1 && yy < penultimate )
                 {
-                    if( yy > 1 && yy < penultimate )
-                    {
-                        // This isn't the top or bottom,
-                        // proceed as normal to yadif
-                        yadif_filter_line(pv, dst2, prev, cur, next, pp,
-                                          width, height, stride,
-                                          parity ^ tff, yy);
-                    }
-                    else
-                    {
-                        // parity == 0 (TFF), y1 = y0
-                        // parity == 1 (BFF), y0 = y1
-                        // parity == 0 (TFF), yu = yp
-                        // parity == 1 (BFF), yp = yu
-                        int yp = (yy ^ parity) * stride;
-                        memcpy(dst2, &pv->ref[1]->plane[pp].data[yp], width);
-                    }
-                    dst2 += stride * 2;
-                    prev += stride * 2;
-                    cur += stride * 2;
-                    next += stride * 2;
+                    // This isn't the top or bottom,
+                    // proceed as normal to yadif
+                    yadif_filter_line(pv, dst2, prev, cur, next, pp,
+                                      width, height, stride,
+                                      parity ^ tff, yy);
                 }
-            }
-            else
-            {
-                // No combing, copy frame
-                for( yy = start; yy < segment_stop; yy += 2 )
+                else
                 {
-                    memcpy(dst2, cur, width);
-                    dst2 += stride * 2;
-                    cur += stride * 2;
+                    // parity == 0 (TFF), y1 = y0
+                    // parity == 1 (BFF), y0 = y1
+                    // parity == 0 (TFF), yu = yp
+                    // parity == 1 (BFF), yp = yu
+                    int yp = (yy ^ parity) * stride;
+                    memcpy(dst2, &pv->ref[1]->plane[pp].data[yp], width);
                 }
+                dst2 += stride * 2;
+                prev += stride * 2;
+                cur += stride * 2;
+                next += stride * 2;
             }
-
-            // Copy unfiltered lines
-            start = !parity ? (segment_start + 1) & ~1 : segment_start | 1;
-            dst2 = &dst->plane[pp].data[start * stride];
-            prev = &pv->ref[0]->plane[pp].data[start * stride];
-            cur  = &pv->ref[1]->plane[pp].data[start * stride];
-            next = &pv->ref[2]->plane[pp].data[start * stride];
+        }
+        else
+        {
+            // No combing, copy frame
             for( yy = start; yy < segment_stop; yy += 2 )
             {
                 memcpy(dst2, cur, width);
@@ -1830,13 +1600,20 @@ static void yadif_decomb_filter_thread( void *thread_args_v )
                 cur += stride * 2;
             }
         }
-        taskset_thread_complete( &pv->yadif_taskset, segment );
-    }
 
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->yadif_taskset, segment );
+        // Copy unfiltered lines
+        start = !parity ? (segment_start + 1) & ~1 : segment_start | 1;
+        dst2 = &dst->plane[pp].data[start * stride];
+        prev = &pv->ref[0]->plane[pp].data[start * stride];
+        cur  = &pv->ref[1]->plane[pp].data[start * stride];
+        next = &pv->ref[2]->plane[pp].data[start * stride];
+        for( yy = start; yy < segment_stop; yy += 2 )
+        {
+            memcpy(dst2, cur, width);
+            dst2 += stride * 2;
+            cur += stride * 2;
+        }
+    }
 }
 
 static void yadif_filter( hb_filter_private_t * pv,
@@ -1933,23 +1710,18 @@ static void yadif_filter( hb_filter_private_t * pv,
         }
         else
         {
-            int segment;
-
-            for( segment = 0; segment < pv->cpu_count; segment++ )
-            {
-                /*
-                 * Setup the work for this plane.
-                 */
-                pv->yadif_arguments[segment].parity = parity;
-                pv->yadif_arguments[segment].tff = tff;
-                pv->yadif_arguments[segment].dst = dst;
-                pv->yadif_arguments[segment].is_combed = is_combed;
-            }
+            /*
+             * Setup the work for this frame.
+             */
+            pv->yadif_arguments.parity = parity;
+            pv->yadif_arguments.tff = tff;
+            pv->yadif_arguments.dst = dst;
+            pv->yadif_arguments.is_combed = is_combed;
 
             /*
-             * Allow the taskset threads to make one pass over the data.
+             * Let the thread pool make one pass over the data.
              */
-            taskset_cycle( &pv->yadif_taskset );
+            hb_parallel_for( pv->cpu_count, yadif_decomb_filter_segment, pv );
 
             /*
              * Entire frame is now deinterlaced.
@@ -1959,7 +1731,7 @@ static void yadif_filter( hb_filter_private_t * pv,
     else
     {
         /*  Just passing through... */
-        pv->yadif_arguments[0].is_combed = is_combed; // 0
+        pv->yadif_arguments.is_combed = is_combed; // 0
         hb_buffer_copy(dst, pv->ref[1]);
     }
 }
@@ -2056,106 +1828,39 @@ static int hb_decomb_init( hb_filter_object_t * filter,
     }
 
     /*
-     * Setup yadif taskset.
-     */
-    pv->yadif_arguments = malloc( sizeof( yadif_arguments_t ) * pv->cpu_count );
-    if( pv->yadif_arguments == NULL ||
-        taskset_init( &pv->yadif_taskset, pv->cpu_count,
-                      sizeof( yadif_thread_arg_t ) ) == 0 )
-    {
-        hb_error( "yadif could not initialize taskset" );
-    }
-
-    yadif_thread_arg_t *yadif_prev_thread_args = NULL;
-    for( ii = 0; ii < pv->cpu_count; ii++ )
-    {
-        yadif_thread_arg_t *thread_args;
-
-        thread_args = taskset_thread_args( &pv->yadif_taskset, ii );
-        thread_args->pv = pv;
-        thread_args->segment = ii;
-
-        int pp;
-        for (pp = 0; pp < 3; pp++)
-        {
-            if (yadif_prev_thread_args != NULL)
-            {
-                thread_args->segment_start[pp] =
-                    yadif_prev_thread_args->segment_start[pp] +
-                    yadif_prev_thread_args->segment_height[pp];
-            }
-            if( ii == pv->cpu_count - 1 )
-            {
-                /*
-                 * Final segment
-                 */
-                thread_args->segment_height[pp] =
-                    hb_image_height(init->pix_fmt, init->height, pp) -
-                    thread_args->segment_start[pp];
-            } else {
-                thread_args->segment_height[pp] = pv->segment_height[pp];
-            }
-        }
-        pv->yadif_arguments[ii].dst = NULL;
-        if( taskset_thread_spawn( &pv->yadif_taskset, ii,
-                                 "yadif_filter_segment",
-                                 yadif_decomb_filter_thread,
-                                 HB_NORMAL_PRIORITY ) == 0 )
-        {
-            hb_error( "yadif could not spawn thread" );
-        }
-        yadif_prev_thread_args = thread_args;
-    }
-
-    /*
-     * Create comb detection taskset.
+     * Split the frame into one slice per CPU for yadif, comb detection
+     * and mask filtering.
      */
-    if( taskset_init( &pv->decomb_filter_taskset, pv->cpu_count,
-                      sizeof( decomb_thread_arg_t ) ) == 0 )
+    pv->segments = calloc( pv->cpu_count, sizeof( decomb_segment_t ) );
+    if( pv->segments == NULL )
     {
-        hb_error( "decomb could not initialize taskset" );
+        hb_error( "decomb could not allocate segments" );
     }
 
-    decomb_thread_arg_t *decomb_prev_thread_args = NULL;
     for( ii = 0; ii < pv->cpu_count; ii++ )
     {
-        decomb_thread_arg_t *thread_args;
-
-        thread_args = taskset_thread_args( &pv->decomb_filter_taskset, ii );
-        thread_args->pv = pv;
-        thread_args->segment = ii;
+        decomb_segment_t *seg = &pv->segments[ii];
 
         int pp;
         for (pp = 0; pp < 3; pp++)
         {
-            if (decomb_prev_thread_args != NULL)
+            if (ii > 0)
             {
-                thread_args->segment_start[pp] =
-                    decomb_prev_thread_args->segment_start[pp] +
-                    decomb_prev_thread_args->segment_height[pp];
+                seg->segment_start[pp] = seg[-1].segment_start[pp] +
+                                         seg[-1].segment_height[pp];
             }
             if( ii == pv->cpu_count - 1 )
             {
                 /*
                  * Final segment
                  */
-                thread_args->segment_height[pp] =
+                seg->segment_height[pp] =
                     hb_image_height(init->pix_fmt, init->height, pp) -
-                    thread_args->segment_start[pp];
+                    seg->segment_start[pp];
             } else {
-                thread_args->segment_height[pp] = pv->segment_height[pp];
+                seg->segment_height[pp] = pv->segment_height[pp];
             }
         }
-
-        if( taskset_thread_spawn( &pv->decomb_filter_taskset, ii,
-                                 "decomb_filter_segment",
-                                 decomb_filter_thread,
-                                 HB_NORMAL_PRIORITY ) == 0 )
-        {
-            hb_error( "decomb could not spawn thread" );
-        }
-
-        decomb_prev_thread_args = thread_args;
     }
 
     pv->comb_check_nthreads = init->height / pv->block_height;
@@ -2166,31 +1871,26 @@ static int hb_decomb_init( hb_filter_object_t * filter,
     pv->block_score = calloc(pv->comb_check_nthreads, sizeof(int));
 
     /*
-     * Create comb check taskset.
+     * Comb check slices are a multiple of block_height.
      */
-    if( taskset_init( &pv->decomb_check_taskset, pv->comb_check_nthreads,
-                      sizeof( decomb_thread_arg_t ) ) == 0 )
+    pv->check_segments = calloc( pv->comb_check_nthreads,
+                                 sizeof( decomb_segment_t ) );
+    if( pv->check_segments == NULL )
     {
-        hb_error( "decomb check could not initialize taskset" );
+        hb_error( "decomb check could not allocate segments" );
     }
 
-    decomb_prev_thread_args = NULL;
     for( ii = 0; ii < pv->comb_check_nthreads; ii++ )
     {
-        decomb_thread_arg_t *thread_args, *decomb_prev_thread_args = NULL;
-
-        thread_args = taskset_thread_args( &pv->decomb_check_taskset, ii );
-        thread_args->pv = pv;
-        thread_args->segment = ii;
+        decomb_segment_t *seg = &pv->check_segments[ii];
 
         int pp;
         for (pp = 0; pp < 3; pp++)
         {
-            if (decomb_prev_thread_args != NULL)
+            if (ii > 0)
             {
-                thread_args->segment_start[pp] =
-                    decomb_prev_thread_args->segment_start[pp] +
-                    decomb_prev_thread_args->segment_height[pp];
+                seg->segment_start[pp] = seg[-1].segment_start[pp] +
+                                         seg[-1].segment_height[pp];
             }
 
             // Make segment hight a multiple of block_height
@@ -2204,189 +1904,17 @@ static int hb_decomb_init( hb_filter_object_t * filter,
                 /*
                  * Final segment
                  */
-                thread_args->segment_height[pp] =
+                seg->segment_height[pp] =
                     hb_image_height(init->pix_fmt, init->height, pp) -
-                    thread_args->segment_start[pp];
+                    seg->segment_start[pp];
             } else {
-                thread_args->segment_height[pp] = h;
-            }
-        }
-
-        if( taskset_thread_spawn( &pv->decomb_check_taskset, ii,
-                                 "decomb_check_segment",
-                                 decomb_check_thread,
-                                 HB_NORMAL_PRIORITY ) == 0 )
-        {
-            hb_error( "decomb check could not spawn thread" );
-        }
-
-        decomb_prev_thread_args = thread_args;
-    }
-
-    if( pv->mode & MODE_FILTER )
-    {
-        if( taskset_init( &pv->mask_filter_taskset, pv->cpu_count,
-                          sizeof( decomb_thread_arg_t ) ) == 0 )
-        {
-            hb_error( "maske filter could not initialize taskset" );
-        }
-
-        decomb_prev_thread_args = NULL;
-        for( ii = 0; ii < pv->cpu_count; ii++ )
-        {
-            decomb_thread_arg_t *thread_args;
-
-            thread_args = taskset_thread_args( &pv->mask_filter_taskset, ii );
-            thread_args->pv = pv;
-            thread_args->segment = ii;
-
-            int pp;
-            for (pp = 0; pp < 3; pp++)
-            {
-                if (decomb_prev_thread_args != NULL)
-                {
-                    thread_args->segment_start[pp] =
-                        decomb_prev_thread_args->segment_start[pp] +
-                        decomb_prev_thread_args->segment_height[pp];
-                }
-
-                if( ii == pv->cpu_count - 1 )
-                {
-                    /*
-                     * Final segment
-                     */
-                    thread_args->segment_height[pp] =
-                        hb_image_height(init->pix_fmt, init->height, pp) -
-                        thread_args->segment_start[pp];
-                } else {
-                    thread_args->segment_height[pp] = pv->segment_height[pp];
-                }
-            }
-
-            if( taskset_thread_spawn( &pv->mask_filter_taskset, ii,
-                                     "mask_filter_segment",
-                                     mask_filter_thread,
-                                     HB_NORMAL_PRIORITY ) == 0 )
-            {
-                hb_error( "mask filter could not spawn thread" );
-            }
-
-            decomb_prev_thread_args = thread_args;
-        }
-
-        if( pv->filter_mode == FILTER_ERODE_DILATE )
-        {
-            if( taskset_init( &pv->mask_erode_taskset, pv->cpu_count,
-                              sizeof( decomb_thread_arg_t ) ) == 0 )
-            {
-                hb_error( "mask erode could not initialize taskset" );
-            }
-
-            decomb_prev_thread_args = NULL;
-            for( ii = 0; ii < pv->cpu_count; ii++ )
-            {
-                decomb_thread_arg_t *thread_args;
-
-                thread_args = taskset_thread_args( &pv->mask_erode_taskset, ii );
-                thread_args->pv = pv;
-                thread_args->segment = ii;
-
-                int pp;
-                for (pp = 0; pp < 3; pp++)
-                {
-                    if (decomb_prev_thread_args != NULL)
-                    {
-                        thread_args->segment_start[pp] =
-                            decomb_prev_thread_args->segment_start[pp] +
-                            decomb_prev_thread_args->segment_height[pp];
-                    }
-
-                    if( ii == pv->cpu_count - 1 )
-                    {
-                        /*
-                         * Final segment
-                         */
-                        thread_args->segment_height[pp] =
-                            hb_image_height(init->pix_fmt, init->height, pp) -
-                            thread_args->segment_start[pp];
-                    } else {
-                        thread_args->segment_height[pp] = pv->segment_height[pp];
-                    }
-                }
-
-                if( taskset_thread_spawn( &pv->mask_erode_taskset, ii,
-                                         "mask_erode_segment",
-                                         mask_erode_thread,
-                                         HB_NORMAL_PRIORITY ) == 0 )
-                {
-                    hb_error( "mask erode could not spawn thread" );
-                }
-
-                decomb_prev_thread_args = thread_args;
-            }
-
-            if( taskset_init( &pv->mask_dilate_taskset, pv->cpu_count,
-                              sizeof( decomb_thread_arg_t ) ) == 0 )
-            {
-                hb_error( "mask dilate could not initialize taskset" );
-            }
-
-            decomb_prev_thread_args = NULL;
-            for( ii = 0; ii < pv->cpu_count; ii++ )
-            {
-                decomb_thread_arg_t *thread_args;
-
-                thread_args = taskset_thread_args( &pv->mask_dilate_taskset, ii );
-                thread_args->pv = pv;
-                thread_args->segment = ii;
-
-                int pp;
-                for (pp = 0; pp < 3; pp++)
-                {
-                    if (decomb_prev_thread_args != NULL)
-                    {
-                        thread_args->segment_start[pp] =
-                            decomb_prev_thread_args->segment_start[pp] +
-                            decomb_prev_thread_args->segment_height[pp];
-                    }
-
-                    if( ii == pv->cpu_count - 1 )
-                    {
-                        /*
-                         * Final segment
-                         */
-                        thread_args->segment_height[pp] =
-                            hb_image_height(init->pix_fmt, init->height, pp) -
-                            thread_args->segment_start[pp];
-                    } else {
-                        thread_args->segment_height[pp] = pv->segment_height[pp];
-                    }
-                }
-
-                if( taskset_thread_spawn( &pv->mask_dilate_taskset, ii,
-                                         "mask_dilate_segment",
-                                         mask_dilate_thread,
-                                         HB_NORMAL_PRIORITY ) == 0 )
-                {
-                    hb_error( "mask dilate could not spawn thread" );
-                }
-
-                decomb_prev_thread_args = thread_args;
+                seg->segment_height[pp] = h;
             }
         }
     }
 
     if( pv->mode & MODE_EEDI2 )
     {
-        /*
-         * Create eedi2 taskset.
-         */
-        if( taskset_init( &pv->eedi2_taskset, /*thread_count*/3,
-                          sizeof( eedi2_thread_arg_t ) ) == 0 )
-        {
-            hb_error( "eedi2 could not initialize taskset" );
-        }
-
         if( pv->post_processing > 1 )
         {
             int stride = hb_image_stride(init->pix_fmt, init->width, 0);
@@ -2408,24 +1936,6 @@ static int hb_decomb_init( hb_filter_object_t * filter,
             else
                 hb_log("EEDI2: successfully mallloced derivative arrays");
         }
-
-        for( ii = 0; ii < 3; ii++ )
-        {
-            eedi2_thread_arg_t *eedi2_thread_args;
-
-            eedi2_thread_args = taskset_thread_args( &pv->eedi2_taskset, ii );
-
-            eedi2_thread_args->pv = pv;
-            eedi2_thread_args->plane = ii;
-
-            if( taskset_thread_spawn( &pv->eedi2_taskset, ii,
-                                      "eedi2_filter_segment",
-                                      eedi2_filter_thread,
-                                      HB_NORMAL_PRIORITY ) == 0 )
-            {
-                hb_error( "eedi2 could not spawn thread" );
-            }
-        }
     }
 
     return 0;
@@ -2442,25 +1952,8 @@ static void hb_decomb_close( hb_filter_object_t * filter )
 
     hb_log("decomb: deinterlaced %i | blended %i | unfiltered %i | total %i", pv->deinterlaced_frames, pv->blended_frames, pv->unfiltered_frames, pv->deinterlaced_frames + pv->blended_frames + pv->unfiltered_frames);
 
-    taskset_fini( &pv->yadif_taskset );
-    taskset_fini( &pv->decomb_filter_taskset );
-    taskset_fini( &pv->decomb_check_taskset );
-
-    if( pv->mode & MODE_FILTER )
-    {
-        taskset_fini( &pv->mask_filter_taskset );
-        if( pv->filter_mode == FILTER_ERODE_DILATE )
-        {
-            taskset_fini( &pv->mask_erode_taskset );
-            taskset_fini( &pv->mask_dilate_taskset );
-        }
-    }
-
-    if( pv->mode & MODE_EEDI2 )
-    {
-        taskset_fini( &pv->eedi2_taskset );
-    }
-
+    free( pv->segments );
+    free( pv->check_segments );
 
     /* Cleanup reference buffers. */
     int ii;
@@ -2500,11 +1993,6 @@ static void hb_decomb_close( hb_filter_object_t * filter )
 
     free(pv->block_score);
 
-    /*
-     * free memory for yadif structs
-     */
-    free( pv->yadif_arguments );
-
     free( pv );
     filter->private_data = NULL;
 }
@@ -2533,7 +2021,7 @@ static int hb_decomb_work( hb_filter_object_t * filter,
     if (!pv->yadif_ready)
     {
         // If yadif is not ready, store another ref and return HB_FILTER_DELAY
-        store_ref(pv, hb_buffer_dup(in));
+        store_ref(pv, hb_buffer_ref(in));
         pv->yadif_ready = 1;
         // Wait for next
         return HB_FILTER_DELAY;
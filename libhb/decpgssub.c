@@ -89,6 +89,9 @@ static void make_empty_pgs( hb_buffer_t * buf )
     {
         int ii = 0;
 
+        // The packet may share its data with other subtitle tracks
+        hb_buffer_make_writable( b );
+
         while (ii + 3 <= b->size)
         {
             uint8_t type;
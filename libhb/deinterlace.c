@@ -18,7 +18,7 @@
 
 #include "hb.h"
 #include "hbffmpeg.h"
-#include "taskset.h"
+#include "threadpool.h"
 
 // yadif_mode is a bit vector with the following flags
 #define MODE_YADIF_ENABLE       1
@@ -44,11 +44,6 @@ typedef struct deint_arguments_s {
     hb_buffer_t * dst;
 } deint_arguments_t;
 
-typedef struct deint_thread_arg_s {
-    hb_filter_private_t *pv;
-    int segment;
-} deint_thread_arg_t;
-
 struct hb_filter_private_s
 {
     int              width;
@@ -65,11 +60,8 @@ struct hb_filter_private_s
 
     int              deint_nsegs;
 
-    taskset_t        deint_taskset;         // Threads for fast deint
-    taskset_t        yadif_taskset;         // Threads for Yadif
-
-    deint_arguments_t *deint_arguments;     // Arguments to thread for work
-    yadif_arguments_t *yadif_arguments;     // Arguments to thread for work
+    deint_arguments_t *deint_arguments;     // Arguments to segments for work
+    yadif_arguments_t  yadif_arguments;     // Arguments to segments for work
 };
 
 static int hb_deinterlace_init( hb_filter_object_t * filter,
@@ -170,127 +162,85 @@ static void yadif_filter_line(
     }
 }
 
-typedef struct yadif_thread_arg_s {
-    hb_filter_private_t *pv;
-    int segment;
-} yadif_thread_arg_t;
-
 /*
  * deinterlace this segment of all three planes in a single thread.
  */
-void yadif_filter_thread( void *thread_args_v )
+static void yadif_filter_segment( void *pv_v, int segment )
 {
-    yadif_arguments_t *yadif_work = NULL;
-    hb_filter_private_t * pv;
-    int run = 1;
-    int segment, segment_start, segment_stop;
-    yadif_thread_arg_t *thread_args = thread_args_v;
+    yadif_arguments_t *yadif_work;
+    hb_filter_private_t * pv = pv_v;
+    int segment_start, segment_stop;
 
-    pv = thread_args->pv;
-    segment = thread_args->segment;
+    yadif_work = &pv->yadif_arguments;
 
-    hb_log("Yadif Deinterlace thread started for segment %d", segment);
-
-    while( run )
+    /*
+     * Process all three planes, but only this segment of it.
+     */
+    int pp;
+    for(pp = 0; pp < 3; pp++)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->yadif_taskset, segment );
-
-
-        if( taskset_thread_stop( &pv->yadif_taskset, segment ) )
+        hb_buffer_t *dst = yadif_work->dst;
+        int w = dst->plane[pp].width;
+        int s = dst->plane[pp].stride;
+        int h = dst->plane[pp].height;
+        int yy;
+        int parity = yadif_work->parity;
+        int tff = yadif_work->tff;
+        int penultimate = h - 2;
+
+        int segment_height = (h / pv->segments) & ~1;
+        segment_start = segment_height * segment;
+        if( segment == pv->segments - 1 )
         {
             /*
-             * No more work to do, exit this thread.
+             * Final segment
              */
-            run = 0;
-            goto report_completion;
+            segment_stop = h;
+        } else {
+            segment_stop = segment_height * ( segment + 1 );
         }
 
-        yadif_work = &pv->yadif_arguments[segment];
-
-        if( yadif_work->dst == NULL )
+        uint8_t *dst2 = &dst->plane[pp].data[segment_start * s];
+        uint8_t *prev = &pv->yadif_ref[0]->plane[pp].data[segment_start * s];
+        uint8_t *cur  = &pv->yadif_ref[1]->plane[pp].data[segment_start * s];
+        uint8_t *next = &pv->yadif_ref[2]->plane[pp].data[segment_start * s];
+        for( yy = segment_start; yy < segment_stop; yy++ )
         {
-            hb_error( "Thread started when no work available" );
-            goto report_completion;
-        }
-
-        /*
-         * Process all three planes, but only this segment of it.
-         */
-        int pp;
-        for(pp = 0; pp < 3; pp++)
-        {
-            hb_buffer_t *dst = yadif_work->dst;
-            int w = dst->plane[pp].width;
-            int s = dst->plane[pp].stride;
-            int h = dst->plane[pp].height;
-            int yy;
-            int parity = yadif_work->parity;
-            int tff = yadif_work->tff;
-            int penultimate = h - 2;
-
-            int segment_height = (h / pv->segments) & ~1;
-            segment_start = segment_height * segment;
-            if( segment == pv->segments - 1 )
-            {
-                /*
-                 * Final segment
-                 */
-                segment_stop = h;
-            } else {
-                segment_stop = segment_height * ( segment + 1 );
-            }
-
-            uint8_t *dst2 = &dst->plane[pp].data[segment_start * s];
-            uint8_t *prev = &pv->yadif_ref[0]->plane[pp].data[segment_start * s];
-            uint8_t *cur  = &pv->yadif_ref[1]->plane[pp].data[segment_start * s];
-            uint8_t *next = &pv->yadif_ref[2]->plane[pp].data[segment_start * s];
-            for( yy = segment_start; yy < segment_stop; yy++ )
+            if(((yy ^ parity) &  1))
             {
-                if(((yy ^ parity) &  1))
+                /* This is the bottom field when TFF and vice-versa.
+                   It's the field that gets filtered. Because yadif
+                   needs 2 lines above and below the one being filtered,
+                   we need to mirror the edges. When TFF, this means
+                   replacing the 2nd line with a copy of the 1st,
+                   and the last with the second-to-last.                  */
+                if( yy > 1 && yy < penultimate )
                 {
-                    /* This is the bottom field when TFF and vice-versa.
-                       It's the field that gets filtered. Because yadif
-                       needs 2 lines above and below the one being filtered,
-                       we need to mirror the edges. When TFF, this means
-                       replacing the 2nd line with a copy of the 1st,
-                       and the last with the second-to-last.                  */
-                    if( yy > 1 && yy < penultimate )
-                    {
-                        /* This isn't the top or bottom,
-                         * proceed as normal to yadif. */
-                        yadif_filter_line(pv, dst2, prev, cur, next, w, s,
-                                          parity ^ tff);
-                    }
-                    else
-                    {
-                        // parity == 0 (TFF), y1 = y0
-                        // parity == 1 (BFF), y0 = y1
-                        // parity == 0 (TFF), yu = yp
-                        // parity == 1 (BFF), yp = yu
-                        uint8_t *src  = &pv->yadif_ref[1]->plane[pp].data[(yy^parity)*s];
-                        memcpy(dst2, src, w);
-                    }
+                    /* This isn't the top or bottom,
+                     * proceed as normal to yadif. */
+                    yadif_filter_line(pv, dst2, prev, cur, next, w, s,
+                                      parity ^ tff);
                 }
                 else
                 {
-                    /* Preserve this field unfiltered */
-                    memcpy(dst2, cur, w);
+                    // parity == 0 (TFF), y1 = y0
+                    // parity == 1 (BFF), y0 = y1
+                    // parity == 0 (TFF), yu = yp
+                    // parity == 1 (BFF), yp = yu
+                    uint8_t *src  = &pv->yadif_ref[1]->plane[pp].data[(yy^parity)*s];
+                    memcpy(dst2, src, w);
                 }
-                dst2 += s;
-                prev += s;
-                cur += s;
-                next += s;
             }
+            else
+            {
+                /* Preserve this field unfiltered */
+                memcpy(dst2, cur, w);
+            }
+            dst2 += s;
+            prev += s;
+            cur += s;
+            next += s;
         }
-
-report_completion:
-        /*
-         * Finished this segment, let everyone know.
-         */
-        taskset_thread_complete( &pv->yadif_taskset, segment );
     }
 }
 
@@ -306,20 +256,15 @@ static void yadif_filter( hb_filter_private_t * pv,
                           hb_buffer_t * dst, int parity, int tff)
 {
 
-    int segment;
-
-    for( segment = 0; segment < pv->segments; segment++ )
-    {
-        /*
-         * Setup the work for this plane.
-         */
-        pv->yadif_arguments[segment].parity = parity;
-        pv->yadif_arguments[segment].tff = tff;
-        pv->yadif_arguments[segment].dst = dst;
-    }
+    /*
+     * Setup the work for this frame.
+     */
+    pv->yadif_arguments.parity = parity;
+    pv->yadif_arguments.tff = tff;
+    pv->yadif_arguments.dst = dst;
 
-    /* Allow the taskset threads to make one pass over the data. */
-    taskset_cycle( &pv->yadif_taskset );
+    /* Let the thread pool make one pass over the data. */
+    hb_parallel_for( pv->segments, yadif_filter_segment, pv );
 
     /*
      * Entire frame is now deinterlaced.
@@ -329,55 +274,12 @@ static void yadif_filter( hb_filter_private_t * pv,
 /*
  * deinterlace a frame in a single thread.
  */
-void deint_filter_thread( void *thread_args_v )
+static void deint_filter_segment( void *pv_v, int segment )
 {
-    deint_arguments_t *args = NULL;
-    hb_filter_private_t * pv;
-    int run = 1;
-    int segment;
-    deint_thread_arg_t *thread_args = thread_args_v;
-
-    pv = thread_args->pv;
-    segment = thread_args->segment;
-
-    hb_log("Fast Deinterlace thread started for segment %d", segment);
-
-    while( run )
-    {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->deint_taskset, segment );
-
-
-        if( taskset_thread_stop( &pv->deint_taskset, segment ) )
-        {
-            /*
-             * No more work to do, exit this thread.
-             */
-            run = 0;
-            goto report_completion;
-        }
+    hb_filter_private_t * pv = pv_v;
+    deint_arguments_t *args = &pv->deint_arguments[segment];
 
-        args = &pv->deint_arguments[segment];
-
-        if( args->dst == NULL )
-        {
-            // This can happen when flushing final buffers.
-            goto report_completion;
-        }
-
-        /*
-         * Process all three planes, but only this segment of it.
-         */
-        hb_deinterlace(args->dst, args->src);
-
-report_completion:
-        /*
-         * Finished this segment, let everyone know.
-         */
-        taskset_thread_complete( &pv->deint_taskset, segment );
-    }
+    hb_deinterlace(args->dst, args->src);
 }
 
 /*
@@ -405,8 +307,8 @@ static hb_buffer_t * deint_fast(hb_filter_private_t * pv, hb_buffer_t * in)
 
     if (pv->deint_nsegs > 0)
     {
-        /* Allow the taskset threads to make one pass over the data. */
-        taskset_cycle( &pv->deint_taskset );
+        /* Let the thread pool make one pass over the data. */
+        hb_parallel_for( pv->deint_nsegs, deint_filter_segment, pv );
     }
 
     hb_buffer_t *first = NULL, *last = NULL;
@@ -469,74 +371,16 @@ static int hb_deinterlace_init( hb_filter_object_t * filter,
     }
 
     pv->cpu_count = hb_get_cpu_count();
+    pv->segments = pv->cpu_count;
 
-    /* Allocate yadif specific buffers */
-    if( pv->yadif_mode & MODE_YADIF_ENABLE )
-    {
-        /*
-         * Setup yadif taskset.
-         */
-        pv->segments = pv->cpu_count;
-        pv->yadif_arguments = malloc( sizeof( yadif_arguments_t ) * pv->segments );
-        if( pv->yadif_arguments == NULL ||
-            taskset_init( &pv->yadif_taskset, /*thread_count*/pv->segments,
-                          sizeof( yadif_thread_arg_t ) ) == 0 )
-        {
-            hb_error( "yadif could not initialize taskset" );
-        }
-
-        int ii;
-        for( ii = 0; ii < pv->segments; ii++ )
-        {
-            yadif_thread_arg_t *thread_args;
-
-            thread_args = taskset_thread_args( &pv->yadif_taskset, ii );
-
-            thread_args->pv = pv;
-            thread_args->segment = ii;
-            pv->yadif_arguments[ii].dst = NULL;
-
-            if( taskset_thread_spawn( &pv->yadif_taskset, ii,
-                                      "yadif_filter_segment",
-                                      yadif_filter_thread,
-                                      HB_NORMAL_PRIORITY ) == 0 )
-            {
-                hb_error( "yadif could not spawn thread" );
-            }
-        }
-    }
-    else
+    /* Fast deint works on one whole frame per segment */
+    if( !( pv->yadif_mode & MODE_YADIF_ENABLE ) )
     {
-        /*
-         * Setup fast deint taskset.
-         */
-        pv->segments = pv->cpu_count;
-        pv->deint_arguments = malloc( sizeof( deint_arguments_t ) * pv->segments );
-        if( pv->deint_arguments == NULL ||
-            taskset_init( &pv->deint_taskset, pv->segments,
-                          sizeof( deint_thread_arg_t ) ) == 0 )
-        {
-            hb_error( "deint could not initialize taskset" );
-        }
-
-        int ii;
-        for( ii = 0; ii < pv->segments; ii++ )
+        pv->deint_arguments = calloc( pv->segments,
+                                      sizeof( deint_arguments_t ) );
+        if( pv->deint_arguments == NULL )
         {
-            deint_thread_arg_t *thread_args;
-
-            thread_args = taskset_thread_args( &pv->deint_taskset, ii );
-
-            thread_args->pv = pv;
-            thread_args->segment = ii;
-            pv->deint_arguments[ii].dst = NULL;
-
-            if( taskset_thread_spawn( &pv->deint_taskset, ii,
-                                      "deint_filter_segment",
-                                      deint_filter_thread,
-                                      HB_NORMAL_PRIORITY ) == 0 )
-            {
-                hb_error( "deint could not spawn thread" );
-            }
+            hb_error( "deint could not allocate segment arguments" );
         }
     }
 
@@ -555,19 +399,14 @@ static void hb_deinterlace_close( hb_filter_object_t * filter )
     /* Cleanup yadif specific buffers */
     if( pv->yadif_mode & MODE_YADIF_ENABLE )
     {
-        taskset_fini( &pv->yadif_taskset );
-
         int ii;
         for(ii = 0; ii < 3; ii++)
         {
             hb_buffer_close(&pv->yadif_ref[ii]);
         }
-
-        free( pv->yadif_arguments );
     }
     else
     {
-        taskset_fini( &pv->deint_taskset );
         free( pv->deint_arguments );
     }
 
@@ -612,7 +451,7 @@ static int hb_deinterlace_work( hb_filter_object_t * filter,
     if (!pv->yadif_ready)
     {
         // If yadif is not ready, store another ref and return HB_FILTER_DELAY
-        yadif_store_ref(pv, hb_buffer_dup(in));
+        yadif_store_ref(pv, hb_buffer_ref(in));
         pv->yadif_ready = 1;
         // Wait for next
         return HB_FILTER_DELAY;
@@ -19,6 +19,7 @@
 
 #include "hb.h"
 #include "hbffmpeg.h"
+#include "threadpool.h"
 
 #define HQDN3D_SPATIAL_LUMA_DEFAULT    4.0f
 #define HQDN3D_SPATIAL_CHROMA_DEFAULT  3.0f
@@ -27,11 +28,31 @@
 #define ABS(A) ( (A) > 0 ? (A) : -(A) )
 #define MIN( a, b ) ( (a) > (b) ? (b) : (a) )
 
+/* Rows a strip runs ahead of its right neighbour between notifications */
+#define HQDN3D_SYNC_ROWS 16
+
 struct hb_filter_private_s
 {
     short            hqdn3d_coef[6][512*16];
-    unsigned short * hqdn3d_line;
+    unsigned short * hqdn3d_line[3];
     unsigned short * hqdn3d_frame[3];
+
+    int              cpu_count;
+    hb_buffer_t    * src;
+    hb_buffer_t    * dst;
+
+    /*
+     * The spatial lowpass is recursive both horizontally and vertically,
+     * so the frame is split into vertical strips that are processed as a
+     * wavefront. Each strip waits for the strip on its left to finish a
+     * group of rows, then continues the horizontal filter from the state
+     * that strip left in hqdn3d_edge. hb_parallel_for starts strips in
+     * order, so the strip being waited on is always already running.
+     */
+    unsigned int   * hqdn3d_edge[3];     // cpu_count * height entries
+    int            * hqdn3d_progress[3]; // rows completed by each strip
+    hb_lock_t      * progress_lock;
+    hb_cond_t      * progress_cond;
 };
 
 static int hb_denoise_init( hb_filter_object_t * filter,
@@ -109,109 +130,254 @@ static void hqdn3d_denoise_temporal( unsigned char * frame_src,
     }
 }
 
-static void hqdn3d_denoise_spatial( unsigned char * frame_src,
+static void hqdn3d_wait_rows( hb_filter_private_t * pv, int * progress,
+                              int rows )
+{
+    if( hb_atomic_load( progress ) >= rows )
+        return;
+
+    hb_lock( pv->progress_lock );
+    while( hb_atomic_load( progress ) < rows )
+    {
+        hb_cond_wait( pv->progress_cond, pv->progress_lock );
+    }
+    hb_unlock( pv->progress_lock );
+}
+
+static void hqdn3d_post_rows( hb_filter_private_t * pv, int * progress,
+                              int rows )
+{
+    hb_lock( pv->progress_lock );
+    hb_atomic_store( progress, rows );
+    hb_cond_broadcast( pv->progress_cond );
+    hb_unlock( pv->progress_lock );
+}
+
+/*
+ * Spatial + temporal denoise of columns x0..x1-1 of a plane.
+ *
+ * edge_in holds, for every row, the horizontal filter state at column
+ * x0-1 as left by the strip to our left; edge_out receives our state at
+ * column x1-1. progress_in/out let neighbouring strips wait for each other.
+ * The leftmost strip has no edge_in, the rightmost no edge_out.
+ */
+static void hqdn3d_denoise_spatial( hb_filter_private_t * pv,
+                                    unsigned char * frame_src,
                                     unsigned char * frame_dst,
                                     unsigned short * line_ant,
                                     unsigned short * frame_ant,
                                     int w, int h,
+                                    int x0, int x1,
+                                    unsigned int * edge_in,
+                                    unsigned int * edge_out,
+                                    int * progress_in,
+                                    int * progress_out,
                                     short * spatial,
                                     short * temporal )
 {
-    int x, y;
+    int x, y, y0, y1;
     unsigned int pixel_ant;
     unsigned int tmp;
 
     spatial  += 0x1000;
     temporal += 0x1000;
 
-    /* First line has no top neighbor. Only left one for each tmp and last frame */
-    pixel_ant = frame_src[0]<<8;
-    for ( x = 0; x < w; x++)
+    for( y0 = 0; y0 < h; y0 = y1 )
     {
-        line_ant[x] = tmp = pixel_ant = hqdn3d_lowpass_mul( pixel_ant,
-                                                            frame_src[x]<<8,
+        y1 = MIN( y0 + HQDN3D_SYNC_ROWS, h );
+        if( progress_in != NULL )
+        {
+            hqdn3d_wait_rows( pv, progress_in, y1 );
+        }
+
+        for( y = y0; y < y1; y++ )
+        {
+            unsigned char  * src = frame_src + y*w;
+            unsigned char  * dst = frame_dst + y*w;
+            unsigned short * ant = frame_ant + y*w;
+
+            x = x0;
+            pixel_ant = ( x0 == 0 ) ? src[0]<<8 : edge_in[y];
+            if( y == 0 )
+            {
+                /* First line has no top neighbor. Only left one for each tmp and last frame */
+                for( ; x < x1; x++ )
+                {
+                    line_ant[x] = tmp = pixel_ant = hqdn3d_lowpass_mul( pixel_ant,
+                                                                        src[x]<<8,
+                                                                        spatial );
+                    ant[x] = tmp = hqdn3d_lowpass_mul( ant[x],
+                                                       tmp,
+                                                       temporal );
+                    dst[x] = (tmp+0x7F)>>8;
+                }
+            }
+            else
+            {
+                if( x0 == 0 )
+                {
+                    /* First column has no left neighbor */
+                    line_ant[0] = tmp = hqdn3d_lowpass_mul( line_ant[0],
+                                                            pixel_ant,
                                                             spatial );
-        frame_ant[x] = tmp = hqdn3d_lowpass_mul( frame_ant[x],
-                                                 tmp,
-                                                 temporal );
-        frame_dst[x] = (tmp+0x7F)>>8;
+                    ant[0] = tmp = hqdn3d_lowpass_mul( ant[0],
+                                                       tmp,
+                                                       temporal );
+                    dst[0] = (tmp+0x7F)>>8;
+                    x++;
+                }
+                for( ; x < x1; x++ )
+                {
+                    pixel_ant =          hqdn3d_lowpass_mul( pixel_ant,
+                                                             src[x]<<8,
+                                                             spatial );
+                    line_ant[x] = tmp =  hqdn3d_lowpass_mul( line_ant[x],
+                                                             pixel_ant,
+                                                             spatial );
+                    ant[x] = tmp = hqdn3d_lowpass_mul( ant[x],
+                                                       tmp,
+                                                       temporal );
+                    dst[x] = (tmp+0x7F)>>8;
+                }
+            }
+            if( edge_out != NULL )
+            {
+                edge_out[y] = pixel_ant;
+            }
+        }
+
+        if( progress_out != NULL )
+        {
+            hqdn3d_post_rows( pv, progress_out, y1 );
+        }
     }
+}
 
-    for( y = 1; y < h; y++ )
+/*
+ * Number of strips a plane of width w is split into for the spatial
+ * denoise. Strips are at least 16 pixels wide.
+ */
+static int hqdn3d_strips( hb_filter_private_t * pv, int w )
+{
+    int strips = w / 16;
+    if( strips < 1 )
+        strips = 1;
+    return MIN( strips, pv->cpu_count );
+}
+
+/*
+ * Denoise this segment of all three planes. For spatial denoise a
+ * segment is a vertical strip, for temporal only denoise it is a band
+ * of rows.
+ */
+static void hqdn3d_denoise_segment( void * pv_v, int segment )
+{
+    hb_filter_private_t * pv = pv_v;
+    hb_buffer_t * src = pv->src;
+    hb_buffer_t * dst = pv->dst;
+    int c;
+
+    for( c = 0; c < 3; c++ )
     {
-        frame_src += w;
-        frame_dst += w;
-        frame_ant += w;
-        pixel_ant = frame_src[0]<<8;
-        for ( x = 0; x < w-1; x++ )
+        short * spatial  = pv->hqdn3d_coef[c * 2];
+        short * temporal = pv->hqdn3d_coef[c * 2 + 1];
+        int w = src->plane[c].stride;
+        int h = src->plane[c].height;
+
+        /* If no spatial coefficients, do temporal denoise only */
+        if( spatial[0] )
         {
-            line_ant[x] = tmp =  hqdn3d_lowpass_mul( line_ant[x],
-                                                     pixel_ant,
-                                                     spatial );
-            pixel_ant =          hqdn3d_lowpass_mul( pixel_ant,
-                                                     frame_src[x+1]<<8,
-                                                     spatial );
-            frame_ant[x] = tmp = hqdn3d_lowpass_mul( frame_ant[x],
-                                                     tmp,
-                                                     temporal );
-            frame_dst[x] = (tmp+0x7F)>>8;
+            int strips = hqdn3d_strips( pv, w );
+            int x0, x1;
+
+            if( segment >= strips )
+                continue;
+
+            x0 = ( ( w / strips ) & ~15 ) * segment;
+            x1 = ( segment == strips - 1 ) ? w :
+                                             x0 + ( ( w / strips ) & ~15 );
+            hqdn3d_denoise_spatial( pv,
+                                    src->plane[c].data,
+                                    dst->plane[c].data,
+                                    pv->hqdn3d_line[c],
+                                    pv->hqdn3d_frame[c],
+                                    w, h, x0, x1,
+                                    segment > 0 ?
+                                        pv->hqdn3d_edge[c] + ( segment - 1 ) * h : NULL,
+                                    segment < strips - 1 ?
+                                        pv->hqdn3d_edge[c] + segment * h : NULL,
+                                    segment > 0 ?
+                                        &pv->hqdn3d_progress[c][segment - 1] : NULL,
+                                    segment < strips - 1 ?
+                                        &pv->hqdn3d_progress[c][segment] : NULL,
+                                    spatial,
+                                    temporal );
+        }
+        else
+        {
+            int y0 = ( h * segment ) / pv->cpu_count;
+            int y1 = ( h * ( segment + 1 ) ) / pv->cpu_count;
+
+            hqdn3d_denoise_temporal( src->plane[c].data + y0 * w,
+                                     dst->plane[c].data + y0 * w,
+                                     pv->hqdn3d_frame[c] + y0 * w,
+                                     w, y1 - y0,
+                                     temporal );
         }
-        line_ant[x] = tmp =  hqdn3d_lowpass_mul( line_ant[x],
-                                                 pixel_ant,
-                                                 spatial );
-        frame_ant[x] = tmp = hqdn3d_lowpass_mul( frame_ant[x],
-                                                 tmp,
-                                                 temporal );
-        frame_dst[x] = (tmp+0x7F)>>8;
     }
 }
 
-static void hqdn3d_denoise( unsigned char * frame_src,
-                            unsigned char * frame_dst,
-                            unsigned short * line_ant,
-                            unsigned short ** frame_ant_ptr,
-                            int w,
-                            int h,
-                            short * spatial,
-                            short * temporal )
+/*
+ * threaded hqdn3d - each thread denoises a single segment of all
+ * three planes.
+ *
+ * This function blocks until the frame is denoised.
+ */
+static void hqdn3d_denoise( hb_filter_private_t * pv,
+                            hb_buffer_t * in,
+                            hb_buffer_t * out )
 {
-    int x, y;
-    unsigned short* frame_ant = (*frame_ant_ptr);
+    int c, x, y;
 
-    if( !frame_ant)
+    for( c = 0; c < 3; c++ )
     {
-        unsigned char * src = frame_src;
-        (*frame_ant_ptr) = frame_ant = malloc( w*h*sizeof(unsigned short) );
-        for ( y = 0; y < h; y++, frame_src += w, frame_ant += w )
+        int w = in->plane[c].stride;
+        int h = in->plane[c].height;
+
+        if( !pv->hqdn3d_frame[c] )
         {
-            for( x = 0; x < w; x++ )
+            unsigned char  * frame_src = in->plane[c].data;
+            unsigned short * frame_ant;
+
+            pv->hqdn3d_frame[c] = frame_ant = malloc( w*h*sizeof(unsigned short) );
+            for ( y = 0; y < h; y++, frame_src += w, frame_ant += w )
             {
-                frame_ant[x] = frame_src[x]<<8;
+                for( x = 0; x < w; x++ )
+                {
+                    frame_ant[x] = frame_src[x]<<8;
+                }
             }
         }
-        frame_src = src;
-        frame_ant = *frame_ant_ptr;
+        if( !pv->hqdn3d_line[c] )
+        {
+            pv->hqdn3d_line[c] = malloc( w * sizeof(unsigned short) );
+            pv->hqdn3d_edge[c] = malloc( pv->cpu_count * h * sizeof(unsigned int) );
+            pv->hqdn3d_progress[c] = malloc( pv->cpu_count * sizeof(int) );
+        }
+        memset( pv->hqdn3d_progress[c], 0, pv->cpu_count * sizeof(int) );
     }
 
-    /* If no spatial coefficients, do temporal denoise only */
-    if( spatial[0] )
-    {
-        hqdn3d_denoise_spatial( frame_src,
-                                frame_dst,
-                                line_ant,
-                                frame_ant,
-                                w, h,
-                                spatial,
-                                temporal );
-    }
-    else
-    {
-        hqdn3d_denoise_temporal( frame_src,
-                                 frame_dst,
-                                 frame_ant,
-                                 w, h,
-                                 temporal);
-    }
+    pv->src = in;
+    pv->dst = out;
+
+    /*
+     * Let the thread pool make one pass over the data.
+     */
+    hb_parallel_for( pv->cpu_count, hqdn3d_denoise_segment, pv );
+
+    /*
+     * Entire frame is now denoised.
+     */
 }
 
 static int hb_denoise_init( hb_filter_object_t * filter,
@@ -286,6 +452,10 @@ static int hb_denoise_init( hb_filter_object_t * filter,
     hqdn3d_precalc_coef( pv->hqdn3d_coef[4], spatial_chroma_r );
     hqdn3d_precalc_coef( pv->hqdn3d_coef[5], temporal_chroma_r );
 
+    pv->cpu_count = hb_get_cpu_count();
+    pv->progress_lock = hb_lock_init();
+    pv->progress_cond = hb_cond_init();
+
     return 0;
 }
 
@@ -298,26 +468,16 @@ static void hb_denoise_close( hb_filter_object_t * filter )
         return;
     }
 
-	if( pv->hqdn3d_line )
-    {
-        free( pv->hqdn3d_line );
-        pv->hqdn3d_line = NULL;
-    }
-	if( pv->hqdn3d_frame[0] )
-    {
-        free( pv->hqdn3d_frame[0] );
-        pv->hqdn3d_frame[0] = NULL;
-    }
-	if( pv->hqdn3d_frame[1] )
+    int c;
+    for( c = 0; c < 3; c++ )
     {
-        free( pv->hqdn3d_frame[1] );
-        pv->hqdn3d_frame[1] = NULL;
-    }
-	if( pv->hqdn3d_frame[2] )
-    {
-        free( pv->hqdn3d_frame[2] );
-        pv->hqdn3d_frame[2] = NULL;
+        free( pv->hqdn3d_line[c] );
+        free( pv->hqdn3d_frame[c] );
+        free( pv->hqdn3d_edge[c] );
+        free( pv->hqdn3d_progress[c] );
     }
+    hb_lock_close( &pv->progress_lock );
+    hb_cond_close( &pv->progress_cond );
 
     free( pv );
     filter->private_data = NULL;
@@ -339,25 +499,7 @@ static int hb_denoise_work( hb_filter_object_t * filter,
 
     out = hb_video_buffer_init( in->f.width, in->f.height );
 
-    if( !pv->hqdn3d_line )
-    {
-        pv->hqdn3d_line = malloc( in->plane[0].stride * sizeof(unsigned short) );
-    }
-
-    int c, coef_index;
-
-    for ( c = 0; c < 3; c++ )
-    {
-        coef_index = c * 2;
-        hqdn3d_denoise( in->plane[c].data,
-                        out->plane[c].data,
-                        pv->hqdn3d_line,
-                        &pv->hqdn3d_frame[c],
-                        in->plane[c].stride,
-                        in->plane[c].height,
-                        pv->hqdn3d_coef[coef_index],
-                        pv->hqdn3d_coef[coef_index+1] );
-    }
+    hqdn3d_denoise( pv, in, out );
 
     out->s = in->s;
     hb_buffer_move_subs( out, in );
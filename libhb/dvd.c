@@ -696,6 +696,7 @@ static int hb_dvdread_start( hb_dvd_t * e, hb_title_t *title, int chapter )
     d->cell_overlap = 0;
     d->in_cell = 0;
     d->in_sync = 2;
+    hb_buffer_close( &d->batch );
 
     return 1;
 }
@@ -708,6 +709,7 @@ static int hb_dvdread_start( hb_dvd_t * e, hb_title_t *title, int chapter )
 static void hb_dvdread_stop( hb_dvd_t * e )
 {
     hb_dvdread_t *d = &(e->dvdread);
+    hb_buffer_close( &d->batch );
     if( d->ifo )
     {
         ifoClose( d->ifo );
@@ -810,6 +812,57 @@ int is_nav_pack( unsigned char *buf )
     }
 }
 
+/***********************************************************************
+ * hb_dvdread_read_block
+ ***********************************************************************
+ * Returns the VOBU data block at d->block.  The data blocks that follow
+ * a NAV pack are read in runs of up to HB_DVD_READ_BATCH blocks with a
+ * single DVDReadBlocks call, and each block is handed out as a slice of
+ * the run so that nothing gets copied.  Once a run fails to read, the
+ * rest of that VOBU is read one block at a time.  Returns NULL on read
+ * error.
+ **********************************************************************/
+#define HB_DVD_READ_BATCH 128
+
+static hb_buffer_t * hb_dvdread_read_block( hb_dvdread_t * d )
+{
+    if( d->batch == NULL || d->block < d->batch_block ||
+        d->block >= d->batch_block + d->batch_count )
+    {
+        int count = MIN( d->pack_len, HB_DVD_READ_BATCH );
+
+        if( d->batch_single )
+        {
+            count = 1;
+        }
+        hb_buffer_close( &d->batch );
+        d->batch = hb_buffer_init( count * HB_DVD_READ_BUFFER_SIZE );
+        if( count > 1 &&
+            DVDReadBlocks( d->file, d->block, count, d->batch->data ) != count )
+        {
+            // Read the rest of this VOBU one block at a time so that
+            // one bad block only costs us the remainder of the VOBU,
+            // as it always did, without retrying the whole run at
+            // every block
+            d->batch_single = 1;
+            count = 1;
+        }
+        if( count == 1 &&
+            DVDReadBlocks( d->file, d->block, 1, d->batch->data ) != 1 )
+        {
+            hb_buffer_close( &d->batch );
+            return NULL;
+        }
+        d->batch->size = count * HB_DVD_READ_BUFFER_SIZE;
+        d->batch_block = d->block;
+        d->batch_count = count;
+    }
+
+    return hb_buffer_slice( d->batch,
+                            ( d->block - d->batch_block ) *
+                            HB_DVD_READ_BUFFER_SIZE, HB_DVD_READ_BUFFER_SIZE );
+}
+
 /***********************************************************************
  * hb_dvdread_read
  ***********************************************************************
@@ -818,7 +871,7 @@ int is_nav_pack( unsigned char *buf )
 static hb_buffer_t * hb_dvdread_read( hb_dvd_t * e )
 {
     hb_dvdread_t *d = &(e->dvdread);
-    hb_buffer_t *b = hb_buffer_init( HB_DVD_READ_BUFFER_SIZE );
+    hb_buffer_t *b = NULL;
  top:
     if( !d->pack_len )
     {
@@ -826,6 +879,11 @@ static hb_buffer_t * hb_dvdread_read( hb_dvd_t * e )
         dsi_t dsi_pack;
         int   error = 0;
 
+        if( b == NULL )
+        {
+            b = hb_buffer_init( HB_DVD_READ_BUFFER_SIZE );
+        }
+
         // if we've just finished the last cell of the title we don't
         // want to read another block because our next_vobu pointer
         // is probably invalid. Just return 'no data' & our caller
@@ -982,6 +1040,7 @@ static hb_buffer_t * hb_dvdread_read( hb_dvd_t * e )
 
             (d->next_vobu)++;
         }
+        d->batch_single = 0;
 
         if( d->in_sync == 0 || d->in_sync == 2 )
         {
@@ -1067,7 +1126,8 @@ static hb_buffer_t * hb_dvdread_read( hb_dvd_t * e )
     }
     else
     {
-        if( DVDReadBlocks( d->file, d->block, 1, b->data ) != 1 )
+        hb_buffer_t * block = hb_dvdread_read_block( d );
+        if( block == NULL )
         {
             // this may be a real DVD error or may be DRM. Either way
             // we don't want to quit because of one bad block so set
@@ -1077,6 +1137,7 @@ static hb_buffer_t * hb_dvdread_read( hb_dvd_t * e )
             d->pack_len = 0;
             goto top;  /* XXX need to restructure this routine & avoid goto */
         }
+        b = block;
         d->pack_len--;
     }
 
@@ -1165,6 +1226,7 @@ static void hb_dvdread_close( hb_dvd_t ** _d )
 {
     hb_dvdread_t * d = &((*_d)->dvdread);
 
+    hb_buffer_close( &d->batch );
     if( d->vmg )
     {
         ifoClose( d->vmg );
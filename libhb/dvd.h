@@ -42,6 +42,12 @@ struct hb_dvdread_s
     int            in_sync;
     uint16_t       cur_vob_id;
     uint8_t        cur_cell_id;
+
+    // Run of VOBU data blocks read ahead in one DVDReadBlocks call
+    hb_buffer_t  * batch;
+    int            batch_block;
+    int            batch_count;
+    int            batch_single;  // multi-block read failed in this VOBU
 };
 
 struct hb_dvdnav_s
@@ -103,7 +103,7 @@ int encavcodecInit( hb_work_object_t * w, hb_job_t * job )
 
     if( job->pass == 2 )
     {
-        hb_interjob_t * interjob = hb_interjob_get( job->h );
+        hb_interjob_t * interjob = job->interjob;
         fps.den = interjob->vrate_base;
         fps.num = interjob->vrate;
     }
@@ -245,7 +245,8 @@ int encavcodecInit( hb_work_object_t * w, hb_job_t * job )
     if( job->pass != 0 && job->pass != -1 )
     {
         char filename[1024]; memset( filename, 0, 1024 );
-        hb_get_tempory_filename( job->h, filename, "ffmpeg.log" );
+        hb_get_tempory_filename( job->h, filename, "ffmpeg%d.log",
+                                 job->sequence_id & 0xFFFFFF );
 
         if( job->pass == 1 )
         {
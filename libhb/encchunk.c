@@ -0,0 +1,774 @@
+/* encchunk.c
+
+   Copyright (c) 2003-2014 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Chunked encoding splits the video of a long title into segments that
+ * are encoded at the same time, to keep more cores busy than x264 and
+ * x265 manage to use on their own.
+ *
+ * Each segment is a copy of the job that reads, decodes, filters and
+ * encodes only its part of the title.  It uses the same pts_to_start and
+ * pts_to_stop machinery as point-to-point encodes: the reader seeks with
+ * hb_stream_seek_ts and sync drops the frames before the start.  The
+ * segment jobs have no audio, subtitles or muxer (see do_job).
+ *
+ * Each segment also gets its own copy of the title.  Opening a stream
+ * stores the demuxer's context in the title (see ffmpeg_open) and the
+ * decoders read it from there, so the segments can't share one.
+ *
+ * The parent job keeps its audio, subtitles and muxer.  Its video still
+ * goes through sync, since the audio and subtitles are synced against
+ * it, but it isn't decoded: the chunk timing object below stands in for
+ * the video decoder and passes on only the time stamps of the demuxed
+ * frames, in display order.  The encchunk work object stands in for the
+ * video encoder.  It starts the segment jobs, then passes their output
+ * on to the muxer in order, shifted so that each segment starts where
+ * the one before it ended.  Output of segments that aren't next in line
+ * is parked in a temporary file until it's their turn.
+ *
+ * Each segment starts a new encoder, so it starts with an IDR frame and
+ * uses the same stream headers as the others.  That lets the segments go
+ * back to back in one stream.
+ */
+
+#include "hb.h"
+
+int  encchunkInit( hb_work_object_t *, hb_job_t * );
+int  encchunkWork( hb_work_object_t *, hb_buffer_t **, hb_buffer_t ** );
+void encchunkClose( hb_work_object_t * );
+
+hb_work_object_t hb_encchunk =
+{
+    WORK_ENCCHUNK,
+    "Chunked video encoder",
+    encchunkInit,
+    encchunkWork,
+    encchunkClose
+};
+
+int  chunktimingInit( hb_work_object_t *, hb_job_t * );
+int  chunktimingWork( hb_work_object_t *, hb_buffer_t **, hb_buffer_t ** );
+void chunktimingClose( hb_work_object_t * );
+
+hb_work_object_t hb_chunktiming =
+{
+    WORK_CHUNKTIMING,
+    "Chunked video timing",
+    chunktimingInit,
+    chunktimingWork,
+    chunktimingClose
+};
+
+// Shortest segment worth encoding on its own.  Every segment starts with
+// an IDR frame and resets the rate control.
+#define HB_CHUNK_MIN_DURATION ( 60 * 90000 )
+
+// Frames the timing object holds back to put them in display order.
+// H.264 and H.265 never reorder by more than this.
+#define HB_CHUNK_REORDER 16
+
+typedef struct
+{
+    hb_fifo_t     * fifo;           // encoded video from the segment job
+    hb_interjob_t * interjob;
+    hb_thread_t   * thread;
+    int             eof;
+
+    int64_t         duration;       // planned length, for progress
+    int64_t         end;            // stop time of the latest frame
+    int             frames;
+
+    FILE          * park;           // output waiting for its turn
+    char            filename[1024];
+} hb_chunk_t;
+
+struct hb_work_private_s
+{
+    hb_job_t      * job;
+    hb_fifo_t     * fifo_out;
+    hb_esconfig_t * config;
+
+    int             count;
+    hb_chunk_t    * chunks;
+    hb_thread_t   * thread;
+
+    int64_t         offset;         // where the current segment starts
+    int64_t         last_dts;
+    int             last_chap;
+
+    uint64_t        st_first;
+    uint64_t        st_date;
+    int             st_frames;
+
+    // Chunk timing, see chunktimingWork
+    hb_buffer_t   * held;           // held back frames, by start time
+    int             held_count;
+    int64_t         key_start;      // start of the first key frame
+    int             chap;           // chapter mark of a dropped frame
+    int64_t         frame_duration;
+};
+
+/*
+ * The segments only read the video of the title, so their copy has just
+ * the chapters.  opaque_priv is filled in when the segment's reader opens
+ * the stream.
+ */
+static hb_title_t * segment_title_copy( hb_title_t * title )
+{
+    hb_title_t * copy = calloc( 1, sizeof( hb_title_t ) );
+
+    memcpy( copy, title, sizeof( hb_title_t ) );
+
+    copy->opaque_priv      = NULL;
+    copy->metadata         = hb_metadata_init();
+    copy->list_chapter     = hb_chapter_list_copy( title->list_chapter );
+    copy->list_audio       = hb_list_init();
+    copy->list_subtitle    = hb_list_init();
+    copy->list_attachment  = hb_list_init();
+#if defined(HB_TITLE_JOBS)
+    copy->job              = NULL;
+#endif
+    if( title->video_codec_name != NULL )
+        copy->video_codec_name = strdup( title->video_codec_name );
+    if( title->container_name != NULL )
+        copy->container_name = strdup( title->container_name );
+
+    return copy;
+}
+
+static hb_job_t * segment_copy( hb_job_t * job, int64_t start,
+                                int64_t duration )
+{
+    hb_job_t * segment = calloc( 1, sizeof( hb_job_t ) );
+
+    memcpy( segment, job, sizeof( hb_job_t ) );
+
+    segment->title           = segment_title_copy( job->title );
+
+    segment->list_chapter    = hb_chapter_list_copy( job->list_chapter );
+    segment->list_audio      = hb_list_init();
+    segment->list_subtitle   = hb_list_init();
+    segment->list_attachment = hb_list_init();
+    segment->list_filter     = hb_filter_list_copy( job->list_filter );
+    segment->metadata        = NULL;
+    segment->file            = NULL;
+
+    if (job->encoder_preset != NULL)
+        segment->encoder_preset = strdup(job->encoder_preset);
+    if (job->encoder_tune != NULL)
+        segment->encoder_tune = strdup(job->encoder_tune);
+    if (job->encoder_options != NULL)
+        segment->encoder_options = strdup(job->encoder_options);
+    if (job->encoder_profile != NULL)
+        segment->encoder_profile = strdup(job->encoder_profile);
+    if (job->encoder_level != NULL)
+        segment->encoder_level = strdup(job->encoder_level);
+
+    segment->chunk_count  = 0;
+    segment->list_chunk   = NULL;
+    segment->pts_to_start = start;
+    segment->pts_to_stop  = duration;
+
+    return segment;
+}
+
+/***********************************************************************
+ * hb_encchunk_segment_close
+ ***********************************************************************
+ * Closes a segment job along with its copy of the title.
+ **********************************************************************/
+void hb_encchunk_segment_close( hb_job_t ** _segment )
+{
+    hb_title_t * title = (*_segment)->title;
+
+    hb_job_close( _segment );
+    hb_title_close( &title );
+}
+
+/***********************************************************************
+ * hb_encchunk_setup
+ ***********************************************************************
+ * Called by do_job before it sets up the job.  If the video can be
+ * encoded in segments, copies the job for each of them into
+ * job->list_chunk.
+ **********************************************************************/
+void hb_encchunk_setup( hb_job_t * job )
+{
+    hb_title_t    * title = job->title;
+    hb_subtitle_t * subtitle;
+    hb_chapter_t  * chapter;
+    const char    * reason = NULL;
+    int64_t         duration = 0, length;
+    int             count, ii;
+
+    for( ii = job->chapter_start; ii <= job->chapter_end; ii++ )
+    {
+        chapter = hb_list_item( title->list_chapter, ii - 1 );
+        if( chapter != NULL )
+        {
+            duration += chapter->duration;
+        }
+    }
+    if( duration <= 0 )
+    {
+        duration = title->duration;
+    }
+    count = MIN( job->chunk_count, duration / HB_CHUNK_MIN_DURATION );
+
+    if( job->vcodec != HB_VCODEC_X264 && job->vcodec != HB_VCODEC_X265 )
+    {
+        reason = "the video encoder doesn't support it";
+    }
+    else if( job->pass != 0 || job->indepth_scan )
+    {
+        reason = "multi-pass encodes aren't supported";
+    }
+    else if( title->type != HB_FF_STREAM_TYPE )
+    {
+        reason = "the source can't seek by time";
+    }
+    else if( job->chapter_start != 1 || job->pts_to_start ||
+             job->pts_to_stop || job->frame_to_start ||
+             job->frame_to_stop || job->start_at_preview )
+    {
+        reason = "the job doesn't start at the beginning of the title";
+    }
+    else if( job->use_opencl )
+    {
+        reason = "OpenCL is in use";
+    }
+#ifdef USE_QSV
+    else if( hb_qsv_decode_is_enabled( job ) )
+    {
+        reason = "QSV decoding is in use";
+    }
+#endif
+    else if( job->interjob->select_subtitle != NULL )
+    {
+        reason = "a subtitle scan was done";
+    }
+    else if( count < 2 )
+    {
+        reason = "the title is too short";
+    }
+    for( ii = 0; reason == NULL &&
+                 ii < hb_list_count( job->list_subtitle ); ii++ )
+    {
+        subtitle = hb_list_item( job->list_subtitle, ii );
+        if( subtitle->config.dest == RENDERSUB )
+        {
+            reason = "subtitles are burned in";
+        }
+    }
+    if( reason != NULL )
+    {
+        hb_log( "encchunk: encoding the video in one piece, %s", reason );
+        return;
+    }
+
+    // The last segment runs to the end of the job
+    length = duration / count;
+    job->list_chunk = hb_list_init();
+    for( ii = 0; ii < count; ii++ )
+    {
+        hb_list_add( job->list_chunk,
+                     segment_copy( job, ii * length,
+                                   ii < count - 1 ? length : 0 ) );
+    }
+    hb_log( "encchunk: encoding the video in %d segments of %"PRId64" s",
+            count, length / 90000 );
+}
+
+static void push( hb_work_private_t * pv, hb_buffer_t * buf )
+{
+    while( !*pv->job->die )
+    {
+        if( hb_fifo_full_wait( pv->fifo_out ) )
+        {
+            hb_fifo_push( pv->fifo_out, buf );
+            return;
+        }
+    }
+    hb_buffer_close( &buf );
+}
+
+/*
+ * Moves a frame of the segment that's next in line from its own time
+ * line to the output's.
+ */
+static void output( hb_work_private_t * pv, hb_buffer_t * buf )
+{
+    buf->s.start += pv->offset;
+    buf->s.stop  += pv->offset;
+    if( buf->s.renderOffset != AV_NOPTS_VALUE )
+    {
+        buf->s.renderOffset += pv->offset;
+
+        // The encoder of a segment starts its decode times before the
+        // segment, which can run into the last ones of the segment
+        // before it.  The muxers need them to increase.
+        if( pv->last_dts != AV_NOPTS_VALUE &&
+            buf->s.renderOffset <= pv->last_dts )
+        {
+            buf->s.renderOffset = pv->last_dts + 1;
+        }
+        pv->last_dts = buf->s.renderOffset;
+
+        if( pv->config->h264.init_delay == 0 && buf->s.renderOffset < 0 )
+        {
+            pv->config->h264.init_delay = -buf->s.renderOffset;
+        }
+    }
+
+    // A segment that starts in the middle of a chapter may mark it again
+    if( buf->s.new_chap )
+    {
+        if( buf->s.new_chap <= pv->last_chap )
+        {
+            buf->s.new_chap = 0;
+        }
+        else
+        {
+            pv->last_chap = buf->s.new_chap;
+        }
+    }
+
+    push( pv, buf );
+}
+
+static void fail( hb_work_private_t * pv, const char * what,
+                  hb_chunk_t * chunk )
+{
+    hb_error( "encchunk: %s failed (%s)", what, chunk->filename );
+    *pv->job->done_error = HB_ERROR_UNKNOWN;
+    *pv->job->die = 1;
+}
+
+static void park( hb_work_private_t * pv, hb_chunk_t * chunk,
+                  hb_buffer_t * buf )
+{
+    if( chunk->park == NULL )
+    {
+        chunk->park = hb_fopen( chunk->filename, "w+b" );
+        if( chunk->park == NULL )
+        {
+            fail( pv, "fopen", chunk );
+            hb_buffer_close( &buf );
+            return;
+        }
+    }
+    if( fwrite( &buf->size, sizeof( buf->size ), 1, chunk->park ) != 1 ||
+        fwrite( &buf->s, sizeof( buf->s ), 1, chunk->park ) != 1 ||
+        fwrite( buf->data, buf->size, 1, chunk->park ) != 1 )
+    {
+        fail( pv, "write", chunk );
+    }
+    hb_buffer_close( &buf );
+}
+
+static void park_close( hb_chunk_t * chunk )
+{
+    if( chunk->park != NULL )
+    {
+        fclose( chunk->park );
+        chunk->park = NULL;
+        unlink( chunk->filename );
+    }
+}
+
+/*
+ * Sends the output parked while an earlier segment was still going.
+ */
+static void unpark( hb_work_private_t * pv, hb_chunk_t * chunk )
+{
+    hb_buffer_t * buf;
+    int           size;
+
+    if( chunk->park == NULL )
+    {
+        return;
+    }
+    rewind( chunk->park );
+    while( !*pv->job->die &&
+           fread( &size, sizeof( size ), 1, chunk->park ) == 1 )
+    {
+        buf = hb_buffer_init( size );
+        if( fread( &buf->s, sizeof( buf->s ), 1, chunk->park ) != 1 ||
+            fread( buf->data, size, 1, chunk->park ) != 1 )
+        {
+            fail( pv, "read", chunk );
+            hb_buffer_close( &buf );
+            break;
+        }
+        output( pv, buf );
+    }
+    park_close( chunk );
+}
+
+static void update_state( hb_work_private_t * pv )
+{
+    hb_job_t   * job = pv->job;
+    hb_state_t   state;
+    uint64_t     now = hb_get_date(), elapsed;
+    int64_t      done = 0, total = 0;
+    int          frames = 0, ii;
+
+    if( now < pv->st_date + 1000 )
+    {
+        return;
+    }
+    for( ii = 0; ii < pv->count; ii++ )
+    {
+        hb_chunk_t * chunk = &pv->chunks[ii];
+
+        done   += chunk->eof ? chunk->duration :
+                               MIN( chunk->end, chunk->duration );
+        total  += chunk->duration;
+        frames += chunk->frames;
+    }
+    elapsed = now - pv->st_first - job->st_paused;
+
+#define p state.param.working
+    state.state = HB_STATE_WORKING;
+    p.progress  = (float)done / (float)total;
+    if( p.progress > 1.0 )
+    {
+        p.progress = 1.0;
+    }
+    p.rate_cur  = 1000.0 * (float)( frames - pv->st_frames ) /
+                           (float)( now - pv->st_date );
+    if( elapsed > 4000 && done > 0 )
+    {
+        int eta;
+        p.rate_avg = 1000.0 * (float)frames / (float)elapsed;
+        eta = (double)elapsed / 1000. * (double)( total - done ) /
+              (double)done;
+        p.hours   = eta / 3600;
+        p.minutes = ( eta % 3600 ) / 60;
+        p.seconds = eta % 60;
+    }
+    else
+    {
+        p.rate_avg = 0.0;
+        p.hours    = -1;
+        p.minutes  = -1;
+        p.seconds  = -1;
+    }
+#undef p
+
+    pv->st_date   = now;
+    pv->st_frames = frames;
+    hb_set_job_state( job, &state );
+}
+
+/*
+ * Collects the output of all the segments.  The segment that's next in
+ * line goes straight to the muxer, the others are parked.
+ */
+static void encchunk_thread( void * _pv )
+{
+    hb_work_private_t * pv = _pv;
+    hb_chunk_t        * chunk;
+    hb_buffer_t       * buf;
+    int                 head = 0, moved, ii;
+
+    pv->st_first = pv->st_date = hb_get_date();
+
+    while( head < pv->count && !*pv->job->die )
+    {
+        moved = 0;
+        for( ii = head; ii < pv->count; ii++ )
+        {
+            chunk = &pv->chunks[ii];
+            while( !chunk->eof && ( buf = hb_fifo_get( chunk->fifo ) ) )
+            {
+                moved = 1;
+                if( buf->size <= 0 )
+                {
+                    chunk->eof = 1;
+                    hb_buffer_close( &buf );
+                    break;
+                }
+                chunk->frames++;
+                if( buf->s.stop > chunk->end )
+                {
+                    chunk->end = buf->s.stop;
+                }
+                if( ii == head )
+                {
+                    output( pv, buf );
+                }
+                else
+                {
+                    park( pv, chunk, buf );
+                }
+            }
+        }
+
+        chunk = &pv->chunks[head];
+        if( chunk->eof )
+        {
+            // The next segment starts where this one ended
+            pv->offset += chunk->end;
+            if( ++head < pv->count )
+            {
+                unpark( pv, &pv->chunks[head] );
+            }
+            continue;
+        }
+        update_state( pv );
+        if( !moved )
+        {
+            hb_snooze( 10 );
+        }
+    }
+
+    if( !*pv->job->die )
+    {
+        push( pv, hb_buffer_init( 0 ) );
+    }
+}
+
+int encchunkInit( hb_work_object_t * w, hb_job_t * job )
+{
+    hb_work_private_t * pv = calloc( 1, sizeof( hb_work_private_t ) );
+    hb_work_object_t  * probe;
+    hb_job_t          * segment;
+    int                 threads, ii;
+
+    w->private_data = pv;
+
+    pv->job       = job;
+    pv->fifo_out  = w->fifo_out;
+    pv->config    = w->config;
+    pv->last_dts  = AV_NOPTS_VALUE;
+    pv->last_chap = job->chapter_start;
+    pv->count     = hb_list_count( job->list_chunk );
+    pv->chunks    = calloc( pv->count, sizeof( hb_chunk_t ) );
+
+    // Each segment gets an even share of the job's threads
+    threads = job->thread_count > 0 ? job->thread_count : hb_get_cpu_count();
+    threads = MAX( 1, threads / pv->count );
+
+    // Open the real encoder once with our job to set up what the muxer
+    // needs from it (stream headers, b-frames).  The segments make the
+    // same choices from the same settings.
+    probe = hb_get_work( job->vcodec == HB_VCODEC_X265 ? WORK_ENCX265 :
+                                                          WORK_ENCX264 );
+    if( probe == NULL )
+    {
+        free( pv->chunks );
+        free( pv );
+        w->private_data = NULL;
+        return 1;
+    }
+    probe->config = w->config;
+    ii = job->thread_count;
+    job->thread_count = threads;
+    if( probe->init( probe, job ) )
+    {
+        job->thread_count = ii;
+        free( probe );
+        free( pv->chunks );
+        free( pv );
+        w->private_data = NULL;
+        return 1;
+    }
+    job->thread_count = ii;
+    probe->close( probe );
+    free( probe );
+
+    for( ii = 0; ii < pv->count; ii++ )
+    {
+        hb_chunk_t * chunk = &pv->chunks[ii];
+
+        segment = hb_list_item( job->list_chunk, 0 );
+        hb_list_rem( job->list_chunk, segment );
+
+        // The last segment has no planned length, it's about as long as
+        // the others
+        chunk->duration = segment->pts_to_stop ? segment->pts_to_stop :
+                                                 pv->chunks[0].duration;
+        chunk->fifo     = hb_fifo_init_spsc( 32, 16 );
+        chunk->interjob = calloc( 1, sizeof( hb_interjob_t ) );
+        hb_get_tempory_filename( job->h, chunk->filename, "chunk%d_%d",
+                                 job->sequence_id & 0xFFFFFF, ii );
+
+        hb_log( "encchunk: segment %d starts at %"PRId64" s with %d threads",
+                ii + 1, segment->pts_to_start / 90000, threads );
+
+        segment->fifo_chunk   = chunk->fifo;
+        segment->interjob     = chunk->interjob;
+        segment->thread_count = threads;
+        chunk->thread = hb_work_segment_init( segment );
+    }
+
+    pv->thread = hb_thread_init( "encchunk", encchunk_thread, pv,
+                                 HB_LOW_PRIORITY );
+    return 0;
+}
+
+/***********************************************************************
+ * encchunkWork
+ ***********************************************************************
+ * The frames from our own job only kept sync going, the segments encode
+ * their own.  At the end of our input, waits for the segments and their
+ * output to be done.  The output thread sends the end of stream on.
+ **********************************************************************/
+int encchunkWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
+                  hb_buffer_t ** buf_out )
+{
+    hb_work_private_t * pv = w->private_data;
+
+    *buf_out = NULL;
+    if( (*buf_in)->size > 0 )
+    {
+        return HB_WORK_OK;
+    }
+    hb_thread_close( &pv->thread );
+    return HB_WORK_DONE;
+}
+
+void encchunkClose( hb_work_object_t * w )
+{
+    hb_work_private_t * pv = w->private_data;
+    int                 ii;
+
+    if( pv->thread != NULL )
+    {
+        hb_thread_close( &pv->thread );
+    }
+    for( ii = 0; ii < pv->count; ii++ )
+    {
+        hb_chunk_t * chunk = &pv->chunks[ii];
+
+        if( chunk->thread != NULL )
+        {
+            hb_thread_close( &chunk->thread );
+        }
+        hb_fifo_close( &chunk->fifo );
+        park_close( chunk );
+        free( chunk->interjob );
+    }
+    free( pv->chunks );
+    free( pv );
+    w->private_data = NULL;
+}
+
+/***********************************************************************
+ * Chunk timing
+ ***********************************************************************
+ * Runs in place of the video decoder of the parent job.  Sync only needs
+ * the time stamps of the video to keep the audio and subtitles in step,
+ * so the demuxed frames are put in display order and passed on as empty
+ * stand-ins without being decoded.
+ *
+ * Like the decoder, frames before the first key frame are dropped, and
+ * so are the leading frames that are shown before it, so that the video
+ * starts at the same time as the first segment's.
+ **********************************************************************/
+int chunktimingInit( hb_work_object_t * w, hb_job_t * job )
+{
+    hb_work_private_t * pv = calloc( 1, sizeof( hb_work_private_t ) );
+
+    w->private_data = pv;
+
+    pv->job            = job;
+    pv->key_start      = AV_NOPTS_VALUE;
+    pv->frame_duration = 90000LL * job->title->rate_base / job->title->rate;
+    return 0;
+}
+
+static hb_buffer_t * timing_pop( hb_work_private_t * pv )
+{
+    hb_buffer_t * out = pv->held;
+
+    pv->held  = out->next;
+    out->next = NULL;
+    pv->held_count--;
+    return out;
+}
+
+int chunktimingWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
+                     hb_buffer_t ** buf_out )
+{
+    hb_work_private_t * pv = w->private_data;
+    hb_buffer_t       * in = *buf_in, * out, ** pp, * tail = NULL;
+
+    *buf_out = NULL;
+    if( in->size <= 0 )
+    {
+        // Send the frames held back, then the end of stream
+        while( pv->held_count > 0 )
+        {
+            out = timing_pop( pv );
+            if( tail == NULL )
+                *buf_out = out;
+            else
+                tail->next = out;
+            tail = out;
+        }
+        *buf_in = NULL;
+        if( tail == NULL )
+            *buf_out = in;
+        else
+            tail->next = in;
+        return HB_WORK_DONE;
+    }
+
+    if( pv->key_start == AV_NOPTS_VALUE && in->s.start != AV_NOPTS_VALUE &&
+        ( in->s.frametype & HB_FRAME_KEY ) )
+    {
+        pv->key_start = in->s.start;
+    }
+    if( pv->key_start == AV_NOPTS_VALUE || in->s.start == AV_NOPTS_VALUE ||
+        in->s.start < pv->key_start )
+    {
+        if( in->s.new_chap )
+        {
+            pv->chap = in->s.new_chap;
+        }
+        return HB_WORK_OK;
+    }
+
+    out = hb_buffer_init( 1 );
+    out->s           = in->s;
+    out->s.type      = FRAME_BUF;
+    out->s.stop      = in->s.start + pv->frame_duration;
+    out->sequence    = in->sequence;
+    if( pv->chap )
+    {
+        out->s.new_chap = pv->chap;
+        pv->chap = 0;
+    }
+
+    for( pp = &pv->held; *pp != NULL && (*pp)->s.start <= out->s.start;
+         pp = &(*pp)->next )
+        ;
+    out->next = *pp;
+    *pp = out;
+    if( ++pv->held_count > HB_CHUNK_REORDER )
+    {
+        *buf_out = timing_pop( pv );
+    }
+    return HB_WORK_OK;
+}
+
+void chunktimingClose( hb_work_object_t * w )
+{
+    hb_work_private_t * pv = w->private_data;
+
+    if( pv == NULL )
+    {
+        return;
+    }
+    hb_buffer_close( &pv->held );
+    free( pv );
+    w->private_data = NULL;
+}
@@ -48,7 +48,8 @@ int enctheoraInit( hb_work_object_t * w, hb_job_t * job )
     {
         char filename[1024];
         memset( filename, 0, 1024 );
-        hb_get_tempory_filename( job->h, filename, "theroa.log" );
+        hb_get_tempory_filename( job->h, filename, "theroa%d.log",
+                                 job->sequence_id & 0xFFFFFF );
         if ( job->pass == 1 )
         {
             pv->file = hb_fopen(filename, "wb");
@@ -73,7 +74,7 @@ int enctheoraInit( hb_work_object_t * w, hb_job_t * job )
 
     if( job->pass == 2 )
     {
-        hb_interjob_t * interjob = hb_interjob_get( job->h );
+        hb_interjob_t * interjob = job->interjob;
         ti.fps_numerator = interjob->vrate;
         ti.fps_denominator = interjob->vrate_base;
     }
@@ -125,7 +125,7 @@ int encx264Init( hb_work_object_t * w, hb_job_t * job )
      * using the encoder_options string. */
     if( job->pass == 2 && job->cfr != 1 )
     {
-        hb_interjob_t * interjob = hb_interjob_get( job->h );
+        hb_interjob_t * interjob = job->interjob;
         param.i_fps_num = interjob->vrate;
         param.i_fps_den = interjob->vrate_base;
     }
@@ -192,6 +192,13 @@ int encx264Init( hb_work_object_t * w, hb_job_t * job )
         param.vui.i_colmatrix = job->title->color_matrix;
     }
 
+    /* Jobs running concurrently share a thread budget, the encoder
+     * options can still override our share */
+    if (job->thread_count > 0)
+    {
+        param.i_threads = job->thread_count;
+    }
+
     /* place job->encoder_options in an hb_dict_t for convenience */
     hb_dict_t * x264_opts = NULL;
     if (job->encoder_options != NULL && *job->encoder_options)
@@ -274,7 +281,8 @@ int encx264Init( hb_work_object_t * w, hb_job_t * job )
         if( job->pass > 0 && job->pass < 3 )
         {
             memset( pv->filename, 0, 1024 );
-            hb_get_tempory_filename( job->h, pv->filename, "x264.log" );
+            hb_get_tempory_filename( job->h, pv->filename, "x264%d.log",
+                                     job->sequence_id & 0xFFFFFF );
         }
         switch( job->pass )
         {
@@ -236,7 +236,8 @@ int encx265Init(hb_work_object_t *w, hb_job_t *job)
     {
         if (param->csvfn == NULL)
         {
-            hb_get_tempory_filename(job->h, pv->csvfn, "x265.csv");
+            hb_get_tempory_filename(job->h, pv->csvfn, "x265%d.csv",
+                                    job->sequence_id & 0xFFFFFF);
             param->csvfn = pv->csvfn;
         }
         else
@@ -16,6 +16,7 @@
 
 #define FIFO_TIMEOUT 200
 //#define HB_FIFO_DEBUG 1
+//#define HB_BUFFER_DEBUG 1
 
 /* Fifo */
 struct hb_fifo_s
@@ -32,6 +33,23 @@ struct hb_fifo_s
     hb_buffer_t  * first;
     hb_buffer_t  * last;
 
+    // Single producer / single consumer ring (see hb_fifo_init_spsc).
+    // When 'ring' is set, buffers normally travel through the ring
+    // without taking 'lock'. 'first', 'last' and 'size' then describe
+    // an overflow list for buffers that did not fit in the ring. 'lock'
+    // and the condition variables are only used for the overflow list
+    // and to park a thread when the fifo is truly empty or full.
+    hb_buffer_t ** ring;
+    uint32_t       ring_mask;
+    uint8_t        pad_head[64];
+    uint32_t       head;    // only written by the consumer
+    uint8_t        pad_tail[64];
+    uint32_t       tail;    // only written by the producer
+
+    // Group whose waiter is woken when a buffer is pushed, see
+    // hb_fifo_group_wait()
+    hb_fifo_group_t * group;
+
 #if defined(HB_FIFO_DEBUG)
     // Fifo list for debugging
     hb_fifo_t    * next;
@@ -45,6 +63,15 @@ static hb_fifo_t fifo_list =
 };
 #endif
 
+/* Fifo group */
+struct hb_fifo_group_s
+{
+    hb_lock_t    * lock;
+    hb_cond_t    * cond;
+    int            waiting;
+    hb_list_t    * list_fifo;
+};
+
 /* we round the requested buffer size up to the next power of 2 so there can
  * be at most 32 possible pools when the size is a 32 bit int. To avoid a lot
  * of slow & error-prone run-time checking we allow for all 32. */
@@ -59,18 +86,51 @@ static hb_fifo_t fifo_list =
  * too much memory. */
 #define BUFFER_POOL_MAX_ELEMENTS 32
 
+/* Every thread keeps a small magazine of recently freed buffers per pool in
+ * front of the shared pools, so that most allocations and frees don't touch
+ * a lock that other threads contend on (each magazine has a lock of its
+ * own, only ever contended by hb_buffer_pool_free). Magazines are refilled from and
+ * drained to the shared pool in batches. Their depth is limited to
+ * BUFFER_CACHE_BYTES per pool so big video frames don't get stranded in
+ * every thread; pools above that limit aren't cached at all. */
+#define BUFFER_CACHE_DEPTH 16
+#define BUFFER_CACHE_BYTES (4 * 1024 * 1024)
+
+typedef struct
+{
+    int           count;
+    hb_buffer_t * buf[BUFFER_CACHE_DEPTH];
+} hb_buffer_magazine_t;
+
+typedef struct hb_buffer_cache_s hb_buffer_cache_t;
+
+struct hb_buffer_cache_s
+{
+    // Only contended when hb_buffer_pool_free() empties the magazine
+    hb_lock_t            * lock;
+    hb_buffer_magazine_t   mag[BUFFER_POOL_LAST + 1];
+    hb_buffer_cache_t    * next;
+};
+
 struct hb_buffer_pools_s
 {
     int64_t allocated;
     hb_lock_t *lock;
     hb_fifo_t *pool[MAX_BUFFER_POOLS];
+    hb_tls_t  *cache;
+    hb_buffer_cache_t *caches;  // of all threads, under 'lock'
 } buffers;
 
+static void buffer_cache_close( void * _cache );
+static void buffer_cache_flush( hb_buffer_cache_t * cache );
 
 void hb_buffer_pool_init( void )
 {
     buffers.lock = hb_lock_init();
-    buffers.allocated = 0;
+    if( buffers.cache == NULL )
+    {
+        buffers.cache = hb_tls_init( buffer_cache_close );
+    }
 
     /* we allocate pools for sizes 2^10 through 2^25. requests larger than
      * 2^25 will get passed through to malloc. */
@@ -243,6 +303,16 @@ void hb_buffer_pool_free( void )
 
     hb_lock(buffers.lock);
 
+    // Return the buffers cached by every thread so that they get freed
+    // too.  The threads keep their (now empty) magazines.
+    hb_buffer_cache_t *cache;
+    for( cache = buffers.caches; cache != NULL; cache = cache->next )
+    {
+        hb_lock( cache->lock );
+        buffer_cache_flush( cache );
+        hb_unlock( cache->lock );
+    }
+
     for( i = BUFFER_POOL_FIRST; i <= BUFFER_POOL_LAST; ++i)
     {
         count = 0;
@@ -276,23 +346,262 @@ void hb_buffer_pool_free( void )
         }
     }
 
+    // Buffers still in use are subtracted when they're freed
+    int64_t allocated = hb_atomic_sub( &buffers.allocated, freed ) + freed;
     hb_deep_log( 2, "Allocated %"PRId64" bytes of buffers on this pass and Freed %"PRId64" bytes, "
-           "%"PRId64" bytes leaked", buffers.allocated, freed, buffers.allocated - freed);
-    buffers.allocated = 0;
+           "%"PRId64" bytes leaked", allocated, freed, allocated - freed);
     hb_unlock(buffers.lock);
 }
 
-static hb_fifo_t *size_to_pool( int size )
+static int size_to_pool_index( int size )
 {
     int i;
     for ( i = BUFFER_POOL_FIRST; i <= BUFFER_POOL_LAST; ++i )
     {
         if ( size <= (1 << i) )
         {
-            return buffers.pool[i];
+            return i;
+        }
+    }
+    return -1;
+}
+
+static hb_fifo_t *size_to_pool( int size )
+{
+    int i = size_to_pool_index( size );
+    return i < 0 ? NULL : buffers.pool[i];
+}
+
+// Frees a buffer and its data without returning it to a pool
+static void buffer_free( hb_buffer_t * b )
+{
+    if( b->data )
+    {
+        if (b->cl.buffer != NULL)
+        {
+            /* OpenCL */
+            if (hb_cl_free_mapped_buffer(b->cl.buffer, b->data) == 0)
+            {
+                hb_log("hb_buffer_pool_free: bad free %p -> buffer %p map %p",
+                       b, b->cl.buffer, b->data);
+            }
+        }
+        else
+        {
+            free(b->data);
+        }
+        hb_atomic_sub( &buffers.allocated, b->alloc );
+    }
+    free( b );
+}
+
+// Takes up to 'count' buffers from pool 'f' with a single lock round trip.
+static int pool_get_batch( hb_fifo_t * f, hb_buffer_t ** bufs, int count )
+{
+    int ii;
+
+    hb_lock( f->lock );
+    for( ii = 0; ii < count && f->size > 0; ii++ )
+    {
+        bufs[ii] = f->first;
+        f->first = bufs[ii]->next;
+        bufs[ii]->next = NULL;
+        f->size -= 1;
+    }
+    hb_unlock( f->lock );
+
+    return ii;
+}
+
+// Returns 'count' buffers to pool 'f' with a single lock round trip.
+// Buffers that don't fit in the pool are freed.
+static void pool_put_batch( hb_fifo_t * f, hb_buffer_t ** bufs, int count )
+{
+    int ii, room;
+
+    hb_lock( f->lock );
+    room = f->capacity > f->size ? f->capacity - f->size : 0;
+    for( ii = 0; ii < count && ii < room; ii++ )
+    {
+        bufs[ii]->next = f->first;
+        f->first = bufs[ii];
+        if( f->size == 0 )
+        {
+            f->last = bufs[ii];
+        }
+        f->size += 1;
+    }
+    hb_unlock( f->lock );
+
+    for( ; ii < count; ii++ )
+    {
+        buffer_free( bufs[ii] );
+    }
+}
+
+static inline int buffer_cache_depth( int pool )
+{
+    return MIN( BUFFER_CACHE_BYTES >> pool, BUFFER_CACHE_DEPTH );
+}
+
+static hb_buffer_cache_t * buffer_cache( void )
+{
+    hb_buffer_cache_t * cache;
+
+    if( buffers.cache == NULL )
+        return NULL;
+
+    cache = hb_tls_get( buffers.cache );
+    if( cache == NULL )
+    {
+        cache = calloc( 1, sizeof( hb_buffer_cache_t ) );
+        if( cache == NULL )
+            return NULL;
+        cache->lock = hb_lock_init();
+        hb_tls_set( buffers.cache, cache );
+
+        hb_lock( buffers.lock );
+        cache->next = buffers.caches;
+        buffers.caches = cache;
+        hb_unlock( buffers.lock );
+    }
+    return cache;
+}
+
+// Hands all cached buffers back to the shared pools.
+// Call with cache->lock held.
+static void buffer_cache_flush( hb_buffer_cache_t * cache )
+{
+    int i;
+
+    for( i = BUFFER_POOL_FIRST; i <= BUFFER_POOL_LAST; ++i )
+    {
+        pool_put_batch( buffers.pool[i], cache->mag[i].buf,
+                        cache->mag[i].count );
+        cache->mag[i].count = 0;
+    }
+}
+
+// Thread exit: hand cached buffers back to the shared pools
+static void buffer_cache_close( void * _cache )
+{
+    hb_buffer_cache_t * cache = _cache, ** prev;
+
+    if( cache == NULL )
+        return;
+
+    hb_lock( buffers.lock );
+    for( prev = &buffers.caches; *prev != NULL; prev = &(*prev)->next )
+    {
+        if( *prev == cache )
+        {
+            *prev = cache->next;
+            break;
+        }
+    }
+    hb_unlock( buffers.lock );
+
+    buffer_cache_flush( cache );
+    hb_lock_close( &cache->lock );
+    free( cache );
+}
+
+static hb_buffer_t * buffer_cache_get( int pool )
+{
+    int                    depth = buffer_cache_depth( pool );
+    hb_buffer_cache_t    * cache;
+    hb_buffer_magazine_t * mag;
+    hb_buffer_t          * b;
+
+    if( depth <= 0 || ( cache = buffer_cache() ) == NULL )
+    {
+        return hb_fifo_get( buffers.pool[pool] );
+    }
+
+    hb_lock( cache->lock );
+    mag = &cache->mag[pool];
+    if( mag->count == 0 )
+    {
+        mag->count = pool_get_batch( buffers.pool[pool], mag->buf,
+                                     ( depth + 1 ) / 2 );
+    }
+    b = mag->count > 0 ? mag->buf[--mag->count] : NULL;
+    hb_unlock( cache->lock );
+
+    return b;
+}
+
+// Returns 0 if the buffer could not be cached or pooled
+static int buffer_cache_put( int pool, hb_buffer_t * b )
+{
+    int                    depth = buffer_cache_depth( pool );
+    hb_buffer_cache_t    * cache;
+    hb_buffer_magazine_t * mag;
+
+    if( depth <= 0 || ( cache = buffer_cache() ) == NULL )
+    {
+        if( hb_fifo_is_full( buffers.pool[pool] ) )
+        {
+            return 0;
         }
+        hb_fifo_push_head( buffers.pool[pool], b );
+        return 1;
     }
-    return NULL;
+
+    hb_lock( cache->lock );
+    mag = &cache->mag[pool];
+    if( mag->count >= depth )
+    {
+        // Keep the most recently freed (cache hot) half
+        int batch = ( depth + 1 ) / 2;
+        pool_put_batch( buffers.pool[pool], mag->buf, batch );
+        memmove( mag->buf, mag->buf + batch,
+                 ( mag->count - batch ) * sizeof( hb_buffer_t * ) );
+        mag->count -= batch;
+    }
+    mag->buf[mag->count++] = b;
+    hb_unlock( cache->lock );
+    return 1;
+}
+
+static const struct settings buffer_settings_init =
+{
+    .start        = AV_NOPTS_VALUE,
+    .stop         = AV_NOPTS_VALUE,
+    .renderOffset = AV_NOPTS_VALUE,
+};
+
+/*
+ * Prepares a buffer taken from a pool for reuse. Rather than zeroing the
+ * whole header, only the fields that consumers read are reset. 'data',
+ * 'alloc' and the OpenCL mapping stay with the buffer. Planes are always
+ * cleared, a buffer's type may have changed since they were set up.
+ *
+ * Define HB_BUFFER_DEBUG to fill the fields that are not reset with
+ * garbage, which quickly shows up any consumer that depends on one of
+ * them being zeroed.
+ */
+static void buffer_recycle( hb_buffer_t * b, int size )
+{
+    b->size     = size;
+    b->offset   = 0;
+    b->sequence = 0;
+    b->s        = buffer_settings_init;
+    memset( &b->f, 0, sizeof(b->f) );
+    memset( b->plane, 0, sizeof(b->plane) );
+#ifdef USE_QSV
+    b->qsv_details.qsv_atom       = NULL;
+    b->qsv_details.filter_details = NULL;
+#endif
+    b->palette  = NULL;
+    b->sub      = NULL;
+    b->next     = NULL;
+    b->shared   = NULL;
+    b->refs     = 0;
+
+#if defined(HB_BUFFER_DEBUG) && !defined(USE_QSV)
+    memset( &b->qsv_details, 0xa5, sizeof(b->qsv_details) );
+#endif
 }
 
 hb_buffer_t * hb_buffer_init_internal( int size , int needsMapped )
@@ -304,11 +613,12 @@ hb_buffer_t * hb_buffer_init_internal( int size , int needsMapped )
     // sometimes we feed data to these libraries starting from arbitrary
     // points within the buffer.
     int alloc = size + 16;
-    hb_fifo_t *buffer_pool = size_to_pool( alloc );
+    int pool = size_to_pool_index( alloc );
+    hb_fifo_t *buffer_pool = pool < 0 ? NULL : buffers.pool[pool];
 
     if( buffer_pool )
     {
-        b = hb_fifo_get( buffer_pool );
+        b = buffer_cache_get( pool );
 
         /* OpenCL */
         if (b != NULL && needsMapped && b->cl.buffer == NULL)
@@ -316,40 +626,14 @@ hb_buffer_t * hb_buffer_init_internal( int size , int needsMapped )
             // We need a mapped OpenCL buffer and that is not
             // what we got out of the pool.
             // Ditch it; it will get replaced with what we need.
-            if (b->data != NULL)
-            {
-                free(b->data);
-            }
-            free(b);
+            buffer_free( b );
             b = NULL;
         }
 
         if( b )
         {
-            /*
-             * Zero the contents of the buffer, would be nice if we
-             * didn't have to do this.
-             */
-            uint8_t *data = b->data;
-
-            /* OpenCL */
-            cl_mem buffer       = b->cl.buffer;
-            cl_event last_event = b->cl.last_event;
-            int loc             = b->cl.buffer_location;
-
-            memset( b, 0, sizeof(hb_buffer_t) );
+            buffer_recycle( b, size );
             b->alloc = buffer_pool->buffer_size;
-            b->size = size;
-            b->data = data;
-            b->s.start = AV_NOPTS_VALUE;
-            b->s.stop = AV_NOPTS_VALUE;
-            b->s.renderOffset = AV_NOPTS_VALUE;
-
-            /* OpenCL */
-            b->cl.buffer          = buffer;
-            b->cl.last_event      = last_event;
-            b->cl.buffer_location = loc;
-
             return( b );
         }
     }
@@ -403,9 +687,7 @@ hb_buffer_t * hb_buffer_init_internal( int size , int needsMapped )
             free( b );
             return NULL;
         }
-        hb_lock(buffers.lock);
-        buffers.allocated += b->alloc;
-        hb_unlock(buffers.lock);
+        hb_atomic_add( &buffers.allocated, b->alloc );
     }
     b->s.start = AV_NOPTS_VALUE;
     b->s.stop = AV_NOPTS_VALUE;
@@ -420,6 +702,9 @@ hb_buffer_t * hb_buffer_init( int size )
 
 void hb_buffer_realloc( hb_buffer_t * b, int size )
 {
+    // Callers resize a buffer in order to write to it
+    hb_buffer_make_writable( b );
+
     if ( size > b->alloc || b->data == NULL )
     {
         uint32_t orig = b->data != NULL ? b->alloc : 0;
@@ -427,9 +712,7 @@ void hb_buffer_realloc( hb_buffer_t * b, int size )
         b->data  = realloc( b->data, size );
         b->alloc = size;
 
-        hb_lock(buffers.lock);
-        buffers.allocated += size - orig;
-        hb_unlock(buffers.lock);
+        hb_atomic_add( &buffers.allocated, size - orig );
     }
 }
 
@@ -472,6 +755,140 @@ hb_buffer_t * hb_buffer_dup( const hb_buffer_t * src )
     return buf;
 }
 
+// Returns a new buffer that shares the payload of 'src' instead of
+// copying it. Both buffers are read-only until hb_buffer_make_writable
+// is called on them. The payload is released when the last buffer
+// that shares it is closed.
+hb_buffer_t * hb_buffer_ref( hb_buffer_t * src )
+{
+    hb_buffer_t * buf, * shared;
+
+    if ( src == NULL )
+        return NULL;
+
+    if ( src->data == NULL || src->size == 0 )
+        return hb_buffer_dup( src );
+
+    shared = src->shared;
+    if ( shared == NULL )
+    {
+        // First reference. Move ownership of the data to a hidden
+        // buffer so that 'src' and the new buffer are equals.
+        shared = calloc( sizeof( hb_buffer_t ), 1 );
+        if ( shared == NULL )
+        {
+            hb_log( "out of memory" );
+            return NULL;
+        }
+        shared->data  = src->data;
+        shared->size  = src->size;
+        shared->alloc = src->alloc;
+        shared->cl    = src->cl;
+        shared->refs  = 1;
+        src->shared   = shared;
+    }
+
+    buf = calloc( sizeof( hb_buffer_t ), 1 );
+    if ( buf == NULL )
+    {
+        hb_log( "out of memory" );
+        return NULL;
+    }
+    hb_atomic_add( &shared->refs, 1 );
+
+    buf->size   = src->size;
+    buf->alloc  = src->alloc;
+    buf->data   = src->data;
+    buf->cl     = src->cl;
+    buf->shared = shared;
+    buf->s      = src->s;
+    buf->f      = src->f;
+    memcpy( buf->plane, src->plane, sizeof( buf->plane ) );
+
+#ifdef USE_QSV
+    memcpy(&buf->qsv_details, &src->qsv_details, sizeof(src->qsv_details));
+#endif
+
+    return buf;
+}
+
+// Returns a new buffer that shares 'size' bytes of the payload of 'src'
+// starting at 'offset'. Used to hand out pieces of one large read
+// without copying them. Read-only like hb_buffer_ref.
+hb_buffer_t * hb_buffer_slice( hb_buffer_t * src, int offset, int size )
+{
+    hb_buffer_t * buf = hb_buffer_ref( src );
+
+    if ( buf == NULL )
+        return NULL;
+
+    buf->data  += offset;
+    buf->size   = size;
+    buf->alloc  = size;
+    memset( buf->plane, 0, sizeof( buf->plane ) );
+    return buf;
+}
+
+// Drops the reference 'b' holds on its shared payload.
+// Returns the buffer that owns the payload when this was the last
+// reference, so the caller can recycle it.
+static hb_buffer_t * buffer_unshare( hb_buffer_t * b )
+{
+    hb_buffer_t * shared = b->shared;
+
+    b->shared = NULL;
+    if ( hb_atomic_sub( &shared->refs, 1 ) > 0 )
+    {
+        return NULL;
+    }
+    shared->refs = 0;
+    return shared;
+}
+
+// Copy-on-write: gives 'b' a private copy of its payload if the payload
+// is shared with other buffers. Plane pointers are rebased to the copy.
+void hb_buffer_make_writable( hb_buffer_t * b )
+{
+    hb_buffer_t * shared = b->shared;
+    hb_buffer_t * tmp;
+    int p;
+
+    if ( shared == NULL )
+        return;
+
+    if ( hb_atomic_load( &shared->refs ) == 1 &&
+         b->data == shared->data && b->alloc == shared->alloc )
+    {
+        // Nobody else is left, take the payload back.
+        // A new reference can only be made from a buffer that holds
+        // one, so this can't race. Slices that don't span the whole
+        // allocation are copied instead.
+        b->shared = NULL;
+        free( shared );
+        return;
+    }
+
+    tmp = hb_buffer_init_internal( b->size, b->cl.buffer != NULL );
+    if ( tmp == NULL )
+        return;
+    memcpy( tmp->data, b->data, b->size );
+    for ( p = 0; p < 4; p++ )
+    {
+        if ( b->plane[p].data != NULL )
+        {
+            b->plane[p].data = tmp->data + ( b->plane[p].data - b->data );
+        }
+    }
+
+    b->data  = tmp->data;
+    b->alloc = tmp->alloc;
+    b->cl    = tmp->cl;
+    free( tmp );
+
+    tmp = buffer_unshare( b );
+    hb_buffer_close( &tmp );
+}
+
 int hb_buffer_copy(hb_buffer_t * dst, const hb_buffer_t * src)
 {
     if (src == NULL || dst == NULL)
@@ -480,6 +897,8 @@ int hb_buffer_copy(hb_buffer_t * dst, const hb_buffer_t * src)
     if ( dst->size < src->size )
         return -1;
 
+    hb_buffer_make_writable( dst );
+
     memcpy( dst->data, src->data, src->size );
     dst->s = src->s;
     dst->f = src->f;
@@ -602,6 +1021,7 @@ void hb_buffer_swap_copy( hb_buffer_t *src, hb_buffer_t *dst )
     uint8_t *data  = dst->data;
     int      size  = dst->size;
     int      alloc = dst->alloc;
+    hb_buffer_t *shared = dst->shared;
 
     /* OpenCL */
     cl_mem buffer       = dst->cl.buffer;
@@ -613,6 +1033,7 @@ void hb_buffer_swap_copy( hb_buffer_t *src, hb_buffer_t *dst )
     src->data  = data;
     src->size  = size;
     src->alloc = alloc;
+    src->shared = shared;
 
     /* OpenCL */
     src->cl.buffer          = buffer;
@@ -628,41 +1049,35 @@ void hb_buffer_close( hb_buffer_t ** _b )
     while( b )
     {
         hb_buffer_t * next = b->next;
-        hb_fifo_t *buffer_pool = size_to_pool( b->alloc );
+        int pool = size_to_pool_index( b->alloc );
 
         b->next = NULL;
 
         // Close any attached subtitle buffers
         hb_buffer_close( &b->sub );
 
-        if( buffer_pool && b->data && !hb_fifo_is_full( buffer_pool ) )
+        if( b->shared != NULL )
+        {
+            // Only the last buffer sharing a payload recycles it
+            hb_buffer_t * shared = buffer_unshare( b );
+            free( b );
+            if( shared == NULL )
+            {
+                b = next;
+                continue;
+            }
+            b = shared;
+            pool = size_to_pool_index( b->alloc );
+        }
+
+        if( pool >= 0 && b->data && buffer_cache_put( pool, b ) )
         {
-            hb_fifo_push_head( buffer_pool, b );
             b = next;
             continue;
         }
         // either the pool is full or this size doesn't use a pool
         // free the buf 
-        if( b->data )
-        {
-            if (b->cl.buffer != NULL)
-            {
-                /* OpenCL */
-                if (hb_cl_free_mapped_buffer(b->cl.buffer, b->data) == 0)
-                {
-                    hb_log("hb_buffer_pool_free: bad free %p -> buffer %p map %p",
-                           b, b->cl.buffer, b->data);
-                }
-            }
-            else
-            {
-                free(b->data);
-            }
-            hb_lock(buffers.lock);
-            buffers.allocated -= b->alloc;
-            hb_unlock(buffers.lock);
-        }
-        free( b );
+        buffer_free( b );
         b = next;
     }
 
@@ -733,6 +1148,218 @@ void hb_image_close(hb_image_t **_image)
     }
 }
 
+/*
+ * Single producer / single consumer fifo.
+ *
+ * Almost every fifo between two pipeline stages has exactly one thread
+ * pushing into it and one thread pulling from it. For those we keep the
+ * buffers in a power of 2 ring of pointers where the producer only
+ * advances 'tail' and the consumer only advances 'head', so a handoff
+ * needs no lock at all.
+ *
+ * hb_fifo_push() must never block or fail, so buffers that don't fit in
+ * the ring (capacity overshoot after a timed out hb_fifo_full_wait, or a
+ * long list of buffers pushed at once) go to the locked overflow list.
+ * Everything in the overflow list is newer than everything in the ring:
+ * the producer keeps appending to the overflow list until the consumer
+ * has drained it, and the consumer drains the ring before it looks at
+ * the overflow list.
+ *
+ * Threads only park on the condition variables when the fifo is truly
+ * empty (consumer) or full (producer). The waiter raises its wait flag
+ * and re-checks the fifo with the lock held, and the other side checks
+ * the flag after a full barrier, so a wakeup can't be lost.
+ */
+static inline uint32_t spsc_ring_count( hb_fifo_t * f )
+{
+    return hb_atomic_load( &f->tail ) - hb_atomic_load( &f->head );
+}
+
+static inline uint32_t spsc_size( hb_fifo_t * f )
+{
+    return spsc_ring_count( f ) + hb_atomic_load( &f->size );
+}
+
+static void spsc_wake_producer( hb_fifo_t * f )
+{
+    hb_memory_barrier();
+    if( hb_atomic_load( &f->wait_full ) &&
+        spsc_size( f ) <= f->capacity - f->thresh )
+    {
+        hb_lock( f->lock );
+        if( f->wait_full )
+        {
+            hb_atomic_store( &f->wait_full, 0 );
+            hb_cond_signal( f->cond_full );
+        }
+        hb_unlock( f->lock );
+    }
+}
+
+static void fifo_group_wake( hb_fifo_t * f );
+
+static void spsc_wake_consumer( hb_fifo_t * f )
+{
+    fifo_group_wake( f );
+    hb_memory_barrier();
+    if( hb_atomic_load( &f->wait_empty ) )
+    {
+        hb_lock( f->lock );
+        if( f->wait_empty )
+        {
+            hb_atomic_store( &f->wait_empty, 0 );
+            hb_cond_signal( f->cond_empty );
+        }
+        hb_unlock( f->lock );
+    }
+}
+
+// Blocks the consumer for up to FIFO_TIMEOUT while the fifo is empty.
+// Returns the number of buffers available.
+static uint32_t spsc_wait_empty( hb_fifo_t * f )
+{
+    uint32_t size;
+
+    hb_lock( f->lock );
+    hb_atomic_store( &f->wait_empty, 1 );
+    hb_memory_barrier();
+    if( spsc_size( f ) < 1 )
+    {
+        hb_cond_timedwait( f->cond_empty, f->lock, FIFO_TIMEOUT );
+    }
+    hb_atomic_store( &f->wait_empty, 0 );
+    size = spsc_size( f );
+    hb_unlock( f->lock );
+
+    return size;
+}
+
+// Returns the n'th (0 or 1) buffer in the fifo without removing it.
+// Consumer side only.
+static hb_buffer_t * spsc_see( hb_fifo_t * f, int n )
+{
+    hb_buffer_t * b = NULL;
+    uint32_t      head = f->head;
+    uint32_t      count = hb_atomic_load( &f->tail ) - head;
+
+    if( count > n )
+    {
+        return f->ring[( head + n ) & f->ring_mask];
+    }
+    if( hb_atomic_load( &f->size ) > 0 )
+    {
+        hb_lock( f->lock );
+        // The producer may have filled the ring before it
+        // started using the overflow list, look again.
+        count = hb_atomic_load( &f->tail ) - head;
+        if( count > n )
+        {
+            b = f->ring[( head + n ) & f->ring_mask];
+        }
+        else
+        {
+            b = f->first;
+            for( n -= count; b != NULL && n > 0; n-- )
+            {
+                b = b->next;
+            }
+        }
+        hb_unlock( f->lock );
+    }
+    return b;
+}
+
+static hb_buffer_t * spsc_get( hb_fifo_t * f )
+{
+    hb_buffer_t * b = NULL;
+    uint32_t      head = f->head;
+
+    if( head == hb_atomic_load( &f->tail ) && hb_atomic_load( &f->size ) > 0 )
+    {
+        hb_lock( f->lock );
+        if( head == hb_atomic_load( &f->tail ) )
+        {
+            b        = f->first;
+            f->first = b->next;
+            b->next  = NULL;
+            if( f->first == NULL )
+            {
+                f->last = NULL;
+            }
+            hb_atomic_store( &f->size, f->size - 1 );
+        }
+        hb_unlock( f->lock );
+    }
+    if( b == NULL && head != hb_atomic_load( &f->tail ) )
+    {
+        b = f->ring[head & f->ring_mask];
+        hb_atomic_store( &f->head, head + 1 );
+    }
+    if( b != NULL )
+    {
+        spsc_wake_producer( f );
+    }
+    return b;
+}
+
+static void spsc_push( hb_fifo_t * f, hb_buffer_t * b )
+{
+    hb_buffer_t * next;
+    uint32_t      tail = f->tail;
+
+    for( ; b != NULL; b = next )
+    {
+        next    = b->next;
+        b->next = NULL;
+
+        if( hb_atomic_load( &f->size ) == 0 &&
+            tail - hb_atomic_load( &f->head ) <= f->ring_mask )
+        {
+            f->ring[tail & f->ring_mask] = b;
+            hb_atomic_store( &f->tail, ++tail );
+            continue;
+        }
+
+        // Ring is full, or the overflow list is in use and must be
+        // drained before the ring can be used again.
+        hb_lock( f->lock );
+        if( f->size > 0 )
+        {
+            f->last->next = b;
+        }
+        else
+        {
+            f->first = b;
+        }
+        f->last = b;
+        hb_atomic_store( &f->size, f->size + 1 );
+        hb_unlock( f->lock );
+    }
+    spsc_wake_consumer( f );
+}
+
+static int spsc_full_wait( hb_fifo_t * f )
+{
+    int result;
+
+    if( spsc_size( f ) < f->capacity )
+    {
+        return 1;
+    }
+    hb_lock( f->lock );
+    hb_atomic_store( &f->wait_full, 1 );
+    hb_memory_barrier();
+    if( spsc_size( f ) >= f->capacity )
+    {
+        hb_cond_timedwait( f->cond_full, f->lock, FIFO_TIMEOUT );
+    }
+    hb_atomic_store( &f->wait_full, 0 );
+    result = ( spsc_size( f ) < f->capacity );
+    hb_unlock( f->lock );
+
+    return result;
+}
+
 hb_fifo_t * hb_fifo_init( int capacity, int thresh )
 {
     hb_fifo_t * f;
@@ -751,11 +1378,41 @@ hb_fifo_t * hb_fifo_init( int capacity, int thresh )
     return f;
 }
 
+// Creates a fifo that may only ever have one thread pushing to it and one
+// thread pulling from it at a time. Buffers are handed over through a
+// lock-free ring, see the comment above spsc_ring_count().
+hb_fifo_t * hb_fifo_init_spsc( int capacity, int thresh )
+{
+    hb_fifo_t * f = hb_fifo_init( capacity, thresh );
+    uint32_t    ring_size = 2;
+
+    // Leave room for lists of buffers pushed in one go so that the
+    // overflow list is only needed in exceptional cases.
+    while( ring_size < 2 * capacity )
+    {
+        ring_size <<= 1;
+    }
+    f->ring      = calloc( ring_size, sizeof( hb_buffer_t * ) );
+    f->ring_mask = ring_size - 1;
+
+    return f;
+}
+
 int hb_fifo_size_bytes( hb_fifo_t * f )
 {
     int ret = 0;
     hb_buffer_t * link;
 
+    if( f->ring != NULL )
+    {
+        // Consumer side only, the producer never touches queued buffers
+        uint32_t ii, head = f->head, tail = hb_atomic_load( &f->tail );
+        for( ii = head; ii != tail; ii++ )
+        {
+            ret += f->ring[ii & f->ring_mask]->size;
+        }
+    }
+
     hb_lock( f->lock );
     link = f->first;
     while ( link )
@@ -772,6 +1429,11 @@ int hb_fifo_size( hb_fifo_t * f )
 {
     int ret;
 
+    if( f->ring != NULL )
+    {
+        return spsc_size( f );
+    }
+
     hb_lock( f->lock );
     ret = f->size;
     hb_unlock( f->lock );
@@ -783,6 +1445,11 @@ int hb_fifo_is_full( hb_fifo_t * f )
 {
     int ret;
 
+    if( f->ring != NULL )
+    {
+        return spsc_size( f ) >= f->capacity;
+    }
+
     hb_lock( f->lock );
     ret = ( f->size >= f->capacity );
     hb_unlock( f->lock );
@@ -794,6 +1461,11 @@ float hb_fifo_percent_full( hb_fifo_t * f )
 {
     float ret;
 
+    if( f->ring != NULL )
+    {
+        return spsc_size( f ) / f->capacity;
+    }
+
     hb_lock( f->lock );
     ret = f->size / f->capacity;
     hb_unlock( f->lock );
@@ -807,6 +1479,16 @@ hb_buffer_t * hb_fifo_get_wait( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if( f->ring != NULL )
+    {
+        b = spsc_get( f );
+        if( b == NULL && spsc_wait_empty( f ) > 0 )
+        {
+            b = spsc_get( f );
+        }
+        return b;
+    }
+
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -837,6 +1519,11 @@ hb_buffer_t * hb_fifo_get( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if( f->ring != NULL )
+    {
+        return spsc_get( f );
+    }
+
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -861,6 +1548,16 @@ hb_buffer_t * hb_fifo_see_wait( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if( f->ring != NULL )
+    {
+        b = spsc_see( f, 0 );
+        if( b == NULL && spsc_wait_empty( f ) > 0 )
+        {
+            b = spsc_see( f, 0 );
+        }
+        return b;
+    }
+
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -884,6 +1581,11 @@ hb_buffer_t * hb_fifo_see( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if( f->ring != NULL )
+    {
+        return spsc_see( f, 0 );
+    }
+
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -900,6 +1602,11 @@ hb_buffer_t * hb_fifo_see2( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if( f->ring != NULL )
+    {
+        return spsc_see( f, 1 );
+    }
+
     hb_lock( f->lock );
     if( f->size < 2 )
     {
@@ -918,6 +1625,11 @@ int hb_fifo_full_wait( hb_fifo_t * f )
 {
     int result;
 
+    if( f->ring != NULL )
+    {
+        return spsc_full_wait( f );
+    }
+
     hb_lock( f->lock );
     if( f->size >= f->capacity )
     {
@@ -938,6 +1650,13 @@ void hb_fifo_push_wait( hb_fifo_t * f, hb_buffer_t * b )
         return;
     }
 
+    if( f->ring != NULL )
+    {
+        spsc_full_wait( f );
+        spsc_push( f, b );
+        return;
+    }
+
     hb_lock( f->lock );
     if( f->size >= f->capacity )
     {
@@ -965,6 +1684,7 @@ void hb_fifo_push_wait( hb_fifo_t * f, hb_buffer_t * b )
         hb_cond_signal( f->cond_empty );
     }
     hb_unlock( f->lock );
+    fifo_group_wake( f );
 }
 
 // Appends the specified packet list to the end of the specified FIFO.
@@ -975,6 +1695,12 @@ void hb_fifo_push( hb_fifo_t * f, hb_buffer_t * b )
         return;
     }
 
+    if( f->ring != NULL )
+    {
+        spsc_push( f, b );
+        return;
+    }
+
     hb_lock( f->lock );
     if( f->size > 0 )
     {
@@ -997,6 +1723,7 @@ void hb_fifo_push( hb_fifo_t * f, hb_buffer_t * b )
         hb_cond_signal( f->cond_empty );
     }
     hb_unlock( f->lock );
+    fifo_group_wake( f );
 }
 
 // Prepends the specified packet list to the start of the specified FIFO.
@@ -1010,6 +1737,18 @@ void hb_fifo_push_head( hb_fifo_t * f, hb_buffer_t * b )
         return;
     }
 
+    if( f->ring != NULL )
+    {
+        // Only the producer may add buffers to an SPSC fifo and it
+        // can't safely move 'head', so there is no front to push to.
+        // Queuing them at the tail would reorder the stream, so refuse.
+        // Only the (locked) buffer pool fifos are pushed to the front.
+        hb_error( "hb_fifo_push_head: not supported on SPSC fifo, "
+                  "dropping buffers" );
+        hb_buffer_close( &b );
+        return;
+    }
+
     hb_lock( f->lock );
 
     /*
@@ -1083,6 +1822,7 @@ void hb_fifo_close( hb_fifo_t ** _f )
     fifo_list_rem( f );
 #endif
 
+    free( f->ring );
     free( f );
 
     *_f = NULL;
@@ -1100,6 +1840,111 @@ void hb_fifo_flush( hb_fifo_t * f )
     hb_cond_signal( f->cond_empty );
     hb_cond_signal( f->cond_full );
     hb_unlock( f->lock );
+    fifo_group_wake( f );
+
+}
+
+/*
+ * A fifo group lets one consumer wait on several fifos at once, e.g. the
+ * muxer on the fifos of all its tracks.  A fifo belongs to at most one
+ * group.  Pushing to any of them wakes the group's waiter, using the same
+ * wait flag handshake as the SPSC fifos so that no lock is taken while
+ * nobody waits.
+ */
+hb_fifo_group_t * hb_fifo_group_init( void )
+{
+    hb_fifo_group_t * g = calloc( sizeof( hb_fifo_group_t ), 1 );
+
+    g->lock      = hb_lock_init();
+    g->cond      = hb_cond_init();
+    g->list_fifo = hb_list_init();
+
+    return g;
+}
+
+void hb_fifo_group_add( hb_fifo_group_t * g, hb_fifo_t * f )
+{
+    hb_lock( g->lock );
+    hb_list_add( g->list_fifo, f );
+    f->group = g;
+    hb_unlock( g->lock );
+}
+
+static int fifo_group_ready( hb_fifo_group_t * g )
+{
+    hb_fifo_t * f;
+    int         ii;
+
+    for( ii = 0; ii < hb_list_count( g->list_fifo ); ii++ )
+    {
+        f = hb_list_item( g->list_fifo, ii );
+        if( ( f->ring != NULL ? spsc_size( f ) :
+                                hb_atomic_load( &f->size ) ) > 0 )
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void fifo_group_wake( hb_fifo_t * f )
+{
+    hb_fifo_group_t * g = f->group;
 
+    if( g == NULL )
+    {
+        return;
+    }
+    hb_memory_barrier();
+    if( hb_atomic_load( &g->waiting ) )
+    {
+        hb_lock( g->lock );
+        if( g->waiting )
+        {
+            hb_atomic_store( &g->waiting, 0 );
+            hb_cond_signal( g->cond );
+        }
+        hb_unlock( g->lock );
+    }
 }
 
+// Waits until any fifo of the group has a buffer or until FIFO_TIMEOUT
+// milliseconds have elapsed.  Returns 1 if a buffer is available.
+int hb_fifo_group_wait( hb_fifo_group_t * g )
+{
+    int result;
+
+    hb_lock( g->lock );
+    hb_atomic_store( &g->waiting, 1 );
+    hb_memory_barrier();
+    if( !fifo_group_ready( g ) )
+    {
+        hb_cond_timedwait( g->cond, g->lock, FIFO_TIMEOUT );
+    }
+    hb_atomic_store( &g->waiting, 0 );
+    result = fifo_group_ready( g );
+    hb_unlock( g->lock );
+
+    return result;
+}
+
+void hb_fifo_group_close( hb_fifo_group_t ** _g )
+{
+    hb_fifo_group_t * g = *_g;
+    hb_fifo_t       * f;
+
+    if( g == NULL )
+        return;
+
+    while( ( f = hb_list_item( g->list_fifo, 0 ) ) != NULL )
+    {
+        f->group = NULL;
+        hb_list_rem( g->list_fifo, f );
+    }
+    hb_list_close( &g->list_fifo );
+    hb_lock_close( &g->lock );
+    hb_cond_close( &g->cond );
+    free( g );
+
+    *_g = NULL;
+}
@@ -9,7 +9,9 @@
  
 #include "hb.h"
 #include "opencl.h"
+#include "openclwrapper.h"
 #include "hbffmpeg.h"
+#include "threadpool.h"
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -53,16 +55,39 @@ struct hb_handle_s
     volatile int   work_die;
     hb_error_code  work_error;
     hb_thread_t  * work_thread;
+    int            max_jobs;        /* jobs run at once */
+    int            thread_budget;   /* threads shared by those jobs */
+    hb_lock_t    * run_lock;
+    hb_list_t    * jobs_running;    /* see hb_job_start() */
+    int            run_opencl;      /* a running job initialized OpenCL */
 
     hb_lock_t    * state_lock;
     hb_state_t     state;
 
     int            paused;
     hb_lock_t    * pause_lock;
+
+    /* Wakes up thread_func when the scan or work thread is done */
+    hb_lock_t    * event_lock;
+    hb_cond_t    * event_cond;
+    int            scan_done;
+    int            work_done;
+
+    /* State change notifications, see hb_set_state_callback() */
+    hb_lock_t           * notify_lock;
+    hb_state_callback_t * state_callback;
+    void                * state_opaque;
+    int                   notify_interval;
+    int                   notify_state;
+    uint64_t              notify_date;
     /* For MacGui active queue
        increments each time the scan thread completes*/
     int            scanCount;
     volatile int   scan_die;
+    char         * scan_cache;
+
+    /* Scan previews, in memory up to a budget and on disk beyond it */
+    hb_preview_store_t * previews;
     
     /* Stash of persistent data between jobs, for stuff
        like correcting frame count and framerate estimates
@@ -77,6 +102,7 @@ hb_work_object_t * hb_objects = NULL;
 int hb_instance_counter = 0;
 
 static void thread_func( void * );
+static void hb_state_notify( hb_handle_t * h );
 
 static int ff_lockmgr_cb(void **mutex, enum AVLockOp op)
 {
@@ -422,6 +448,15 @@ hb_handle_t * hb_init( int verbose, int update_check )
 
     h->pause_lock = hb_lock_init();
 
+    h->run_lock     = hb_lock_init();
+    h->jobs_running = hb_list_init();
+
+    h->event_lock  = hb_lock_init();
+    h->event_cond  = hb_cond_init();
+    h->notify_lock = hb_lock_init();
+
+    h->previews = hb_preview_store_init( h, HB_PREVIEW_STORE_DEFAULT_BUDGET );
+
     h->interjob = calloc( sizeof( hb_interjob_t ), 1 );
 
     /* Start library thread */
@@ -494,6 +529,15 @@ hb_handle_t * hb_init_dl( int verbose, int update_check )
 
     h->pause_lock = hb_lock_init();
 
+    h->run_lock     = hb_lock_init();
+    h->jobs_running = hb_list_init();
+
+    h->event_lock  = hb_lock_init();
+    h->event_cond  = hb_cond_init();
+    h->notify_lock = hb_lock_init();
+
+    h->previews = hb_preview_store_init( h, HB_PREVIEW_STORE_DEFAULT_BUDGET );
+
     /* Start library thread */
     hb_log( "hb_init: starting libhb thread" );
     h->die         = 0;
@@ -549,6 +593,8 @@ void hb_remove_previews( hb_handle_t * h )
     DIR           * dir;
     struct dirent * entry;
 
+    hb_preview_store_clear( h->previews );
+
     memset( dirname, 0, 1024 );
     hb_get_temporary_directory( dirname );
     dir = opendir( dirname );
@@ -618,9 +664,25 @@ void hb_scan( hb_handle_t * h, const char * path, int title_index,
 #endif
 
     hb_log( "hb_scan: path=%s, title_index=%d", path, title_index );
+    // Hold the event lock until scan_thread is set, thread_func
+    // can't be told the scan is done before it knows about the thread
+    hb_lock( h->event_lock );
     h->scan_thread = hb_scan_init( h, &h->scan_die, path, title_index, 
                                    &h->title_set, preview_count, 
-                                   store_previews, min_duration );
+                                   store_previews, min_duration,
+                                   h->scan_cache );
+    hb_unlock( h->event_lock );
+}
+
+/**
+ * Sets the directory scan results are cached in.
+ * @param h Handle to hb_handle_t.
+ * @param path Cache directory, NULL to disable the cache.
+ */
+void hb_scan_set_cache( hb_handle_t * h, const char * path )
+{
+    free( h->scan_cache );
+    h->scan_cache = path != NULL ? strdup( path ) : NULL;
 }
 
 /**
@@ -638,22 +700,55 @@ hb_title_set_t * hb_get_title_set( hb_handle_t * h )
     return &h->title_set;
 }
 
-int hb_save_preview( hb_handle_t * h, int title, int preview, hb_buffer_t *buf )
+/**
+ * Sets how many bytes of scan previews are kept in memory.
+ * @param h Handle to hb_handle_t.
+ * @param bytes Memory budget, 0 to keep all previews on disk.
+ */
+void hb_set_preview_budget( hb_handle_t * h, int64_t bytes )
 {
-    FILE * file;
-    char   filename[1024];
+    hb_preview_store_set_budget( h->previews, bytes );
+}
+
+uint8_t * hb_get_preview_data( hb_handle_t * h, int title, int preview,
+                               int * size )
+{
+    return hb_preview_store_get( h->previews, title, preview, size );
+}
+
+int hb_set_preview_data( hb_handle_t * h, int title, int preview,
+                         uint8_t * data, int size )
+{
+    return hb_preview_store_put( h->previews, title, preview, data, size );
+}
 
-    hb_get_tempory_filename( h, filename, "%d_%d_%d",
-                             hb_get_instance_id(h), title, preview );
+void hb_clear_preview_data( hb_handle_t * h, int title, int count )
+{
+    hb_preview_store_clear_title( h->previews, title, count );
+}
 
-    file = hb_fopen(filename, "wb");
-    if( !file )
+/*
+ * Previews are stored with the rows of each plane packed back to back,
+ * without the stride padding of the frame buffers they came from.
+ */
+int hb_save_preview( hb_handle_t * h, int title, int preview, hb_buffer_t *buf )
+{
+    uint8_t * packed, * pen;
+    int       size = 0;
+
+    int pp, hh;
+    for( pp = 0; pp < 3; pp++ )
+    {
+        size += buf->plane[pp].width * buf->plane[pp].height;
+    }
+    packed = malloc( size );
+    if( packed == NULL )
     {
-        hb_error( "hb_save_preview: fopen failed (%s)", filename );
+        hb_error( "hb_save_preview: out of memory" );
         return -1;
     }
 
-    int pp, hh;
+    pen = packed;
     for( pp = 0; pp < 3; pp++ )
     {
         uint8_t *data = buf->plane[pp].data;
@@ -663,26 +758,24 @@ int hb_save_preview( hb_handle_t * h, int title, int preview, hb_buffer_t *buf )
 
         for( hh = 0; hh < h; hh++ )
         {
-            fwrite( data, w, 1, file );
+            memcpy( pen, data, w );
+            pen += w;
             data += stride;
         }
     }
-    fclose( file );
-    return 0;
+    return hb_preview_store_put( h->previews, title, preview, packed, size );
 }
 
 hb_buffer_t * hb_read_preview(hb_handle_t * h, hb_title_t *title, int preview)
 {
-    FILE * file;
-    char   filename[1024];
-
-    hb_get_tempory_filename(h, filename, "%d_%d_%d",
-                            hb_get_instance_id(h), title->index, preview);
+    uint8_t * packed, * pen;
+    int       size = 0, expected = 0;
 
-    file = hb_fopen(filename, "rb");
-    if (!file)
+    packed = hb_preview_store_get(h->previews, title->index, preview, &size);
+    if (packed == NULL)
     {
-        hb_error( "hb_read_preview: fopen failed (%s)", filename );
+        hb_error( "hb_read_preview: no preview %d for title %d",
+                  preview, title->index );
         return NULL;
     }
 
@@ -691,6 +784,20 @@ hb_buffer_t * hb_read_preview(hb_handle_t * h, hb_title_t *title, int preview)
 
     int pp, hh;
     for (pp = 0; pp < 3; pp++)
+    {
+        expected += buf->plane[pp].width * buf->plane[pp].height;
+    }
+    if (size != expected)
+    {
+        hb_error( "hb_read_preview: preview %d of title %d has %d bytes, "
+                  "expected %d", preview, title->index, size, expected );
+        hb_buffer_close(&buf);
+        free(packed);
+        return NULL;
+    }
+
+    pen = packed;
+    for (pp = 0; pp < 3; pp++)
     {
         uint8_t *data = buf->plane[pp].data;
         int stride = buf->plane[pp].stride;
@@ -699,11 +806,12 @@ hb_buffer_t * hb_read_preview(hb_handle_t * h, hb_title_t *title, int preview)
 
         for (hh = 0; hh < h; hh++)
         {
-            fread(data, w, 1, file);
+            memcpy(data, pen, w);
+            pen += w;
             data += stride;
         }
     }
-    fclose(file);
+    free(packed);
 
     return buf;
 }
@@ -1534,12 +1642,17 @@ void hb_start( hb_handle_t * h )
     p.sequence_id = 0;
 #undef p
     hb_unlock( h->state_lock );
+    hb_state_notify( h );
 
     h->paused = 0;
 
     h->work_die    = 0;
     h->work_error  = HB_ERROR_NONE;
-    h->work_thread = hb_work_init( h->jobs, &h->work_die, &h->work_error, &h->current_job );
+    hb_lock( h->event_lock );
+    h->work_thread = hb_work_init( h, h->jobs, &h->work_die, &h->work_error,
+                                   &h->current_job, h->max_jobs,
+                                   h->thread_budget );
+    hb_unlock( h->event_lock );
 }
 
 /**
@@ -1550,14 +1663,27 @@ void hb_pause( hb_handle_t * h )
 {
     if( !h->paused )
     {
+        hb_job_t * job;
+        uint64_t   now;
+        int        ii;
+
         hb_lock( h->pause_lock );
         h->paused = 1;
 
-        hb_current_job( h )->st_pause_date = hb_get_date();
+        // Every running job stops at its next state update
+        now = hb_get_date();
+        hb_lock( h->run_lock );
+        for( ii = 0; ii < hb_list_count( h->jobs_running ); ii++ )
+        {
+            job = hb_list_item( h->jobs_running, ii );
+            job->st_pause_date = now;
+        }
+        hb_unlock( h->run_lock );
 
         hb_lock( h->state_lock );
         h->state.state = HB_STATE_PAUSED;
         hb_unlock( h->state_lock );
+        hb_state_notify( h );
     }
 }
 
@@ -1569,12 +1695,22 @@ void hb_resume( hb_handle_t * h )
 {
     if( h->paused )
     {
-#define job hb_current_job( h )
-        if( job->st_pause_date != -1 )
+        hb_job_t * job;
+        uint64_t   now;
+        int        ii;
+
+        now = hb_get_date();
+        hb_lock( h->run_lock );
+        for( ii = 0; ii < hb_list_count( h->jobs_running ); ii++ )
         {
-           job->st_paused += hb_get_date() - job->st_pause_date;
+            job = hb_list_item( h->jobs_running, ii );
+            if( job->st_pause_date != -1 )
+            {
+                job->st_paused += now - job->st_pause_date;
+                job->st_pause_date = -1;
+            }
         }
-#undef job
+        hb_unlock( h->run_lock );
 
         hb_unlock( h->pause_lock );
         h->paused = 0;
@@ -1652,7 +1788,10 @@ void hb_close( hb_handle_t ** _h )
     hb_handle_t * h = *_h;
     hb_title_t * title;
 
+    hb_lock( h->event_lock );
     h->die = 1;
+    hb_cond_signal( h->event_cond );
+    hb_unlock( h->event_lock );
     
     hb_thread_close( &h->main_thread );
 
@@ -1666,10 +1805,17 @@ void hb_close( hb_handle_t ** _h )
     hb_list_close( &h->jobs );
     hb_lock_close( &h->state_lock );
     hb_lock_close( &h->pause_lock );
+    hb_lock_close( &h->run_lock );
+    hb_list_close( &h->jobs_running );
+    hb_lock_close( &h->event_lock );
+    hb_cond_close( &h->event_cond );
+    hb_lock_close( &h->notify_lock );
 
     hb_system_sleep_opaque_close(&h->system_sleep_opaque);
 
+    hb_preview_store_close( &h->previews );
     free( h->interjob );
+    free( h->scan_cache );
 
     free( h );
     *_h = NULL;
@@ -1686,6 +1832,14 @@ int hb_global_init()
         return -1;
     }
 
+    /* Worker threads shared by the multithreaded filters */
+    result = hb_thread_pool_init(hb_get_cpu_count());
+    if (result < 0)
+    {
+        hb_error("Filter thread pool initialization failed!");
+        return -1;
+    }
+
 #ifdef USE_QSV
     result = hb_qsv_info_init();
     if (result < 0)
@@ -1730,6 +1884,8 @@ int hb_global_init()
 #ifdef USE_QSV
     hb_register(&hb_encqsv);
 #endif
+    hb_register(&hb_encchunk);
+    hb_register(&hb_chunktiming);
     
     hb_common_global_init();
 
@@ -1745,6 +1901,8 @@ void hb_global_close()
     DIR * dir;
     struct dirent * entry;
     
+    hb_thread_pool_close();
+
     /* Find and remove temp folder */
     memset( dirname, 0, 1024 );
     hb_get_temporary_directory( dirname );
@@ -1787,6 +1945,7 @@ static void thread_func( void * _h )
 
     hb_mkdir( dirname );
 
+    hb_lock( h->event_lock );
     while( !h->die )
     {
         /* In case the check_update thread hangs, it'll die sooner or
@@ -1797,10 +1956,28 @@ static void thread_func( void * _h )
             hb_thread_close( &h->update_thread );
         }
 
+        if( !h->scan_done && !h->work_done )
+        {
+            /* Sleep until a thread is done.  The update thread doesn't
+               tell us when it exits, keep checking on it while it runs */
+            if( h->update_thread )
+            {
+                hb_cond_timedwait( h->event_cond, h->event_lock, 500 );
+            }
+            else
+            {
+                hb_cond_wait( h->event_cond, h->event_lock );
+            }
+            continue;
+        }
+
         /* Check if the scan thread is done */
-        if( h->scan_thread &&
-            hb_thread_has_exited( h->scan_thread ) )
+        if( h->scan_done )
         {
+            h->scan_done = 0;
+            hb_unlock( h->event_lock );
+
+            /* The thread is returning, this won't block for long */
             hb_thread_close( &h->scan_thread );
 
             if ( h->scan_die )
@@ -1827,12 +2004,17 @@ static void thread_func( void * _h )
 			/*we increment this sessions scan count by one for the MacGui
 			to trigger a new source being set */
             h->scanCount++;
+            hb_state_notify( h );
+
+            hb_lock( h->event_lock );
         }
 
         /* Check if the work thread is done */
-        if( h->work_thread &&
-            hb_thread_has_exited( h->work_thread ) )
+        if( h->work_done )
         {
+            h->work_done = 0;
+            hb_unlock( h->event_lock );
+
             hb_thread_close( &h->work_thread );
 
             hb_log( "libhb: work result = %d",
@@ -1845,10 +2027,12 @@ static void thread_func( void * _h )
             if (h->job_count < 1)
                 h->job_count_permanent = 0;
             hb_unlock( h->state_lock );
-        }
+            hb_state_notify( h );
 
-        hb_snooze( 50 );
+            hb_lock( h->event_lock );
+        }
     }
+    hb_unlock( h->event_lock );
 
     if( h->scan_thread )
     {
@@ -1906,6 +2090,170 @@ int hb_get_instance_id( hb_handle_t * h )
     return h->id;
 }
 
+/**
+ * Called by the scan thread right before it returns.
+ * Wakes up thread_func to join it.
+ * @param h Handle to hb_handle_t
+ */
+void hb_scan_done( hb_handle_t * h )
+{
+    hb_lock( h->event_lock );
+    h->scan_done = 1;
+    hb_cond_signal( h->event_cond );
+    hb_unlock( h->event_lock );
+}
+
+/**
+ * Called by the work thread right before it returns.
+ * Wakes up thread_func to join it.
+ * @param h Handle to hb_handle_t
+ */
+void hb_work_done( hb_handle_t * h )
+{
+    hb_lock( h->event_lock );
+    h->work_done = 1;
+    hb_cond_signal( h->event_cond );
+    hb_unlock( h->event_lock );
+}
+
+/**
+ * Registers a function to be called on state changes.
+ * @param h Handle to hb_handle_t
+ * @param callback Function to call, NULL to stop notifications
+ * @param opaque Passed to callback
+ * @param interval Minimum time between progress notifications in ms
+ */
+void hb_set_state_callback( hb_handle_t * h, hb_state_callback_t * callback,
+                            void * opaque, int interval )
+{
+    hb_lock( h->notify_lock );
+    h->state_callback  = callback;
+    h->state_opaque    = opaque;
+    h->notify_interval = interval;
+    h->notify_state    = -1;
+    h->notify_date     = 0;
+    hb_unlock( h->notify_lock );
+}
+
+/*
+ * Passes the current state on to the registered callback.  State
+ * changes always are, updates within a state only if notify_interval
+ * has passed since the last one.
+ *
+ * The callback is called without notify_lock held so that it may call
+ * back into libhb, including hb_set_state_callback().  A notification
+ * that was already picked may still arrive just after the callback was
+ * changed.
+ */
+static void hb_state_notify( hb_handle_t * h )
+{
+    hb_state_callback_t * callback = NULL;
+    void                * opaque   = NULL;
+    hb_state_t            state;
+    uint64_t              now;
+
+    hb_lock( h->notify_lock );
+    if( h->state_callback != NULL )
+    {
+        hb_get_state2( h, &state );
+        now = hb_get_date();
+        if( state.state != h->notify_state ||
+            now >= h->notify_date + h->notify_interval )
+        {
+            h->notify_state = state.state;
+            h->notify_date  = now;
+            callback        = h->state_callback;
+            opaque          = h->state_opaque;
+        }
+    }
+    hb_unlock( h->notify_lock );
+
+    if( callback != NULL )
+    {
+        callback( h, &state, opaque );
+    }
+}
+
+/**
+ * Sets the current state on behalf of a job.  When several jobs run at
+ * once, only the one in h->current_job reports its progress so the
+ * state doesn't jump between jobs.
+ * @param job Handle to the hb_job_t reporting
+ * @param s Handle to new hb_state_t
+ */
+void hb_set_job_state( hb_job_t * job, hb_state_t * s )
+{
+    hb_handle_t * h = job->h;
+
+    // Segments of a chunked encode leave it to their parent job
+    if( job->fifo_chunk != NULL ||
+        ( h->max_jobs > 1 && h->current_job != job ) )
+    {
+        // Still wait here while paused, as hb_set_state would
+        hb_lock( h->pause_lock );
+        hb_unlock( h->pause_lock );
+        return;
+    }
+    hb_set_state( h, s );
+}
+
+/**
+ * Registers a job that do_job is starting.  Jobs that run at the same
+ * time share the buffer pool and OpenCL.  OpenCL is set up here for the
+ * jobs that ask for it, and hb_job_done frees both once the last running
+ * job is done.
+ * @param job Handle to the hb_job_t starting
+ */
+void hb_job_start( hb_job_t * job )
+{
+    hb_handle_t * h = job->h;
+
+    hb_lock( h->run_lock );
+    hb_list_add( h->jobs_running, job );
+    if( job->use_opencl )
+    {
+        if( hb_ocl_init() || hb_init_opencl_run_env( 0, NULL, "-I." ) )
+        {
+            hb_log( "work: failed to initialize OpenCL environment, "
+                    "using fallback" );
+            job->use_opencl = 0;
+            if( !h->run_opencl )
+            {
+                hb_ocl_close();
+            }
+        }
+        else
+        {
+            h->run_opencl = 1;
+        }
+    }
+    hb_unlock( h->run_lock );
+}
+
+/**
+ * Unregisters a job started with hb_job_start.
+ * @param job Handle to the hb_job_t that is done
+ */
+void hb_job_done( hb_job_t * job )
+{
+    hb_handle_t * h = job->h;
+
+    hb_lock( h->run_lock );
+    hb_list_rem( h->jobs_running, job );
+    if( hb_list_count( h->jobs_running ) == 0 )
+    {
+        hb_buffer_pool_free();
+
+        /* OpenCL: must be closed *after* freeing the buffer pool */
+        if( h->run_opencl )
+        {
+            hb_ocl_close();
+            h->run_opencl = 0;
+        }
+    }
+    hb_unlock( h->run_lock );
+}
+
 /**
  * Sets the current state.
  * @param h Handle to hb_handle_t
@@ -1935,6 +2283,7 @@ void hb_set_state( hb_handle_t * h, hb_state_t * s )
     }
     hb_unlock( h->state_lock );
     hb_unlock( h->pause_lock );
+    hb_state_notify( h );
 }
 
 void hb_system_sleep_allow(hb_handle_t *h)
@@ -1952,3 +2301,16 @@ hb_interjob_t * hb_interjob_get( hb_handle_t * h )
 {
     return h->interjob;
 }
+
+/**
+ * Sets how many jobs the work thread may run at once.
+ * @param h Handle to hb_handle_t
+ * @param max_jobs Number of jobs to run at once
+ * @param thread_budget Encoder and decoder threads shared by the running
+ *                      jobs, 0 for one per CPU
+ */
+void hb_set_job_concurrency( hb_handle_t * h, int max_jobs, int thread_budget )
+{
+    h->max_jobs      = max_jobs > 1 ? max_jobs : 1;
+    h->thread_budget = thread_budget > 0 ? thread_budget : 0;
+}
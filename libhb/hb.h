@@ -49,6 +49,10 @@ void          hb_scan( hb_handle_t *, const char * path,
                        int title_index, int preview_count,
                        int store_previews, uint64_t min_duration );
 void          hb_scan_stop( hb_handle_t * );
+/* hb_scan_set_cache()
+   Keep scan results in the directory 'path' and reuse them when the same
+   unchanged source is scanned again.  NULL disables the cache (default). */
+void          hb_scan_set_cache( hb_handle_t *, const char * path );
 uint64_t      hb_first_duration( hb_handle_t * );
 
 /* hb_get_titles()
@@ -70,6 +74,10 @@ int           hb_save_preview( hb_handle_t * h, int title, int preview,
                                hb_buffer_t *buf );
 hb_buffer_t * hb_read_preview( hb_handle_t * h, hb_title_t *title,
                                int preview );
+/* hb_set_preview_budget()
+   Sets how many bytes of scan previews are kept in memory.  Previews
+   beyond that go to the temporary directory, 0 keeps them all there. */
+void          hb_set_preview_budget( hb_handle_t * h, int64_t bytes );
 void          hb_get_preview( hb_handle_t *, hb_job_t *, int,
                               uint8_t * );
 hb_image_t  * hb_get_preview2(hb_handle_t * h, int title_idx, int picture,
@@ -119,11 +127,33 @@ typedef struct hb_interjob_s
 
 hb_interjob_t * hb_interjob_get( hb_handle_t * ); 
 
+/* hb_set_job_concurrency()
+   Lets the work thread run up to max_jobs encodes at once.  Jobs that
+   share a sequence_id (e.g. the subtitle scan and both passes of a two
+   pass encode) still run one after the other.  thread_budget is the
+   number of encoder and decoder threads shared by the running jobs, 0
+   for one per CPU.  The default of 1 job runs the queue in order.
+   Takes effect at the next hb_start(). */
+void hb_set_job_concurrency( hb_handle_t *, int max_jobs, int thread_budget );
+
 /* hb_get_state()
    Should be regularly called by the UI (like 5 or 10 times a second).
    Look at test/test.c to see how to use it. */
 void hb_get_state( hb_handle_t *, hb_state_t * );
 void hb_get_state2( hb_handle_t *, hb_state_t * );
+
+/* hb_set_state_callback()
+   Alternative to polling hb_get_state().  callback is called with the
+   new state whenever it changes, e.g. when a scan or encode is done.
+   Progress updates within the same state are passed on at most once
+   every interval ms.  The callback runs on libhb's threads and must
+   return quickly; it may read the state but must not call functions
+   that change it (hb_pause(), hb_start(), ...).  Pass a NULL callback
+   to unregister. */
+typedef void (hb_state_callback_t)( hb_handle_t * h, hb_state_t * state,
+                                    void * opaque );
+void hb_set_state_callback( hb_handle_t *, hb_state_callback_t * callback,
+                            void * opaque, int interval );
 /* hb_get_scancount() is called by the MacGui in UpdateUI to
    check for a new scan during HB_STATE_WORKING phase  */
 int hb_get_scancount( hb_handle_t * );
@@ -34,12 +34,23 @@ void hb_list_empty( hb_list_t ** );
 
 hb_title_t * hb_title_init( char * dvd, int index );
 void         hb_title_close( hb_title_t ** );
+int64_t      hb_job_duration( hb_job_t * );
 
 /***********************************************************************
  * hb.c
  **********************************************************************/
 int  hb_get_pid( hb_handle_t * );
 void hb_set_state( hb_handle_t *, hb_state_t * );
+void hb_set_job_state( hb_job_t *, hb_state_t * );
+void hb_job_start( hb_job_t * );
+void hb_job_done( hb_job_t * );
+void hb_scan_done( hb_handle_t * );
+void hb_work_done( hb_handle_t * );
+uint8_t * hb_get_preview_data( hb_handle_t *, int title, int preview,
+                               int * size );
+int       hb_set_preview_data( hb_handle_t *, int title, int preview,
+                               uint8_t * data, int size );
+void      hb_clear_preview_data( hb_handle_t *, int title, int count );
 
 /***********************************************************************
  * fifo.c
@@ -147,6 +158,13 @@ struct hb_buffer_s
     // Packets in a list:
     //   the next packet in the list
     hb_buffer_t * next;
+
+    // Reference counted payload (see hb_buffer_ref):
+    //   buffers that share their data all point to a hidden 'shared'
+    //   buffer that owns the data. Its 'refs' counts the sharing buffers.
+    //   Call hb_buffer_make_writable before modifying data in place.
+    hb_buffer_t * shared;
+    int           refs;
 };
 
 void hb_buffer_pool_init( void );
@@ -160,12 +178,16 @@ void          hb_video_buffer_realloc( hb_buffer_t * b, int w, int h );
 void          hb_buffer_reduce( hb_buffer_t * b, int size );
 void          hb_buffer_close( hb_buffer_t ** );
 hb_buffer_t * hb_buffer_dup( const hb_buffer_t * src );
+hb_buffer_t * hb_buffer_ref( hb_buffer_t * src );
+hb_buffer_t * hb_buffer_slice( hb_buffer_t * src, int offset, int size );
+void          hb_buffer_make_writable( hb_buffer_t * b );
 int           hb_buffer_copy( hb_buffer_t * dst, const hb_buffer_t * src );
 void          hb_buffer_swap_copy( hb_buffer_t *src, hb_buffer_t *dst );
 void          hb_buffer_move_subs( hb_buffer_t * dst, hb_buffer_t * src );
 hb_image_t  * hb_buffer_to_image(hb_buffer_t *buf);
 
 hb_fifo_t   * hb_fifo_init( int capacity, int thresh );
+hb_fifo_t   * hb_fifo_init_spsc( int capacity, int thresh );
 int           hb_fifo_size( hb_fifo_t * );
 int           hb_fifo_size_bytes( hb_fifo_t * );
 int           hb_fifo_is_full( hb_fifo_t * );
@@ -184,6 +206,11 @@ hb_buffer_t * hb_fifo_get_list_element( hb_fifo_t *fifo );
 void          hb_fifo_close( hb_fifo_t ** );
 void          hb_fifo_flush( hb_fifo_t * f );
 
+hb_fifo_group_t * hb_fifo_group_init( void );
+void          hb_fifo_group_add( hb_fifo_group_t *, hb_fifo_t * );
+int           hb_fifo_group_wait( hb_fifo_group_t * );
+void          hb_fifo_group_close( hb_fifo_group_t ** );
+
 static inline int hb_image_stride( int pix_fmt, int width, int plane )
 {
     int linesize = av_image_get_linesize( pix_fmt, width, plane );
@@ -249,11 +276,15 @@ hb_thread_t * hb_update_init( int * build, char * version );
 hb_thread_t * hb_scan_init( hb_handle_t *, volatile int * die, 
                             const char * path, int title_index, 
                             hb_title_set_t * title_set, int preview_count, 
-                            int store_previews, uint64_t min_duration );
-hb_thread_t * hb_work_init( hb_list_t * jobs,
-                            volatile int * die, hb_error_code * error, hb_job_t ** job );
+                            int store_previews, uint64_t min_duration,
+                            const char * cache_path );
+hb_thread_t * hb_work_init( hb_handle_t *, hb_list_t * jobs,
+                            volatile int * die, hb_error_code * error,
+                            hb_job_t ** job, int max_jobs, int thread_budget );
+hb_thread_t * hb_work_segment_init( hb_job_t * segment );
 void ReadLoop( void * _w );
 hb_work_object_t * hb_muxer_init( hb_job_t * );
+void hb_muxer_loop( hb_work_object_t * );
 hb_work_object_t * hb_get_work( int );
 hb_work_object_t * hb_codec_decoder( int );
 hb_work_object_t * hb_codec_encoder( int );
@@ -263,6 +294,33 @@ hb_work_object_t * hb_codec_encoder( int );
  **********************************************************************/
 hb_work_object_t * hb_sync_init( hb_job_t * job );
 
+/***********************************************************************
+ * encchunk.c
+ **********************************************************************/
+void hb_encchunk_setup( hb_job_t * job );
+void hb_encchunk_segment_close( hb_job_t ** segment );
+
+/***********************************************************************
+ * mp4moov.c
+ **********************************************************************/
+int64_t hb_mp4_moov_estimate( hb_job_t * job );
+int     hb_mp4_moov_relocate( const char * path, int move );
+
+/***********************************************************************
+ * writer.c
+ **********************************************************************/
+typedef struct hb_writer_s hb_writer_t;
+
+hb_writer_t * hb_writer_open( const char * path, int64_t estimate,
+                              volatile int * die );
+int           hb_writer_write( hb_writer_t *, const uint8_t * data, int size );
+int64_t       hb_writer_seek( hb_writer_t *, int64_t pos );
+int64_t       hb_writer_tell( hb_writer_t * );
+int64_t       hb_writer_size( hb_writer_t * );
+int           hb_writer_close( hb_writer_t ** );
+FILE        * hb_writer_stream( hb_writer_t * );
+int64_t       hb_writer_estimate( hb_job_t * job );
+
 /***********************************************************************
  * mpegdemux.c
  **********************************************************************/
@@ -288,6 +346,39 @@ extern const hb_muxer_t hb_demux[];
  **********************************************************************/
 extern int decmetadata( hb_title_t *title );
 
+/***********************************************************************
+ * scancache.c
+ **********************************************************************/
+typedef struct hb_scan_cache_s hb_scan_cache_t;
+
+hb_scan_cache_t * hb_scan_cache_init( const char * dir, const char * path,
+                                      int title_index, int preview_count,
+                                      int store_previews,
+                                      uint64_t min_duration );
+void              hb_scan_cache_close( hb_scan_cache_t ** );
+int               hb_scan_cache_load( hb_scan_cache_t *, hb_handle_t *,
+                                      hb_title_set_t * title_set );
+void              hb_scan_cache_save( hb_scan_cache_t *, hb_handle_t *,
+                                      hb_title_set_t * title_set );
+
+/***********************************************************************
+ * previewstore.c
+ **********************************************************************/
+#define HB_PREVIEW_STORE_DEFAULT_BUDGET ( 64 * 1024 * 1024 )
+
+typedef struct hb_preview_store_s hb_preview_store_t;
+
+hb_preview_store_t * hb_preview_store_init( hb_handle_t *, int64_t budget );
+void      hb_preview_store_close( hb_preview_store_t ** );
+void      hb_preview_store_set_budget( hb_preview_store_t *, int64_t budget );
+int       hb_preview_store_put( hb_preview_store_t *, int title, int preview,
+                                uint8_t * data, int size );
+uint8_t * hb_preview_store_get( hb_preview_store_t *, int title, int preview,
+                                int * size );
+void      hb_preview_store_clear( hb_preview_store_t * );
+void      hb_preview_store_clear_title( hb_preview_store_t *, int title,
+                                        int count );
+
 /***********************************************************************
  * batch.c
  **********************************************************************/
@@ -428,7 +519,9 @@ enum
     WORK_ENCAVCODEC_AUDIO,
     WORK_MUX,
     WORK_READER,
-    WORK_DECPGSSUB
+    WORK_DECPGSSUB,
+    WORK_ENCCHUNK,
+    WORK_CHUNKTIMING
 };
 
 extern hb_filter_object_t hb_filter_detelecine;
@@ -0,0 +1,417 @@
+/* mp4moov.c
+
+   Copyright (c) 2003-2014 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * "Web optimized" MP4 files have their index, the moov atom, in front of
+ * the media data so players can start before they have the whole file.
+ * The muxers only know what goes in the moov once all media is written,
+ * so they write it at the end.  Moving it to the front afterwards means
+ * moving all of the media data, a second write of the whole file.
+ *
+ * Instead the muxer can reserve room for the moov in front of the media
+ * data, sized by hb_mp4_moov_estimate().  hb_mp4_moov_relocate() then
+ * copies the moov into that room and cuts it off the end of the file.
+ * The media data stays where it is, so the sample offsets in the moov
+ * stay valid.  Only when the moov doesn't fit is the media data moved
+ * to make room.
+ */
+
+#include "hb.h"
+
+#define MP4_ATOM( a, b, c, d ) \
+    ( ( (uint32_t)(a) << 24 ) | ( (b) << 16 ) | ( (c) << 8 ) | (d) )
+
+// Size of the blocks the media data is moved in when the moov doesn't
+// fit in the room reserved for it
+#define MP4_MOVE_BLOCK ( 8 * 1024 * 1024 )
+
+static uint32_t rb32( const uint8_t * p )
+{
+    return ( (uint32_t)p[0] << 24 ) | ( p[1] << 16 ) | ( p[2] << 8 ) | p[3];
+}
+
+static uint64_t rb64( const uint8_t * p )
+{
+    return ( (uint64_t)rb32( p ) << 32 ) | rb32( p + 4 );
+}
+
+static void wb32( uint8_t * p, uint32_t v )
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void wb64( uint8_t * p, uint64_t v )
+{
+    wb32( p, v >> 32 );
+    wb32( p + 4, v );
+}
+
+/***********************************************************************
+ * hb_mp4_moov_estimate
+ ***********************************************************************
+ * Returns the number of bytes to reserve for the moov of the job's
+ * output.  Leans to the high side, running out of room costs a move of
+ * the whole file while spare room only costs a free atom.
+ **********************************************************************/
+int64_t hb_mp4_moov_estimate( hb_job_t * job )
+{
+    hb_subtitle_t * subtitle;
+    hb_coverart_t * art;
+    int64_t         bytes;
+    double          seconds, fps;
+    int             offset_size = job->largeFileSize ? 8 : 4;
+    int             sample, ii;
+
+    seconds = (double)hb_job_duration( job ) / 90000.;
+    fps     = (double)job->vrate / job->vrate_base;
+
+    // Every sample costs a size entry, and about every sample starts a
+    // chunk since the tracks are interleaved frame by frame (a chunk
+    // offset and a samples to chunk entry).  Video also needs
+    // composition offsets with b-frames and decode time entries when
+    // the frame rate varies.
+    sample = 4 + offset_size + 12;
+    if( job->areBframes )
+    {
+        sample += 8;
+    }
+    if( job->cfr == 0 )
+    {
+        sample += 8;
+    }
+    bytes = seconds * fps * sample;
+
+    // The usual audio codecs make 30 to 50 frames a second, a couple of
+    // them go in each chunk
+    sample = 4 + ( offset_size + 12 ) / 2;
+    bytes += seconds * 50 * sample * hb_list_count( job->list_audio );
+
+    // Allow for a subtitle a second
+    for( ii = 0; ii < hb_list_count( job->list_subtitle ); ii++ )
+    {
+        subtitle = hb_list_item( job->list_subtitle, ii );
+        if( subtitle->config.dest == PASSTHRUSUB )
+        {
+            bytes += seconds * ( 4 + offset_size + 12 + 8 );
+        }
+    }
+
+    // Headers, chapter names and metadata
+    bytes += 64 * 1024 + hb_list_count( job->list_chapter ) * 256;
+    if( job->metadata != NULL )
+    {
+        for( ii = 0; ii < hb_list_count( job->metadata->list_coverart ); ii++ )
+        {
+            art = hb_list_item( job->metadata->list_coverart, ii );
+            bytes += art->size + 64;
+        }
+    }
+
+    return bytes + bytes / 8;
+}
+
+/*
+ * Adds 'delta' to the chunk offsets of all tracks in the atoms between
+ * 'p' and 'end'.  Fails if a 32 bit offset would overflow.  Offsets
+ * only ever move up.
+ */
+static int patch_offsets( uint8_t * p, uint8_t * end, int64_t delta )
+{
+    uint64_t size, count, ii;
+    uint32_t type;
+    int      header;
+
+    if( delta <= 0 )
+    {
+        return -1;
+    }
+    while( end - p >= 8 )
+    {
+        size   = rb32( p );
+        type   = rb32( p + 4 );
+        header = 8;
+        if( size == 1 && end - p >= 16 )
+        {
+            size   = rb64( p + 8 );
+            header = 16;
+        }
+        else if( size == 0 )
+        {
+            size = end - p;
+        }
+        if( size < header || size > end - p )
+        {
+            return -1;
+        }
+
+        switch( type )
+        {
+            case MP4_ATOM( 'm', 'o', 'o', 'v' ):
+            case MP4_ATOM( 't', 'r', 'a', 'k' ):
+            case MP4_ATOM( 'm', 'd', 'i', 'a' ):
+            case MP4_ATOM( 'm', 'i', 'n', 'f' ):
+            case MP4_ATOM( 's', 't', 'b', 'l' ):
+                if( patch_offsets( p + header, p + size, delta ) )
+                {
+                    return -1;
+                }
+                break;
+
+            case MP4_ATOM( 's', 't', 'c', 'o' ):
+                count = size >= header + 8 ? rb32( p + header + 4 ) : 0;
+                if( header + 8 + count * 4 > size )
+                {
+                    return -1;
+                }
+                for( ii = 0; ii < count; ii++ )
+                {
+                    uint8_t * entry = p + header + 8 + ii * 4;
+                    if( rb32( entry ) + delta > UINT32_MAX )
+                    {
+                        return -1;
+                    }
+                    wb32( entry, rb32( entry ) + delta );
+                }
+                break;
+
+            case MP4_ATOM( 'c', 'o', '6', '4' ):
+                count = size >= header + 8 ? rb32( p + header + 4 ) : 0;
+                if( header + 8 + count * 8 > size )
+                {
+                    return -1;
+                }
+                for( ii = 0; ii < count; ii++ )
+                {
+                    uint8_t * entry = p + header + 8 + ii * 8;
+                    wb64( entry, rb64( entry ) + delta );
+                }
+                break;
+
+            default:
+                break;
+        }
+        p += size;
+    }
+    return 0;
+}
+
+static int write_at( FILE * file, int64_t pos, const void * data,
+                     size_t size )
+{
+    return fseeko( file, pos, SEEK_SET ) ||
+           ( size && fwrite( data, size, 1, file ) != 1 );
+}
+
+static int read_at( FILE * file, int64_t pos, void * data, size_t size )
+{
+    return fseeko( file, pos, SEEK_SET ) ||
+           ( size && fread( data, size, 1, file ) != 1 );
+}
+
+/*
+ * Writes the ftyp and moov at the start of the file and turns the rest
+ * of the 'room' bytes in front of the media data into a free atom.
+ */
+static int write_head( FILE * file, uint8_t * ftyp, int64_t ftyp_size,
+                       uint8_t * moov, int64_t moov_size, int64_t room )
+{
+    uint8_t atom[8];
+
+    if( write_at( file, 0, ftyp, ftyp_size ) ||
+        write_at( file, ftyp_size, moov, moov_size ) )
+    {
+        return -1;
+    }
+    if( room > ftyp_size + moov_size )
+    {
+        wb32( atom, room - ftyp_size - moov_size );
+        memcpy( atom + 4, "free", 4 );
+        if( write_at( file, ftyp_size + moov_size, atom, 8 ) )
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Moves the bytes from 'start' to 'end' 'delta' bytes further into the
+ * file, last block first so nothing is overwritten before it was read.
+ */
+static int move_data( FILE * file, int64_t start, int64_t end,
+                      int64_t delta )
+{
+    uint8_t * block = malloc( MP4_MOVE_BLOCK );
+    int64_t   size;
+    int       result = 0;
+
+    // Moving backwards this way would overwrite what is still to be read
+    if( delta <= 0 || block == NULL )
+    {
+        free( block );
+        return -1;
+    }
+    while( end > start && !result )
+    {
+        size = MIN( MP4_MOVE_BLOCK, end - start );
+        end -= size;
+        result = read_at( file, end, block, size ) ||
+                 write_at( file, end + delta, block, size );
+    }
+    free( block );
+
+    return result;
+}
+
+/***********************************************************************
+ * hb_mp4_moov_relocate
+ ***********************************************************************
+ * Moves the moov at the end of the MP4 file 'path' in front of the media
+ * data.  If there's no room for it there, the media data is moved to
+ * make room when 'move' is set.  Returns 0 when the moov was moved, 1
+ * when the file was left with the moov at the end, -1 on error.
+ **********************************************************************/
+int hb_mp4_moov_relocate( const char * path, int move )
+{
+    FILE    * file;
+    uint8_t   header[16], * ftyp = NULL, * moov = NULL;
+    int64_t   pos = 0, file_size, size;
+    int64_t   ftyp_pos = -1, ftyp_size = 0, mdat_pos = -1;
+    int64_t   moov_pos = -1, moov_size = 0, room, delta;
+    int       result = -1;
+
+    file = hb_fopen( path, "r+b" );
+    if( file == NULL )
+    {
+        hb_error( "mp4moov: could not open %s", path );
+        return -1;
+    }
+    if( fseeko( file, 0, SEEK_END ) || ( file_size = ftello( file ) ) < 0 )
+    {
+        goto done;
+    }
+
+    // Find the atoms that matter at the top level
+    while( pos + 8 <= file_size )
+    {
+        if( read_at( file, pos, header, 8 ) )
+        {
+            goto done;
+        }
+        size = rb32( header );
+        if( size == 1 )
+        {
+            if( read_at( file, pos + 8, header + 8, 8 ) )
+            {
+                goto done;
+            }
+            size = rb64( header + 8 );
+        }
+        else if( size == 0 )
+        {
+            size = file_size - pos;
+        }
+        if( size < 8 || pos + size > file_size )
+        {
+            hb_error( "mp4moov: bad atom at %"PRId64" in %s", pos, path );
+            goto done;
+        }
+        switch( rb32( header + 4 ) )
+        {
+            case MP4_ATOM( 'f', 't', 'y', 'p' ):
+                ftyp_pos  = pos;
+                ftyp_size = size;
+                break;
+            case MP4_ATOM( 'm', 'd', 'a', 't' ):
+                if( mdat_pos < 0 )
+                {
+                    mdat_pos = pos;
+                }
+                break;
+            case MP4_ATOM( 'm', 'o', 'o', 'v' ):
+                moov_pos  = pos;
+                moov_size = size;
+                break;
+            default:
+                break;
+        }
+        pos += size;
+    }
+    if( ftyp_pos < 0 || mdat_pos < ftyp_pos || moov_pos < mdat_pos ||
+        moov_pos + moov_size != file_size || ftyp_size > 4096 )
+    {
+        // Not laid out the way our muxers write files
+        result = 1;
+        goto done;
+    }
+
+    ftyp = malloc( ftyp_size );
+    moov = malloc( moov_size );
+    if( ftyp == NULL || moov == NULL ||
+        read_at( file, ftyp_pos, ftyp, ftyp_size ) ||
+        read_at( file, moov_pos, moov, moov_size ) )
+    {
+        goto done;
+    }
+
+    // Everything in front of the media data is ours to rewrite
+    room = mdat_pos;
+    if( room == ftyp_size + moov_size || room >= ftyp_size + moov_size + 8 )
+    {
+        if( write_head( file, ftyp, ftyp_size, moov, moov_size, room ) ||
+            fflush( file ) || hb_ftruncate( file, moov_pos ) )
+        {
+            goto done;
+        }
+        hb_log( "mp4moov: moved index into reserved space, %"PRId64" of "
+                "%"PRId64" bytes used", ftyp_size + moov_size, room );
+        result = 0;
+        goto done;
+    }
+
+    delta = ftyp_size + moov_size - room;
+    if( delta < 0 )
+    {
+        // The spare room is too small for a free atom, move the media
+        // data far enough to fit one
+        delta += 8;
+    }
+    if( !move || patch_offsets( moov, moov + moov_size, delta ) )
+    {
+        // Leave the moov at the end, but put the ftyp back in front
+        hb_log( "mp4moov: index (%"PRId64" bytes) doesn't fit in reserved "
+                "space (%"PRId64" bytes)", moov_size, room );
+        result = write_head( file, ftyp, ftyp_size, NULL, 0, room ) ? -1 : 1;
+        goto done;
+    }
+
+    hb_log( "mp4moov: index (%"PRId64" bytes) doesn't fit in reserved "
+            "space (%"PRId64" bytes), moving media data", moov_size, room );
+    if( move_data( file, mdat_pos, moov_pos, delta ) ||
+        write_head( file, ftyp, ftyp_size, moov, moov_size, room + delta ) ||
+        fflush( file ) || hb_ftruncate( file, moov_pos + delta ) )
+    {
+        goto done;
+    }
+    result = 0;
+
+done:
+    if( result < 0 )
+    {
+        hb_error( "mp4moov: failed to move index of %s", path );
+    }
+    free( ftyp );
+    free( moov );
+    fclose( file );
+
+    return result;
+}
@@ -49,6 +49,26 @@ struct hb_mux_object_s
     hb_mux_data_t    ** tracks;
 
     int64_t             delay;
+
+    int64_t             moov_reserve; // room for the moov after the ftyp
+
+    // The reserved room is written through libavformat's AVIOContext in
+    // front of the ftyp, and swapped with the ftyp on its way to the file
+    // (see mux_avio_write)
+    int64_t             head_skip;    // reserved bytes still to swallow
+    int                 ftyp_size;    // ftyp bytes collected so far
+    uint8_t             ftyp[4096];
+
+    hb_writer_t       * writer;
+
+    // Fragmented and segmented MP4, times in 90 kHz ticks
+    int                 fragmented;
+    int64_t             fragment_duration;
+    int64_t             fragment_start;
+    int64_t             segment_duration;
+    int64_t             segment_start;
+    int                 segment;      // number of the file being written
+    int64_t             segment_base; // offset of that file in the output
 };
 
 enum
@@ -109,6 +129,195 @@ static char* lookup_lang_code(int mux, char *iso639_2)
     return out;
 }
 
+#define MUX_AVIO_BUFFER_SIZE (64 * 1024)
+// ms per fragment of segmented output when no fragment duration is given,
+// movenc holds a whole fragment in memory until it's written
+#define MUX_DEFAULT_FRAGMENT 2000
+
+/* avio callbacks that hand libavformat's output to the write-behind
+ * writer (see writer.c).  Offsets are those of the whole output.  In
+ * segmented output the current file starts at segment_base, and what
+ * comes before it is already closed. */
+/* Writes the ftyp collected in m->ftyp, followed by the reserved room
+ * as a free atom.  That takes up the same bytes as the free atom and
+ * ftyp libavformat wrote, so everything after them lands at the offset
+ * libavformat expects. */
+static int mux_write_head(hb_mux_object_t *m)
+{
+    static const uint8_t zero[4096];
+    uint8_t atom[8];
+    int64_t left = m->moov_reserve - 8;
+
+    AV_WB32(atom, m->moov_reserve);
+    memcpy(atom + 4, "free", 4);
+    if (hb_writer_write(m->writer, m->ftyp, m->ftyp_size) < 0 ||
+        hb_writer_write(m->writer, atom, 8) < 0)
+        return -1;
+    while (left > 0)
+    {
+        if (hb_writer_write(m->writer, zero, MIN(left, sizeof(zero))) < 0)
+            return -1;
+        left -= MIN(left, sizeof(zero));
+    }
+    return 0;
+}
+
+static int mux_avio_write(void *opaque, uint8_t *buf, int size)
+{
+    hb_mux_object_t *m = opaque;
+    int len = size;
+
+    if (m->writer == NULL)
+        return AVERROR(EIO);
+
+    if (m->head_skip > 0)
+    {
+        // Swallow our free atom, then collect the ftyp behind it
+        int skip = MIN(m->head_skip, len);
+
+        m->head_skip -= skip;
+        buf += skip;
+        len -= skip;
+    }
+    while (m->head_skip == 0 && m->moov_reserve > 0 &&
+           m->ftyp_size >= 0 && len > 0)
+    {
+        // Collect the size first, then the rest of the ftyp
+        int want = m->ftyp_size < 4 ? 4 : AV_RB32(m->ftyp);
+        int copy;
+
+        if (want < 4 || want > sizeof(m->ftyp) ||
+            (m->ftyp_size >= 4 && want < 8))
+        {
+            hb_error("muxavformat: unexpected file header");
+            return AVERROR(EIO);
+        }
+        copy = MIN(want - m->ftyp_size, len);
+        memcpy(m->ftyp + m->ftyp_size, buf, copy);
+        m->ftyp_size += copy;
+        buf += copy;
+        len -= copy;
+        if (m->ftyp_size >= 8 && m->ftyp_size == AV_RB32(m->ftyp))
+        {
+            if (mux_write_head(m) < 0)
+                return AVERROR(EIO);
+            // Pass the rest straight through from now on
+            m->ftyp_size = -1;
+        }
+    }
+    if (len > 0 && hb_writer_write(m->writer, buf, len) < 0)
+        return AVERROR(EIO);
+    return size;
+}
+
+static int64_t mux_avio_seek(void *opaque, int64_t offset, int whence)
+{
+    hb_mux_object_t *m = opaque;
+
+    if (m->writer == NULL)
+        return AVERROR(EIO);
+    switch (whence)
+    {
+        case AVSEEK_SIZE:
+            return m->segment_base + hb_writer_size(m->writer);
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += m->segment_base + hb_writer_tell(m->writer);
+            break;
+        case SEEK_END:
+            offset += m->segment_base + hb_writer_size(m->writer);
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if (offset < m->segment_base ||
+        hb_writer_seek(m->writer, offset - m->segment_base) < 0)
+        return AVERROR(EINVAL);
+    return offset;
+}
+
+static void mux_avio_close(hb_mux_object_t *m)
+{
+    if (m->oc != NULL && m->oc->pb != NULL)
+    {
+        avio_flush(m->oc->pb);
+        av_free(m->oc->pb->buffer);
+        av_free(m->oc->pb);
+        m->oc->pb = NULL;
+    }
+}
+
+/* Segment n > 0 of "dir/name.mp4" goes to "dir/name-0000n.m4s".  The
+ * first file holds the header (ftyp and moov) and the first segment,
+ * and the files played back to back are one fragmented MP4. */
+static char * segment_name(const char *file, int segment)
+{
+    const char *ext = strrchr(file, '.');
+    const char *sep = strrchr(file, '/');
+    int len = strlen(file);
+
+#if defined( SYS_MINGW )
+    if (strrchr(file, '\\') > sep)
+        sep = strrchr(file, '\\');
+#endif
+    if (ext != NULL && (sep == NULL || ext > sep))
+        len = ext - file;
+    return hb_strdup_printf("%.*s-%05d.m4s", len, file, segment);
+}
+
+/* Ends the current fragment at a sync sample and, if the segment is
+ * long enough, closes its file and goes on in the next one. */
+static int mux_fragment(hb_mux_object_t *m, int64_t start)
+{
+    hb_job_t *job = m->job;
+    int new_segment;
+    char *name;
+
+    if (m->fragment_start == AV_NOPTS_VALUE)
+    {
+        m->fragment_start = m->segment_start = start;
+        return 0;
+    }
+    new_segment = m->segment_duration > 0 &&
+                  start - m->segment_start >= m->segment_duration;
+    if (!new_segment && (m->fragment_duration <= 0 ||
+                         start - m->fragment_start < m->fragment_duration))
+    {
+        return 0;
+    }
+
+    // Write out what is queued for interleaving, then the fragment
+    if (av_interleaved_write_frame(m->oc, NULL) < 0 ||
+        av_write_frame(m->oc, NULL) < 0)
+    {
+        return -1;
+    }
+    m->fragment_start = start;
+    if (!new_segment)
+    {
+        return 0;
+    }
+
+    avio_flush(m->oc->pb);
+    if (m->oc->pb->error != 0 || hb_writer_close(&m->writer) < 0)
+    {
+        return -1;
+    }
+    m->segment_base  = avio_tell(m->oc->pb);
+    m->segment_start = start;
+    m->segment++;
+    name = segment_name(job->file, m->segment);
+    m->writer = hb_writer_open(name, 0, m->job->die);
+    if (m->writer != NULL)
+    {
+        hb_deep_log(2, "muxavformat: segment %d in %s", m->segment, name);
+    }
+    free(name);
+
+    return m->writer != NULL ? 0 : -1;
+}
+
 /**********************************************************************
  * avformatInit
  **********************************************************************
@@ -156,9 +365,36 @@ static int avformatInit( hb_mux_object_t * m )
             meta_mux = META_MUX_MP4;
 
             av_dict_set(&av_opts, "brand", "mp42", 0);
-            if (job->mp4_optimize)
-                av_dict_set( &av_opts, "movflags", "faststart", 0 );
+            if (job->fragment_duration > 0 || job->segment_duration > 0)
+            {
+                // An empty moov up front, then a moof/mdat pair per
+                // fragment.  We end the fragments ourselves, on IDR
+                // frames (see mux_fragment).  The file is usable up to
+                // the last fragment written, and it already has the
+                // index at the front.
+                av_dict_set(&av_opts, "movflags",
+                            "disable_chpl+frag_custom+empty_moov", 0);
+                m->fragmented        = 1;
+                m->fragment_duration = job->fragment_duration * 90LL;
+                if (m->fragment_duration <= 0)
+                {
+                    m->fragment_duration = MIN(job->segment_duration,
+                                               MUX_DEFAULT_FRAGMENT) * 90LL;
+                }
+                m->segment_duration  = job->segment_duration * 90LL;
+                m->fragment_start    = AV_NOPTS_VALUE;
+                if (job->chapter_markers)
+                {
+                    hb_log("muxavformat: chapter markers are not written "
+                           "to fragmented MP4");
+                }
+                break;
+            }
             av_dict_set( &av_opts, "movflags", "disable_chpl", 0 );
+            // Rather than have the moov moved to the front by rewriting
+            // the file, reserve room for it (see mp4moov.c)
+            if (job->mp4_optimize)
+                m->moov_reserve = hb_mp4_moov_estimate(job);
             break;
 
         case HB_MUX_AV_MKV:
@@ -168,6 +404,11 @@ static int avformatInit( hb_mux_object_t * m )
             m->time_base.den = 1000;
             muxer_name = "matroska";
             meta_mux = META_MUX_MKV;
+            if (job->fragment_duration > 0 || job->segment_duration > 0)
+            {
+                hb_log("muxavformat: fragmented and segmented output is "
+                       "only supported for MP4");
+            }
             break;
 
         default:
@@ -183,11 +424,23 @@ static int avformatInit( hb_mux_object_t * m )
         goto error;
     }
     av_strlcpy(m->oc->filename, job->file, sizeof(m->oc->filename));
-    ret = avio_open2(&m->oc->pb, job->file, AVIO_FLAG_WRITE,
-                     &m->oc->interrupt_callback, NULL);
-    if( ret < 0 )
+    m->writer = hb_writer_open(job->file, m->segment_duration > 0 ? 0 :
+                                          hb_writer_estimate(job), job->die);
+    if (m->writer == NULL)
+    {
+        goto error;
+    }
+    uint8_t *avio_buf = av_malloc(MUX_AVIO_BUFFER_SIZE);
+    if (avio_buf != NULL)
+    {
+        m->oc->pb = avio_alloc_context(avio_buf, MUX_AVIO_BUFFER_SIZE, 1,
+                                       m, NULL,
+                                       mux_avio_write, mux_avio_seek);
+    }
+    if (m->oc->pb == NULL)
     {
-        hb_error( "avio_open2 failed, errno %d", ret);
+        av_free(avio_buf);
+        hb_error("avio_alloc_context failed");
         goto error;
     }
 
@@ -363,7 +616,7 @@ static int avformatInit( hb_mux_object_t * m )
     int vrate_base, vrate;
     if( job->pass == 2 )
     {
-        hb_interjob_t * interjob = hb_interjob_get( job->h );
+        hb_interjob_t * interjob = job->interjob;
         vrate_base = interjob->vrate_base;
         vrate = interjob->vrate;
     }
@@ -897,6 +1150,28 @@ static int avformatInit( hb_mux_object_t * m )
              HB_PROJECT_VERSION, HB_PROJECT_BUILD);
     av_dict_set(&m->oc->metadata, "encoding_tool", tool_string, 0);
 
+    if (m->moov_reserve > 0)
+    {
+        // The reserved room goes in front of everything libavformat
+        // writes, as a free atom, so that all file offsets libavformat
+        // records account for it.  mux_avio_write puts the ftyp back in
+        // front of it in the file.
+        static const uint8_t zero[4096];
+        int64_t left = m->moov_reserve - 8;
+
+        hb_log("muxavformat: reserving %"PRId64" bytes for the index",
+               m->moov_reserve);
+        m->head_skip = m->moov_reserve;
+        m->ftyp_size = 0;
+        avio_wb32(m->oc->pb, m->moov_reserve);
+        avio_write(m->oc->pb, (const unsigned char*)"free", 4);
+        while (left > 0)
+        {
+            avio_write(m->oc->pb, zero, MIN(left, sizeof(zero)));
+            left -= MIN(left, sizeof(zero));
+        }
+    }
+
     ret = avformat_write_header(m->oc, &av_opts);
     if( ret < 0 )
     {
@@ -917,6 +1192,8 @@ static int avformatInit( hb_mux_object_t * m )
 error:
     free(job->mux_data);
     job->mux_data = NULL;
+    mux_avio_close(m);
+    hb_writer_close(&m->writer);
     avformat_free_context(m->oc);
     *job->done_error = HB_ERROR_INIT;
     *job->die = 1;
@@ -929,6 +1206,12 @@ static int add_chapter(hb_mux_object_t *m, int64_t start, int64_t end, char * ti
     AVChapter **chapters;
     int nchap = m->oc->nb_chapters;
 
+    if (m->fragmented)
+    {
+        // The moov is written before any chapter is known
+        return 0;
+    }
+
     nchap++;
     chapters = av_realloc(m->oc->chapters, nchap * sizeof(AVChapter*));
     if (chapters == NULL)
@@ -1068,6 +1351,16 @@ static int avformatMux(hb_mux_object_t *m, hb_mux_data_t *track, hb_buffer_t *bu
 
     track->duration += pkt.duration;
 
+    if (m->fragmented && track->type == MUX_TYPE_VIDEO &&
+        buf->s.frametype == HB_FRAME_IDR &&
+        mux_fragment(m, buf->s.start) < 0)
+    {
+        hb_error("avformatMux: failed to write fragment");
+        *job->done_error = HB_ERROR_UNKNOWN;
+        *job->die = 1;
+        return -1;
+    }
+
     switch (track->type)
     {
         case MUX_TYPE_VIDEO:
@@ -1307,9 +1600,22 @@ static int avformatEnd(hb_mux_object_t *m)
     }
 
     av_write_trailer(m->oc);
-    avio_close(m->oc->pb);
+    mux_avio_close(m);
     avformat_free_context(m->oc);
     m->oc = NULL;
+    if (hb_writer_close(&m->writer) < 0)
+    {
+        *job->done_error = HB_ERROR_UNKNOWN;
+    }
+
+    if (m->moov_reserve > 0)
+    {
+        hb_log("muxavformat: optimizing file");
+        if (hb_mp4_moov_relocate(job->file, 1) < 0)
+        {
+            *job->done_error = HB_ERROR_UNKNOWN;
+        }
+    }
 
     return 0;
 }
@@ -12,17 +12,16 @@
 #define MIN_BUFFERING (1024*1024*10)
 #define MAX_BUFFERING (1024*1024*50)
 
+// Small packets are packed into slabs of this size while they wait to be
+// muxed, see mux_pack().  Sized to fill a buffer pool block exactly.
+#define MUX_SLAB_SIZE (1024*1024 - 16)
+#define MUX_SLAB_ALIGN 16
+
 struct hb_mux_object_s
 {
     HB_MUX_COMMON;
 };
 
-typedef struct
-{
-    int         size;   // Size in bits
-    uint32_t  * vec;
-} hb_bitvec_t;
-
 typedef struct
 {
     hb_buffer_t **fifo;
@@ -34,28 +33,34 @@ typedef struct
 typedef struct
 {
     hb_mux_data_t * mux_data;
+    hb_fifo_t     * fifo;           // fifo the track's data arrives on
     uint64_t        frames;
     uint64_t        bytes;
     mux_fifo_t      mf;
     int             buffered_size;
+    int             continuous;     // audio or video, see add_mux_track
+    int             eof;
 } hb_track_t;
 
 typedef struct
 {
-    hb_lock_t       * mutex;
-    int               ref;
     int               done;
     hb_mux_object_t * m;
-    double            pts;        // end time of next muxing chunk
-    double            interleave; // size in 90KHz ticks of media chunks we mux
+    double            pts;        // end time of the data muxed so far
     uint32_t          max_tracks; // total number of tracks allocated
     uint32_t          ntracks;    // total number of tracks we're muxing
-    hb_bitvec_t     * eof;        // bitmask of track with eof
-    hb_bitvec_t     * rdy;        // bitmask of tracks ready to output
-    hb_bitvec_t     * allEof;     // valid bits in eof (all tracks)
-    hb_bitvec_t     * allRdy;     // valid bits in rdy (audio & video tracks)
+    uint32_t          neof;       // number of tracks at eof
+    uint32_t          nstarved;   // continuous tracks not at eof that
+                                  // have nothing buffered
+    uint32_t          nfull;      // tracks with more than MAX_BUFFERING
     hb_track_t     ** track;      // tracks to mux 'max_tracks' elements
+    int             * heap;       // tracks with buffered data, min-heap
+                                  // on the start of their next buf
+    uint32_t          nheap;
     int               buffered_size;
+    hb_fifo_group_t * fifo_group; // the fifos of all tracks
+    hb_buffer_t     * slab;       // slab small packets are packed into
+    int               slab_used;
 } hb_mux_t;
 
 struct hb_work_private_s
@@ -65,130 +70,6 @@ struct hb_work_private_s
     hb_mux_t * mux;
 };
 
-
-static int hb_bitvec_add_bits(hb_bitvec_t *bv, int bits)
-{
-    int ii;
-    int words_cur = (bv->size + 31) >> 5;
-    int words = (bv->size + bits + 31) >> 5;
-    if (words > words_cur)
-    {
-        uint32_t *tmp = realloc(bv->vec, words * sizeof(uint32_t));
-        if (tmp == NULL)
-        {
-            return -1;
-        }
-        for (ii = words_cur; ii < words; ii++)
-            tmp[ii] = 0;
-        bv->vec = tmp;
-    }
-    bv->size += bits;
-    return 0;
-}
-
-static hb_bitvec_t* hb_bitvec_new(int size)
-{
-    hb_bitvec_t *bv = calloc(sizeof(hb_bitvec_t), 1);
-    hb_bitvec_add_bits(bv, size);
-    return bv;
-}
-
-static void hb_bitvec_free(hb_bitvec_t **_bv)
-{
-    hb_bitvec_t *bv = *_bv;
-    free(bv->vec);
-    free(bv);
-    *_bv = NULL;
-}
-
-static void hb_bitvec_set(hb_bitvec_t *bv, int n)
-{
-    if (n >= bv->size)
-        return; // Error.  Should never happen.
-
-    int word = n >> 5;
-    uint32_t bit = 1 << (n & 0x1F);
-    bv->vec[word] |= bit;
-}
-
-static void hb_bitvec_clr(hb_bitvec_t *bv, int n)
-{
-    if (n >= bv->size)
-        return; // Error.  Should never happen.
-
-    int word = n >> 5;
-    uint32_t bit = 1 << (n & 0x1F);
-    bv->vec[word] &= ~bit;
-}
-
-static void hb_bitvec_zero(hb_bitvec_t *bv)
-{
-    int words = (bv->size + 31) >> 5;
-    memset(bv->vec, 0, words * sizeof(uint32_t));
-}
-
-static int hb_bitvec_bit(hb_bitvec_t *bv, int n)
-{
-    if (n >= bv->size)
-        return 0; // Error.  Should never happen.
-
-    int word = n >> 5;
-    uint32_t bit = 1 << (n & 0x1F);
-    return !!(bv->vec[word] & bit);
-}
-
-static int hb_bitvec_any(hb_bitvec_t *bv)
-{
-    uint32_t result = 0;;
-    int ii;
-    int words = (bv->size + 31) >> 5;
-    for (ii = 0; ii < words; ii++)
-        result |= bv->vec[ii];
-
-    return !!result;
-}
-
-static int hb_bitvec_cmp(hb_bitvec_t *bv1, hb_bitvec_t *bv2)
-{
-    if (bv1->size != bv2->size)
-        return 0;
-
-    int ii;
-    int words = (bv1->size + 31) >> 5;
-    for (ii = 0; ii < words; ii++)
-        if (bv1->vec[ii] != bv2->vec[ii])
-            return 0;
-    return 1;
-}
-
-static int hb_bitvec_and_cmp(hb_bitvec_t *bv1, hb_bitvec_t *bv2, hb_bitvec_t *bv3)
-{
-    if (bv1->size != bv2->size)
-        return 0;
-
-    int ii;
-    int words = (bv1->size + 31) >> 5;
-    for (ii = 0; ii < words; ii++)
-        if ((bv1->vec[ii] & bv2->vec[ii]) != bv3->vec[ii])
-            return 0;
-    return 1;
-}
-
-static int hb_bitvec_cpy(hb_bitvec_t *bv1, hb_bitvec_t *bv2)
-{
-    if (bv1->size < bv2->size)
-    {
-        int result = hb_bitvec_add_bits(bv1, bv2->size - bv1->size);
-        if (result < 0)
-            return result;
-    }
-
-    int words = (bv1->size + 31) >> 5;
-    memcpy(bv1->vec, bv2->vec, words * sizeof(uint32_t));
-
-    return 0;
-}
-
 // The muxer handles two different kinds of media: Video and audio tracks
 // are continuous: once they start they generate continuous, consecutive
 // sequence of bufs until they end. The muxer will time align all continuous
@@ -197,8 +78,9 @@ static int hb_bitvec_cpy(hb_bitvec_t *bv1, hb_bitvec_t *bv2)
 // data that's going to be presented close together in time also be close
 // together in the output file). Since HB's audio and video encoders run at
 // different speeds, the time-aligning involves buffering *all* the continuous
-// media tracks until a frame with a timestamp beyond the current alignment
-// point arrives on the slowest fifo (usually the video encoder).
+// media tracks until every one of them has data buffered, so that the
+// slowest fifo (usually the video encoder) can't come up with anything
+// earlier than what gets written.
 //
 // The other kind of media, subtitles, close-captions, vobsubs and
 // similar tracks, are intermittent. They generate frames sporadically or on
@@ -209,21 +91,27 @@ static int hb_bitvec_cpy(hb_bitvec_t *bv1, hb_bitvec_t *bv2)
 // (essentially it assumes that they will always go through the HB processing
 // pipeline faster than the associated video). They are still time aligned and
 // interleaved at the appropriate point in the output file.
+//
+// All tracks are muxed from a single thread (hb_muxer_loop) that waits on
+// the fifos of all tracks at once. Tracks with buffered data are kept in a
+// min-heap on the start time of their next buf, the top of the heap is the
+// next buf to write.
 
 // This routine adds another track for the muxer to process. The media input
 // stream will be read from HandBrake fifo 'fifo'. Buffers read from that
 // stream will be time-aligned with all the other media streams then passed
 // to the container-specific 'mux' routine with argument 'mux_data' (see
-// routine OutputTrackChunk). 'is_continuous' must be 1 for an audio or video
+// routine OutputTracks). 'is_continuous' must be 1 for an audio or video
 // track and 0 otherwise (see above).
 
 static void add_mux_track( hb_mux_t *mux, hb_mux_data_t *mux_data,
-                           int is_continuous )
+                           hb_fifo_t *fifo, int is_continuous )
 {
     if ( mux->ntracks + 1 > mux->max_tracks )
     {
         int max_tracks = mux->max_tracks ? mux->max_tracks * 2 : 32;
         hb_track_t **tmp;
+        int *heap;
         tmp = realloc(mux->track, max_tracks * sizeof(hb_track_t*));
         if (tmp == NULL)
         {
@@ -232,27 +120,135 @@ static void add_mux_track( hb_mux_t *mux, hb_mux_data_t *mux_data,
             return;
         }
         mux->track = tmp;
+        heap = realloc(mux->heap, max_tracks * sizeof(int));
+        if (heap == NULL)
+        {
+            hb_error("add_mux_track: realloc failed, too many tracks (>%d)",
+                     max_tracks);
+            return;
+        }
+        mux->heap = heap;
         mux->max_tracks = max_tracks;
     }
 
     hb_track_t *track = calloc( sizeof( hb_track_t ), 1 );
     track->mux_data = mux_data;
+    track->fifo = fifo;
+    track->continuous = is_continuous;
     track->mf.flen = 8;
     track->mf.fifo = calloc( sizeof(track->mf.fifo[0]), track->mf.flen );
 
     int t = mux->ntracks++;
     mux->track[t] = track;
-    hb_bitvec_set(mux->allEof, t);
     if (is_continuous)
-        hb_bitvec_set(mux->allRdy, t);
+        mux->nstarved++;
+    if (fifo != NULL)
+        hb_fifo_group_add(mux->fifo_group, fifo);
+}
+
+static hb_buffer_t *mf_peek( hb_track_t *track )
+{
+    return track->mf.out == track->mf.in ?
+                NULL : track->mf.fifo[track->mf.out & (track->mf.flen - 1)];
 }
 
-static int mf_full( hb_track_t * track )
+// Heap order: start time of the track's next buf, ties go to the lower
+// track number so video comes before audio.
+static int heap_less( hb_mux_t * mux, int tk1, int tk2 )
 {
-    if ( track->buffered_size > MAX_BUFFERING )
-        return 1;
+    int64_t start1 = mf_peek( mux->track[tk1] )->s.start;
+    int64_t start2 = mf_peek( mux->track[tk2] )->s.start;
 
-    return 0;
+    return start1 < start2 || ( start1 == start2 && tk1 < tk2 );
+}
+
+static void heap_push( hb_mux_t * mux, int tk )
+{
+    int ii = mux->nheap++, parent;
+
+    while ( ii > 0 )
+    {
+        parent = ( ii - 1 ) / 2;
+        if ( !heap_less( mux, tk, mux->heap[parent] ) )
+            break;
+        mux->heap[ii] = mux->heap[parent];
+        ii = parent;
+    }
+    mux->heap[ii] = tk;
+}
+
+static int heap_pop( hb_mux_t * mux )
+{
+    int top = mux->heap[0];
+    int tk = mux->heap[--mux->nheap];
+    int ii = 0, child;
+
+    while ( ( child = 2 * ii + 1 ) < mux->nheap )
+    {
+        if ( child + 1 < mux->nheap &&
+             heap_less( mux, mux->heap[child + 1], mux->heap[child] ) )
+            child++;
+        if ( !heap_less( mux, mux->heap[child], tk ) )
+            break;
+        mux->heap[ii] = mux->heap[child];
+        ii = child;
+    }
+    if ( mux->nheap > 0 )
+        mux->heap[ii] = tk;
+    return top;
+}
+
+// Encoders hand us packets in pool buffers sized for the largest packet
+// they could produce, so buffering up to MAX_BUFFERING bytes of small
+// packets as they come would pin many times that in pool blocks.  Small
+// packets are instead copied back to back into a slab and replaced with a
+// slice of it, and their pool blocks go straight back to the encoders.
+// The slab goes back to the pool in one piece once the muxer has written
+// all packets in it.
+static hb_buffer_t * mux_pack( hb_mux_t * mux, hb_buffer_t * buf )
+{
+    hb_buffer_t * packed;
+    int offset;
+
+    if ( buf->size >= buf->alloc / 8 && buf->data != NULL )
+    {
+        // Uses its allocation well enough to be kept as it is
+        return buf;
+    }
+    if ( buf->size > MUX_SLAB_SIZE / 8 )
+    {
+        hb_buffer_reduce( buf, buf->size );
+        return buf;
+    }
+
+    offset = ( mux->slab_used + MUX_SLAB_ALIGN - 1 ) & ~( MUX_SLAB_ALIGN - 1 );
+    if ( mux->slab == NULL || offset + buf->size > mux->slab->size )
+    {
+        // Drop our reference, the slab is freed along with the last
+        // packet still sliced out of it.
+        hb_buffer_close( &mux->slab );
+        mux->slab = hb_buffer_init( MUX_SLAB_SIZE );
+        if ( mux->slab == NULL )
+        {
+            return buf;
+        }
+        offset = 0;
+    }
+    if ( buf->size > 0 )
+    {
+        memcpy( mux->slab->data + offset, buf->data, buf->size );
+    }
+    packed = hb_buffer_slice( mux->slab, offset, buf->size );
+    if ( packed == NULL )
+    {
+        return buf;
+    }
+    packed->s = buf->s;
+    packed->sequence = buf->sequence;
+    mux->slab_used = offset + buf->size;
+    hb_buffer_close( &buf );
+
+    return packed;
 }
 
 static void mf_push( hb_mux_t * mux, int tk, hb_buffer_t *buf )
@@ -260,12 +256,9 @@ static void mf_push( hb_mux_t * mux, int tk, hb_buffer_t *buf )
     hb_track_t * track = mux->track[tk];
     uint32_t mask = track->mf.flen - 1;
     uint32_t in = track->mf.in;
+    int empty = ( track->mf.out == in );
 
-    hb_buffer_reduce( buf, buf->size );
-    if ( track->buffered_size > MAX_BUFFERING )
-    {
-        hb_bitvec_cpy(mux->rdy, mux->allRdy);
-    }
+    buf = mux_pack( mux, buf );
     if ( ( ( in + 1 ) & mask ) == ( track->mf.out & mask ) )
     {
         // fifo is full - expand it to double the current size.
@@ -294,8 +287,20 @@ static void mf_push( hb_mux_t * mux, int tk, hb_buffer_t *buf )
     }
     track->mf.fifo[in & mask] = buf;
     track->mf.in = in + 1;
+    if ( track->buffered_size <= MAX_BUFFERING &&
+         track->buffered_size + buf->size > MAX_BUFFERING )
+    {
+        mux->nfull++;
+    }
     track->buffered_size += buf->size;
     mux->buffered_size += buf->size;
+
+    if ( empty )
+    {
+        if ( track->continuous )
+            mux->nstarved--;
+        heap_push( mux, tk );
+    }
 }
 
 static hb_buffer_t *mf_pull( hb_mux_t * mux, int tk )
@@ -308,44 +313,90 @@ static hb_buffer_t *mf_pull( hb_mux_t * mux, int tk )
         b = track->mf.fifo[track->mf.out & (track->mf.flen - 1)];
         ++track->mf.out;
 
+        if ( track->buffered_size > MAX_BUFFERING &&
+             track->buffered_size - b->size <= MAX_BUFFERING )
+        {
+            mux->nfull--;
+        }
         track->buffered_size -= b->size;
         mux->buffered_size -= b->size;
     }
     return b;
 }
 
-static hb_buffer_t *mf_peek( hb_track_t *track )
+static void mux_add( hb_mux_t *mux, int tk, hb_job_t *job, hb_buffer_t *buf )
 {
-    return track->mf.out == track->mf.in ?
-                NULL : track->mf.fifo[track->mf.out & (track->mf.flen - 1)];
-}
+    hb_track_t *track = mux->track[tk];
 
-static void MoveToInternalFifos( int tk, hb_mux_t *mux, hb_buffer_t * buf )
-{
-    // move all the buffers on the track's fifo to our internal
-    // fifo so that (a) we don't deadlock in the reader and
-    // (b) we can control how data from multiple tracks is
-    // interleaved in the output file.
-    mf_push( mux, tk, buf );
-    if ( buf->s.start >= mux->pts )
+    if ( buf->size <= 0 )
     {
-        // buffer is past our next interleave point so
-        // note that this track is ready to be output.
-        hb_bitvec_set(mux->rdy, tk);
+        // EOF - mark this track as done
+        hb_buffer_close( &buf );
+        if ( !track->eof )
+        {
+            track->eof = 1;
+            mux->neof++;
+            if ( track->continuous && track->mf.out == track->mf.in )
+                mux->nstarved--;
+        }
+    }
+    else if ((job->pass != 0 && job->pass != 2) || track->eof)
+    {
+        hb_buffer_close( &buf );
+    }
+    else
+    {
+        // move all the buffers on the track's fifo to our internal
+        // fifo so that (a) we don't deadlock in the reader and
+        // (b) we can control how data from multiple tracks is
+        // interleaved in the output file.
+        mf_push( mux, tk, buf );
     }
 }
 
-static void OutputTrackChunk( hb_mux_t *mux, int tk, hb_mux_object_t *m )
+// Writes bufs in timestamp order for as long as no continuous track can
+// still come up with an earlier one, or buffering limits force us to.
+static void OutputTracks( hb_mux_t *mux )
 {
-    hb_track_t *track = mux->track[tk];
+    hb_track_t *track;
     hb_buffer_t *buf;
+    int tk;
 
-    while ( ( buf = mf_peek( track ) ) != NULL && buf->s.start < mux->pts )
+    while ( mux->nheap > 0 &&
+            ( mux->neof == mux->ntracks || mux->nfull > 0 ||
+              ( mux->nstarved == 0 && mux->buffered_size > MIN_BUFFERING ) ) )
     {
+        tk = heap_pop( mux );
+        track = mux->track[tk];
         buf = mf_pull( mux, tk );
+        if ( track->mf.out != track->mf.in )
+        {
+            heap_push( mux, tk );
+        }
+        else if ( track->continuous && !track->eof )
+        {
+            mux->nstarved++;
+        }
+
+        if ( buf->s.stop > mux->pts )
+            mux->pts = buf->s.stop;
         track->frames += 1;
         track->bytes  += buf->size;
-        m->mux( m, track->mux_data, buf );
+        if ( mux->m )
+        {
+            mux->m->mux( mux->m, track->mux_data, buf );
+        }
+        else
+        {
+            hb_buffer_close( &buf );
+        }
+    }
+
+    // if all the tracks are at eof and their internal fifos are
+    // empty we're done.
+    if ( mux->neof == mux->ntracks && mux->nheap == 0 )
+    {
+        mux->done = 1;
     }
 }
 
@@ -353,106 +404,55 @@ static int muxWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
                      hb_buffer_t ** buf_out )
 {
     hb_work_private_t * pv = w->private_data;
-    hb_job_t    * job = pv->job;
     hb_mux_t    * mux = pv->mux;
-    hb_track_t  * track;
-    int           i;
-    hb_buffer_t * buf = *buf_in;
 
-    hb_lock( mux->mutex );
     if ( mux->done )
     {
-        hb_unlock( mux->mutex );
         return HB_WORK_DONE;
     }
 
-    if ( buf->size <= 0 )
-    {
-        // EOF - mark this track as done
-        hb_buffer_close( &buf );
-        hb_bitvec_set(mux->eof, pv->track);
-        hb_bitvec_set(mux->rdy, pv->track);
-    }
-    else if ((job->pass != 0 && job->pass != 2) ||
-             hb_bitvec_bit(mux->eof, pv->track))
-    {
-        hb_buffer_close( &buf );
-    }
-    else
-    {
-        MoveToInternalFifos( pv->track, mux, buf );
-    }
+    mux_add( mux, pv->track, pv->job, *buf_in );
     *buf_in = NULL;
+    OutputTracks( mux );
 
-    if (!hb_bitvec_and_cmp(mux->rdy, mux->allRdy, mux->allRdy) &&
-        !hb_bitvec_and_cmp(mux->eof, mux->allEof, mux->allEof))
-    {
-        hb_unlock( mux->mutex );
-        return HB_WORK_OK;
-    }
+    return mux->done ? HB_WORK_DONE : HB_WORK_OK;
+}
+
+/***********************************************************************
+ * hb_muxer_loop
+ ***********************************************************************
+ * Muxes all tracks until they're done.  Runs in do_job's thread, the
+ * one thread that reads the fifos of all tracks.
+ **********************************************************************/
+void hb_muxer_loop( hb_work_object_t * w )
+{
+    hb_work_private_t * pv = w->private_data;
+    hb_job_t          * job = pv->job;
+    hb_mux_t          * mux = pv->mux;
+    hb_buffer_t       * buf;
+    int                 i, moved;
 
-    hb_bitvec_t *more;
-    more = hb_bitvec_new(0);
-    hb_bitvec_cpy(more, mux->rdy);
-    // all tracks have at least 'interleave' ticks of data. Output
-    // all that we can in 'interleave' size chunks.
-    while ((hb_bitvec_and_cmp(mux->rdy, mux->allRdy, mux->allRdy) &&
-            hb_bitvec_any(more) && mux->buffered_size > MIN_BUFFERING ) ||
-           (hb_bitvec_cmp(mux->eof, mux->allEof)))
+    while ( !*job->die && !mux->done )
     {
-        hb_bitvec_zero(more);
+        moved = 0;
         for ( i = 0; i < mux->ntracks; ++i )
         {
-            track = mux->track[i];
-            OutputTrackChunk( mux, i, mux->m );
-            if ( mf_full( track ) )
+            while ( ( buf = hb_fifo_get( mux->track[i]->fifo ) ) != NULL )
             {
-                // If the track's fifo is still full, advance
-                // the currint interleave point and try again.
-                hb_bitvec_cpy(mux->rdy, mux->allRdy);
-                break;
-            }
-
-            // if the track is at eof or still has data that's past
-            // our next interleave point then leave it marked as rdy.
-            // Otherwise clear rdy.
-            if (hb_bitvec_bit(mux->eof, i) &&
-                (track->mf.out == track->mf.in ||
-                 track->mf.fifo[(track->mf.in-1) & (track->mf.flen-1)]->s.start
-                     < mux->pts + mux->interleave))
-            {
-                hb_bitvec_clr(mux->rdy, i);
-            }
-            if ( track->mf.out != track->mf.in )
-            {
-                hb_bitvec_set(more, i);
+                mux_add( mux, i, job, buf );
+                moved = 1;
             }
         }
-
-        // if all the tracks are at eof we're just purging their
-        // remaining data -- keep going until all internal fifos are empty.
-        if (hb_bitvec_cmp(mux->eof, mux->allEof))
+        if ( moved )
         {
-            for ( i = 0; i < mux->ntracks; ++i )
-            {
-                if ( mux->track[i]->mf.out != mux->track[i]->mf.in )
-                {
-                    break;
-                }
-            }
-            if ( i >= mux->ntracks )
-            {
-                mux->done = 1;
-                hb_unlock( mux->mutex );
-                return HB_WORK_DONE;
-            }
+            OutputTracks( mux );
+        }
+        else
+        {
+            hb_fifo_group_wait( mux->fifo_group );
         }
-        mux->pts += mux->interleave;
     }
-    hb_bitvec_free(&more);
-
-    hb_unlock( mux->mutex );
-    return HB_WORK_OK;
+    w->status = HB_WORK_DONE;
 }
 
 void muxClose( hb_work_object_t * w )
@@ -463,151 +463,94 @@ void muxClose( hb_work_object_t * w )
     hb_track_t  * track;
     int           i;
 
-    hb_lock( mux->mutex );
-    if ( --mux->ref == 0 )
+    // Update state before closing muxer.  Closing the muxer
+    // may initiate optimization which can take a while and
+    // we want the muxing state to be visible while this is
+    // happening.
+    if( job->pass == 0 || job->pass == 2 )
     {
-        // Update state before closing muxer.  Closing the muxer
-        // may initiate optimization which can take a while and
-        // we want the muxing state to be visible while this is
-        // happening.
-        if( job->pass == 0 || job->pass == 2 )
-        {
-            /* Update the UI */
-            hb_state_t state;
-            state.state = HB_STATE_MUXING;
-            state.param.muxing.progress = 0;
-            hb_set_state( job->h, &state );
-        }
+        /* Update the UI */
+        hb_state_t state;
+        state.state = HB_STATE_MUXING;
+        state.param.muxing.progress = 0;
+        hb_set_job_state( job, &state );
+    }
 
-        if( mux->m )
-        {
-            mux->m->end( mux->m );
-            free( mux->m );
-        }
+    if( mux->m )
+    {
+        mux->m->end( mux->m );
+        free( mux->m );
+    }
+
+    // we're all done muxing -- print final stats and cleanup.
+    if( job->pass == 0 || job->pass == 2 )
+    {
+        hb_stat_t sb;
+        uint64_t bytes_total, frames_total;
 
-        // we're all done muxing -- print final stats and cleanup.
-        if( job->pass == 0 || job->pass == 2 )
+        if (!hb_stat(job->file, &sb))
         {
-            hb_stat_t sb;
-            uint64_t bytes_total, frames_total;
+            hb_deep_log( 2, "mux: file size, %"PRId64" bytes", (uint64_t) sb.st_size );
 
-            if (!hb_stat(job->file, &sb))
+            bytes_total  = 0;
+            frames_total = 0;
+            for( i = 0; i < mux->ntracks; ++i )
             {
-                hb_deep_log( 2, "mux: file size, %"PRId64" bytes", (uint64_t) sb.st_size );
-
-                bytes_total  = 0;
-                frames_total = 0;
-                for( i = 0; i < mux->ntracks; ++i )
-                {
-                    track = mux->track[i];
-                    hb_log( "mux: track %d, %"PRId64" frames, %"PRId64" bytes, %.2f kbps, fifo %d",
-                            i, track->frames, track->bytes,
-                            90000.0 * track->bytes / mux->pts / 125,
-                            track->mf.flen );
-                    if( !i && job->vquality < 0 )
-                    {
-                        /* Video */
-                        hb_deep_log( 2, "mux: video bitrate error, %+"PRId64" bytes",
-                                (int64_t)(track->bytes - mux->pts * job->vbitrate * 125 / 90000) );
-                    }
-                    bytes_total  += track->bytes;
-                    frames_total += track->frames;
-                }
-
-                if( bytes_total && frames_total )
+                track = mux->track[i];
+                hb_log( "mux: track %d, %"PRId64" frames, %"PRId64" bytes, %.2f kbps, fifo %d",
+                        i, track->frames, track->bytes,
+                        90000.0 * track->bytes / mux->pts / 125,
+                        track->mf.flen );
+                if( !i && job->vquality < 0 )
                 {
-                    hb_deep_log( 2, "mux: overhead, %.2f bytes per frame",
-                            (float) ( sb.st_size - bytes_total ) /
-                            frames_total );
+                    /* Video */
+                    hb_deep_log( 2, "mux: video bitrate error, %+"PRId64" bytes",
+                            (int64_t)(track->bytes - mux->pts * job->vbitrate * 125 / 90000) );
                 }
+                bytes_total  += track->bytes;
+                frames_total += track->frames;
             }
-        }
 
-        for( i = 0; i < mux->ntracks; ++i )
-        {
-            hb_buffer_t * b;
-            track = mux->track[i];
-            while ( (b = mf_pull( mux, i )) != NULL )
+            if( bytes_total && frames_total )
             {
-                hb_buffer_close( &b );
+                hb_deep_log( 2, "mux: overhead, %.2f bytes per frame",
+                        (float) ( sb.st_size - bytes_total ) /
+                        frames_total );
             }
-            if( track->mux_data )
-            {
-                free( track->mux_data );
-                free( track->mf.fifo );
-            }
-            free( track );
         }
-        hb_unlock( mux->mutex );
-        hb_lock_close( &mux->mutex );
-        hb_bitvec_free(&mux->eof);
-        hb_bitvec_free(&mux->rdy);
-        hb_bitvec_free(&mux->allEof);
-        hb_bitvec_free(&mux->allRdy);
-        free( mux );
     }
-    else
-    {
-        hb_unlock( mux->mutex );
-    }
-    free( pv );
-    w->private_data = NULL;
-}
-
-static void mux_loop( void * _w )
-{
-    hb_work_object_t  * w = _w;
-    hb_work_private_t * pv = w->private_data;
-    hb_job_t          * job = pv->job;
-    hb_buffer_t       * buf_in;
 
-    while ( !*job->die && w->status != HB_WORK_DONE )
+    for( i = 0; i < mux->ntracks; ++i )
     {
-        buf_in = hb_fifo_get_wait( w->fifo_in );
-        if ( pv->mux->done )
-            break;
-        if ( buf_in == NULL )
-            continue;
-        if ( *job->die )
+        hb_buffer_t * b;
+        track = mux->track[i];
+        while ( (b = mf_pull( mux, i )) != NULL )
         {
-            if( buf_in )
-            {
-                hb_buffer_close( &buf_in );
-            }
-            break;
+            hb_buffer_close( &b );
         }
-
-        w->status = w->work( w, &buf_in, NULL );
-        if( buf_in )
+        if( track->mux_data )
         {
-            hb_buffer_close( &buf_in );
+            free( track->mux_data );
+            free( track->mf.fifo );
         }
+        free( track );
     }
+    hb_buffer_close( &mux->slab );
+    hb_fifo_group_close( &mux->fifo_group );
+    free( mux->track );
+    free( mux->heap );
+    free( mux );
+    free( pv );
+    w->private_data = NULL;
 }
 
 hb_work_object_t * hb_muxer_init( hb_job_t * job )
 {
     int           i;
     hb_mux_t    * mux = calloc( sizeof( hb_mux_t ), 1 );
-    hb_work_object_t  * w;
     hb_work_object_t  * muxer;
 
-    // The bit vectors must be allocated before hb_thread_init for the
-    // audio and subtitle muxer jobs below.
-    int bit_vec_size = 1 + hb_list_count(job->list_audio) +
-                           hb_list_count(job->list_subtitle);
-    mux->rdy = hb_bitvec_new(bit_vec_size);
-    mux->eof = hb_bitvec_new(bit_vec_size);
-    mux->allRdy = hb_bitvec_new(bit_vec_size);
-    mux->allEof = hb_bitvec_new(bit_vec_size);
-
-    mux->mutex = hb_lock_init();
-
-    // set up to interleave track data in blocks of 1 video frame time.
-    // (the best case for buffering and playout latency). The container-
-    // specific muxers can reblock this into bigger chunks if necessary.
-    mux->interleave = 90000. * (double)job->vrate_base / (double)job->vrate;
-    mux->pts = mux->interleave;
+    mux->fifo_group = hb_fifo_group_init();
 
     /* Get a real muxer */
     if( job->pass == 0 || job->pass == 2)
@@ -643,33 +586,22 @@ hb_work_object_t * hb_muxer_init( hb_job_t * job )
         }
     }
 
-    /* Initialize the work objects that will receive fifo data */
+    /* Initialize the work object that muxes all tracks */
 
     muxer = hb_get_work( WORK_MUX );
     muxer->private_data = calloc( sizeof( hb_work_private_t ), 1 );
     muxer->private_data->job = job;
     muxer->private_data->mux = mux;
-    mux->ref++;
     muxer->private_data->track = mux->ntracks;
     muxer->fifo_in = job->fifo_mpeg4;
-    add_mux_track( mux, job->mux_data, 1 );
+    add_mux_track( mux, job->mux_data, job->fifo_mpeg4, 1 );
     muxer->done = &muxer->private_data->mux->done;
 
     for( i = 0; i < hb_list_count( job->list_audio ); i++ )
     {
         hb_audio_t  *audio = hb_list_item( job->list_audio, i );
 
-        w = hb_get_work( WORK_MUX );
-        w->private_data = calloc( sizeof( hb_work_private_t ), 1 );
-        w->private_data->job = job;
-        w->private_data->mux = mux;
-        mux->ref++;
-        w->private_data->track = mux->ntracks;
-        w->fifo_in = audio->priv.fifo_out;
-        add_mux_track( mux, audio->priv.mux_data, 1 );
-        w->done = &job->done;
-        hb_list_add( job->list_work, w );
-        w->thread = hb_thread_init( w->name, mux_loop, w, HB_NORMAL_PRIORITY );
+        add_mux_track( mux, audio->priv.mux_data, audio->priv.fifo_out, 1 );
     }
 
     for( i = 0; i < hb_list_count( job->list_subtitle ); i++ )
@@ -679,17 +611,7 @@ hb_work_object_t * hb_muxer_init( hb_job_t * job )
         if (subtitle->config.dest != PASSTHRUSUB)
             continue;
 
-        w = hb_get_work( WORK_MUX );
-        w->private_data = calloc( sizeof( hb_work_private_t ), 1 );
-        w->private_data->job = job;
-        w->private_data->mux = mux;
-        mux->ref++;
-        w->private_data->track = mux->ntracks;
-        w->fifo_in = subtitle->fifo_out;
-        add_mux_track( mux, subtitle->mux_data, 0 );
-        w->done = &job->done;
-        hb_list_add( job->list_work, w );
-        w->thread = hb_thread_init( w->name, mux_loop, w, HB_NORMAL_PRIORITY );
+        add_mux_track( mux, subtitle->mux_data, subtitle->fifo_out, 0 );
     }
     return muxer;
 }
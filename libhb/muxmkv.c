@@ -23,6 +23,9 @@
 #define NANOSECOND_SCALE 1000000000L
 #define TIMECODE_SCALE 1000000000L / 90000
 
+/* From contrib/libmkv/A03-writer-fp.patch */
+mk_Writer *mk_createWriterFp(FILE *fp, int64_t timescale, uint8_t vlc_compat);
+
 struct hb_mux_object_s
 {
     HB_MUX_COMMON;
@@ -130,7 +133,24 @@ static int MKVInit( hb_mux_object_t * m )
         return 0;
     }
 
-    m->file = mk_createWriter(path, 1000000, 1);
+    // Write through hb_writer where the C library can wrap it in a
+    // stream, libmkv doesn't know any other way to write
+    hb_writer_t *writer = hb_writer_open(job->file, hb_writer_estimate(job),
+                                         job->die);
+    FILE *stream = writer != NULL ? hb_writer_stream(writer) : NULL;
+    if (stream != NULL)
+    {
+        m->file = mk_createWriterFp(stream, 1000000, 1);
+        if (m->file == NULL)
+        {
+            fclose(stream);
+        }
+    }
+    else
+    {
+        hb_writer_close(&writer);
+        m->file = mk_createWriter(path, 1000000, 1);
+    }
     free(path);
 
     if( !m->file )
@@ -230,7 +250,7 @@ static int MKVInit( hb_mux_object_t * m )
     int vrate_base, vrate;
     if( job->pass == 2 )
     {
-        hb_interjob_t * interjob = hb_interjob_get( job->h );
+        hb_interjob_t * interjob = job->interjob;
         vrate_base = interjob->vrate_base;
         vrate = interjob->vrate;
     }
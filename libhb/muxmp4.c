@@ -13,6 +13,11 @@
 
 #include "mp4v2/mp4v2.h"
 
+/* mp4v2 2.0 lets us do the file I/O, through hb_writer */
+#if defined(MP4V2_PROJECT_version_hex) && MP4V2_PROJECT_version_hex >= 0x00020000
+#define HB_MP4_WRITER
+#endif
+
 struct hb_mux_object_s
 {
     HB_MUX_COMMON;
@@ -82,6 +87,96 @@ static const uint16_t ac3_bitrate_tab[19] = {
 };  
 
 
+#if defined(HB_MP4_WRITER)
+/* The provider's open gets no context, the writer for it is handed over
+ * here while MP4CreateWriter holds mp4_open_lock */
+static hb_lock_t   * mp4_open_lock;
+static hb_writer_t * mp4_open_writer;
+
+static void * MP4WriterOpen( const char * name, MP4FileMode mode )
+{
+    hb_writer_t * w = mp4_open_writer;
+
+    if( mode != FILEMODE_CREATE )
+    {
+        return NULL;
+    }
+    mp4_open_writer = NULL;
+    return w;
+}
+
+static int MP4WriterSeek( void * w, int64_t pos )
+{
+    return hb_writer_seek( w, pos ) < 0;
+}
+
+static int MP4WriterRead( void * w, void * buffer, int64_t size,
+                          int64_t * nin, int64_t maxChunkSize )
+{
+    // Only ever written
+    return 1;
+}
+
+static int MP4WriterWrite( void * w, const void * buffer, int64_t size,
+                           int64_t * nout, int64_t maxChunkSize )
+{
+    if( size > INT_MAX ||
+        hb_writer_write( w, (const uint8_t*)buffer, size ) < 0 )
+    {
+        return 1;
+    }
+    *nout = size;
+    return 0;
+}
+
+static int MP4WriterClose( void * w )
+{
+    hb_writer_t * writer = w;
+    return hb_writer_close( &writer ) < 0;
+}
+
+static const MP4FileProvider mp4_writer_provider =
+{
+    MP4WriterOpen,
+    MP4WriterSeek,
+    MP4WriterRead,
+    MP4WriterWrite,
+    MP4WriterClose,
+};
+#endif
+
+static MP4FileHandle MP4CreateWriter( hb_job_t * job, const char * path,
+                                      uint32_t flags )
+{
+#if defined(HB_MP4_WRITER)
+    MP4FileHandle file;
+    hb_writer_t * writer;
+
+    writer = hb_writer_open( job->file, hb_writer_estimate( job ), job->die );
+    if( writer == NULL )
+    {
+        return MP4_INVALID_FILE_HANDLE;
+    }
+    if( mp4_open_lock == NULL )
+    {
+        mp4_open_lock = hb_lock_init();
+    }
+    hb_lock( mp4_open_lock );
+    mp4_open_writer = writer;
+    file = MP4CreateProvider( path, flags, &mp4_writer_provider );
+    writer = mp4_open_writer;
+    mp4_open_writer = NULL;
+    hb_unlock( mp4_open_lock );
+
+    // mp4v2 owns the writer once it opened it
+    hb_writer_close( &writer );
+    return file;
+#else
+    // Older mp4v2 only writes files it opens itself
+    return MP4Create( path, MP4_DETAILS_ERROR, flags );
+#endif
+}
+
 /**********************************************************************
  * MP4Init
  **********************************************************************
@@ -120,13 +215,13 @@ static int MP4Init( hb_mux_object_t * m )
     if (job->largeFileSize)
     /* Use 64-bit MP4 file */
     {
-        m->file = MP4Create(m->path, MP4_DETAILS_ERROR, MP4_CREATE_64BIT_DATA);
+        m->file = MP4CreateWriter(job, m->path, MP4_CREATE_64BIT_DATA);
         hb_deep_log( 2, "muxmp4: using 64-bit MP4 formatting.");
     }
     else
     /* Limit MP4s to less than 4 GB */
     {
-        m->file = MP4Create(m->path, MP4_DETAILS_ERROR, 0);
+        m->file = MP4CreateWriter(job, m->path, 0);
     }
 
     if (m->file == MP4_INVALID_FILE_HANDLE)
@@ -52,6 +52,15 @@
 
 #include "hb.h"
 #include "hbffmpeg.h"
+#include "threadpool.h"
+
+#if ARCH_X86_64 || ARCH_X86_32
+#include <immintrin.h>
+#define NLMEANS_SSE2 1
+#if defined(AV_CPU_FLAG_AVX2)
+#define NLMEANS_AVX2 1
+#endif
+#endif
 
 #define NLMEANS_STRENGTH_LUMA_DEFAULT      8
 #define NLMEANS_STRENGTH_CHROMA_DEFAULT    8
@@ -96,11 +105,48 @@ typedef struct
     int border;
 } BorderedPlane;
 
-struct PixelSum
+// Description of the plane currently being filtered, shared by all
+// segment threads
+typedef struct
 {
-    float weight_sum;
-    float pixel_sum;
-};
+    BorderedPlane *plane_tmp;
+    int           *plane_ready;
+    uint8_t       *dst;
+    int            w;
+    int            h;
+    int            n;
+    int            r;
+    double         origin_tune;
+    float          weight_fact_table;
+    int            diff_max;
+    float          exptable[NLMEANS_EXPSIZE];
+} nlmeans_plane_args_t;
+
+// Row kernels, picked at init from the CPU flags
+typedef struct
+{
+    void (*integral_row)(uint32_t *out,
+                         const uint32_t *prev,
+                         const uint8_t *p1,
+                         const uint8_t *p2,
+                         int w);
+    void (*accumulate_row)(float *weight_sum,
+                           float *pixel_sum,
+                           const uint32_t *integral_ptr1,
+                           const uint32_t *integral_ptr2,
+                           const uint8_t *compare,
+                           int count,
+                           int n,
+                           int diff_max,
+                           float weight_fact_table,
+                           const float *exptable);
+} nlmeans_functions_t;
+
+typedef struct
+{
+    uint32_t            *integral_mem; // integral image of this segment
+    int                  integral_size;
+} nlmeans_segment_t;
 
 struct hb_filter_private_s
 {
@@ -113,6 +159,17 @@ struct hb_filter_private_s
 
     BorderedPlane frame_tmp[3][32];
     int           frame_ready[3][32];
+
+    // Per pixel weight and weighted pixel sums, kept for the lifetime
+    // of the filter rather than allocated for every plane
+    float        *weight_sum;
+    float        *pixel_sum;
+    int           sum_size;
+
+    int                  cpu_count;
+    nlmeans_segment_t   *segments;        // Per segment scratch - one per CPU
+    nlmeans_plane_args_t plane_args;
+    nlmeans_functions_t  functions;
 };
 
 static int hb_nlmeans_init(hb_filter_object_t *filter,
@@ -541,54 +598,327 @@ static void nlmeans_prefilter(BorderedPlane *src,
 
 }
 
-static void nlmeans_plane(BorderedPlane *plane_tmp,
-                          int *plane_ready,
-                          uint8_t *dst,
-                          int w,
-                          int h,
-                          double h_param,
-                          double origin_tune,
-                          int n,
-                          int r)
+// Builds one row of the integral image of squared differences between
+// p1 and p2, given the previous integral row
+static void nlmeans_integral_row_c(uint32_t *out,
+                                   const uint32_t *prev,
+                                   const uint8_t *p1,
+                                   const uint8_t *p2,
+                                   int w)
+{
+
+    uint32_t sum = 0;
+    for (int x = 0; x < w; x++)
+    {
+        int diff = p1[x] - p2[x];
+        sum   += diff * diff;
+        out[x] = sum + prev[x];
+    }
+
+}
+
+// Accumulates the weights of one row of patches
+static void nlmeans_accumulate_row_c(float *weight_sum,
+                                     float *pixel_sum,
+                                     const uint32_t *integral_ptr1,
+                                     const uint32_t *integral_ptr2,
+                                     const uint8_t *compare,
+                                     int count,
+                                     int n,
+                                     int diff_max,
+                                     float weight_fact_table,
+                                     const float *exptable)
+{
+
+    for (int x = 0; x < count; x++)
+    {
+        // Difference between patches
+        int diff = (uint32_t)(integral_ptr2[x+n] - integral_ptr2[x] - integral_ptr1[x+n] + integral_ptr1[x]);
+
+        // Sum pixel with weight
+        if (diff < diff_max)
+        {
+            int diffidx = diff * weight_fact_table;
+
+            //float weight = exp(-diff*weightFact);
+            float weight = exptable[diffidx];
+
+            weight_sum[x] += weight;
+            pixel_sum[x]  += weight * compare[x];
+        }
+    }
+
+}
+
+#ifdef NLMEANS_SSE2
+__attribute__((target("sse2")))
+static void nlmeans_integral_row_sse2(uint32_t *out,
+                                      const uint32_t *prev,
+                                      const uint8_t *p1,
+                                      const uint8_t *p2,
+                                      int w)
+{
+
+    const __m128i zero = _mm_setzero_si128();
+    __m128i carry      = zero;
+    int x              = 0;
+
+    for (; x <= w - 8; x += 8)
+    {
+        __m128i a  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p1 + x)), zero);
+        __m128i b  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p2 + x)), zero);
+        __m128i d  = _mm_sub_epi16(a, b);
+        // 255^2 fits an unsigned 16 bit lane
+        __m128i sq = _mm_mullo_epi16(d, d);
+        __m128i lo = _mm_unpacklo_epi16(sq, zero);
+        __m128i hi = _mm_unpackhi_epi16(sq, zero);
+
+        // Prefix sums within each vector, then add the running sum
+        lo    = _mm_add_epi32(lo, _mm_slli_si128(lo, 4));
+        lo    = _mm_add_epi32(lo, _mm_slli_si128(lo, 8));
+        lo    = _mm_add_epi32(lo, carry);
+        carry = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 3, 3, 3));
+        hi    = _mm_add_epi32(hi, _mm_slli_si128(hi, 4));
+        hi    = _mm_add_epi32(hi, _mm_slli_si128(hi, 8));
+        hi    = _mm_add_epi32(hi, carry);
+        carry = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 3, 3, 3));
+
+        _mm_storeu_si128((__m128i*)(out + x),
+            _mm_add_epi32(lo, _mm_loadu_si128((const __m128i*)(prev + x))));
+        _mm_storeu_si128((__m128i*)(out + x + 4),
+            _mm_add_epi32(hi, _mm_loadu_si128((const __m128i*)(prev + x + 4))));
+    }
+
+    uint32_t sum = _mm_cvtsi128_si32(carry);
+    for (; x < w; x++)
+    {
+        int diff = p1[x] - p2[x];
+        sum   += diff * diff;
+        out[x] = sum + prev[x];
+    }
+
+}
+
+__attribute__((target("sse2")))
+static void nlmeans_accumulate_row_sse2(float *weight_sum,
+                                        float *pixel_sum,
+                                        const uint32_t *integral_ptr1,
+                                        const uint32_t *integral_ptr2,
+                                        const uint8_t *compare,
+                                        int count,
+                                        int n,
+                                        int diff_max,
+                                        float weight_fact_table,
+                                        const float *exptable)
+{
+
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i dmax  = _mm_set1_epi32(diff_max);
+    const __m128  wfact = _mm_set1_ps(weight_fact_table);
+    int x               = 0;
+
+    for (; x <= count - 4; x += 4)
+    {
+        __m128i a    = _mm_loadu_si128((const __m128i*)(integral_ptr2 + x + n));
+        __m128i b    = _mm_loadu_si128((const __m128i*)(integral_ptr2 + x));
+        __m128i c    = _mm_loadu_si128((const __m128i*)(integral_ptr1 + x + n));
+        __m128i d    = _mm_loadu_si128((const __m128i*)(integral_ptr1 + x));
+        __m128i diff = _mm_add_epi32(_mm_sub_epi32(_mm_sub_epi32(a, b), c), d);
+        int mask     = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(diff, dmax)));
+
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        // No gather in SSE2, look up the weights one at a time.
+        // Lanes over diff_max get a weight of 0, which leaves their
+        // sums unchanged just like the C version.
+        int32_t diffidx[4];
+        _mm_storeu_si128((__m128i*)diffidx,
+                         _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(diff), wfact)));
+        __m128 weight = _mm_set_ps(mask & 8 ? exptable[diffidx[3]] : 0,
+                                   mask & 4 ? exptable[diffidx[2]] : 0,
+                                   mask & 2 ? exptable[diffidx[1]] : 0,
+                                   mask & 1 ? exptable[diffidx[0]] : 0);
+
+        int32_t pixels;
+        memcpy(&pixels, compare + x, sizeof(pixels));
+        __m128 pix = _mm_cvtepi32_ps(_mm_unpacklo_epi16(
+                         _mm_unpacklo_epi8(_mm_cvtsi32_si128(pixels), zero), zero));
+
+        _mm_storeu_ps(weight_sum + x, _mm_add_ps(_mm_loadu_ps(weight_sum + x), weight));
+        _mm_storeu_ps(pixel_sum + x,  _mm_add_ps(_mm_loadu_ps(pixel_sum + x),
+                                                 _mm_mul_ps(weight, pix)));
+    }
+
+    nlmeans_accumulate_row_c(weight_sum + x, pixel_sum + x,
+                             integral_ptr1 + x, integral_ptr2 + x,
+                             compare + x, count - x, n,
+                             diff_max, weight_fact_table, exptable);
+
+}
+
+#endif
+
+#ifdef NLMEANS_AVX2
+__attribute__((target("avx2")))
+static void nlmeans_integral_row_avx2(uint32_t *out,
+                                      const uint32_t *prev,
+                                      const uint8_t *p1,
+                                      const uint8_t *p2,
+                                      int w)
+{
+
+    const __m256i last = _mm256_set1_epi32(7);
+    __m256i carry      = _mm256_setzero_si256();
+    int x              = 0;
+
+    for (; x <= w - 8; x += 8)
+    {
+        __m256i a  = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p1 + x)));
+        __m256i b  = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p2 + x)));
+        __m256i d  = _mm256_sub_epi32(a, b);
+        __m256i sq = _mm256_mullo_epi32(d, d);
+
+        // Byte shifts stay within each 128 bit lane, so build the
+        // prefix sums per lane and then carry the low lane's total
+        // into the high lane
+        sq = _mm256_add_epi32(sq, _mm256_slli_si256(sq, 4));
+        sq = _mm256_add_epi32(sq, _mm256_slli_si256(sq, 8));
+        __m256i low = _mm256_shuffle_epi32(sq, _MM_SHUFFLE(3, 3, 3, 3));
+        sq    = _mm256_add_epi32(sq, _mm256_permute2x128_si256(low, low, 0x08));
+        sq    = _mm256_add_epi32(sq, carry);
+        carry = _mm256_permutevar8x32_epi32(sq, last);
+
+        _mm256_storeu_si256((__m256i*)(out + x),
+            _mm256_add_epi32(sq, _mm256_loadu_si256((const __m256i*)(prev + x))));
+    }
+
+    uint32_t sum = _mm_cvtsi128_si32(_mm256_castsi256_si128(carry));
+    for (; x < w; x++)
+    {
+        int diff = p1[x] - p2[x];
+        sum   += diff * diff;
+        out[x] = sum + prev[x];
+    }
+
+}
+
+__attribute__((target("avx2")))
+static void nlmeans_accumulate_row_avx2(float *weight_sum,
+                                        float *pixel_sum,
+                                        const uint32_t *integral_ptr1,
+                                        const uint32_t *integral_ptr2,
+                                        const uint8_t *compare,
+                                        int count,
+                                        int n,
+                                        int diff_max,
+                                        float weight_fact_table,
+                                        const float *exptable)
 {
 
+    const __m256i dmax  = _mm256_set1_epi32(diff_max);
+    const __m256  wfact = _mm256_set1_ps(weight_fact_table);
+    const __m256  zero  = _mm256_setzero_ps();
+    int x               = 0;
+
+    for (; x <= count - 8; x += 8)
+    {
+        __m256i a    = _mm256_loadu_si256((const __m256i*)(integral_ptr2 + x + n));
+        __m256i b    = _mm256_loadu_si256((const __m256i*)(integral_ptr2 + x));
+        __m256i c    = _mm256_loadu_si256((const __m256i*)(integral_ptr1 + x + n));
+        __m256i d    = _mm256_loadu_si256((const __m256i*)(integral_ptr1 + x));
+        __m256i diff = _mm256_add_epi32(_mm256_sub_epi32(_mm256_sub_epi32(a, b), c), d);
+        __m256i mask = _mm256_cmpgt_epi32(dmax, diff);
+
+        if (_mm256_testz_si256(mask, mask))
+        {
+            continue;
+        }
+
+        // Masked gather of the weights; lanes over diff_max are not
+        // loaded and get a weight of 0
+        __m256i diffidx = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(diff), wfact));
+        __m256  weight  = _mm256_mask_i32gather_ps(zero, exptable, diffidx,
+                                                   _mm256_castsi256_ps(mask), 4);
+        __m256  pix     = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+                              _mm_loadl_epi64((const __m128i*)(compare + x))));
+
+        _mm256_storeu_ps(weight_sum + x, _mm256_add_ps(_mm256_loadu_ps(weight_sum + x), weight));
+        _mm256_storeu_ps(pixel_sum + x,  _mm256_add_ps(_mm256_loadu_ps(pixel_sum + x),
+                                                       _mm256_mul_ps(weight, pix)));
+    }
+
+    nlmeans_accumulate_row_c(weight_sum + x, pixel_sum + x,
+                             integral_ptr1 + x, integral_ptr2 + x,
+                             compare + x, count - x, n,
+                             diff_max, weight_fact_table, exptable);
+
+}
+#endif
+
+/*
+ * Filter one horizontal segment of the current plane.
+ *
+ * Segments are made of whole rows of patches, so every segment owns
+ * the sums of its rows of output pixels and builds its own integral
+ * image covering just the source rows its patches span.
+ */
+static void nlmeans_plane_segment(void *pv_v, int segment)
+{
+
+    hb_filter_private_t *pv = pv_v;
+    nlmeans_segment_t *seg  = &pv->segments[segment];
+
+    nlmeans_plane_args_t *args = &pv->plane_args;
+
+    int w      = args->w;
+    int h      = args->h;
+    int n      = args->n;
     int n_half = (n-1) /2;
-    int r_half = (r-1) /2;
+    int r_half = (args->r-1) /2;
 
-    // Source image
-    uint8_t *src     = plane_tmp[0].image;
-    uint8_t *src_pre = plane_tmp[0].image_pre;
-    int src_w        = plane_tmp[0].w;
+    // Rows of patches handled by this segment
+    int rows = h - n + 1;
+    int y0   = rows *  segment      / pv->cpu_count;
+    int y1   = rows * (segment + 1) / pv->cpu_count;
+    if (y0 >= y1)
+    {
+        return;
+    }
 
-    // Allocate temporary pixel sums
-    struct PixelSum *tmp_data = calloc(w * h, sizeof(struct PixelSum));
+    // Source image
+    uint8_t *src     = args->plane_tmp[0].image;
+    uint8_t *src_pre = args->plane_tmp[0].image_pre;
+    int src_w        = args->plane_tmp[0].w;
 
-    // Allocate integral image
+    // Segment integral image; row -1 is all zeroes
     int integral_stride = w + 2*16;
-    uint32_t *integral_mem = malloc(integral_stride * (h+1) * sizeof(uint32_t));
-    uint32_t *integral     = integral_mem + integral_stride + 16;
-
-    // Precompute exponential table
-    float exptable[NLMEANS_EXPSIZE];
-    const float weight_factor       = 1.0/n/n / (h_param * h_param);
-    const float min_weight_in_table = 0.0005;
-    const float stretch             = NLMEANS_EXPSIZE / (-log(min_weight_in_table));
-    const float weight_fact_table   = weight_factor * stretch;
-    const int   diff_max            = NLMEANS_EXPSIZE / weight_fact_table;
-    for (int i = 0; i < NLMEANS_EXPSIZE; i++)
+    int integral_size   = integral_stride * (y1 - y0 + n);
+    if (seg->integral_size < integral_size)
     {
-        exptable[i] = exp(-i/stretch);
+        free(seg->integral_mem);
+        seg->integral_mem  = malloc(integral_size * sizeof(uint32_t));
+        seg->integral_size = integral_size;
     }
-    exptable[NLMEANS_EXPSIZE-1] = 0;
+    uint32_t *integral = seg->integral_mem + integral_stride + 16;
+    memset(integral-1 - integral_stride, 0, (w+1) * sizeof(uint32_t));
+
+    // Clear the sums of the output rows owned by this segment
+    float *weight_sum = pv->weight_sum;
+    float *pixel_sum  = pv->pixel_sum;
+    memset(weight_sum + (y0 + n_half)*w, 0, (y1 - y0) * w * sizeof(float));
+    memset(pixel_sum  + (y0 + n_half)*w, 0, (y1 - y0) * w * sizeof(float));
 
     // Iterate through available frames
-    for (int plane_index = 0; plane_ready[plane_index] == 1; plane_index++)
+    for (int plane_index = 0; args->plane_ready[plane_index] == 1; plane_index++)
     {
 
         // Compare image
-        uint8_t *compare     = plane_tmp[plane_index].image;
-        uint8_t *compare_pre = plane_tmp[plane_index].image_pre;
-        int compare_w        = plane_tmp[plane_index].w;
+        uint8_t *compare     = args->plane_tmp[plane_index].image;
+        uint8_t *compare_pre = args->plane_tmp[plane_index].image_pre;
+        int compare_w        = args->plane_tmp[plane_index].w;
 
         // Iterate through all displacements
         for (int dy = -r_half; dy <= r_half; dy++)
@@ -599,82 +929,121 @@ static void nlmeans_plane(BorderedPlane *plane_tmp,
                 // Apply special weight tuning to origin patch
                 if (dx == 0 && dy == 0 && plane_index == 0)
                 {
-                    // TODO: Parallelize this
-                    for (int y = n_half; y < h-n + n_half; y++)
+                    for (int y = y0 + n_half; y < y1 + n_half && y < h-n + n_half; y++)
                     {
                         for (int x = n_half; x < w-n + n_half; x++)
                         {
-                            tmp_data[y*w + x].weight_sum += origin_tune;
-                            tmp_data[y*w + x].pixel_sum  += origin_tune * src[y*src_w + x];
+                            weight_sum[y*w + x] += args->origin_tune;
+                            pixel_sum[y*w + x]  += args->origin_tune * src[y*src_w + x];
                         }
                     }
                     continue;
                 }
 
                 // Build integral
-                memset(integral-1 - integral_stride, 0, (w+1) * sizeof(uint32_t));
-                for (int y = 0; y < h; y++)
+                for (int y = 0; y < y1 - y0 + n - 1; y++)
                 {
-                    const uint8_t *p1 = src_pre + y*src_w;
-                    const uint8_t *p2 = compare_pre + (y+dy)*compare_w + dx;
-                    uint32_t *out = integral + (y*integral_stride) - 1;
-
-                    *out++ = 0;
-
-                    for (int x = 0; x < w; x++)
-                    {
-                        int diff = *p1++ - *p2++;
-                        *out = *(out-1) + diff * diff;
-                        out++;
-                    }
+                    uint32_t *out = integral + y*integral_stride;
 
-                    if (y > 0)
-                    {
-                        out = integral + y*integral_stride;
-
-                        for (int x = 0; x < w; x++)
-                        {
-                            *out += *(out - integral_stride);
-                            out++;
-                        }
-                    }
+                    out[-1] = 0;
+                    pv->functions.integral_row(out, out - integral_stride,
+                                               src_pre + (y0+y)*src_w,
+                                               compare_pre + (y0+y+dy)*compare_w + dx,
+                                               w);
                 }
 
                 // Average displacement
-                // TODO: Parallelize this
-                for (int y = 0; y <= h-n; y++)
+                for (int y = y0; y < y1; y++)
                 {
-                    const uint32_t *integral_ptr1 = integral + (y  -1)*integral_stride - 1;
-                    const uint32_t *integral_ptr2 = integral + (y+n-1)*integral_stride - 1;
+                    const uint32_t *integral_ptr1 = integral + (y-y0  -1)*integral_stride - 1;
+                    const uint32_t *integral_ptr2 = integral + (y-y0+n-1)*integral_stride - 1;
+                    int yc = y + n_half;
+
+                    pv->functions.accumulate_row(weight_sum + yc*w + n_half,
+                                                   pixel_sum  + yc*w + n_half,
+                                                   integral_ptr1,
+                                                   integral_ptr2,
+                                                   compare + (yc+dy)*compare_w + n_half + dx,
+                                                   w-n + 1,
+                                                   n,
+                                                   args->diff_max,
+                                                   args->weight_fact_table,
+                                                   args->exptable);
+                }
+            }
+        }
+    }
 
-                    for (int x = 0; x <= w-n; x++)
-                    {
-                        int xc = x + n_half;
-                        int yc = y + n_half;
+    // Copy main image
+    uint8_t result;
+    uint8_t *dst = args->dst;
+    for (int y = y0 + n_half; y < y1 + n_half; y++)
+    {
+        for (int x = n_half; x < w-n_half; x++)
+        {
+            result = (uint8_t)(pixel_sum[y*w + x] / weight_sum[y*w + x]);
+            *(dst + y*w + x) = result ? result : *(src + y*src_w + x);
+        }
+    }
 
-                        // Difference between patches
-                        int diff = (uint32_t)(integral_ptr2[n] - integral_ptr2[0] - integral_ptr1[n] + integral_ptr1[0]);
+}
 
-                        // Sum pixel with weight
-                        if (diff < diff_max)
-                        {
-                            int diffidx = diff * weight_fact_table;
+static void nlmeans_plane(hb_filter_private_t *pv,
+                          BorderedPlane *plane_tmp,
+                          int *plane_ready,
+                          uint8_t *dst,
+                          int w,
+                          int h,
+                          double h_param,
+                          double origin_tune,
+                          int n,
+                          int r)
+{
 
-                            //float weight = exp(-diff*weightFact);
-                            float weight = exptable[diffidx];
+    nlmeans_plane_args_t *args = &pv->plane_args;
 
-                            tmp_data[yc*w + xc].weight_sum += weight;
-                            tmp_data[yc*w + xc].pixel_sum  += weight * compare[(yc+dy)*compare_w + xc + dx];
-                        }
+    int n_half = (n-1) /2;
 
-                        integral_ptr1++;
-                        integral_ptr2++;
-                    }
-                }
-            }
-        }
+    // Source image
+    uint8_t *src     = plane_tmp[0].image;
+    int src_w        = plane_tmp[0].w;
+
+    // Temporary pixel sums, sized for the largest plane
+    if (pv->sum_size < w * h)
+    {
+        free(pv->weight_sum);
+        free(pv->pixel_sum);
+        pv->weight_sum = malloc(w * h * sizeof(float));
+        pv->pixel_sum  = malloc(w * h * sizeof(float));
+        pv->sum_size   = w * h;
     }
 
+    // Precompute exponential table
+    const float weight_factor       = 1.0/n/n / (h_param * h_param);
+    const float min_weight_in_table = 0.0005;
+    const float stretch             = NLMEANS_EXPSIZE / (-log(min_weight_in_table));
+    const float weight_fact_table   = weight_factor * stretch;
+    const int   diff_max            = NLMEANS_EXPSIZE / weight_fact_table;
+    for (int i = 0; i < NLMEANS_EXPSIZE; i++)
+    {
+        args->exptable[i] = exp(-i/stretch);
+    }
+    args->exptable[NLMEANS_EXPSIZE-1] = 0;
+
+    args->plane_tmp         = plane_tmp;
+    args->plane_ready       = plane_ready;
+    args->dst               = dst;
+    args->w                 = w;
+    args->h                 = h;
+    args->n                 = n;
+    args->r                 = r;
+    args->origin_tune       = origin_tune;
+    args->weight_fact_table = weight_fact_table;
+    args->diff_max          = diff_max;
+
+    // Filter the interior of the plane, one segment per CPU
+    hb_parallel_for(pv->cpu_count, nlmeans_plane_segment, pv);
+
     // Copy edges
     for (int y = 0; y < h; y++)
     {
@@ -690,20 +1059,6 @@ static void nlmeans_plane(BorderedPlane *plane_tmp,
         memcpy(dst + (h-y-1)*w, src + (y+h)*src_w, w);
     }
 
-    // Copy main image
-    uint8_t result;
-    for (int y = n_half; y < h-n_half; y++)
-    {
-        for (int x = n_half; x < w-n_half; x++)
-        {
-            result = (uint8_t)(tmp_data[y*w + x].pixel_sum / tmp_data[y*w + x].weight_sum);
-            *(dst + y*w + x) = result ? result : *(src + y*src_w + x);
-        }
-    }
-
-    free(tmp_data);
-    free(integral_mem);
-
 }
 
 static int hb_nlmeans_init(hb_filter_object_t *filter,
@@ -773,6 +1128,33 @@ static int hb_nlmeans_init(hb_filter_object_t *filter,
         }
     }
 
+    // Allocate NL-means segment scratch
+    pv->cpu_count = hb_get_cpu_count();
+    pv->segments  = calloc(pv->cpu_count, sizeof(nlmeans_segment_t));
+    if (pv->segments == NULL)
+    {
+        hb_error("NL-means could not allocate segments");
+        return -1;
+    }
+
+    // Pick the row kernels for this CPU
+    pv->functions.integral_row   = nlmeans_integral_row_c;
+    pv->functions.accumulate_row = nlmeans_accumulate_row_c;
+#ifdef NLMEANS_SSE2
+    if (hb_get_cpu_flags() & AV_CPU_FLAG_SSE2)
+    {
+        pv->functions.integral_row   = nlmeans_integral_row_sse2;
+        pv->functions.accumulate_row = nlmeans_accumulate_row_sse2;
+    }
+#endif
+#ifdef NLMEANS_AVX2
+    if (hb_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+    {
+        pv->functions.integral_row   = nlmeans_integral_row_avx2;
+        pv->functions.accumulate_row = nlmeans_accumulate_row_avx2;
+    }
+#endif
+
     return 0;
 }
 
@@ -803,6 +1185,18 @@ static void hb_nlmeans_close(hb_filter_object_t *filter)
         }
     }
 
+    if (pv->segments != NULL)
+    {
+        for (int ii = 0; ii < pv->cpu_count; ii++)
+        {
+            free(pv->segments[ii].integral_mem);
+        }
+        free(pv->segments);
+    }
+
+    free(pv->weight_sum);
+    free(pv->pixel_sum);
+
     free(pv);
     filter->private_data = NULL;
 }
@@ -876,7 +1270,8 @@ static int hb_nlmeans_work(hb_filter_object_t *filter,
         }
 
         // Process current plane
-        nlmeans_plane(pv->frame_tmp[c],
+        nlmeans_plane(pv,
+                      pv->frame_tmp[c],
                       pv->frame_ready[c],
                       out->plane[c].data,
                       in->plane[c].stride,
@@ -50,6 +50,7 @@
 #include <wchar.h>
 #include <mbctype.h>
 #include <locale.h>
+#include <io.h>
 #endif
 
 #ifdef SYS_SunOS
@@ -229,6 +230,7 @@ struct
         uint32_t buf4[12];
     };
     int count;
+    int flags;
 } hb_cpu_info;
 
 int hb_get_cpu_count()
@@ -236,6 +238,11 @@ int hb_get_cpu_count()
     return hb_cpu_info.count;
 }
 
+int hb_get_cpu_flags()
+{
+    return hb_cpu_info.flags;
+}
+
 int hb_get_cpu_platform()
 {
     return hb_cpu_info.platform;
@@ -291,8 +298,9 @@ static void init_cpu_info()
     hb_cpu_info.name     = NULL;
     hb_cpu_info.count    = init_cpu_count();
     hb_cpu_info.platform = HB_CPU_PLATFORM_UNSPECIFIED;
+    hb_cpu_info.flags    = av_get_cpu_flags();
 
-    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE)
+    if (hb_cpu_info.flags & AV_CPU_FLAG_SSE)
     {
 #if ARCH_X86_64 || ARCH_X86_32
         int eax, ebx, ecx, edx, family, model;
@@ -570,6 +578,36 @@ FILE * hb_fopen(const char *path, const char *mode)
 #endif
 }
 
+/************************************************************************
+ * hb_ftruncate
+ ************************************************************************
+ * Cuts an open file off at 'size' bytes, with 64 bit sizes on windows.
+ ***********************************************************************/
+int hb_ftruncate(FILE *file, int64_t size)
+{
+#ifdef SYS_MINGW
+    return _chsize_s(_fileno(file), size) ? -1 : 0;
+#else
+    return ftruncate(fileno(file), size);
+#endif
+}
+
+/************************************************************************
+ * hb_fpreallocate
+ ************************************************************************
+ * Asks the file system to set aside 'size' bytes for a file that is
+ * about to be written, without changing its size.  Only file systems
+ * that can do so natively are asked, returns -1 everywhere else.
+ ***********************************************************************/
+int hb_fpreallocate(FILE *file, int64_t size)
+{
+#if defined(SYS_LINUX) && defined(FALLOC_FL_KEEP_SIZE)
+    return fallocate(fileno(file), FALLOC_FL_KEEP_SIZE, 0, size);
+#else
+    return -1;
+#endif
+}
+
 HB_DIR* hb_opendir(char *path)
 {
 #ifdef SYS_MINGW
@@ -1045,6 +1083,52 @@ void hb_cond_broadcast( hb_cond_t * c )
 #endif
 }
 
+/************************************************************************
+ * Thread local storage
+ ***********************************************************************/
+#if !USE_PTHREAD
+#error "hb_tls_t needs pthreads"
+#endif
+
+struct hb_tls_s
+{
+    pthread_key_t key;
+};
+
+/************************************************************************
+ * hb_tls_init()
+ * hb_tls_get()
+ * hb_tls_set()
+ ************************************************************************
+ * A per-thread pointer. 'destructor' is called with the thread's value
+ * when a thread that set a non-NULL value exits. Keys are never freed.
+ ***********************************************************************/
+hb_tls_t * hb_tls_init( void (*destructor)( void * ) )
+{
+    hb_tls_t * tls = calloc( sizeof( hb_tls_t ), 1 );
+
+    if( tls == NULL )
+        return NULL;
+
+    if( pthread_key_create( &tls->key, destructor ) )
+    {
+        free( tls );
+        return NULL;
+    }
+
+    return tls;
+}
+
+void * hb_tls_get( hb_tls_t * tls )
+{
+    return pthread_getspecific( tls->key );
+}
+
+void hb_tls_set( hb_tls_t * tls, void * value )
+{
+    pthread_setspecific( tls->key, value );
+}
+
 /************************************************************************
  * Network
  ***********************************************************************/
@@ -35,6 +35,7 @@ enum hb_cpu_platform
     HB_CPU_PLATFORM_INTEL_HSW,
 };
 int         hb_get_cpu_count();
+int         hb_get_cpu_flags(); // libavutil AV_CPU_FLAG_* mask
 int         hb_get_cpu_platform();
 const char* hb_get_cpu_name();
 const char* hb_get_cpu_platform_name();
@@ -76,6 +77,8 @@ struct dirent * hb_readdir(HB_DIR *dir);
 int hb_mkdir(char * name);
 int hb_stat(const char *path, hb_stat_t *sb);
 FILE * hb_fopen(const char *path, const char *mode);
+int hb_ftruncate(FILE *file, int64_t size);
+int hb_fpreallocate(FILE *file, int64_t size);
 char * hb_strr_dir_sep(const char *path);
 
 #ifdef __LIBHB__
@@ -146,6 +149,31 @@ void        hb_cond_signal( hb_cond_t * );
 void        hb_cond_broadcast( hb_cond_t * c );
 void        hb_cond_close( hb_cond_t ** );
 
+/************************************************************************
+ * Thread local storage
+ ***********************************************************************/
+typedef struct hb_tls_s hb_tls_t;
+
+hb_tls_t  * hb_tls_init( void (*destructor)( void * ) );
+void      * hb_tls_get( hb_tls_t * );
+void        hb_tls_set( hb_tls_t *, void * );
+
+/************************************************************************
+ * Atomics
+ ************************************************************************
+ * Thin wrappers around the GCC/clang __atomic builtins. Loads have
+ * acquire semantics and stores have release semantics, which is what
+ * the lock-free producer/consumer code in libhb relies on.
+ ***********************************************************************/
+#define hb_atomic_load( p )      __atomic_load_n( (p), __ATOMIC_ACQUIRE )
+#define hb_atomic_store( p, v )  __atomic_store_n( (p), (v), __ATOMIC_RELEASE )
+#define hb_atomic_add( p, v )    __atomic_add_fetch( (p), (v), __ATOMIC_ACQ_REL )
+#define hb_atomic_sub( p, v )    __atomic_sub_fetch( (p), (v), __ATOMIC_ACQ_REL )
+#define hb_atomic_cas( p, e, v ) \
+    __atomic_compare_exchange_n( (p), (e), (v), 0, \
+                                 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE )
+#define hb_memory_barrier()      __atomic_thread_fence( __ATOMIC_SEQ_CST )
+
 /************************************************************************
  * Network
  ***********************************************************************/
@@ -0,0 +1,390 @@
+/* previewstore.c
+
+   Copyright (c) 2003-2014 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Scan previews are kept in memory as long as they fit in the store's
+ * byte budget.  When a new preview doesn't fit, the least recently used
+ * ones are written out to the temporary directory, under the same names
+ * and in the same packed planar layout hb_save_preview used to write
+ * them in, and are read back from there on demand.
+ *
+ * Previews are saved from the scan thread and its preview decoders and
+ * read from UI threads, so every entry point takes the store lock.
+ */
+
+#include <limits.h>
+#include "hb.h"
+
+#define HB_PREVIEW_STORE_BUCKETS 256
+
+typedef struct hb_preview_s hb_preview_t;
+
+struct hb_preview_s
+{
+    int            title;
+    int            preview;
+    uint8_t      * data;
+    int            size;
+
+    hb_preview_t * hash_next;
+    hb_preview_t * lru_prev;     /* toward the most recently used */
+    hb_preview_t * lru_next;     /* toward the least recently used */
+};
+
+struct hb_preview_store_s
+{
+    hb_handle_t  * h;
+    hb_lock_t    * lock;
+    int64_t        budget;
+    int64_t        used;
+    int            spilled;      /* some previews were written to disk */
+    hb_preview_t * lru_head;
+    hb_preview_t * lru_tail;
+    hb_preview_t * hash[HB_PREVIEW_STORE_BUCKETS];
+};
+
+static int hash_key( int title, int preview )
+{
+    return ( title * 31 + preview ) & ( HB_PREVIEW_STORE_BUCKETS - 1 );
+}
+
+static void preview_filename( hb_preview_store_t * store, char name[1024],
+                              int title, int preview )
+{
+    hb_get_tempory_filename( store->h, name, "%d_%d_%d",
+                             hb_get_instance_id( store->h ), title, preview );
+}
+
+static void lru_unlink( hb_preview_store_t * store, hb_preview_t * p )
+{
+    if( p->lru_prev != NULL )
+        p->lru_prev->lru_next = p->lru_next;
+    else
+        store->lru_head = p->lru_next;
+    if( p->lru_next != NULL )
+        p->lru_next->lru_prev = p->lru_prev;
+    else
+        store->lru_tail = p->lru_prev;
+    p->lru_prev = p->lru_next = NULL;
+}
+
+static void lru_push( hb_preview_store_t * store, hb_preview_t * p )
+{
+    p->lru_prev = NULL;
+    p->lru_next = store->lru_head;
+    if( store->lru_head != NULL )
+        store->lru_head->lru_prev = p;
+    else
+        store->lru_tail = p;
+    store->lru_head = p;
+}
+
+static hb_preview_t * lookup( hb_preview_store_t * store,
+                              int title, int preview )
+{
+    hb_preview_t * p = store->hash[hash_key( title, preview )];
+
+    while( p != NULL && ( p->title != title || p->preview != preview ) )
+    {
+        p = p->hash_next;
+    }
+    return p;
+}
+
+/*
+ * Unlink an entry from the store and return it to the caller, who owns
+ * it and its data afterwards.
+ */
+static hb_preview_t * detach( hb_preview_store_t * store, hb_preview_t * p )
+{
+    hb_preview_t ** pp = &store->hash[hash_key( p->title, p->preview )];
+
+    while( *pp != p )
+    {
+        pp = &(*pp)->hash_next;
+    }
+    *pp = p->hash_next;
+    lru_unlink( store, p );
+    store->used -= p->size;
+    return p;
+}
+
+static void preview_free( hb_preview_t * p )
+{
+    free( p->data );
+    free( p );
+}
+
+static int write_file( hb_preview_store_t * store, int title, int preview,
+                       const uint8_t * data, int size )
+{
+    FILE * file;
+    char   filename[1024];
+
+    preview_filename( store, filename, title, preview );
+    file = hb_fopen( filename, "wb" );
+    if( file == NULL )
+    {
+        hb_error( "hb_preview_store: fopen failed (%s)", filename );
+        return -1;
+    }
+    if( fwrite( data, size, 1, file ) != 1 )
+    {
+        hb_error( "hb_preview_store: write failed (%s)", filename );
+        fclose( file );
+        unlink( filename );
+        return -1;
+    }
+    fclose( file );
+    store->spilled = 1;
+    return 0;
+}
+
+static uint8_t * read_file( hb_preview_store_t * store, int title,
+                            int preview, int * size )
+{
+    FILE      * file;
+    char        filename[1024];
+    hb_stat_t   st;
+    uint8_t   * data;
+
+    preview_filename( store, filename, title, preview );
+    if( hb_stat( filename, &st ) || st.st_size <= 0 ||
+        st.st_size > INT_MAX )
+    {
+        return NULL;
+    }
+    file = hb_fopen( filename, "rb" );
+    if( file == NULL )
+    {
+        return NULL;
+    }
+    data = malloc( st.st_size );
+    if( data != NULL && fread( data, st.st_size, 1, file ) != 1 )
+    {
+        free( data );
+        data = NULL;
+    }
+    fclose( file );
+    if( data != NULL )
+    {
+        *size = st.st_size;
+    }
+    return data;
+}
+
+static void remove_file( hb_preview_store_t * store, int title, int preview )
+{
+    char filename[1024];
+
+    if( store->spilled )
+    {
+        preview_filename( store, filename, title, preview );
+        unlink( filename );
+    }
+}
+
+/*
+ * Move least recently used previews to disk until size more bytes fit
+ * in the budget.  Must be called with store->lock held.
+ */
+static void make_room( hb_preview_store_t * store, int64_t size )
+{
+    hb_preview_t * p;
+
+    while( store->used + size > store->budget &&
+           ( p = store->lru_tail ) != NULL )
+    {
+        detach( store, p );
+        write_file( store, p->title, p->preview, p->data, p->size );
+        preview_free( p );
+    }
+}
+
+/***********************************************************************
+ * hb_preview_store_init
+ ***********************************************************************
+ * budget is the number of bytes of previews kept in memory, 0 keeps
+ * them all on disk.
+ **********************************************************************/
+hb_preview_store_t * hb_preview_store_init( hb_handle_t * h, int64_t budget )
+{
+    hb_preview_store_t * store = calloc( 1, sizeof( hb_preview_store_t ) );
+
+    store->h      = h;
+    store->lock   = hb_lock_init();
+    store->budget = budget > 0 ? budget : 0;
+
+    return store;
+}
+
+void hb_preview_store_close( hb_preview_store_t ** _store )
+{
+    hb_preview_store_t * store = *_store;
+
+    if( store == NULL )
+    {
+        return;
+    }
+    hb_preview_store_clear( store );
+    hb_lock_close( &store->lock );
+    free( store );
+    *_store = NULL;
+}
+
+void hb_preview_store_set_budget( hb_preview_store_t * store, int64_t budget )
+{
+    hb_lock( store->lock );
+    store->budget = budget > 0 ? budget : 0;
+    make_room( store, 0 );
+    hb_unlock( store->lock );
+}
+
+/***********************************************************************
+ * hb_preview_store_put
+ ***********************************************************************
+ * Store a packed preview.  The store takes ownership of data.
+ **********************************************************************/
+int hb_preview_store_put( hb_preview_store_t * store, int title, int preview,
+                          uint8_t * data, int size )
+{
+    hb_preview_t * p;
+    int            result = 0;
+
+    hb_lock( store->lock );
+    p = lookup( store, title, preview );
+    if( p != NULL )
+    {
+        preview_free( detach( store, p ) );
+    }
+    if( size > store->budget )
+    {
+        // Too large to ever be kept in memory
+        result = write_file( store, title, preview, data, size );
+        free( data );
+        hb_unlock( store->lock );
+        return result;
+    }
+
+    make_room( store, size );
+    remove_file( store, title, preview );
+
+    p = calloc( 1, sizeof( hb_preview_t ) );
+    p->title   = title;
+    p->preview = preview;
+    p->data    = data;
+    p->size    = size;
+    p->hash_next = store->hash[hash_key( title, preview )];
+    store->hash[hash_key( title, preview )] = p;
+    lru_push( store, p );
+    store->used += size;
+    hb_unlock( store->lock );
+
+    return result;
+}
+
+/***********************************************************************
+ * hb_preview_store_get
+ ***********************************************************************
+ * Returns a copy of a packed preview that the caller must free, or NULL
+ * if there is no such preview.  Previews read back from disk are moved
+ * into memory when they fit.
+ **********************************************************************/
+uint8_t * hb_preview_store_get( hb_preview_store_t * store, int title,
+                                int preview, int * size )
+{
+    hb_preview_t * p;
+    uint8_t      * data = NULL;
+
+    hb_lock( store->lock );
+    p = lookup( store, title, preview );
+    if( p != NULL )
+    {
+        lru_unlink( store, p );
+        lru_push( store, p );
+        data = malloc( p->size );
+        if( data != NULL )
+        {
+            memcpy( data, p->data, p->size );
+            *size = p->size;
+        }
+        hb_unlock( store->lock );
+        return data;
+    }
+
+    data = store->spilled ? read_file( store, title, preview, size ) : NULL;
+    if( data != NULL && *size <= store->budget )
+    {
+        make_room( store, *size );
+
+        p = calloc( 1, sizeof( hb_preview_t ) );
+        p->title   = title;
+        p->preview = preview;
+        p->data    = malloc( *size );
+        p->size    = *size;
+        if( p->data != NULL )
+        {
+            memcpy( p->data, data, *size );
+            p->hash_next = store->hash[hash_key( title, preview )];
+            store->hash[hash_key( title, preview )] = p;
+            lru_push( store, p );
+            store->used += p->size;
+            remove_file( store, title, preview );
+        }
+        else
+        {
+            free( p );
+        }
+    }
+    hb_unlock( store->lock );
+
+    return data;
+}
+
+/*
+ * Drop every preview held in memory.  Previews that went to disk are
+ * removed along with the rest of the temporary files, see
+ * hb_remove_previews().
+ */
+void hb_preview_store_clear( hb_preview_store_t * store )
+{
+    hb_preview_t * p;
+
+    hb_lock( store->lock );
+    while( ( p = store->lru_head ) != NULL )
+    {
+        preview_free( detach( store, p ) );
+    }
+    hb_unlock( store->lock );
+}
+
+/*
+ * Drop the first count previews of one title, in memory or on disk.
+ */
+void hb_preview_store_clear_title( hb_preview_store_t * store, int title,
+                                   int count )
+{
+    hb_preview_t * p, * next;
+    int            ii;
+
+    hb_lock( store->lock );
+    for( p = store->lru_head; p != NULL; p = next )
+    {
+        next = p->lru_next;
+        if( p->title == title && p->preview < count )
+        {
+            preview_free( detach( store, p ) );
+        }
+    }
+    for( ii = 0; ii < count; ii++ )
+    {
+        remove_file( store, title, ii );
+    }
+    hb_unlock( store->lock );
+}
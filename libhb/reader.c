@@ -33,6 +33,31 @@ typedef struct
     int valid;      // Stream timing is not valid until next scr.
 } stream_timing_t;
 
+// Default read-ahead budget.  Sized to ride out a few hundred ms of
+// disc spin-up or network stall at Blu-ray bitrates.
+#define READER_PREFETCH_SIZE    (16 * 1024 * 1024)
+#define READER_PREFETCH_BLOCKS  8192
+
+/*
+ * Blocks read from the source by the prefetch thread that the demux loop
+ * has not consumed yet.  The queue is bounded both in blocks and in
+ * bytes of buffer memory.
+ */
+typedef struct
+{
+    hb_thread_t  * thread;
+    hb_lock_t    * lock;
+    hb_cond_t    * cond;            // signalled whenever the queue changes
+    hb_buffer_t  * first;
+    hb_buffer_t  * last;
+    int            count;
+    int            size;            // bytes of buffer memory queued
+    int            max_count;
+    int            max_size;        // 0 disables prefetching
+    int            stop;            // ask the prefetch thread to exit
+    int            eof;             // prefetch thread has exited
+} reader_prefetch_t;
+
 struct hb_work_private_s
 {
     hb_job_t     * job;
@@ -57,6 +82,9 @@ struct hb_work_private_s
     uint64_t       st_first;
     uint64_t       duration;
     hb_fifo_t    * fifos[100];
+
+    int            chapter_end;     // last on-media chapter to read
+    reader_prefetch_t prefetch;
 };
 
 /***********************************************************************
@@ -64,6 +92,8 @@ struct hb_work_private_s
  **********************************************************************/
 static hb_fifo_t ** GetFifoForId( hb_work_private_t * r, int id );
 static void UpdateState( hb_work_private_t  * r, int64_t start);
+static hb_buffer_t * reader_next( hb_work_private_t * r );
+static void reader_prefetch_stop( hb_work_private_t * r );
 
 /***********************************************************************
  * hb_reader_init
@@ -121,6 +151,16 @@ static int hb_reader_init( hb_work_object_t * w, hb_job_t * job )
 
     r->demux.last_scr = AV_NOPTS_VALUE;
 
+    r->prefetch.lock = hb_lock_init();
+    r->prefetch.cond = hb_cond_init();
+    r->prefetch.max_count = READER_PREFETCH_BLOCKS;
+    if ( job->reader_prefetch >= 0 )
+    {
+        r->prefetch.max_size = job->reader_prefetch ?
+                               job->reader_prefetch * 1024 :
+                               READER_PREFETCH_SIZE;
+    }
+
     if ( !job->pts_to_start )
         r->start_found = 1;
     else
@@ -158,6 +198,8 @@ static int hb_reader_init( hb_work_object_t * w, hb_job_t * job )
     // with the reader. Specifically avcodec needs this.
     if ( hb_reader_open( r ) )
     {
+        hb_lock_close( &r->prefetch.lock );
+        hb_cond_close( &r->prefetch.cond );
         free( r->stream_timing );
         free( r );
         return 1;
@@ -170,6 +212,11 @@ static void hb_reader_close( hb_work_object_t * w )
 {
     hb_work_private_t * r = w->private_data;
 
+    // The prefetch thread must be gone before the source is closed
+    reader_prefetch_stop( r );
+    hb_lock_close( &r->prefetch.lock );
+    hb_cond_close( &r->prefetch.cond );
+
     if (r->bd)
     {
         hb_bd_stop( r->bd );
@@ -339,6 +386,174 @@ static void new_scr_offset( hb_work_private_t *r, hb_buffer_t *buf )
     r->scr_changes = r->demux.scr_changes;
 }
 
+/*
+ * Read the next block from the source.  Returns NULL at the end of the
+ * title, after the last chapter of the job, or on a read error.
+ */
+static hb_buffer_t * reader_read( hb_work_private_t * r )
+{
+    int chapter = -1;
+
+    if (r->bd)
+        chapter = hb_bd_chapter( r->bd );
+    else if (r->dvd)
+        chapter = hb_dvd_chapter( r->dvd );
+    else if (r->stream)
+        chapter = hb_stream_chapter( r->stream );
+
+    if( chapter < 0 )
+    {
+        hb_log( "reader: end of the title reached" );
+        return NULL;
+    }
+    if( chapter > r->chapter_end )
+    {
+        hb_log( "reader: end of chapter %d (media %d) reached at media chapter %d",
+                r->job->chapter_end, r->chapter_end, chapter );
+        return NULL;
+    }
+
+    if (r->bd)
+        return hb_bd_read( r->bd );
+    else if (r->dvd)
+        return hb_dvd_read( r->dvd );
+    else if (r->stream)
+        return hb_stream_read( r->stream );
+    return NULL;
+}
+
+/*
+ * Prefetch thread.  Keeps reading blocks from the source into the
+ * prefetch queue until the queue is full, so that slow reads (disc
+ * seeks, network stalls) overlap with demuxing and decoding instead of
+ * stalling them.
+ */
+static void PrefetchLoop( void * _r )
+{
+    hb_work_private_t * r = _r;
+    reader_prefetch_t * p = &r->prefetch;
+    hb_buffer_t       * buf;
+
+    while ( !*r->die && !r->job->done )
+    {
+        hb_lock( p->lock );
+        while ( !p->stop && !*r->die && !r->job->done &&
+                ( p->count >= p->max_count || p->size >= p->max_size ) )
+        {
+            // die and done are not signalled on our cond, so poll them
+            hb_cond_timedwait( p->cond, p->lock, 100 );
+        }
+        if ( p->stop )
+        {
+            hb_unlock( p->lock );
+            break;
+        }
+        hb_unlock( p->lock );
+
+        buf = reader_read( r );
+        if ( buf == NULL )
+        {
+            break;
+        }
+
+        hb_lock( p->lock );
+        if ( p->last != NULL )
+            p->last->next = buf;
+        else
+            p->first = buf;
+        p->last = buf;
+        p->count++;
+        p->size += buf->alloc;
+        hb_cond_broadcast( p->cond );
+        hb_unlock( p->lock );
+    }
+
+    hb_lock( p->lock );
+    p->eof = 1;
+    hb_cond_broadcast( p->cond );
+    hb_unlock( p->lock );
+}
+
+/*
+ * Stop the prefetch thread and drop anything it read ahead.  Must be
+ * called before the source is seeked or closed.
+ */
+static void reader_prefetch_stop( hb_work_private_t * r )
+{
+    reader_prefetch_t * p = &r->prefetch;
+    hb_buffer_t       * buf;
+
+    if ( p->thread == NULL )
+    {
+        return;
+    }
+
+    hb_lock( p->lock );
+    p->stop = 1;
+    hb_cond_broadcast( p->cond );
+    hb_unlock( p->lock );
+    hb_thread_close( &p->thread );
+
+    while ( ( buf = p->first ) != NULL )
+    {
+        p->first = buf->next;
+        buf->next = NULL;
+        hb_buffer_close( &buf );
+    }
+    p->last  = NULL;
+    p->count = 0;
+    p->size  = 0;
+    p->stop  = 0;
+    p->eof   = 0;
+}
+
+/*
+ * Get the next source block for the demux loop, from the prefetch queue
+ * when read-ahead is enabled.
+ */
+static hb_buffer_t * reader_next( hb_work_private_t * r )
+{
+    reader_prefetch_t * p = &r->prefetch;
+    hb_buffer_t       * buf;
+
+    if ( p->thread == NULL )
+    {
+        // Until a stream finds pts_to_start it may ask for a keyframe,
+        // which only applies to blocks that have not been read yet.
+        // So read synchronously until then.
+        if ( p->max_size <= 0 || ( r->stream && !r->start_found ) )
+        {
+            return reader_read( r );
+        }
+        p->thread = hb_thread_init( "reader prefetch", PrefetchLoop, r,
+                                    HB_NORMAL_PRIORITY );
+        if ( p->thread == NULL )
+        {
+            return reader_read( r );
+        }
+    }
+
+    hb_lock( p->lock );
+    while ( p->first == NULL && !p->eof && !*r->die && !r->job->done )
+    {
+        hb_cond_timedwait( p->cond, p->lock, 100 );
+    }
+    buf = p->first;
+    if ( buf != NULL )
+    {
+        p->first = buf->next;
+        if ( p->first == NULL )
+            p->last = NULL;
+        buf->next = NULL;
+        p->count--;
+        p->size -= buf->alloc;
+        hb_cond_broadcast( p->cond );
+    }
+    hb_unlock( p->lock );
+
+    return buf;
+}
+
 /***********************************************************************
  * ReaderFunc
  ***********************************************************************
@@ -352,7 +567,6 @@ void ReadLoop( void * _w )
     hb_buffer_t  * buf = NULL;
     hb_list_t    * list;
     int            n;
-    int            chapter = -1;
     int            chapter_end = r->job->chapter_end;
     uint8_t        done = 0;
 
@@ -485,50 +699,16 @@ void ReadLoop( void * _w )
     }
 
     list  = hb_list_init();
+    r->chapter_end = chapter_end;
 
+    // All seeking is done, source reads may now run ahead of us
     while(!*r->die && !r->job->done && !done)
     {
-        if (r->bd)
-            chapter = hb_bd_chapter( r->bd );
-        else if (r->dvd)
-            chapter = hb_dvd_chapter( r->dvd );
-        else if (r->stream)
-            chapter = hb_stream_chapter( r->stream );
-
-        if( chapter < 0 )
-        {
-            hb_log( "reader: end of the title reached" );
-            break;
-        }
-        if( chapter > chapter_end )
-        {
-            hb_log( "reader: end of chapter %d (media %d) reached at media chapter %d",
-                    r->job->chapter_end, chapter_end, chapter );
-            break;
-        }
-
         if (buf == NULL)
         {
-            if (r->bd)
-            {
-                if( (buf = hb_bd_read( r->bd )) == NULL )
-                {
-                    break;
-                }
-            }
-            else if (r->dvd)
-            {
-                if( (buf = hb_dvd_read( r->dvd )) == NULL )
-                {
-                    break;
-                }
-            }
-            else if (r->stream)
+            if ( (buf = reader_next( r )) == NULL )
             {
-                if ( (buf = hb_stream_read( r->stream )) == NULL )
-                {
-                  break;
-                }
+                break;
             }
         }
         if (r->stream && r->start_found == 2 )
@@ -681,15 +861,15 @@ void ReadLoop( void * _w )
                 }
 
                 buf->sequence = r->sequence++;
-                /* if there are mutiple output fifos, send a copy of the
-                 * buffer down all but the first (we have to not ship the
-                 * original buffer or we'll race with the thread that's
-                 * consuming the buffer & inject garbage into the data stream). */
+                /* if there are mutiple output fifos, send a reference to
+                 * the buffer down all but the first (we have to not ship
+                 * the original buffer or we'll race with the thread that's
+                 * consuming the buffer & inject garbage into the data stream).
+                 * The references share the payload, consumers that modify
+                 * it get their own copy through hb_buffer_make_writable. */
                 for( n = 1; fifos[n] != NULL; n++)
                 {
-                    hb_buffer_t *buf_copy = hb_buffer_init( buf->size );
-                    buf_copy->s = buf->s;
-                    memcpy( buf_copy->data, buf->data, buf->size );
+                    hb_buffer_t *buf_copy = hb_buffer_ref( buf );
                     push_buf( r, fifos[n], buf_copy );
                 }
                 push_buf( r, fifos[0], buf );
@@ -702,6 +882,8 @@ void ReadLoop( void * _w )
         }
     }
 
+    reader_prefetch_stop( r );
+
     // send empty buffers downstream to video & audio decoders to signal we're done.
     if( !*r->die && !r->job->done )
     {
@@ -781,7 +963,7 @@ static void UpdateState( hb_work_private_t  * r, int64_t start)
     }
 #undef p
 
-    hb_set_state( r->job->h, &state );
+    hb_set_job_state( r->job, &state );
 }
 /***********************************************************************
  * GetFifoForId
@@ -180,6 +180,9 @@ static void ApplySub( hb_filter_private_t * pv, hb_buffer_t * buf, hb_buffer_t *
 {
     int top, left, margin_top, margin_percent;
 
+    // The frame may share its data with duplicates of itself
+    hb_buffer_make_writable( buf );
+
     if ( !pv->ssa )
     {
         /*
@@ -30,9 +30,34 @@ typedef struct
 
     uint64_t       min_title_duration;
 
+    char            * cache_path;
+    hb_scan_cache_t * cache;
+
+    /* Set on the private copies used by the concurrent batch scan */
+    int            batch_worker;
+
 } hb_scan_t;
 
+/* Upper bound on the number of files scanned at once in a batch */
+#define HB_SCAN_MAX_BATCH_WORKERS 8
+
+typedef struct
+{
+    hb_scan_t    * data;
+    hb_title_t  ** titles;      /* one slot per file or title, in order */
+    int          * failed;      /* titles whose previews failed */
+    int            count;
+    int            previews;    /* 0 probes files, 1 decodes previews */
+    int            next;        /* next slot to hand out */
+    int            done;
+    hb_lock_t    * lock;
+} batch_scan_t;
+
 static void ScanFunc( void * );
+static int  ScanTitle( hb_scan_t *, hb_title_t * title );
+static void ScanDropTitle( hb_scan_t *, hb_title_t * title );
+static int  BatchScanCount( hb_scan_t * data );
+static void BatchScanParallel( hb_scan_t * data, int count );
 static int  DecodePreviews( hb_scan_t *, hb_title_t * title );
 static void LookForAudio( hb_title_t * title, hb_buffer_t * b );
 static int  AllAudioOK( hb_title_t * title );
@@ -40,22 +65,22 @@ static void UpdateState1(hb_scan_t *scan, int title);
 static void UpdateState2(hb_scan_t *scan, int title);
 static void UpdateState3(hb_scan_t *scan, int preview);
 
-static const char *aspect_to_string( double aspect )
+static const char *aspect_to_string( char arstr[32], double aspect )
 {
     switch ( (int)(aspect * 9.) )
     {
         case 9 * 4 / 3:    return "4:3";
         case 9 * 16 / 9:   return "16:9";
     }
-    static char arstr[32];
-    sprintf( arstr, aspect >= 1.? "%.2f:1" : "1:%.2f", aspect );
+    snprintf( arstr, 32, aspect >= 1.? "%.2f:1" : "1:%.2f", aspect );
     return arstr;
 }
 
 hb_thread_t * hb_scan_init( hb_handle_t * handle, volatile int * die,
                             const char * path, int title_index, 
                             hb_title_set_t * title_set, int preview_count, 
-                            int store_previews, uint64_t min_duration )
+                            int store_previews, uint64_t min_duration,
+                            const char * cache_path )
 {
     hb_scan_t * data = calloc( sizeof( hb_scan_t ), 1 );
 
@@ -68,6 +93,10 @@ hb_thread_t * hb_scan_init( hb_handle_t * handle, volatile int * die,
     data->preview_count  = preview_count;
     data->store_previews = store_previews;
     data->min_title_duration = min_duration;
+    if( cache_path != NULL )
+    {
+        data->cache_path = strdup( cache_path );
+    }
     
     return hb_thread_init( "scan", ScanFunc, data, HB_NORMAL_PRIORITY );
 }
@@ -83,6 +112,21 @@ static void ScanFunc( void * _data )
     data->dvd = NULL;
     data->stream = NULL;
 
+    if( data->cache_path != NULL )
+    {
+        data->cache = hb_scan_cache_init( data->cache_path, data->path,
+                                          data->title_index,
+                                          data->preview_count,
+                                          data->store_previews,
+                                          data->min_title_duration );
+        if( data->cache != NULL &&
+            hb_scan_cache_load( data->cache, data->h, data->title_set ) )
+        {
+            hb_scan_cache_close( &data->cache );
+            goto complete;
+        }
+    }
+
     /* Try to open the path as a DVD. If it fails, try as a file */
     if( ( data->bd = hb_bd_init( data->path ) ) )
     {
@@ -145,6 +189,16 @@ static void ScanFunc( void * _data )
                 hb_list_add( data->title_set->list_title, title );
             }
         }
+        else if( ( i = BatchScanCount( data ) ) > 1 )
+        {
+            /* Scan all titles, several files at once */
+            BatchScanParallel( data, i );
+            if ( *data->die )
+            {
+                goto finish;
+            }
+            goto scanned;
+        }
         else
         {
             /* Scan all titles */
@@ -175,15 +229,12 @@ static void ScanFunc( void * _data )
         {
             hb_title_close( &title );
             hb_log( "scan: unrecognized file type" );
-            return;
+            goto finish;
         }
     }
 
     for( i = 0; i < hb_list_count( data->title_set->list_title ); )
     {
-        int j;
-        hb_audio_t * audio;
-
         if ( *data->die )
         {
             goto finish;
@@ -192,66 +243,24 @@ static void ScanFunc( void * _data )
 
         UpdateState2(data, i + 1);
 
-        /* Decode previews */
-        /* this will also detect more AC3 / DTS information */
-        if( !DecodePreviews( data, title ) )
+        if( !ScanTitle( data, title ) )
         {
-            /* TODO: free things */
-            hb_list_rem( data->title_set->list_title, title );
-            for( j = 0; j < hb_list_count( title->list_audio ); j++)
-            {
-                audio = hb_list_item( title->list_audio, j );
-                if ( audio->priv.scan_cache )
-                {
-                    hb_fifo_flush( audio->priv.scan_cache );
-                    hb_fifo_close( &audio->priv.scan_cache );
-                }
-            }
-            hb_title_close( &title );
+            ScanDropTitle( data, title );
             continue;
         }
-
-        /* Make sure we found audio rates and bitrates */
-        for( j = 0; j < hb_list_count( title->list_audio ); )
-        {
-            audio = hb_list_item( title->list_audio, j );
-            if ( audio->priv.scan_cache )
-            {
-                hb_fifo_flush( audio->priv.scan_cache );
-                hb_fifo_close( &audio->priv.scan_cache );
-            }
-            if( !audio->config.in.bitrate )
-            {
-                hb_log( "scan: removing audio 0x%x because no bitrate found",
-                        audio->id );
-                hb_list_rem( title->list_audio, audio );
-                free( audio );
-                continue;
-            }
-            j++;
-        }
-
-        if ( data->dvd || data->bd )
-        {
-            // The subtitle width and height needs to be set to the 
-            // title widht and height for DVDs.  title width and
-            // height don't get set until we decode previews, so
-            // we can't set subtitle width/height till we get here.
-            for( j = 0; j < hb_list_count( title->list_subtitle ); j++ )
-            {
-                hb_subtitle_t *subtitle = hb_list_item( title->list_subtitle, j );
-                if ( subtitle->source == VOBSUB || subtitle->source == PGSSUB )
-                {
-                    subtitle->width = title->width;
-                    subtitle->height = title->height;
-                }
-            }
-        }
         i++;
     }
 
+scanned:
     data->title_set->feature = feature;
 
+    if( data->cache != NULL &&
+        hb_list_count( data->title_set->list_title ) > 0 )
+    {
+        hb_scan_cache_save( data->cache, data->h, data->title_set );
+    }
+
+complete:
     /* Mark title scan complete and init jobs */
     for( i = 0; i < hb_list_count( data->title_set->list_title ); i++ )
     {
@@ -280,12 +289,233 @@ finish:
     {
         hb_batch_close( &data->batch );
     }
+    hb_scan_cache_close( &data->cache );
+    hb_scan_done( data->h );
+    free( data->cache_path );
     free( data->path );
     free( data );
     _data = NULL;
     hb_buffer_pool_free();
 }
 
+/***********************************************************************
+ * ScanTitle
+ ***********************************************************************
+ * Decode previews for a title and drop the audio tracks they could not
+ * identify.  Returns 0 if the title is unusable.
+ **********************************************************************/
+static int ScanTitle( hb_scan_t * data, hb_title_t * title )
+{
+    int j, ok;
+    hb_audio_t * audio;
+
+    /* Decode previews */
+    /* this will also detect more AC3 / DTS information */
+    ok = DecodePreviews( data, title );
+
+    /* Make sure we found audio rates and bitrates */
+    for( j = 0; j < hb_list_count( title->list_audio ); )
+    {
+        audio = hb_list_item( title->list_audio, j );
+        if ( audio->priv.scan_cache )
+        {
+            hb_fifo_flush( audio->priv.scan_cache );
+            hb_fifo_close( &audio->priv.scan_cache );
+        }
+        if( ok && !audio->config.in.bitrate )
+        {
+            hb_log( "scan: removing audio 0x%x because no bitrate found",
+                    audio->id );
+            hb_list_rem( title->list_audio, audio );
+            free( audio );
+            continue;
+        }
+        j++;
+    }
+    if ( !ok )
+    {
+        return 0;
+    }
+
+    if ( data->dvd || data->bd )
+    {
+        // The subtitle width and height needs to be set to the 
+        // title widht and height for DVDs.  title width and
+        // height don't get set until we decode previews, so
+        // we can't set subtitle width/height till we get here.
+        for( j = 0; j < hb_list_count( title->list_subtitle ); j++ )
+        {
+            hb_subtitle_t *subtitle = hb_list_item( title->list_subtitle, j );
+            if ( subtitle->source == VOBSUB || subtitle->source == PGSSUB )
+            {
+                subtitle->width = title->width;
+                subtitle->height = title->height;
+            }
+        }
+    }
+    return 1;
+}
+
+/***********************************************************************
+ * ScanDropTitle
+ ***********************************************************************
+ * Remove a title that failed to scan from the title set, along with
+ * the previews that were saved for it.
+ **********************************************************************/
+static void ScanDropTitle( hb_scan_t * data, hb_title_t * title )
+{
+    hb_clear_preview_data( data->h, title->index, data->preview_count );
+    hb_list_rem( data->title_set->list_title, title );
+    hb_title_close( &title );
+}
+
+/*
+ * Number of files to scan at once in a batch.  Each file is probed and
+ * has its previews decoded by a single thread, so this is bounded by
+ * the number of CPUs.
+ */
+static int BatchScanCount( hb_scan_t * data )
+{
+    int count = hb_get_cpu_count();
+
+    if ( count > HB_SCAN_MAX_BATCH_WORKERS )
+    {
+        count = HB_SCAN_MAX_BATCH_WORKERS;
+    }
+    if ( count > hb_batch_title_count( data->batch ) )
+    {
+        count = hb_batch_title_count( data->batch );
+    }
+    return count;
+}
+
+static void BatchScanThread( void * _bs )
+{
+    batch_scan_t * bs = (batch_scan_t *) _bs;
+    hb_scan_t      data;
+    int            i;
+
+    // Private copy so the worker opens its own source streams and
+    // decodes previews on its own thread
+    data = *bs->data;
+    data.stream = NULL;
+    data.batch_worker = 1;
+
+    while ( !*data.die )
+    {
+        hb_lock( bs->lock );
+        i = bs->next++;
+        hb_unlock( bs->lock );
+        if ( i >= bs->count )
+        {
+            break;
+        }
+
+        if ( bs->previews )
+        {
+            bs->failed[i] = !ScanTitle( &data, bs->titles[i] );
+        }
+        else
+        {
+            bs->titles[i] = hb_batch_title_scan( data.batch, i + 1 );
+        }
+
+        // Report the number of slots finished rather than the one just
+        // handed out, so progress never goes backwards
+        hb_lock( bs->lock );
+        bs->done++;
+        if ( bs->previews )
+        {
+            UpdateState2( bs->data, bs->done );
+        }
+        else
+        {
+            UpdateState1( bs->data, bs->done );
+        }
+        hb_unlock( bs->lock );
+    }
+}
+
+static void BatchScanRun( batch_scan_t * bs, int count )
+{
+    hb_thread_t ** threads;
+    int            i;
+
+    bs->next = 0;
+    bs->done = 0;
+    threads = calloc( count, sizeof( hb_thread_t * ) );
+    for ( i = 0; i < count; i++ )
+    {
+        threads[i] = hb_thread_init( "scan_batch", BatchScanThread, bs,
+                                     HB_NORMAL_PRIORITY );
+    }
+    for ( i = 0; i < count; i++ )
+    {
+        hb_thread_close( &threads[i] );
+    }
+    free( threads );
+}
+
+/***********************************************************************
+ * BatchScanParallel
+ ***********************************************************************
+ * Scan all files of a batch with count worker threads.  Files are first
+ * probed, then have their previews decoded.  Results are collected in
+ * per file slots so the title list keeps the sorted file order no matter
+ * which worker finishes first.
+ **********************************************************************/
+static void BatchScanParallel( hb_scan_t * data, int count )
+{
+    hb_list_t    * list_title = data->title_set->list_title;
+    batch_scan_t   bs;
+    int            i;
+
+    hb_log( "scan: scanning %d files, %d at a time",
+            hb_batch_title_count( data->batch ), count );
+
+    memset( &bs, 0, sizeof( bs ) );
+    bs.data   = data;
+    bs.count  = hb_batch_title_count( data->batch );
+    bs.titles = calloc( bs.count, sizeof( hb_title_t * ) );
+    bs.failed = calloc( bs.count, sizeof( int ) );
+    bs.lock   = hb_lock_init();
+
+    /* Probe the files */
+    BatchScanRun( &bs, count );
+    for ( i = 0; i < bs.count; i++ )
+    {
+        if ( bs.titles[i] != NULL )
+        {
+            hb_list_add( list_title, bs.titles[i] );
+        }
+    }
+    if ( *data->die || hb_list_count( list_title ) == 0 )
+    {
+        goto done;
+    }
+
+    /* Decode previews */
+    bs.count = hb_list_count( list_title );
+    for ( i = 0; i < bs.count; i++ )
+    {
+        bs.titles[i] = hb_list_item( list_title, i );
+    }
+    bs.previews = 1;
+    BatchScanRun( &bs, count < bs.count ? count : bs.count );
+    for ( i = 0; i < bs.count; i++ )
+    {
+        if ( bs.failed[i] )
+        {
+            ScanDropTitle( data, bs.titles[i] );
+        }
+    }
+
+done:
+    free( bs.titles );
+    free( bs.failed );
+    hb_lock_close( &bs.lock );
+}
+
 // -----------------------------------------------
 // stuff related to cropping
 
@@ -470,347 +700,729 @@ static int is_close_to( int val, int target, int thresh )
     return diff < thresh;
 }
 
-/***********************************************************************
- * DecodePreviews
- ***********************************************************************
- * Decode 10 pictures for the given title.
- * It assumes that data->reader and data->vts have successfully been
- * DVDOpen()ed and ifoOpen()ed.
- **********************************************************************/
-static int DecodePreviews( hb_scan_t * data, hb_title_t * title )
-{
-    int             i, npreviews = 0;
-    hb_buffer_t   * buf, * buf_es;
-    hb_list_t     * list_es;
-    int progressive_count = 0;
-    int pulldown_count = 0;
-    int doubled_frame_count = 0;
-    int interlaced_preview_count = 0;
-    info_list_t * info_list = calloc( data->preview_count+1, sizeof(*info_list) );
-    crop_record_t *crops = crop_record_init( data->preview_count );
+// -----------------------------------------------
+// preview decoding
 
-    list_es  = hb_list_init();
+/*
+ * Everything DecodePreviews needs to know about one decoded preview.
+ * Previews are decoded in any order but always merged in preview order,
+ * so the crop and frame info results don't depend on the timing of the
+ * decoders.
+ */
+typedef struct {
+    int decoded;            /* preview was decoded and analyzed */
+    hb_work_info_t info;
+    int pulldown;
+    int doubled;
+    int progressive;
+    int interlaced;
+    int cropped;            /* t/b/l/r are valid */
+    int t, b, l, r;
+} preview_result_t;
 
-    if( data->batch )
-    {
-        hb_log( "scan: decoding previews for title %d (%s)", title->index, title->path );
-    }
-    else
+typedef struct {
+    hb_scan_t        * data;
+    hb_title_t       * title;       /* title, or a private copy of it */
+    hb_stream_t      * stream;
+    hb_work_object_t * vid_decoder;
+    hb_list_t        * list_es;
+    preview_result_t * results;
+
+    /* Parallel decoding only */
+    hb_title_t       * scan_title;  /* the title being scanned */
+    hb_thread_t      * thread;
+    int                first;       /* decodes previews first, first + */
+    int                step;        /* step, first + 2 * step, ... */
+    int                own_stream;
+    int              * audio_found; /* preview an audio was first id'd in */
+    hb_lock_t        * audio_lock;
+    int              * progress;
+} preview_decoder_t;
+
+#define HB_SCAN_MAX_PREVIEW_DECODERS 8
+
+static hb_audio_t * find_audio( hb_list_t * list_audio, int id )
+{
+    int i;
+
+    for ( i = 0; i < hb_list_count( list_audio ); i++ )
     {
-        hb_log( "scan: decoding previews for title %d", title->index );
+        hb_audio_t * audio = hb_list_item( list_audio, i );
+        if ( audio->id == id )
+            return audio;
     }
+    return NULL;
+}
+
+static void LookForAudioLocked( preview_decoder_t * pd, hb_buffer_t * b )
+{
+    // Audio bitstream info procs aren't all reentrant
+    if ( pd->audio_lock )
+        hb_lock( pd->audio_lock );
+    LookForAudio( pd->title, b );
+    if ( pd->audio_lock )
+        hb_unlock( pd->audio_lock );
+}
+
+/***********************************************************************
+ * DecodePreview
+ ***********************************************************************
+ * Seek to preview i, decode one picture and look for interlacing and
+ * black borders in it.  Results go to pd->results[i].
+ **********************************************************************/
+static void DecodePreview( preview_decoder_t * pd, int i )
+{
+    hb_scan_t        * data        = pd->data;
+    hb_title_t       * title       = pd->title;
+    hb_work_object_t * vid_decoder = pd->vid_decoder;
+    preview_result_t * res         = &pd->results[i];
+    hb_buffer_t      * buf, * buf_es;
+    hb_buffer_t      * vid_buf = NULL;
+    int                j;
 
     if (data->bd)
     {
-        hb_bd_start( data->bd, title );
-        hb_log( "scan: title angle(s) %d", title->angle_count );
-    }
-    else if (data->dvd)
-    {
-        hb_dvd_start( data->dvd, title, 1 );
-        title->angle_count = hb_dvd_angle_count( data->dvd );
-        hb_log( "scan: title angle(s) %d", title->angle_count );
+        if( !hb_bd_seek( data->bd, (float) ( i + 1 ) / ( data->preview_count + 1.0 ) ) )
+        {
+            return;
+        }
     }
-    else if (data->batch)
+    if (data->dvd)
     {
-        data->stream = hb_stream_open( title->path, title, 1 );
+        if( !hb_dvd_seek( data->dvd, (float) ( i + 1 ) / ( data->preview_count + 1.0 ) ) )
+        {
+            return;
+        }
     }
-
-    if (title->video_codec == WORK_NONE)
+    else if (pd->stream)
     {
-        hb_error("No video decoder set!");
-        return 0;
+        /* we start reading streams at zero rather than 1/11 because
+         * short streams may have only one sequence header in the entire
+         * file and we need it to decode any previews.
+         *
+         * Also, seeking to position 0 loses the palette of avi files
+         * so skip initial seek */
+        if (i != 0)
+        {
+            if (!hb_stream_seek(pd->stream,
+                                (float)i / (data->preview_count + 1.0)))
+            {
+                return;
+            }
+        }
     }
-    hb_work_object_t *vid_decoder = hb_get_work(title->video_codec);
-    vid_decoder->codec_param = title->video_codec_param;
-    vid_decoder->title = title;
-    vid_decoder->init( vid_decoder, NULL );
 
-    for( i = 0; i < data->preview_count; i++ )
-    {
-        int j;
+    hb_deep_log( 2, "scan: preview %d", i + 1 );
 
-        UpdateState3(data, i + 1);
+    if ( vid_decoder->flush )
+        vid_decoder->flush( vid_decoder );
 
-        if ( *data->die )
+    for( j = 0; j < 10240 ; j++ )
+    {
+        if (data->bd)
         {
-            free( info_list );
-            crop_record_free( crops );
-            return 0;
+          if( (buf = hb_bd_read( data->bd )) == NULL )
+          {
+              if ( vid_buf )
+              {
+                break;
+              }
+              hb_log( "Warning: Could not read data for preview %d, skipped", i + 1 );
+              goto skip_preview;
+          }
         }
-        if (data->bd)
+        else if (data->dvd)
         {
-            if( !hb_bd_seek( data->bd, (float) ( i + 1 ) / ( data->preview_count + 1.0 ) ) )
+          if( (buf = hb_dvd_read( data->dvd )) == NULL )
           {
-              continue;
+              if ( vid_buf )
+              {
+                break;
+              }
+              hb_log( "Warning: Could not read data for preview %d, skipped", i + 1 );
+              goto skip_preview;
           }
         }
-        if (data->dvd)
+        else if (pd->stream)
         {
-            if( !hb_dvd_seek( data->dvd, (float) ( i + 1 ) / ( data->preview_count + 1.0 ) ) )
+          if ( (buf = hb_stream_read( pd->stream )) == NULL )
           {
-              continue;
+              if ( vid_buf )
+              {
+                break;
+              }
+              hb_log( "Warning: Could not read data for preview %d, skipped", i + 1 );
+              goto skip_preview;
           }
         }
-        else if (data->stream)
+        else
         {
-            /* we start reading streams at zero rather than 1/11 because
-             * short streams may have only one sequence header in the entire
-             * file and we need it to decode any previews.
-             *
-             * Also, seeking to position 0 loses the palette of avi files
-             * so skip initial seek */
-            if (i != 0)
-            {
-                if (!hb_stream_seek(data->stream,
-                                    (float)i / (data->preview_count + 1.0)))
-                {
-                    continue;
-                }
-            }
+            // Silence compiler warning
+            buf = NULL;
+            hb_error( "Error: This can't happen!" );
+            goto skip_preview;
         }
 
-        hb_deep_log( 2, "scan: preview %d", i + 1 );
-
-        if ( vid_decoder->flush )
-            vid_decoder->flush( vid_decoder );
-
-        hb_buffer_t * vid_buf = NULL;
+        (hb_demux[title->demuxer])(buf, pd->list_es, 0 );
 
-        for( j = 0; j < 10240 ; j++ )
+        while( ( buf_es = hb_list_item( pd->list_es, 0 ) ) )
         {
-            if (data->bd)
-            {
-              if( (buf = hb_bd_read( data->bd )) == NULL )
-              {
-                  if ( vid_buf )
-                  {
-                    break;
-                  }
-                  hb_log( "Warning: Could not read data for preview %d, skipped", i + 1 );
-                  goto skip_preview;
-              }
-            }
-            else if (data->dvd)
+            hb_list_rem( pd->list_es, buf_es );
+            if( buf_es->s.id == title->video_id && vid_buf == NULL )
             {
-              if( (buf = hb_dvd_read( data->dvd )) == NULL )
-              {
-                  if ( vid_buf )
-                  {
-                    break;
-                  }
-                  hb_log( "Warning: Could not read data for preview %d, skipped", i + 1 );
-                  goto skip_preview;
-              }
+                vid_decoder->work( vid_decoder, &buf_es, &vid_buf );
             }
-            else if (data->stream)
+            else if( ! AllAudioOK( title ) ) 
             {
-              if ( (buf = hb_stream_read( data->stream )) == NULL )
-              {
-                  if ( vid_buf )
-                  {
-                    break;
-                  }
-                  hb_log( "Warning: Could not read data for preview %d, skipped", i + 1 );
-                  goto skip_preview;
-              }
-            }
-            else
-            {
-                // Silence compiler warning
-                buf = NULL;
-                hb_error( "Error: This can't happen!" );
-                goto skip_preview;
+                LookForAudioLocked( pd, buf_es );
+                buf_es = NULL;
             }
+            if ( buf_es )
+                hb_buffer_close( &buf_es );
+        }
 
-            (hb_demux[title->demuxer])(buf, list_es, 0 );
+        if( vid_buf && AllAudioOK( title ) )
+            break;
+    }
 
-            while( ( buf_es = hb_list_item( list_es, 0 ) ) )
-            {
-                hb_list_rem( list_es, buf_es );
-                if( buf_es->s.id == title->video_id && vid_buf == NULL )
-                {
-                    vid_decoder->work( vid_decoder, &buf_es, &vid_buf );
-                }
-                else if( ! AllAudioOK( title ) ) 
-                {
-                    LookForAudio( title, buf_es );
-                    buf_es = NULL;
-                }
-                if ( buf_es )
-                    hb_buffer_close( &buf_es );
-            }
+    if( ! vid_buf )
+    {
+        hb_log( "scan: could not get a decoded picture" );
+        return;
+    }
+
+    /* Get size and rate infos */
+
+    hb_work_info_t * vid_info = &res->info;
+    if( !vid_decoder->info( vid_decoder, vid_info ) )
+    {
+        /*
+         * Could not fill vid_info, don't continue and try to use vid_info
+         * in this case.
+         */
+        hb_buffer_close( &vid_buf );
+        hb_log( "scan: could not get a video information" );
+        return;
+    }
+
+    if( is_close_to( vid_info->rate_base, 900900, 100 ) &&
+        ( vid_buf->s.flags & PIC_FLAG_REPEAT_FIRST_FIELD ) )
+    {
+        /* Potentially soft telecine material */
+        res->pulldown = 1;
+    }
+
+    if( vid_buf->s.flags & PIC_FLAG_REPEAT_FRAME )
+    {
+        // AVCHD-Lite specifies that all streams are
+        // 50 or 60 fps.  To produce 25 or 30 fps, camera
+        // makers are repeating all frames.
+        res->doubled = 1;
+    }
+
+    if( is_close_to( vid_info->rate_base, 1126125, 100 ) )
+    {
+        // Frame FPS is 23.976 (meaning it's progressive), so start keeping
+        // track of how many are reporting at that speed. When enough 
+        // show up that way, we want to make that the overall title FPS.
+        res->progressive = 1;
+    }
+
+    while( ( buf_es = hb_list_item( pd->list_es, 0 ) ) )
+    {
+        hb_list_rem( pd->list_es, buf_es );
+        hb_buffer_close( &buf_es );
+    }
+
+    /* Check preview for interlacing artifacts */
+    if( hb_detect_comb( vid_buf, 10, 30, 9, 10, 30, 9 ) )
+    {
+        hb_deep_log( 2, "Interlacing detected in preview frame %i", i+1);
+        res->interlaced = 1;
+    }
+    
+    if( data->store_previews )
+    {
+        hb_save_preview( data->h, title->index, i, vid_buf );
+    }
 
-            if( vid_buf && AllAudioOK( title ) )
+    /* Detect black borders */
+
+    int top, bottom, left, right;
+    int h4 = vid_info->height / 4, w4 = vid_info->width / 4;
+
+    // When widescreen content is matted to 16:9 or 4:3 there's sometimes
+    // a thin border on the outer edge of the matte. On TV content it can be
+    // "line 21" VBI data that's normally hidden in the overscan. For HD
+    // content it can just be a diagnostic added in post production so that
+    // the frame borders are visible. We try to ignore these borders so
+    // we can crop the matte. The border width depends on the resolution
+    // (12 pixels on 1080i looks visually the same as 4 pixels on 480i)
+    // so we allow the border to be up to 1% of the frame height.
+    const int border = vid_info->height / 100;
+
+    for ( top = border; top < h4; ++top )
+    {
+        if ( ! row_all_dark( vid_buf, top ) )
+            break;
+    }
+    if ( top <= border )
+    {
+        // we never made it past the border region - see if the rows we
+        // didn't check are dark or if we shouldn't crop at all.
+        for ( top = 0; top < border; ++top )
+        {
+            if ( ! row_all_dark( vid_buf, top ) )
                 break;
         }
-
-        if( ! vid_buf )
+        if ( top >= border )
         {
-            hb_log( "scan: could not get a decoded picture" );
-            continue;
+            top = 0;
         }
-
-        /* Get size and rate infos */
-
-        hb_work_info_t vid_info;
-        if( !vid_decoder->info( vid_decoder, &vid_info ) )
+    }
+    for ( bottom = border; bottom < h4; ++bottom )
+    {
+        if ( ! row_all_dark( vid_buf, vid_info->height - 1 - bottom ) )
+            break;
+    }
+    if ( bottom <= border )
+    {
+        for ( bottom = 0; bottom < border; ++bottom )
         {
-            /*
-             * Could not fill vid_info, don't continue and try to use vid_info
-             * in this case.
-             */
-            if (vid_buf)
-            {
-                hb_buffer_close( &vid_buf );
-            }
-            hb_log( "scan: could not get a video information" );
-            continue;
+            if ( ! row_all_dark( vid_buf, vid_info->height - 1 - bottom ) )
+                break;
         }
+        if ( bottom >= border )
+        {
+            bottom = 0;
+        }
+    }
+    for ( left = 0; left < w4; ++left )
+    {
+        if ( ! column_all_dark( vid_buf, top, bottom, left ) )
+            break;
+    }
+    for ( right = 0; right < w4; ++right )
+    {
+        if ( ! column_all_dark( vid_buf, top, bottom, vid_info->width - 1 - right ) )
+            break;
+    }
 
-        remember_info( info_list, &vid_info );
+    // only record the result if all the crops are less than a quarter of
+    // the frame otherwise we can get fooled by frames with a lot of black
+    // like titles, credits & fade-thru-black transitions.
+    if ( top < h4 && bottom < h4 && left < w4 && right < w4 )
+    {
+        res->cropped = 1;
+        res->t = top;
+        res->b = bottom;
+        res->l = left;
+        res->r = right;
+    }
+    res->decoded = 1;
 
-        if( is_close_to( vid_info.rate_base, 900900, 100 ) &&
-            ( vid_buf->s.flags & PIC_FLAG_REPEAT_FIRST_FIELD ) )
+skip_preview:
+    /* Make sure we found audio rates and bitrates */
+    for( j = 0; j < hb_list_count( title->list_audio ); j++ )
+    {
+        hb_audio_t * audio = hb_list_item( title->list_audio, j );
+        if ( audio->priv.scan_cache )
         {
-            /* Potentially soft telecine material */
-            pulldown_count++;
+            hb_fifo_flush( audio->priv.scan_cache );
         }
+    }
+    if (vid_buf)
+    {
+        hb_buffer_close( &vid_buf );
+    }
+}
+
+static int preview_decoder_init( preview_decoder_t * pd, hb_title_t * title )
+{
+    pd->vid_decoder = hb_get_work( title->video_codec );
+    pd->vid_decoder->codec_param = title->video_codec_param;
+    pd->vid_decoder->title = title;
+    if ( pd->vid_decoder->init( pd->vid_decoder, NULL ) )
+    {
+        free( pd->vid_decoder );
+        pd->vid_decoder = NULL;
+        return -1;
+    }
+    pd->list_es = hb_list_init();
+    return 0;
+}
 
-        if( vid_buf->s.flags & PIC_FLAG_REPEAT_FRAME )
+static void preview_decoder_close( preview_decoder_t * pd )
+{
+    hb_buffer_t * buf_es;
+
+    if ( pd->vid_decoder )
+    {
+        pd->vid_decoder->close( pd->vid_decoder );
+        free( pd->vid_decoder );
+        pd->vid_decoder = NULL;
+    }
+    if ( pd->list_es )
+    {
+        while( ( buf_es = hb_list_item( pd->list_es, 0 ) ) )
         {
-            // AVCHD-Lite specifies that all streams are
-            // 50 or 60 fps.  To produce 25 or 30 fps, camera
-            // makers are repeating all frames.
-            doubled_frame_count++;
+            hb_list_rem( pd->list_es, buf_es );
+            hb_buffer_close( &buf_es );
         }
+        hb_list_close( &pd->list_es );
+    }
+}
 
-        if( is_close_to( vid_info.rate_base, 1126125, 100 ) )
+/*
+ * Decode all previews one after another with a single decoder.  This is
+ * what discs use since seeking around on them is expensive.
+ */
+static int DecodePreviewsSerial( hb_scan_t * data, hb_title_t * title,
+                                 preview_result_t * results )
+{
+    preview_decoder_t pd;
+    int               i;
+
+    memset( &pd, 0, sizeof( pd ) );
+    pd.data    = data;
+    pd.title   = title;
+    pd.stream  = data->stream;
+    pd.results = results;
+
+    if ( preview_decoder_init( &pd, title ) )
+    {
+        hb_error( "scan: failed to initialize video decoder" );
+        return 0;
+    }
+
+    for( i = 0; i < data->preview_count; i++ )
+    {
+        UpdateState3(data, i + 1);
+
+        if ( *data->die )
         {
-            // Frame FPS is 23.976 (meaning it's progressive), so start keeping
-            // track of how many are reporting at that speed. When enough 
-            // show up that way, we want to make that the overall title FPS.
-            progressive_count++;
+            preview_decoder_close( &pd );
+            return 0;
         }
+        DecodePreview( &pd, i );
+    }
+    UpdateState3(data, i);
+
+    preview_decoder_close( &pd );
+    return 1;
+}
 
-        while( ( buf_es = hb_list_item( list_es, 0 ) ) )
+static void DecodePreviewsThread( void * _pd )
+{
+    preview_decoder_t * pd   = _pd;
+    hb_scan_t         * data = pd->data;
+    hb_title_t        * title = pd->title;
+    int                 i, k;
+
+    if ( pd->stream == NULL )
+    {
+        pd->stream = hb_stream_open( title->path, title, 1 );
+        pd->own_stream = 1;
+        if ( pd->stream == NULL )
         {
-            hb_list_rem( list_es, buf_es );
-            hb_buffer_close( &buf_es );
+            return;
         }
+    }
+    if ( preview_decoder_init( pd, title ) )
+    {
+        hb_error( "scan: failed to initialize video decoder" );
+        return;
+    }
 
-        /* Check preview for interlacing artifacts */
-        if( hb_detect_comb( vid_buf, 10, 30, 9, 10, 30, 9 ) )
+    for( i = pd->first; i < data->preview_count; i += pd->step )
+    {
+        if ( *data->die )
         {
-            hb_deep_log( 2, "Interlacing detected in preview frame %i", i+1);
-            interlaced_preview_count++;
+            break;
         }
-        
-        if( data->store_previews )
+        UpdateState3( data, hb_atomic_add( pd->progress, 1 ) );
+
+        DecodePreview( pd, i );
+
+        // Remember which preview identified each audio track so the
+        // results of all decoders can be merged in preview order
+        for ( k = 0; k < hb_list_count( pd->scan_title->list_audio ); k++ )
         {
-            hb_save_preview( data->h, title->index, i, vid_buf );
+            hb_audio_t * audio = hb_list_item( pd->scan_title->list_audio, k );
+            audio = find_audio( title->list_audio, audio->id );
+            if ( audio && audio->config.in.bitrate && pd->audio_found[k] < 0 )
+            {
+                pd->audio_found[k] = i;
+            }
         }
+    }
+    preview_decoder_close( pd );
+}
 
-        /* Detect black borders */
-
-        int top, bottom, left, right;
-        int h4 = vid_info.height / 4, w4 = vid_info.width / 4;
+/*
+ * Decode previews with several decoders at once, each reading the source
+ * through its own stream handle.  Audio tracks are identified on private
+ * copies of the title's audio list and merged back afterwards, taking
+ * each track from the earliest preview it was identified in.
+ */
+static int DecodePreviewsParallel( hb_scan_t * data, hb_title_t * title,
+                                   preview_result_t * results, int count )
+{
+    preview_decoder_t * pds;
+    hb_audio_t       ** audios;
+    hb_lock_t         * audio_lock = hb_lock_init();
+    int                 progress = 0;
+    int                 naudio = hb_list_count( title->list_audio );
+    int                 i, k;
 
-        // When widescreen content is matted to 16:9 or 4:3 there's sometimes
-        // a thin border on the outer edge of the matte. On TV content it can be
-        // "line 21" VBI data that's normally hidden in the overscan. For HD
-        // content it can just be a diagnostic added in post production so that
-        // the frame borders are visible. We try to ignore these borders so
-        // we can crop the matte. The border width depends on the resolution
-        // (12 pixels on 1080i looks visually the same as 4 pixels on 480i)
-        // so we allow the border to be up to 1% of the frame height.
-        const int border = vid_info.height / 100;
+    hb_log( "scan: decoding previews with %d decoders", count );
 
-        for ( top = border; top < h4; ++top )
+    pds = calloc( count, sizeof( preview_decoder_t ) );
+    for ( i = 0; i < count; i++ )
+    {
+        preview_decoder_t * pd = &pds[i];
+        hb_title_t        * t  = malloc( sizeof( hb_title_t ) );
+
+        // The decoders and the stream only read the title, except for
+        // opaque_priv which hb_stream_open sets for libav sources and
+        // the audio list which LookForAudio updates
+        memcpy( t, title, sizeof( hb_title_t ) );
+        t->list_audio = hb_list_init();
+        for ( k = 0; k < naudio; k++ )
         {
-            if ( ! row_all_dark( vid_buf, top ) )
-                break;
+            hb_audio_t * audio = hb_audio_copy( hb_list_item( title->list_audio, k ) );
+            audio->priv.scan_cache = NULL;
+            hb_list_add( t->list_audio, audio );
         }
-        if ( top <= border )
+
+        pd->data        = data;
+        pd->scan_title  = title;
+        pd->title       = t;
+        pd->results     = results;
+        pd->first       = i;
+        pd->step        = count;
+        pd->audio_lock  = audio_lock;
+        pd->progress    = &progress;
+        pd->audio_found = malloc( ( naudio + 1 ) * sizeof( int ) );
+        for ( k = 0; k < naudio; k++ )
         {
-            // we never made it past the border region - see if the rows we
-            // didn't check are dark or if we shouldn't crop at all.
-            for ( top = 0; top < border; ++top )
-            {
-                if ( ! row_all_dark( vid_buf, top ) )
-                    break;
-            }
-            if ( top >= border )
-            {
-                top = 0;
-            }
+            pd->audio_found[k] = -1;
         }
-        for ( bottom = border; bottom < h4; ++bottom )
+        // The first decoder keeps using the stream the title was scanned with
+        if ( i == 0 )
         {
-            if ( ! row_all_dark( vid_buf, vid_info.height - 1 - bottom ) )
-                break;
+            pd->stream = data->stream;
         }
-        if ( bottom <= border )
+    }
+    for ( i = 0; i < count; i++ )
+    {
+        pds[i].thread = hb_thread_init( "scan_preview", DecodePreviewsThread,
+                                        &pds[i], HB_NORMAL_PRIORITY );
+    }
+    for ( i = 0; i < count; i++ )
+    {
+        hb_thread_close( &pds[i].thread );
+    }
+    UpdateState3( data, data->preview_count );
+
+    // Merge the audio track info found by the decoders
+    audios = malloc( ( naudio + 1 ) * sizeof( hb_audio_t * ) );
+    for ( k = 0; k < naudio; k++ )
+    {
+        audios[k] = hb_list_item( title->list_audio, k );
+    }
+    for ( k = 0; k < naudio; k++ )
+    {
+        hb_audio_t * audio = audios[k];
+        hb_audio_t * best = NULL;
+        int          best_preview = data->preview_count;
+        int          dropped = 0;
+
+        for ( i = 0; i < count; i++ )
         {
-            for ( bottom = 0; bottom < border; ++bottom )
+            preview_decoder_t * pd = &pds[i];
+            hb_audio_t        * copy;
+
+            copy = find_audio( pd->title->list_audio, audio->id );
+            if ( copy == NULL )
             {
-                if ( ! row_all_dark( vid_buf, vid_info.height - 1 - bottom ) )
-                    break;
+                // LookForAudio dropped it, there's no decoder for it
+                dropped = 1;
             }
-            if ( bottom >= border )
+            else if ( copy->config.in.bitrate &&
+                      pd->audio_found[k] >= 0 &&
+                      pd->audio_found[k] < best_preview )
             {
-                bottom = 0;
+                best = copy;
+                best_preview = pd->audio_found[k];
             }
         }
-        for ( left = 0; left < w4; ++left )
+        if ( best != NULL )
         {
-            if ( ! column_all_dark( vid_buf, top, bottom, left ) )
-                break;
+            audio->config.in   = best->config.in;
+            audio->config.lang = best->config.lang;
         }
-        for ( right = 0; right < w4; ++right )
+        else if ( dropped )
         {
-            if ( ! column_all_dark( vid_buf, top, bottom, vid_info.width - 1 - right ) )
-                break;
+            hb_list_rem( title->list_audio, audio );
+            hb_audio_close( &audio );
         }
+    }
+    free( audios );
+
+    for ( i = 0; i < count; i++ )
+    {
+        preview_decoder_t * pd = &pds[i];
+        hb_audio_t        * audio;
 
-        // only record the result if all the crops are less than a quarter of
-        // the frame otherwise we can get fooled by frames with a lot of black
-        // like titles, credits & fade-thru-black transitions.
-        if ( top < h4 && bottom < h4 && left < w4 && right < w4 )
+        if ( pd->own_stream )
         {
-            record_crop( crops, top, bottom, left, right );
+            hb_stream_close( &pd->stream );
         }
-        ++npreviews;
-
-skip_preview:
-        /* Make sure we found audio rates and bitrates */
-        for( j = 0; j < hb_list_count( title->list_audio ); j++ )
+        while ( ( audio = hb_list_item( pd->title->list_audio, 0 ) ) )
         {
-            hb_audio_t * audio = hb_list_item( title->list_audio, j );
+            hb_list_rem( pd->title->list_audio, audio );
             if ( audio->priv.scan_cache )
             {
                 hb_fifo_flush( audio->priv.scan_cache );
+                hb_fifo_close( &audio->priv.scan_cache );
             }
+            hb_audio_close( &audio );
         }
-        if (vid_buf)
-        {
-            hb_buffer_close( &vid_buf );
-        }
+        hb_list_close( &pd->title->list_audio );
+        free( pd->title );
+        free( pd->audio_found );
     }
-    UpdateState3(data, i);
+    free( pds );
+    hb_lock_close( &audio_lock );
+
+    return !*data->die;
+}
 
-    vid_decoder->close( vid_decoder );
-    free( vid_decoder );
+/*
+ * Number of decoders to decode previews with.  Discs are always read
+ * with a single decoder, seeking around on them is slow and they only
+ * offer one reader anyway.  Neither are files of a concurrent batch
+ * scan, those already keep a thread per file busy.
+ */
+static int preview_decoder_count( hb_scan_t * data )
+{
+    int count;
+
+    if ( data->bd || data->dvd || data->batch_worker )
+    {
+        return 1;
+    }
+    count = hb_get_cpu_count();
+    if ( count > HB_SCAN_MAX_PREVIEW_DECODERS )
+    {
+        count = HB_SCAN_MAX_PREVIEW_DECODERS;
+    }
+    if ( count > data->preview_count )
+    {
+        count = data->preview_count;
+    }
+    return count;
+}
+
+/***********************************************************************
+ * DecodePreviews
+ ***********************************************************************
+ * Decode 10 pictures for the given title.
+ * It assumes that data->reader and data->vts have successfully been
+ * DVDOpen()ed and ifoOpen()ed.
+ **********************************************************************/
+static int DecodePreviews( hb_scan_t * data, hb_title_t * title )
+{
+    int             i, npreviews = 0;
+    int progressive_count = 0;
+    int pulldown_count = 0;
+    int doubled_frame_count = 0;
+    int interlaced_preview_count = 0;
+    info_list_t * info_list = calloc( data->preview_count+1, sizeof(*info_list) );
+    crop_record_t *crops = crop_record_init( data->preview_count );
+    preview_result_t * results;
+    int ndecoders = preview_decoder_count( data );
+
+    if( data->batch )
+    {
+        hb_log( "scan: decoding previews for title %d (%s)", title->index, title->path );
+    }
+    else
+    {
+        hb_log( "scan: decoding previews for title %d", title->index );
+    }
+
+    if (data->bd)
+    {
+        hb_bd_start( data->bd, title );
+        hb_log( "scan: title angle(s) %d", title->angle_count );
+    }
+    else if (data->dvd)
+    {
+        hb_dvd_start( data->dvd, title, 1 );
+        title->angle_count = hb_dvd_angle_count( data->dvd );
+        hb_log( "scan: title angle(s) %d", title->angle_count );
+    }
+    else if (data->batch && ndecoders <= 1)
+    {
+        data->stream = hb_stream_open( title->path, title, 1 );
+    }
+
+    if (title->video_codec == WORK_NONE)
+    {
+        hb_error("No video decoder set!");
+        return 0;
+    }
+
+    results = calloc( data->preview_count, sizeof( preview_result_t ) );
+    if ( ndecoders > 1 )
+    {
+        i = DecodePreviewsParallel( data, title, results, ndecoders );
+    }
+    else
+    {
+        i = DecodePreviewsSerial( data, title, results );
+    }
 
     if ( data->batch && data->stream )
     {
         hb_stream_close( &data->stream );
     }
 
+    if ( !i )
+    {
+        free( results );
+        free( info_list );
+        crop_record_free( crops );
+        return 0;
+    }
+
+    for ( i = 0; i < data->preview_count; i++ )
+    {
+        preview_result_t * res = &results[i];
+
+        if ( !res->decoded )
+        {
+            continue;
+        }
+        remember_info( info_list, &res->info );
+        pulldown_count += res->pulldown;
+        doubled_frame_count += res->doubled;
+        progressive_count += res->progressive;
+        interlaced_preview_count += res->interlaced;
+        if ( res->cropped )
+        {
+            record_crop( crops, res->t, res->b, res->l, res->r );
+        }
+        ++npreviews;
+    }
+    free( results );
     if ( npreviews )
     {
         // use the most common frame info for our final title dimensions
         hb_work_info_t vid_info;
+        char arstr[32];
         most_common_info( info_list, &vid_info );
 
         title->has_resolution_change = has_resolution_change( info_list );
@@ -920,7 +1532,8 @@ skip_preview:
                 npreviews, title->width, title->height, (float) title->rate /
                 (float) title->rate_base,
                 title->crop[0], title->crop[1], title->crop[2], title->crop[3],
-                aspect_to_string( title->aspect ), title->pixel_aspect_width,
+                aspect_to_string( arstr, title->aspect ),
+                title->pixel_aspect_width,
                 title->pixel_aspect_height );
 
         if( interlaced_preview_count >= ( npreviews / 2 ) )
@@ -937,12 +1550,6 @@ skip_preview:
     crop_record_free( crops );
     free( info_list );
 
-    while( ( buf_es = hb_list_item( list_es, 0 ) ) )
-    {
-        hb_list_rem( list_es, buf_es );
-        hb_buffer_close( &buf_es );
-    }
-    hb_list_close( &list_es );
     if (data->bd)
       hb_bd_stop( data->bd );
     if (data->dvd)
@@ -1282,6 +1889,12 @@ static void UpdateState3(hb_scan_t *scan, int preview)
 {
     hb_state_t state;
 
+    if ( scan->batch_worker )
+    {
+        // Several titles are decoding at once, per preview progress
+        // of any one of them would make the title progress jump around
+        return;
+    }
     hb_get_state2(scan->h, &state);
 #define p state.param.scanning
     p.preview_cur = preview;
@@ -0,0 +1,793 @@
+/* scancache.c
+
+   Copyright (c) 2003-2014 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Persistent cache of scan results.
+ *
+ * A scan of an unchanged source always produces the same title set, so
+ * the titles found by ScanFunc() (chapters, audio and subtitle tracks,
+ * attachments, metadata, autocrop, detected interlacing and the preview
+ * frames themselves) are written to a file in the cache directory and
+ * read back on the next scan of the same source instead of parsing and
+ * decoding it again.
+ *
+ * Sources are identified by a fingerprint made of the path, size and
+ * modification time of the file and a hash of its first and last
+ * megabyte.  Only regular files (streams and disc images) are cached.
+ *
+ * The structs are stored as raw copies with their pointer members
+ * written separately, so a cache file is only valid for the build that
+ * wrote it.  The header records the build and the struct sizes and
+ * anything else is treated as a miss.
+ */
+
+#include "hb.h"
+
+#define HB_SCAN_CACHE_MAGIC     0x43534248  // "HBSC"
+#define HB_SCAN_CACHE_VERSION   1
+#define HB_SCAN_CACHE_HASH_SIZE (1024 * 1024)
+
+// Sanity limits for lengths read back from a cache file
+#define HB_SCAN_CACHE_MAX_STR   (1024 * 1024)
+#define HB_SCAN_CACHE_MAX_BLOB  (256 * 1024 * 1024)
+#define HB_SCAN_CACHE_MAX_COUNT 65536
+
+struct hb_scan_cache_s
+{
+    char     * dir;
+    char     * path;
+    int64_t    size;
+    int64_t    mtime;
+    uint64_t   hash;
+
+    int        title_index;
+    int        preview_count;
+    int        store_previews;
+    uint64_t   min_duration;
+
+    char       filename[1024];
+};
+
+typedef struct
+{
+    FILE * file;
+    int    error;
+} cache_io_t;
+
+static hb_chan_map_t * chan_maps[] =
+{
+    NULL,
+    &hb_libav_chan_map,
+    &hb_liba52_chan_map,
+    &hb_vorbis_chan_map,
+    &hb_aac_chan_map,
+};
+#define CHAN_MAP_COUNT (sizeof( chan_maps ) / sizeof( chan_maps[0] ))
+
+/***********************************************************************
+ * Fingerprint
+ **********************************************************************/
+static uint64_t hash_bytes( uint64_t hash, const void * data, size_t size )
+{
+    // 64 bit FNV-1a
+    const uint8_t * p = data;
+    size_t          ii;
+
+    for( ii = 0; ii < size; ii++ )
+    {
+        hash ^= p[ii];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static int hash_range( FILE * file, int64_t offset, int64_t size,
+                       uint8_t * buf, uint64_t * hash )
+{
+    if( fseeko( file, offset, SEEK_SET ) )
+    {
+        return -1;
+    }
+    while( size > 0 )
+    {
+        size_t len = size < HB_SCAN_CACHE_HASH_SIZE ? size :
+                                                      HB_SCAN_CACHE_HASH_SIZE;
+        if( fread( buf, 1, len, file ) != len )
+        {
+            return -1;
+        }
+        *hash = hash_bytes( *hash, buf, len );
+        size -= len;
+    }
+    return 0;
+}
+
+/*
+ * Hash the first and last HB_SCAN_CACHE_HASH_SIZE bytes of the file,
+ * or the whole file when it is smaller than both together.
+ */
+static int hash_content( const char * path, int64_t size, uint64_t * hash )
+{
+    FILE    * file;
+    uint8_t * buf;
+    int       err;
+
+    file = hb_fopen( path, "rb" );
+    if( file == NULL )
+    {
+        return -1;
+    }
+    buf = malloc( HB_SCAN_CACHE_HASH_SIZE );
+    if( buf == NULL )
+    {
+        fclose( file );
+        return -1;
+    }
+
+    *hash = 0xcbf29ce484222325ULL;
+    if( size <= 2 * HB_SCAN_CACHE_HASH_SIZE )
+    {
+        err = hash_range( file, 0, size, buf, hash );
+    }
+    else
+    {
+        err = hash_range( file, 0, HB_SCAN_CACHE_HASH_SIZE, buf, hash ) ||
+              hash_range( file, size - HB_SCAN_CACHE_HASH_SIZE,
+                          HB_SCAN_CACHE_HASH_SIZE, buf, hash );
+    }
+    free( buf );
+    fclose( file );
+    return err ? -1 : 0;
+}
+
+/***********************************************************************
+ * hb_scan_cache_init
+ ***********************************************************************
+ * Fingerprints the source and works out the name of its cache file.
+ * Returns NULL when the source can't be cached.
+ **********************************************************************/
+hb_scan_cache_t * hb_scan_cache_init( const char * dir, const char * path,
+                                      int title_index, int preview_count,
+                                      int store_previews,
+                                      uint64_t min_duration )
+{
+    hb_scan_cache_t * cache;
+    hb_stat_t         st;
+    uint64_t          key;
+
+    if( hb_stat( path, &st ) || !S_ISREG( st.st_mode ) )
+    {
+        hb_log( "scan: cache not used, %s is not a regular file", path );
+        return NULL;
+    }
+
+    cache = calloc( 1, sizeof( hb_scan_cache_t ) );
+    cache->dir            = strdup( dir );
+    cache->path           = strdup( path );
+    cache->size           = st.st_size;
+    cache->mtime          = st.st_mtime;
+    cache->title_index    = title_index;
+    cache->preview_count  = preview_count;
+    cache->store_previews = store_previews;
+    cache->min_duration   = min_duration;
+
+    if( hash_content( path, cache->size, &cache->hash ) )
+    {
+        hb_log( "scan: cache not used, failed to read %s", path );
+        hb_scan_cache_close( &cache );
+        return NULL;
+    }
+
+    // Scans with different parameters produce different title sets,
+    // so the parameters are part of the key as well
+    key = hash_bytes( cache->hash, path, strlen( path ) );
+    key = hash_bytes( key, &cache->size, sizeof( cache->size ) );
+    key = hash_bytes( key, &cache->mtime, sizeof( cache->mtime ) );
+    key = hash_bytes( key, &title_index, sizeof( title_index ) );
+    key = hash_bytes( key, &preview_count, sizeof( preview_count ) );
+    key = hash_bytes( key, &store_previews, sizeof( store_previews ) );
+    key = hash_bytes( key, &min_duration, sizeof( min_duration ) );
+
+    snprintf( cache->filename, sizeof( cache->filename ),
+              "%s/%016"PRIx64".hbscan", dir, key );
+    return cache;
+}
+
+void hb_scan_cache_close( hb_scan_cache_t ** _cache )
+{
+    hb_scan_cache_t * cache = *_cache;
+
+    if( cache == NULL )
+    {
+        return;
+    }
+    free( cache->dir );
+    free( cache->path );
+    free( cache );
+    *_cache = NULL;
+}
+
+/***********************************************************************
+ * Serialization helpers
+ **********************************************************************/
+static void put( cache_io_t * io, const void * data, size_t size )
+{
+    if( !io->error && size && fwrite( data, size, 1, io->file ) != 1 )
+    {
+        io->error = 1;
+    }
+}
+
+static void put_int( cache_io_t * io, int32_t val )
+{
+    put( io, &val, sizeof( val ) );
+}
+
+static void put_int64( cache_io_t * io, int64_t val )
+{
+    put( io, &val, sizeof( val ) );
+}
+
+static void put_blob( cache_io_t * io, const void * data, int size )
+{
+    put_int( io, data != NULL ? size : -1 );
+    if( data != NULL )
+    {
+        put( io, data, size );
+    }
+}
+
+static void put_str( cache_io_t * io, const char * str )
+{
+    put_blob( io, str, str != NULL ? strlen( str ) : 0 );
+}
+
+static void get( cache_io_t * io, void * data, size_t size )
+{
+    if( !io->error && size && fread( data, size, 1, io->file ) != 1 )
+    {
+        io->error = 1;
+    }
+}
+
+static int32_t get_int( cache_io_t * io )
+{
+    int32_t val = 0;
+    get( io, &val, sizeof( val ) );
+    return val;
+}
+
+static int64_t get_int64( cache_io_t * io )
+{
+    int64_t val = 0;
+    get( io, &val, sizeof( val ) );
+    return val;
+}
+
+static int get_count( cache_io_t * io )
+{
+    int32_t count = get_int( io );
+    if( count < 0 || count > HB_SCAN_CACHE_MAX_COUNT )
+    {
+        io->error = 1;
+        return 0;
+    }
+    return count;
+}
+
+/*
+ * Returns a malloced copy of the next blob, with a terminating 0 so
+ * that strings can be read the same way.  NULL blobs come back as NULL.
+ */
+static void * get_blob( cache_io_t * io, int * size, int max )
+{
+    int32_t   len = get_int( io );
+    uint8_t * data;
+
+    if( size != NULL )
+    {
+        *size = 0;
+    }
+    if( io->error || len < 0 )
+    {
+        return NULL;
+    }
+    if( len > max || ( data = malloc( len + 1 ) ) == NULL )
+    {
+        io->error = 1;
+        return NULL;
+    }
+    get( io, data, len );
+    if( io->error )
+    {
+        free( data );
+        return NULL;
+    }
+    data[len] = 0;
+    if( size != NULL )
+    {
+        *size = len;
+    }
+    return data;
+}
+
+static char * get_str( cache_io_t * io )
+{
+    return get_blob( io, NULL, HB_SCAN_CACHE_MAX_STR );
+}
+
+static int chan_map_index( hb_chan_map_t * map )
+{
+    int ii;
+
+    for( ii = 0; ii < CHAN_MAP_COUNT; ii++ )
+    {
+        if( chan_maps[ii] == map )
+        {
+            return ii;
+        }
+    }
+    return 0;
+}
+
+/***********************************************************************
+ * Titles
+ **********************************************************************/
+static void put_metadata( cache_io_t * io, hb_metadata_t * m )
+{
+    hb_coverart_t * art;
+    int             ii;
+
+    put_str( io, m->name );
+    put_str( io, m->artist );
+    put_str( io, m->composer );
+    put_str( io, m->release_date );
+    put_str( io, m->comment );
+    put_str( io, m->album );
+    put_str( io, m->album_artist );
+    put_str( io, m->genre );
+    put_str( io, m->description );
+    put_str( io, m->long_description );
+
+    put_int( io, hb_list_count( m->list_coverart ) );
+    for( ii = 0; ii < hb_list_count( m->list_coverart ); ii++ )
+    {
+        art = hb_list_item( m->list_coverart, ii );
+        put_int( io, art->type );
+        put_blob( io, art->data, art->size );
+    }
+}
+
+static void get_metadata( cache_io_t * io, hb_metadata_t * m )
+{
+    int ii, count, type, size;
+    uint8_t * data;
+
+    m->name             = get_str( io );
+    m->artist           = get_str( io );
+    m->composer         = get_str( io );
+    m->release_date     = get_str( io );
+    m->comment          = get_str( io );
+    m->album            = get_str( io );
+    m->album_artist     = get_str( io );
+    m->genre            = get_str( io );
+    m->description      = get_str( io );
+    m->long_description = get_str( io );
+
+    count = get_count( io );
+    for( ii = 0; ii < count && !io->error; ii++ )
+    {
+        type = get_int( io );
+        data = get_blob( io, &size, HB_SCAN_CACHE_MAX_BLOB );
+        if( data != NULL )
+        {
+            hb_metadata_add_coverart( m, data, size, type );
+            free( data );
+        }
+    }
+}
+
+static void put_title( cache_io_t * io, hb_title_t * title )
+{
+    hb_title_t        t = *title;
+    hb_chapter_t    * chapter;
+    hb_audio_t      * audio;
+    hb_subtitle_t   * subtitle;
+    hb_attachment_t * attachment;
+    int               ii;
+
+    // Pointer members are stored separately below
+    t.opaque_priv      = NULL;
+    t.video_codec_name = NULL;
+    t.container_name   = NULL;
+    t.metadata         = NULL;
+    t.list_chapter     = NULL;
+    t.list_audio       = NULL;
+    t.list_subtitle    = NULL;
+    t.list_attachment  = NULL;
+#if defined(HB_TITLE_JOBS)
+    t.job              = NULL;
+#endif
+    put( io, &t, sizeof( t ) );
+    put_str( io, title->video_codec_name );
+    put_str( io, title->container_name );
+    put_metadata( io, title->metadata );
+
+    put_int( io, hb_list_count( title->list_chapter ) );
+    for( ii = 0; ii < hb_list_count( title->list_chapter ); ii++ )
+    {
+        hb_chapter_t c;
+
+        chapter = hb_list_item( title->list_chapter, ii );
+        c = *chapter;
+        c.title = NULL;
+        put( io, &c, sizeof( c ) );
+        put_str( io, chapter->title );
+    }
+
+    put_int( io, hb_list_count( title->list_audio ) );
+    for( ii = 0; ii < hb_list_count( title->list_audio ); ii++ )
+    {
+        hb_audio_t a;
+
+        audio = hb_list_item( title->list_audio, ii );
+        a = *audio;
+        a.config.out.name = NULL;
+        a.config.in.channel_map = NULL;
+        memset( &a.priv, 0, sizeof( a.priv ) );
+        put( io, &a, sizeof( a ) );
+        put_str( io, audio->config.out.name );
+        put_int( io, chan_map_index( audio->config.in.channel_map ) );
+    }
+
+    put_int( io, hb_list_count( title->list_subtitle ) );
+    for( ii = 0; ii < hb_list_count( title->list_subtitle ); ii++ )
+    {
+        hb_subtitle_t s;
+
+        subtitle = hb_list_item( title->list_subtitle, ii );
+        s = *subtitle;
+        s.extradata = NULL;
+        s.fifo_in   = NULL;
+        s.fifo_raw  = NULL;
+        s.fifo_sync = NULL;
+        s.fifo_out  = NULL;
+        s.mux_data  = NULL;
+        put( io, &s, sizeof( s ) );
+        put_blob( io, subtitle->extradata, subtitle->extradata_size );
+    }
+
+    put_int( io, hb_list_count( title->list_attachment ) );
+    for( ii = 0; ii < hb_list_count( title->list_attachment ); ii++ )
+    {
+        attachment = hb_list_item( title->list_attachment, ii );
+        put_int( io, attachment->type );
+        put_str( io, attachment->name );
+        put_blob( io, attachment->data, attachment->size );
+    }
+}
+
+static hb_title_t * get_title( cache_io_t * io )
+{
+    hb_title_t * title;
+    int          ii, count;
+
+    title = calloc( 1, sizeof( hb_title_t ) );
+    get( io, title, sizeof( hb_title_t ) );
+    title->list_chapter    = hb_list_init();
+    title->list_audio      = hb_list_init();
+    title->list_subtitle   = hb_list_init();
+    title->list_attachment = hb_list_init();
+    title->metadata        = hb_metadata_init();
+    title->opaque_priv     = NULL;
+#if defined(HB_TITLE_JOBS)
+    title->job             = NULL;
+#endif
+    title->path[sizeof( title->path ) - 1] = 0;
+    title->name[sizeof( title->name ) - 1] = 0;
+
+    title->video_codec_name = get_str( io );
+    title->container_name   = get_str( io );
+    get_metadata( io, title->metadata );
+
+    count = get_count( io );
+    for( ii = 0; ii < count && !io->error; ii++ )
+    {
+        hb_chapter_t * chapter = calloc( 1, sizeof( hb_chapter_t ) );
+
+        get( io, chapter, sizeof( hb_chapter_t ) );
+        chapter->title = get_str( io );
+        hb_list_add( title->list_chapter, chapter );
+    }
+
+    count = get_count( io );
+    for( ii = 0; ii < count && !io->error; ii++ )
+    {
+        hb_audio_t * audio = calloc( 1, sizeof( hb_audio_t ) );
+        int          map;
+
+        get( io, audio, sizeof( hb_audio_t ) );
+        memset( &audio->priv, 0, sizeof( audio->priv ) );
+        audio->config.out.name = get_str( io );
+        map = get_int( io );
+        if( map < 0 || map >= CHAN_MAP_COUNT )
+        {
+            io->error = 1;
+            map = 0;
+        }
+        audio->config.in.channel_map = chan_maps[map];
+        hb_list_add( title->list_audio, audio );
+    }
+
+    count = get_count( io );
+    for( ii = 0; ii < count && !io->error; ii++ )
+    {
+        hb_subtitle_t * subtitle = calloc( 1, sizeof( hb_subtitle_t ) );
+
+        get( io, subtitle, sizeof( hb_subtitle_t ) );
+        subtitle->fifo_in   = NULL;
+        subtitle->fifo_raw  = NULL;
+        subtitle->fifo_sync = NULL;
+        subtitle->fifo_out  = NULL;
+        subtitle->mux_data  = NULL;
+        subtitle->extradata = get_blob( io, &subtitle->extradata_size,
+                                        HB_SCAN_CACHE_MAX_BLOB );
+        hb_list_add( title->list_subtitle, subtitle );
+    }
+
+    count = get_count( io );
+    for( ii = 0; ii < count && !io->error; ii++ )
+    {
+        hb_attachment_t * attachment = calloc( 1, sizeof( hb_attachment_t ) );
+
+        attachment->type = get_int( io );
+        attachment->name = get_str( io );
+        attachment->data = get_blob( io, &attachment->size,
+                                     HB_SCAN_CACHE_MAX_BLOB );
+        hb_list_add( title->list_attachment, attachment );
+    }
+
+    return title;
+}
+
+/***********************************************************************
+ * Previews
+ ***********************************************************************
+ * Previews are copied in and out of the handle's preview store as the
+ * packed planes hb_save_preview stores them as.
+ **********************************************************************/
+static void put_previews( cache_io_t * io, hb_handle_t * h,
+                          hb_title_t * title, int count )
+{
+    uint8_t * data;
+    int       ii, size;
+
+    for( ii = 0; ii < count && !io->error; ii++ )
+    {
+        size = 0;
+        data = hb_get_preview_data( h, title->index, ii, &size );
+        if( data != NULL && size >= HB_SCAN_CACHE_MAX_BLOB )
+        {
+            free( data );
+            data = NULL;
+            size = 0;
+        }
+        // Previews that failed to decode are recorded as missing
+        put_blob( io, data, size );
+        free( data );
+    }
+}
+
+static void get_previews( cache_io_t * io, hb_handle_t * h,
+                          hb_title_t * title, int count )
+{
+    uint8_t * data;
+    int       ii, size;
+
+    for( ii = 0; ii < count && !io->error; ii++ )
+    {
+        data = get_blob( io, &size, HB_SCAN_CACHE_MAX_BLOB );
+        if( data == NULL )
+        {
+            continue;
+        }
+        if( hb_set_preview_data( h, title->index, ii, data, size ) < 0 )
+        {
+            hb_error( "scan: failed to restore preview %d of title %d",
+                      ii, title->index );
+            io->error = 1;
+        }
+    }
+}
+
+/***********************************************************************
+ * Header
+ **********************************************************************/
+static void put_header( cache_io_t * io, hb_scan_cache_t * cache )
+{
+    put_int( io, HB_SCAN_CACHE_MAGIC );
+    put_int( io, HB_SCAN_CACHE_VERSION );
+    put_int( io, HB_PROJECT_BUILD );
+    put_int( io, sizeof( hb_title_t ) );
+    put_int( io, sizeof( hb_chapter_t ) );
+    put_int( io, sizeof( hb_audio_t ) );
+    put_int( io, sizeof( hb_subtitle_t ) );
+
+    put_str( io, cache->path );
+    put_int64( io, cache->size );
+    put_int64( io, cache->mtime );
+    put_int64( io, cache->hash );
+    put_int( io, cache->title_index );
+    put_int( io, cache->preview_count );
+    put_int( io, cache->store_previews );
+    put_int64( io, cache->min_duration );
+}
+
+static int check_header( cache_io_t * io, hb_scan_cache_t * cache )
+{
+    char * path;
+    int    match;
+
+    if( get_int( io ) != HB_SCAN_CACHE_MAGIC ||
+        get_int( io ) != HB_SCAN_CACHE_VERSION ||
+        get_int( io ) != HB_PROJECT_BUILD ||
+        get_int( io ) != sizeof( hb_title_t ) ||
+        get_int( io ) != sizeof( hb_chapter_t ) ||
+        get_int( io ) != sizeof( hb_audio_t ) ||
+        get_int( io ) != sizeof( hb_subtitle_t ) )
+    {
+        return 0;
+    }
+
+    path = get_str( io );
+    match = path != NULL && !strcmp( path, cache->path );
+    free( path );
+
+    match = match &&
+            get_int64( io ) == cache->size &&
+            get_int64( io ) == cache->mtime &&
+            (uint64_t)get_int64( io ) == cache->hash &&
+            get_int( io ) == cache->title_index &&
+            get_int( io ) == cache->preview_count &&
+            get_int( io ) == cache->store_previews &&
+            (uint64_t)get_int64( io ) == cache->min_duration;
+
+    return match && !io->error;
+}
+
+/***********************************************************************
+ * hb_scan_cache_load
+ ***********************************************************************
+ * Fills title_set from the cache file.  Returns 1 on a hit.
+ **********************************************************************/
+int hb_scan_cache_load( hb_scan_cache_t * cache, hb_handle_t * h,
+                        hb_title_set_t * title_set )
+{
+    cache_io_t   io;
+    hb_list_t  * list;
+    hb_title_t * title;
+    int          ii, count, feature;
+
+    io.file = hb_fopen( cache->filename, "rb" );
+    io.error = 0;
+    if( io.file == NULL )
+    {
+        return 0;
+    }
+    if( !check_header( &io, cache ) )
+    {
+        hb_log( "scan: stale cache entry %s", cache->filename );
+        fclose( io.file );
+        return 0;
+    }
+
+    list = hb_list_init();
+    feature = get_int( &io );
+    count = get_count( &io );
+    for( ii = 0; ii < count && !io.error; ii++ )
+    {
+        title = get_title( &io );
+        hb_list_add( list, title );
+        if( cache->store_previews )
+        {
+            get_previews( &io, h, title, cache->preview_count );
+        }
+    }
+    fclose( io.file );
+
+    if( io.error )
+    {
+        hb_error( "scan: corrupt cache entry %s", cache->filename );
+        while( ( title = hb_list_item( list, 0 ) ) )
+        {
+            // Don't let previews restored from the bad entry stand in
+            // for the ones the real scan is about to make
+            if( cache->store_previews )
+            {
+                hb_clear_preview_data( h, title->index,
+                                       cache->preview_count );
+            }
+            hb_list_rem( list, title );
+            hb_title_close( &title );
+        }
+        hb_list_close( &list );
+        return 0;
+    }
+
+    while( ( title = hb_list_item( list, 0 ) ) )
+    {
+        hb_list_rem( list, title );
+        hb_list_add( title_set->list_title, title );
+    }
+    hb_list_close( &list );
+    title_set->feature = feature;
+
+    hb_log( "scan: using cached scan of %s (%d title(s))",
+            cache->path, count );
+    return 1;
+}
+
+/***********************************************************************
+ * hb_scan_cache_save
+ ***********************************************************************
+ * Writes title_set to the cache.  The file is written under a temporary
+ * name and renamed into place so that concurrent scans of the same
+ * source never see a partial entry.
+ **********************************************************************/
+void hb_scan_cache_save( hb_scan_cache_t * cache, hb_handle_t * h,
+                         hb_title_set_t * title_set )
+{
+    cache_io_t   io;
+    hb_title_t * title;
+    char         tmpname[1024];
+    int          ii;
+
+    hb_mkdir( cache->dir );
+    snprintf( tmpname, sizeof( tmpname ), "%s.%d.%d.tmp", cache->filename,
+              (int)getpid(), hb_get_instance_id( h ) );
+    io.file = hb_fopen( tmpname, "wb" );
+    io.error = 0;
+    if( io.file == NULL )
+    {
+        hb_error( "scan: can't create cache entry %s", tmpname );
+        return;
+    }
+
+    put_header( &io, cache );
+    put_int( &io, title_set->feature );
+    put_int( &io, hb_list_count( title_set->list_title ) );
+    for( ii = 0; ii < hb_list_count( title_set->list_title ); ii++ )
+    {
+        title = hb_list_item( title_set->list_title, ii );
+        put_title( &io, title );
+        if( cache->store_previews )
+        {
+            put_previews( &io, h, title, cache->preview_count );
+        }
+    }
+    if( fclose( io.file ) )
+    {
+        io.error = 1;
+    }
+
+#if defined( SYS_MINGW )
+    // rename() doesn't replace existing files on windows
+    if( !io.error )
+    {
+        remove( cache->filename );
+    }
+#endif
+    if( io.error || rename( tmpname, cache->filename ) )
+    {
+        hb_error( "scan: failed to write cache entry %s", cache->filename );
+        remove( tmpname );
+        return;
+    }
+    hb_log( "scan: cached scan results in %s", cache->filename );
+}
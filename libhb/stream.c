@@ -10,6 +10,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include "hb.h"
 #include "hbffmpeg.h"
@@ -20,6 +21,13 @@
 #define min(a, b) a < b ? a : b
 #define HB_MAX_PROBE_SIZE (1*1024*1024)
 
+// TS and PS input is read in blocks of STREAM_BLOCK_SIZE bytes.  The
+// last STREAM_HISTORY bytes before the read position are kept when the
+// buffer is refilled so that short backward seeks never touch the file.
+#define STREAM_BLOCK_SIZE   (1024*1024)
+#define STREAM_BUFFER_SIZE  (4*STREAM_BLOCK_SIZE)
+#define STREAM_HISTORY      (64*1024)
+
 /*
  * This table defines how ISO MPEG stream type codes map to HandBrake
  * codecs. It is indexed by the 8 bit stream type and contains the codec
@@ -168,7 +176,6 @@ struct hb_stream_s
         int64_t last_timestamp; // used for discontinuity detection when
                                 // there are no PCRs
 
-        uint8_t *packet;        // buffer for one TS packet
         hb_ts_stream_t *list;
         int count;
         int alloc;
@@ -197,6 +204,13 @@ struct hb_stream_s
 
     char    *path;
     FILE    *file_handle;
+    struct
+    {
+        uint8_t *buf;           // STREAM_BUFFER_SIZE bytes of file data
+        int      size;          // valid bytes in buf
+        int      pos;           // read position in buf
+        off_t    offset;        // file offset of buf[0]
+    } in;
     hb_stream_type_t hb_stream_type;
     hb_title_t *title;
 
@@ -285,6 +299,180 @@ static void hb_ps_resolve_stream_types(hb_stream_t *stream);
 void hb_ts_stream_reset(hb_stream_t *stream);
 void hb_ps_stream_reset(hb_stream_t *stream);
 
+/*
+ * Buffered input for transport and program streams.
+ *
+ * Packets are parsed directly out of a large buffer that is refilled one
+ * block at a time, which replaces the per-packet fread() and getc()
+ * calls and the small backward fseeko()s the demuxers used to make.
+ * Reads always end on a STREAM_BLOCK_SIZE boundary of the file.  The
+ * position of file_handle is always in.offset + in.size.
+ */
+static void stream_input_init( hb_stream_t *stream, FILE *f )
+{
+    stream->file_handle = f;
+    stream->in.size = 0;
+    stream->in.pos = 0;
+    stream->in.offset = 0;
+
+    // We do our own buffering, a second copy through stdio is wasted
+    setvbuf( f, NULL, _IONBF, 0 );
+#if defined( POSIX_FADV_SEQUENTIAL )
+    posix_fadvise( fileno( f ), 0, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+}
+
+static void stream_input_close( hb_stream_t *stream )
+{
+    if ( stream->file_handle )
+    {
+        fclose( stream->file_handle );
+        stream->file_handle = NULL;
+    }
+    free( stream->in.buf );
+    stream->in.buf = NULL;
+    stream->in.size = 0;
+    stream->in.pos = 0;
+}
+
+/*
+ * Make at least 'len' bytes available at the read position.
+ * Returns the number of bytes available, which is less than 'len'
+ * only at eof.
+ */
+static int stream_fill( hb_stream_t *stream, int len )
+{
+    int avail = stream->in.size - stream->in.pos;
+    int discard, space, n;
+
+    if ( avail >= len )
+    {
+        return avail;
+    }
+    if ( stream->in.buf == NULL )
+    {
+        stream->in.buf = malloc( STREAM_BUFFER_SIZE );
+        if ( stream->in.buf == NULL )
+        {
+            hb_error( "stream_fill: out of memory" );
+            return avail;
+        }
+    }
+
+    discard = stream->in.pos - STREAM_HISTORY;
+    if ( discard > 0 )
+    {
+        memmove( stream->in.buf, stream->in.buf + discard,
+                 stream->in.size - discard );
+        stream->in.size -= discard;
+        stream->in.pos -= discard;
+        stream->in.offset += discard;
+    }
+
+    while ( avail < len )
+    {
+        space = STREAM_BUFFER_SIZE - stream->in.size;
+        if ( space <= 0 )
+        {
+            break;
+        }
+        // Stop at a block boundary so the following reads stay aligned
+        n = space - ( stream->in.offset + STREAM_BUFFER_SIZE ) %
+                    STREAM_BLOCK_SIZE;
+        if ( n <= 0 )
+        {
+            n = space;
+        }
+        n = fread( stream->in.buf + stream->in.size, 1, n,
+                   stream->file_handle );
+        if ( n <= 0 )
+        {
+            break;
+        }
+        stream->in.size += n;
+        avail += n;
+    }
+    return avail;
+}
+
+/*
+ * Return a pointer to the next 'len' bytes and advance past them, or NULL
+ * if fewer than 'len' bytes remain.  The data stays valid until the next
+ * read from the stream.
+ */
+static const uint8_t *stream_get( hb_stream_t *stream, int len )
+{
+    const uint8_t *p;
+
+    if ( stream_fill( stream, len ) < len )
+    {
+        return NULL;
+    }
+    p = stream->in.buf + stream->in.pos;
+    stream->in.pos += len;
+    return p;
+}
+
+static int stream_read( hb_stream_t *stream, void *dst, int len )
+{
+    int avail = stream_fill( stream, len );
+
+    if ( avail > len )
+    {
+        avail = len;
+    }
+    memcpy( dst, stream->in.buf + stream->in.pos, avail );
+    stream->in.pos += avail;
+    return avail;
+}
+
+static inline int stream_getc( hb_stream_t *stream )
+{
+    if ( stream->in.pos >= stream->in.size && stream_fill( stream, 1 ) < 1 )
+    {
+        return EOF;
+    }
+    return stream->in.buf[stream->in.pos++];
+}
+
+static off_t stream_tell( hb_stream_t *stream )
+{
+    return stream->in.offset + stream->in.pos;
+}
+
+static int stream_seek( hb_stream_t *stream, off_t pos, int whence )
+{
+    if ( whence == SEEK_CUR )
+    {
+        pos += stream_tell( stream );
+    }
+    if ( pos >= stream->in.offset &&
+         pos <= stream->in.offset + stream->in.size )
+    {
+        stream->in.pos = pos - stream->in.offset;
+        return 0;
+    }
+    if ( fseeko( stream->file_handle, pos, SEEK_SET ) == -1 )
+    {
+        return -1;
+    }
+    stream->in.offset = pos;
+    stream->in.size = 0;
+    stream->in.pos = 0;
+    return 0;
+}
+
+static off_t stream_file_size( hb_stream_t *stream )
+{
+    off_t size;
+
+    fseeko( stream->file_handle, 0, SEEK_END );
+    size = ftello( stream->file_handle );
+    fseeko( stream->file_handle, stream->in.offset + stream->in.size,
+            SEEK_SET );
+    return size;
+}
+
 /*
  * logging routines.
  * these frontend hb_log because transport streams can have a lot of errors
@@ -544,7 +732,7 @@ static int hb_stream_check_for_ps(hb_stream_t *stream)
     uint8_t sc_buf[4];
     int pos = 0;
 
-    fseek(stream->file_handle, 0, SEEK_SET);
+    stream_seek( stream, 0, SEEK_SET );
 
     // program streams should start with a PACK then some other mpeg start
     // code (usually a SYS but that might be missing if we only have a clip).
@@ -552,7 +740,7 @@ static int hb_stream_check_for_ps(hb_stream_t *stream)
     {
         int offset;
 
-        if ( fread(buf, 1, sizeof(buf), stream->file_handle) != sizeof(buf) )
+        if ( stream_read( stream, buf, sizeof(buf) ) != sizeof(buf) )
             return 0;
 
         for ( offset = 0; offset < 8*1024-27; ++offset )
@@ -582,23 +770,23 @@ static int hb_stream_check_for_ps(hb_stream_t *stream)
                 data_len = (b[4] << 8) + b[5];
                 if ( data_len && sid > 0xba && sid < 0xf9 )
                 {
-                    prev = ftell( stream->file_handle );
+                    prev = stream_tell( stream );
                     pos = prev - ( sizeof(buf) - offset );
                     pos += pes_offset + 6 + data_len;
-                    fseek( stream->file_handle, pos, SEEK_SET );
-                    if ( fread(sc_buf, 1, 4, stream->file_handle) != 4 )
+                    stream_seek( stream, pos, SEEK_SET );
+                    if ( stream_read( stream, sc_buf, 4 ) != 4 )
                         return 0;
                     if (sc_buf[0] == 0x00 && sc_buf[1] == 0x00 &&
                         sc_buf[2] == 0x01)
                     {
                         return 1;
                     }
-                    fseek( stream->file_handle, prev, SEEK_SET );
+                    stream_seek( stream, prev, SEEK_SET );
                 }
             }
         }
-        fseek( stream->file_handle, -27, SEEK_CUR );
-        pos = ftell( stream->file_handle );
+        stream_seek( stream, -27, SEEK_CUR );
+        pos = stream_tell( stream );
     }
     return 0;
 }
@@ -607,7 +795,7 @@ static int hb_stream_get_type(hb_stream_t *stream)
 {
     uint8_t buf[2048*4];
 
-    if ( fread(buf, 1, sizeof(buf), stream->file_handle) == sizeof(buf) )
+    if ( stream_read( stream, buf, sizeof(buf) ) == sizeof(buf) )
     {
 #ifdef USE_HWD
         if ( hb_gui_use_hwd_flag == 1 )
@@ -640,19 +828,10 @@ static int hb_stream_get_type(hb_stream_t *stream)
 
 static void hb_stream_delete_dynamic( hb_stream_t *d )
 {
-    if( d->file_handle )
-    {
-        fclose( d->file_handle );
-        d->file_handle = NULL;
-    }
+    stream_input_close( d );
 
     int i=0;
 
-    if ( d->ts.packet )
-    {
-        free( d->ts.packet );
-        d->ts.packet = NULL;
-    }
     if ( d->ts.list )
     {
         for (i = 0; i < d->ts.count; i++)
@@ -839,7 +1018,7 @@ hb_stream_t * hb_stream_open( char *path, hb_title_t *title, int scan )
      * If it's something we can deal with (MPEG2 PS or TS) return a stream
      * reference structure & null otherwise.
      */
-    d->file_handle = f;
+    stream_input_init( d, f );
     d->title = title;
     d->scan = scan;
     d->path = strdup( path );
@@ -856,17 +1035,13 @@ hb_stream_t * hb_stream_open( char *path, hb_title_t *title, int scan )
             hb_stream_seek( d, 0. );
             return d;
         }
-        fclose( d->file_handle );
-        d->file_handle = NULL;
+        stream_input_close( d );
         if ( ffmpeg_open( d, title, scan ) )
         {
             return d;
         }
     }
-    if ( d->file_handle )
-    {
-        fclose( d->file_handle );
-    }
+    stream_input_close( d );
     if (d->path)
     {
         free( d->path );
@@ -939,7 +1114,6 @@ hb_stream_t * hb_bd_stream_open( hb_title_t *title )
     d->file_handle = NULL;
     d->title = title;
     d->path = NULL;
-    d->ts.packet = NULL;
 
     int pid = title->video_id;
     int stream_type = title->video_stream_type;
@@ -1136,21 +1310,20 @@ hb_title_t * hb_stream_title_scan(hb_stream_t *stream, hb_title_t * title)
  */
 static const uint8_t *next_packet( hb_stream_t *stream )
 {
-    uint8_t *buf = stream->ts.packet + stream->packetsize - 188;
-
     while ( 1 )
     {
-        if ( fread(stream->ts.packet, 1, stream->packetsize, stream->file_handle) !=
-             stream->packetsize )
+        const uint8_t *buf = stream_get( stream, stream->packetsize );
+        if ( buf == NULL )
         {
             return NULL;
         }
+        buf += stream->packetsize - 188;
         if (buf[0] == 0x47)
         {
             return buf;
         }
         // lost sync - back up to where we started then try to re-establish.
-        off_t pos = ftello(stream->file_handle) - stream->packetsize;
+        off_t pos = stream_tell(stream) - stream->packetsize;
         off_t pos2 = align_to_next_packet(stream);
         if ( pos2 == 0 )
         {
@@ -1171,21 +1344,19 @@ static void skip_to_next_pack( hb_stream_t *src_stream )
     uint32_t strt_code = -1;
     int c;
 
-    flockfile( src_stream->file_handle );
-    while ( ( c = getc_unlocked( src_stream->file_handle ) ) != EOF )
+    while ( ( c = stream_getc( src_stream ) ) != EOF )
     {
         strt_code = ( strt_code << 8 ) | c;
         if ( strt_code == 0x000001ba )
             // we found the start of the next pack
             break;
     }
-    funlockfile( src_stream->file_handle );
 
     // if we didn't terminate on an eof back up so the next read
     // starts on the pack boundary.
     if ( c != EOF )
     {
-        fseeko( src_stream->file_handle, -4, SEEK_CUR );
+        stream_seek( src_stream, -4, SEEK_CUR );
     }
 }
 
@@ -1544,7 +1715,7 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
     {
         const uint8_t *buf;
         int adapt_len;
-        fseeko( stream->file_handle, fpos, SEEK_SET );
+        stream_seek( stream, fpos, SEEK_SET );
         align_to_next_packet( stream );
         int pid = stream->ts.list[ts_index_of_video(stream)].pid;
         buf = hb_ts_stream_getPEStype( stream, pid, &adapt_len );
@@ -1572,7 +1743,7 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
                 ++stream->has_IDRs;
             }
         }
-        pp.pos = ftello(stream->file_handle);
+        pp.pos = stream_tell(stream);
         if ( !stream->has_IDRs )
         {
             // Scan a little more to see if we will stumble upon one
@@ -1597,7 +1768,7 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
 
         // round address down to nearest dvd sector start
         fpos &=~ ( HB_DVD_READ_BUFFER_SIZE - 1 );
-        fseeko( stream->file_handle, fpos, SEEK_SET );
+        stream_seek( stream, fpos, SEEK_SET );
         if ( stream->hb_stream_type == program )
         {
             skip_to_next_pack( stream );
@@ -1642,7 +1813,7 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
         }
 
         pp.pts = pes_info.pts;
-        pp.pos = ftello(stream->file_handle);
+        pp.pos = stream_tell(stream);
     }
     return pp;
 }
@@ -1702,8 +1873,7 @@ static void hb_stream_duration(hb_stream_t *stream, hb_title_t *inTitle)
     struct pts_pos *pp = ptspos;
     int i;
 
-    fseeko(stream->file_handle, 0, SEEK_END);
-    uint64_t fsize = ftello(stream->file_handle);
+    uint64_t fsize = stream_file_size(stream);
     uint64_t fincr = fsize / NDURSAMPLES;
     uint64_t fpos = fincr / 2;
     for ( i = NDURSAMPLES; --i >= 0; fpos += fincr )
@@ -1717,7 +1887,7 @@ static void hb_stream_duration(hb_stream_t *stream, hb_title_t *inTitle)
     inTitle->minutes  = ( dur % 3600 ) / 60;
     inTitle->seconds  = dur % 60;
 
-    rewind(stream->file_handle);
+    stream_seek(stream, 0, SEEK_SET);
 }
 
 /***********************************************************************
@@ -1812,16 +1982,15 @@ int hb_stream_seek( hb_stream_t * stream, float f )
     }
     off_t stream_size, cur_pos, new_pos;
     double pos_ratio = f;
-    cur_pos = ftello( stream->file_handle );
-    fseeko( stream->file_handle, 0, SEEK_END );
-    stream_size = ftello( stream->file_handle );
+    cur_pos = stream_tell( stream );
+    stream_size = stream_file_size( stream );
     new_pos = (off_t) ((double) (stream_size) * pos_ratio);
     new_pos &=~ (HB_DVD_READ_BUFFER_SIZE - 1);
 
-    int r = fseeko( stream->file_handle, new_pos, SEEK_SET );
+    int r = stream_seek( stream, new_pos, SEEK_SET );
     if (r == -1)
     {
-        fseeko( stream->file_handle, cur_pos, SEEK_SET );
+        stream_seek( stream, cur_pos, SEEK_SET );
         return 0;
     }
 
@@ -1874,8 +2043,6 @@ static char* strncpyupper( char *dst, const char *src, int len )
 
 static const char *stream_type_name2(hb_stream_t *stream, hb_pes_stream_t *pes)
 {
-    static char codec_name_caps[80];
-
     if ( stream->reg_desc == STR4_TO_UINT32("HDMV") )
     {
         // Names for streams we know about.
@@ -1913,8 +2080,9 @@ static const char *stream_type_name2(hb_stream_t *stream, hb_pes_stream_t *pes)
         AVCodec * codec = avcodec_find_decoder( pes->codec_param );
         if ( codec && codec->name && codec->name[0] )
         {
-            strncpyupper( codec_name_caps, codec->name, 80 );
-            return codec_name_caps;
+            // Keep the name with the stream, a static buffer would be
+            // shared by streams scanned on other threads
+            return strncpyupper( pes->codec_name, codec->name, 80 );
         }
     }
     return "Unknown";
@@ -2214,8 +2382,6 @@ static int hb_ts_stream_init(hb_stream_t *stream)
     }
     stream->pes.count = 0;
 
-    stream->ts.packet = malloc( stream->packetsize );
-
     // Find the audio and video pids in the stream
     if (hb_ts_stream_find_pids(stream) < 0)
     {
@@ -2393,25 +2559,27 @@ static void hb_ps_stream_init(hb_stream_t *stream)
 
 static off_t align_to_next_packet(hb_stream_t *stream)
 {
-    uint8_t buf[MAX_HOLE];
+    const uint8_t *buf;
     off_t pos = 0;
-    off_t start = ftello(stream->file_handle);
+    off_t start = stream_tell(stream);
     off_t orig;
 
     if ( start >= stream->packetsize ) {
         start -= stream->packetsize;
-        fseeko(stream->file_handle, start, SEEK_SET);
+        stream_seek(stream, start, SEEK_SET);
     }
     orig = start;
 
+    // The search runs over the input buffer directly, so sync
+    // recovery only goes back to the file when it needs more data.
     while (1)
     {
-        if (fread(buf, sizeof(buf), 1, stream->file_handle) == 1)
+        if ( stream_fill(stream, MAX_HOLE) >= MAX_HOLE )
         {
-            const uint8_t *bp = buf;
+            const uint8_t *bp = buf = stream->in.buf + stream->in.pos;
             int i;
 
-            for ( i = sizeof(buf) - 8 * stream->packetsize; --i >= 0; ++bp )
+            for ( i = MAX_HOLE - 8 * stream->packetsize; --i >= 0; ++bp )
             {
                 if ( have_ts_sync( bp, stream->packetsize, 8 ) )
                 {
@@ -2423,15 +2591,15 @@ static off_t align_to_next_packet(hb_stream_t *stream)
                 pos = ( bp - buf ) - stream->packetsize + 188;
                 break;
             }
-            fseeko(stream->file_handle, -8 * stream->packetsize, SEEK_CUR);
-            start = ftello(stream->file_handle);
+            stream_seek(stream, MAX_HOLE - 8 * stream->packetsize, SEEK_CUR);
+            start = stream_tell(stream);
         }
         else
         {
             return 0;
         }
     }
-    fseeko(stream->file_handle, start+pos, SEEK_SET);
+    stream_seek(stream, start+pos, SEEK_SET);
     return start - orig + pos;
 }
 
@@ -3246,8 +3414,7 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
     int c;
 
 #define cp (b->data)
-    flockfile( stream->file_handle );
-    while ( ( c = getc_unlocked( stream->file_handle ) ) != EOF )
+    while ( ( c = stream_getc( stream ) ) != EOF )
     {
         start_code = ( start_code << 8 ) | c;
         if ( ( start_code >> 8 )== 0x000001 )
@@ -3279,17 +3446,17 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
         }
 
         // There are at least 8 bytes.  More if this is mpeg2 pack.
-        fread( cp+pos, 1, 8, stream->file_handle );
+        stream_read( stream, cp+pos, 8 );
         int mark = cp[pos] >> 4;
         pos += 8;
 
         if ( mark != 0x02 )
         {
             // mpeg-2 pack,
-            fread( cp+pos, 1, 2, stream->file_handle );
+            stream_read( stream, cp+pos, 2 );
             pos += 2;
             int len = cp[start+13] & 0x7;
-            fread( cp+pos, 1, len, stream->file_handle );
+            stream_read( stream, cp+pos, len );
             pos += len;
         }
     }
@@ -3299,11 +3466,11 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
     else if ( stream_id >= 0xbb )
     {
         int len = 0;
-        c = getc_unlocked( stream->file_handle );
+        c = stream_getc( stream );
         if ( c == EOF )
             goto done;
         len = c << 8;
-        c = getc_unlocked( stream->file_handle );
+        c = stream_getc( stream );
         if ( c == EOF )
             goto done;
         len |= c;
@@ -3319,7 +3486,7 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
         if ( len )
         {
             // Length is non-zero, read the packet all at once
-            len = fread( cp+pos, 1, len, stream->file_handle );
+            len = stream_read( stream, cp+pos, len );
             pos += len;
         }
         else
@@ -3327,7 +3494,7 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
             // Length is zero, read bytes till we find a start code.
             // Only video PES packets are allowed to have zero length.
             start_code = -1;
-            while ( ( c = getc_unlocked( stream->file_handle ) ) != EOF )
+            while ( ( c = stream_getc( stream ) ) != EOF )
             {
                 start_code = ( start_code << 8 ) | c;
                 if ( pos  >= b->alloc )
@@ -3346,14 +3513,14 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
             if ( c == EOF )
                 goto done;
             pos -= 4;
-            fseeko( stream->file_handle, -4, SEEK_CUR );
+            stream_seek( stream, -4, SEEK_CUR );
         }
     }
     else
     {
         // Unknown, find next start code
         start_code = -1;
-        while ( ( c = getc_unlocked( stream->file_handle ) ) != EOF )
+        while ( ( c = stream_getc( stream ) ) != EOF )
         {
             start_code = ( start_code << 8 ) | c;
             if ( pos  >= b->alloc )
@@ -3370,11 +3537,10 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
         if ( c == EOF )
             goto done;
         pos -= 4;
-        fseeko( stream->file_handle, -4, SEEK_CUR );
+        stream_seek( stream, -4, SEEK_CUR );
     }
 done:
     // Parse packet for information we might need
-    funlockfile( stream->file_handle );
     int len = pos - b->size;
     b->size = pos;
 #undef cp
@@ -3749,7 +3915,7 @@ static void hb_ps_stream_find_streams(hb_stream_t *stream)
     int ii, jj;
     hb_buffer_t *buf  = hb_buffer_init(HB_DVD_READ_BUFFER_SIZE);
 
-    fseeko( stream->file_handle, 0, SEEK_SET );
+    stream_seek( stream, 0, SEEK_SET );
     // Scan beginning of file, then if no program stream map is found
     // seek to 20% and scan again since there's occasionally no
     // audio at the beginning (particularly for vobs).
@@ -4371,9 +4537,8 @@ static int hb_ts_stream_find_pids(hb_stream_t *stream)
     // changes PMTs (and thus video & audio PIDs) when 'programs' change. Since
     // we may have the tail of the previous program at the beginning of this
     // file, take our PMT from the middle of the file.
-    fseeko(stream->file_handle, 0, SEEK_END);
-    uint64_t fsize = ftello(stream->file_handle);
-    fseeko(stream->file_handle, fsize >> 1, SEEK_SET);
+    uint64_t fsize = stream_file_size(stream);
+    stream_seek(stream, fsize >> 1, SEEK_SET);
     align_to_next_packet(stream);
 
     // Read the Transport Stream Packets (188 bytes each) looking at first for PID 0 (the PAT PID), then decode that
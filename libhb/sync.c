@@ -158,7 +158,7 @@ hb_work_object_t * hb_sync_init( hb_job_t * job )
     if( job->pass == 2 )
     {
         /* We already have an accurate frame count from pass 1 */
-        hb_interjob_t * interjob = hb_interjob_get( job->h );
+        hb_interjob_t * interjob = job->interjob;
         sync->count_frames_max = interjob->frame_count;
     }
     else
@@ -265,7 +265,7 @@ void syncVideoClose( hb_work_object_t * w )
     if( job->pass == 1 )
     {
         /* Preserve frame count for better accuracy in pass 2 */
-        hb_interjob_t * interjob = hb_interjob_get( job->h );
+        hb_interjob_t * interjob = job->interjob;
         interjob->frame_count = pv->common->count_frames;
         interjob->last_job = job->sequence_id;
     }
@@ -592,6 +592,12 @@ int syncVideoWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
 
             return HB_WORK_OK;
         }
+        if( job->fifo_chunk != NULL && job->pts_to_stop )
+        {
+            // Segment of a chunked encode: end where the next segment
+            // starts, not pts_to_stop after the first frame we kept
+            job->pts_to_stop -= next_start - job->pts_to_start;
+        }
         hb_lock( pv->common->mutex );
         pv->common->audio_pts_thresh = 0;
         pv->common->audio_pts_slip += next_start;
@@ -1515,6 +1521,11 @@ static void UpdateState( hb_work_object_t * w )
         // to find start & end points.
         return;
     }
+    if (pv->job->list_chunk != NULL)
+    {
+        // Progress of chunked encodes is reported by encchunk
+        return;
+    }
 
     if( hb_get_date() > sync->st_dates[3] + 1000 )
     {
@@ -1556,7 +1567,7 @@ static void UpdateState( hb_work_object_t * w )
     }
 #undef p
 
-    hb_set_state( pv->job->h, &state );
+    hb_set_job_state( pv->job, &state );
 }
 
 static void UpdateSearchState( hb_work_object_t * w, int64_t start )
@@ -1624,7 +1635,7 @@ static void UpdateSearchState( hb_work_object_t * w, int64_t start )
     }
 #undef p
 
-    hb_set_state( pv->job->h, &state );
+    hb_set_job_state( pv->job, &state );
 }
 
 static void getPtsOffset( hb_work_object_t * w )
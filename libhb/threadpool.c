@@ -0,0 +1,264 @@
+/* threadpool.c
+
+   Copyright (c) 2003-2014 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "hb.h"
+#include "ports.h"
+#include "threadpool.h"
+
+typedef struct hb_parallel_job_s hb_parallel_job_t;
+
+struct hb_parallel_job_s
+{
+    hb_parallel_func_t * func;
+    void               * arg;
+    int                  count;
+    int                  started;   // Iterations handed out so far
+    int                  completed; // Iterations finished so far
+    hb_parallel_job_t  * next;      // Next job with iterations to hand out
+};
+
+typedef struct
+{
+    int                  thread_count;
+    hb_thread_t       ** threads;
+    hb_lock_t          * lock;
+    hb_cond_t          * work;      // Signalled when iterations are queued
+    hb_cond_t          * complete;  // Signalled when a job finishes
+    hb_parallel_job_t  * head;      // Jobs with iterations left to start
+    hb_parallel_job_t  * tail;
+    int                  die;
+} hb_thread_pool_t;
+
+static hb_thread_pool_t * thread_pool = NULL;
+
+/*
+ * Hand out the next iteration of job, or of the oldest pending job when
+ * job is NULL.  Must be called with pool->lock held.
+ */
+static hb_parallel_job_t * pool_claim( hb_thread_pool_t * pool,
+                                       hb_parallel_job_t * job, int * index )
+{
+    if( job == NULL )
+    {
+        job = pool->head;
+    }
+    if( job == NULL || job->started >= job->count )
+    {
+        return NULL;
+    }
+
+    *index = job->started++;
+    if( job->started == job->count )
+    {
+        /*
+         * Nothing left to start.  Unlink the job so idle workers move on
+         * to the next one.  The queue only holds one entry per filter
+         * thread that is currently inside hb_parallel_for(), so a linear
+         * search for the predecessor is cheap.
+         */
+        hb_parallel_job_t * prev = NULL, * cur = pool->head;
+        while( cur != job )
+        {
+            prev = cur;
+            cur = cur->next;
+        }
+        if( prev != NULL )
+        {
+            prev->next = job->next;
+        }
+        else
+        {
+            pool->head = job->next;
+        }
+        if( pool->tail == job )
+        {
+            pool->tail = prev;
+        }
+        job->next = NULL;
+    }
+    return job;
+}
+
+/*
+ * Record completion of one iteration.
+ * Must be called with pool->lock held.
+ */
+static void pool_complete( hb_thread_pool_t * pool, hb_parallel_job_t * job )
+{
+    if( ++job->completed == job->count )
+    {
+        hb_cond_broadcast( pool->complete );
+    }
+}
+
+static void pool_thread( void * arg )
+{
+    hb_thread_pool_t  * pool = arg;
+    hb_parallel_job_t * job;
+    int                 index;
+
+    hb_lock( pool->lock );
+    while( !pool->die )
+    {
+        job = pool_claim( pool, NULL, &index );
+        if( job == NULL )
+        {
+            hb_cond_wait( pool->work, pool->lock );
+            continue;
+        }
+        hb_unlock( pool->lock );
+
+        job->func( job->arg, index );
+
+        hb_lock( pool->lock );
+        pool_complete( pool, job );
+    }
+    hb_unlock( pool->lock );
+}
+
+int hb_thread_pool_init( int thread_count )
+{
+    hb_thread_pool_t * pool;
+    int                ii;
+
+    if( thread_pool != NULL )
+    {
+        return 0;
+    }
+    if( thread_count < 1 )
+    {
+        thread_count = 1;
+    }
+
+    pool = calloc( 1, sizeof( hb_thread_pool_t ) );
+    if( pool == NULL )
+    {
+        hb_error( "hb_thread_pool_init: out of memory" );
+        return -1;
+    }
+    pool->threads  = calloc( thread_count, sizeof( hb_thread_t * ) );
+    pool->lock     = hb_lock_init();
+    pool->work     = hb_cond_init();
+    pool->complete = hb_cond_init();
+    if( pool->threads == NULL || pool->lock == NULL ||
+        pool->work == NULL || pool->complete == NULL )
+    {
+        hb_error( "hb_thread_pool_init: out of memory" );
+        free( pool->threads );
+        hb_lock_close( &pool->lock );
+        hb_cond_close( &pool->work );
+        hb_cond_close( &pool->complete );
+        free( pool );
+        return -1;
+    }
+
+    for( ii = 0; ii < thread_count; ii++ )
+    {
+        pool->threads[ii] = hb_thread_init( "thread_pool", pool_thread, pool,
+                                            HB_NORMAL_PRIORITY );
+        if( pool->threads[ii] == NULL )
+        {
+            break;
+        }
+    }
+    pool->thread_count = ii;
+    if( pool->thread_count < thread_count )
+    {
+        hb_error( "hb_thread_pool_init: only %d of %d threads started",
+                  pool->thread_count, thread_count );
+    }
+    hb_log( "hb_thread_pool_init: %d worker threads", pool->thread_count );
+
+    thread_pool = pool;
+    return 0;
+}
+
+void hb_thread_pool_close( void )
+{
+    hb_thread_pool_t * pool = thread_pool;
+    int                ii;
+
+    if( pool == NULL )
+    {
+        return;
+    }
+    thread_pool = NULL;
+
+    hb_lock( pool->lock );
+    pool->die = 1;
+    hb_cond_broadcast( pool->work );
+    hb_unlock( pool->lock );
+
+    for( ii = 0; ii < pool->thread_count; ii++ )
+    {
+        hb_thread_close( &pool->threads[ii] );
+    }
+    free( pool->threads );
+    hb_lock_close( &pool->lock );
+    hb_cond_close( &pool->work );
+    hb_cond_close( &pool->complete );
+    free( pool );
+}
+
+void hb_parallel_for( int count, hb_parallel_func_t * func, void * arg )
+{
+    hb_thread_pool_t  * pool = thread_pool;
+    hb_parallel_job_t   job;
+    int                 index;
+
+    if( pool == NULL || pool->thread_count == 0 || count < 2 )
+    {
+        /*
+         * Nothing to share, run every iteration on the calling thread.
+         */
+        for( index = 0; index < count; index++ )
+        {
+            func( arg, index );
+        }
+        return;
+    }
+
+    job.func      = func;
+    job.arg       = arg;
+    job.count     = count;
+    job.started   = 0;
+    job.completed = 0;
+    job.next      = NULL;
+
+    hb_lock( pool->lock );
+    if( pool->tail != NULL )
+    {
+        pool->tail->next = &job;
+    }
+    else
+    {
+        pool->head = &job;
+    }
+    pool->tail = &job;
+    hb_cond_broadcast( pool->work );
+
+    /*
+     * Work on our own loop rather than sleeping while the pool does.
+     */
+    while( pool_claim( pool, &job, &index ) != NULL )
+    {
+        hb_unlock( pool->lock );
+
+        func( arg, index );
+
+        hb_lock( pool->lock );
+        pool_complete( pool, &job );
+    }
+
+    while( job.completed < job.count )
+    {
+        hb_cond_wait( pool->complete, pool->lock );
+    }
+    hb_unlock( pool->lock );
+}
@@ -0,0 +1,35 @@
+/* threadpool.h
+
+   Copyright (c) 2003-2014 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#ifndef HB_THREADPOOL_H
+#define HB_THREADPOOL_H
+
+/*
+ * Process wide pool of worker threads shared by all filters.
+ *
+ * hb_parallel_for() runs func( arg, index ) once for every index in
+ * [0, count) and returns when all of them have completed.  The calling
+ * thread works on its own loop too, and idle pool workers pick up
+ * iterations from whichever loops are pending, so slice jobs submitted
+ * by different filters overlap instead of each filter keeping a private
+ * set of threads.
+ *
+ * Iterations of a loop are started in increasing index order, and an
+ * iteration is only handed out once every lower index has been started.
+ * An iteration may therefore wait on results of lower indexes (see the
+ * hqdn3d wavefront in denoise.c), but never on higher ones.
+ */
+typedef void (hb_parallel_func_t)( void * arg, int index );
+
+int  hb_thread_pool_init( int thread_count );
+void hb_thread_pool_close( void );
+
+void hb_parallel_for( int count, hb_parallel_func_t * func, void * arg );
+
+#endif /* HB_THREADPOOL_H */
@@ -287,7 +287,7 @@ static void adjust_frame_rate( hb_filter_private_t *pv, hb_buffer_t **buf_out )
             for ( ; excess_dur >= pv->frame_rate; excess_dur -= pv->frame_rate )
             {
                 /* next frame too far ahead - dup current frame */
-                hb_buffer_t *dup = hb_buffer_dup( out );
+                hb_buffer_t *dup = hb_buffer_ref( out );
                 dup->s.new_chap = 0;
                 dup->s.start = cfr_stop;
                 cfr_stop += pv->frame_rate;
@@ -436,7 +436,7 @@ static void hb_vfr_close( hb_filter_object_t * filter )
 
     if( pv->job )
     {
-        hb_interjob_t * interjob = hb_interjob_get( pv->job->h );
+        hb_interjob_t * interjob = pv->job->interjob;
         
         /* Preserve dropped frame count for more accurate 
          * framerates in 2nd passes. 
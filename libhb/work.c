@@ -17,19 +17,72 @@
 #include "qsv_filter_pp.h"
 #endif
 
+typedef struct hb_work_chain_s hb_work_chain_t;
+
 typedef struct
 {
+    hb_handle_t * h;
     hb_list_t * jobs;
     hb_job_t  ** current_job;
     hb_error_code * error;
     volatile int * die;
 
+    /* Concurrent jobs, see work_schedule() */
+    int               max_jobs;
+    int               thread_budget;
+    int               threads_used;
+    int               chain_count;
+    hb_work_chain_t * chains;       /* running chains, oldest first */
+    hb_lock_t       * lock;
+    hb_cond_t       * cond;         /* signalled when a chain is done */
+
 } hb_work_t;
 
+/*
+ * The jobs of one encode (subtitle scan, first and second pass) share a
+ * sequence_id.  They run one after the other on the chain's thread and
+ * hand results on through the chain's hb_interjob_t.
+ */
+struct hb_work_chain_s
+{
+    hb_work_t       * work;
+    int               sequence_id;
+    hb_job_t        * job;          /* job running now */
+    int               threads;      /* taken from work->thread_budget */
+    hb_interjob_t   * interjob;
+    hb_thread_t     * thread;
+    int               done;
+    hb_work_chain_t * next;
+};
+
+/*
+ * Shared by all instances of a frame parallel filter.  Input frames are
+ * numbered as they are taken from fifo_in, and an instance may only push
+ * its result once every lower numbered frame has been pushed.
+ */
+struct hb_filter_reorder_s
+{
+    hb_lock_t * in_lock;        // Serializes reads from fifo_in
+    hb_lock_t * out_lock;       // Serializes writes to fifo_out
+    hb_cond_t * out_cond;       // Signalled when next_out advances
+    int64_t     next_in;        // Sequence number of the next input frame
+    int64_t     next_out;       // Sequence number allowed to output next
+    int         eof;            // An instance returned HB_FILTER_DONE
+
+    // Chapter bridging, see filter_loop
+    int         chapter_val;
+    int64_t     chapter_time;
+};
+
 static void work_func();
+static void work_schedule( hb_work_t * );
 static void do_job( hb_job_t *);
 static void work_loop( void * );
 static void filter_loop( void * );
+static void filter_parallel_loop( void * );
+static void filter_parallel_init( hb_job_t *, hb_filter_object_t *,
+                                  hb_filter_init_t * );
+static void filter_parallel_close( hb_filter_object_t * );
 
 #define FIFO_UNBOUNDED 65536
 #define FIFO_UNBOUNDED_WAKE 65535
@@ -42,23 +95,31 @@ static void filter_loop( void * );
 
 /**
  * Allocates work object and launches work thread with work_func.
+ * @param h Handle to hb_handle_t, notified when the thread is done.
  * @param jobs Handle to hb_list_t.
  * @param die Handle to user inititated exit indicator.
  * @param error Handle to error indicator.
+ * @param job Set to the job being worked on.
+ * @param max_jobs Number of jobs to run at once.
+ * @param thread_budget Threads shared by concurrent jobs, 0 for the CPU count.
  */
-hb_thread_t * hb_work_init( hb_list_t * jobs, volatile int * die, hb_error_code * error, hb_job_t ** job )
+hb_thread_t * hb_work_init( hb_handle_t * h, hb_list_t * jobs, volatile int * die, hb_error_code * error, hb_job_t ** job, int max_jobs, int thread_budget )
 {
     hb_work_t * work = calloc( sizeof( hb_work_t ), 1 );
 
+    work->h         = h;
     work->jobs      = jobs;
     work->current_job = job;
     work->die       = die;
     work->error     = error;
+    work->max_jobs  = max_jobs;
+    work->thread_budget = thread_budget > 0 ? thread_budget :
+                                              hb_get_cpu_count();
 
     return hb_thread_init( "work", work_func, work, HB_LOW_PRIORITY );
 }
 
-static void InitWorkState( hb_handle_t * h )
+static void InitWorkState( hb_job_t * job )
 {
     hb_state_t state;
 
@@ -72,7 +133,7 @@ static void InitWorkState( hb_handle_t * h )
     p.seconds   = -1; 
 #undef p
 
-    hb_set_state( h, &state );
+    hb_set_job_state( job, &state );
 
 }
 
@@ -87,20 +148,250 @@ static void work_func( void * _work )
 
     hb_log( "%d job(s) to process", hb_list_count( work->jobs ) );
 
-    while( !*work->die && ( job = hb_list_item( work->jobs, 0 ) ) )
+    if( work->max_jobs > 1 )
+    {
+        work_schedule( work );
+    }
+    else while( !*work->die && ( job = hb_list_item( work->jobs, 0 ) ) )
     {
         hb_list_rem( work->jobs, job );
         job->die = work->die;
         job->done_error = work->error;
+        job->interjob = hb_interjob_get( work->h );
         *(work->current_job) = job;
-        InitWorkState( job->h );
+        InitWorkState( job );
         do_job( job );
         *(work->current_job) = NULL;
     }
 
+    hb_work_done( work->h );
     free( work );
 }
 
+/*
+ * Report the oldest running chain's job as the current one.
+ * Must be called with work->lock held.
+ */
+static void work_update_current( hb_work_t * work )
+{
+    hb_work_chain_t * chain;
+
+    for( chain = work->chains; chain != NULL; chain = chain->next )
+    {
+        if( chain->job != NULL )
+        {
+            break;
+        }
+    }
+    *(work->current_job) = chain != NULL ? chain->job : NULL;
+}
+
+static int chain_running( hb_work_t * work, int sequence_id )
+{
+    hb_work_chain_t * chain;
+
+    for( chain = work->chains; chain != NULL; chain = chain->next )
+    {
+        if( chain->sequence_id == sequence_id )
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Take the first queued job of a chain that isn't running yet, picking
+ * the chain with the highest priority and, among equals, the one queued
+ * first.  Must be called with work->lock held.
+ */
+static hb_job_t * work_next_chain( hb_work_t * work )
+{
+    hb_job_t * job, * best = NULL;
+    int        i, j, seq;
+
+    for( i = 0; i < hb_list_count( work->jobs ); i++ )
+    {
+        job = hb_list_item( work->jobs, i );
+        seq = job->sequence_id & 0xFFFFFF;
+        if( chain_running( work, seq ) )
+        {
+            continue;
+        }
+        // Only the first queued job of a chain may start it
+        for( j = 0; j < i; j++ )
+        {
+            hb_job_t * prev = hb_list_item( work->jobs, j );
+            if( ( prev->sequence_id & 0xFFFFFF ) == seq )
+            {
+                break;
+            }
+        }
+        if( j < i )
+        {
+            continue;
+        }
+        if( best == NULL || job->priority > best->priority )
+        {
+            best = job;
+        }
+    }
+    if( best != NULL )
+    {
+        hb_list_rem( work->jobs, best );
+    }
+    return best;
+}
+
+/*
+ * Take the next queued job of a running chain.
+ * Must be called with work->lock held.
+ */
+static hb_job_t * work_next_in_chain( hb_work_t * work, int sequence_id )
+{
+    hb_job_t * job;
+    int        i;
+
+    for( i = 0; i < hb_list_count( work->jobs ); i++ )
+    {
+        job = hb_list_item( work->jobs, i );
+        if( ( job->sequence_id & 0xFFFFFF ) == sequence_id )
+        {
+            hb_list_rem( work->jobs, job );
+            return job;
+        }
+    }
+    return NULL;
+}
+
+static void chain_func( void * _chain )
+{
+    hb_work_chain_t * chain = _chain;
+    hb_work_t       * work  = chain->work;
+    hb_job_t        * job   = chain->job;
+
+    while( job != NULL )
+    {
+        job->die = work->die;
+        job->done_error = work->error;
+        job->interjob = chain->interjob;
+        job->thread_count = chain->threads;
+        InitWorkState( job );
+        do_job( job );
+
+        hb_lock( work->lock );
+        job = NULL;
+        if( !*work->die )
+        {
+            job = work_next_in_chain( work, chain->sequence_id );
+        }
+        chain->job = job;
+        chain->done = job == NULL;
+        work_update_current( work );
+        hb_cond_signal( work->cond );
+        hb_unlock( work->lock );
+    }
+}
+
+/*
+ * Run up to work->max_jobs chains of jobs at once.  Each chain gets an
+ * even share of the thread budget that the running chains leave over,
+ * and gives it back when it's done.
+ */
+static void work_schedule( hb_work_t * work )
+{
+    hb_work_chain_t * chain, ** prev;
+    hb_job_t        * job;
+
+    hb_log( "work: running up to %d jobs at once with %d threads",
+            work->max_jobs, work->thread_budget );
+
+    work->lock = hb_lock_init();
+    work->cond = hb_cond_init();
+
+    hb_lock( work->lock );
+    for( ;; )
+    {
+        /* Join chains that have run all their jobs */
+        prev = &work->chains;
+        while( ( chain = *prev ) != NULL )
+        {
+            if( !chain->done )
+            {
+                prev = &chain->next;
+                continue;
+            }
+            *prev = chain->next;
+            work->chain_count--;
+            work->threads_used -= chain->threads;
+
+            hb_unlock( work->lock );
+            hb_thread_close( &chain->thread );
+            if( chain->interjob->select_subtitle != NULL )
+            {
+                free( chain->interjob->select_subtitle );
+            }
+            free( chain->interjob );
+            free( chain );
+            hb_lock( work->lock );
+        }
+
+        /* Start new chains while there's room */
+        while( !*work->die && work->chain_count < work->max_jobs &&
+               ( job = work_next_chain( work ) ) != NULL )
+        {
+            chain = calloc( 1, sizeof( hb_work_chain_t ) );
+            chain->work        = work;
+            chain->job         = job;
+            chain->sequence_id = job->sequence_id & 0xFFFFFF;
+            chain->interjob    = calloc( 1, sizeof( hb_interjob_t ) );
+            chain->threads     = ( work->thread_budget - work->threads_used ) /
+                                 ( work->max_jobs - work->chain_count );
+            if( chain->threads < 1 )
+            {
+                chain->threads = 1;
+            }
+            work->threads_used += chain->threads;
+
+            for( prev = &work->chains; *prev != NULL; prev = &(*prev)->next );
+            *prev = chain;
+            work->chain_count++;
+            work_update_current( work );
+
+            hb_log( "work: starting job sequence %d with %d threads",
+                    chain->sequence_id, chain->threads );
+            chain->thread = hb_thread_init( "work_chain", chain_func, chain,
+                                            HB_LOW_PRIORITY );
+        }
+
+        if( work->chains == NULL )
+        {
+            break;
+        }
+        hb_cond_wait( work->cond, work->lock );
+    }
+    *(work->current_job) = NULL;
+    hb_unlock( work->lock );
+
+    hb_lock_close( &work->lock );
+    hb_cond_close( &work->cond );
+}
+
+/*
+ * Runs a segment of a chunked encode, see encchunk.c.  The segment job
+ * is freed when it's done.
+ */
+static void segment_func( void * segment )
+{
+    do_job( segment );
+}
+
+hb_thread_t * hb_work_segment_init( hb_job_t * segment )
+{
+    return hb_thread_init( "segment", segment_func, segment,
+                           HB_LOW_PRIORITY );
+}
+
 hb_work_object_t * hb_get_work( int id )
 {
     hb_work_object_t * w;
@@ -512,7 +803,7 @@ void hb_display_job_info(hb_job_t *job)
 /* Corrects framerates when actual duration and frame count numbers are known. */
 void correct_framerate( hb_job_t * job )
 {
-    hb_interjob_t * interjob = hb_interjob_get( job->h );
+    hb_interjob_t * interjob = job->interjob;
 
     if( ( job->sequence_id & 0xFFFFFF ) != ( interjob->last_job & 0xFFFFFF) )
         return; // Interjob information is for a different encode.
@@ -539,7 +830,8 @@ static void do_job(hb_job_t *job)
     hb_interjob_t *interjob;
     hb_work_object_t *w;
     hb_work_object_t *sync;
-    hb_work_object_t *muxer;
+    hb_work_object_t *muxer = NULL;
+    hb_work_object_t *encoder = NULL;
     hb_work_object_t *reader = hb_get_work(WORK_READER);
 
     hb_audio_t *audio;
@@ -552,7 +844,7 @@ static void do_job(hb_job_t *job)
     unsigned int subtitle_hit         = 0;
 
     title = job->title;
-    interjob = hb_interjob_get( job->h );
+    interjob = job->interjob;
 
     if( job->pass == 2 )
     {
@@ -561,16 +853,18 @@ static void do_job(hb_job_t *job)
 
     job->list_work = hb_list_init();
 
-    /* OpenCL */
-    if (job->use_opencl && (hb_ocl_init() || hb_init_opencl_run_env(0, NULL, "-I.")))
-    {
-        hb_log("work: failed to initialize OpenCL environment, using fallback");
-        job->use_opencl = 0;
-        hb_ocl_close();
-    }
+    /* Buffer pool and OpenCL, shared with jobs running at the same time */
+    hb_job_start( job );
 
     hb_log( "starting job" );
 
+    /* A chunked encode copies the job for its segments before anything
+     * below modifies it, see encchunk.c */
+    if( job->chunk_count > 1 )
+    {
+        hb_encchunk_setup( job );
+    }
+
     /* Look for the scanned subtitle in the existing subtitle list
      * select_subtitle implies that we did a scan. */
     if( !job->indepth_scan && interjob->select_subtitle )
@@ -891,6 +1185,7 @@ static void do_job(hb_job_t *job)
         for( i = 0; i < hb_list_count( job->list_filter ); )
         {
             hb_filter_object_t * filter = hb_list_item( job->list_filter, i );
+            hb_filter_init_t     filter_init = init;
             if( filter->init( filter, &init ) )
             {
                 hb_log( "Failure to initialise filter '%s', disabling",
@@ -899,6 +1194,11 @@ static void do_job(hb_job_t *job)
                 hb_filter_close( &filter );
                 continue;
             }
+            if( filter->frame_parallel && job->filter_threads > 1 &&
+                !job->indepth_scan && job->list_chunk == NULL )
+            {
+                filter_parallel_init( job, filter, &filter_init );
+            }
             i++;
         }
         job->width = init.width;
@@ -946,10 +1246,11 @@ static void do_job(hb_job_t *job)
     else
 #endif
     {
-        job->fifo_mpeg2  = hb_fifo_init( FIFO_LARGE, FIFO_LARGE_WAKE );
-        job->fifo_raw    = hb_fifo_init( FIFO_SMALL, FIFO_SMALL_WAKE );
-        job->fifo_sync   = hb_fifo_init( FIFO_SMALL, FIFO_SMALL_WAKE );
-        job->fifo_mpeg4  = hb_fifo_init( FIFO_LARGE, FIFO_LARGE_WAKE );
+        // Each of these has exactly one producer and one consumer thread
+        job->fifo_mpeg2  = hb_fifo_init_spsc( FIFO_LARGE, FIFO_LARGE_WAKE );
+        job->fifo_raw    = hb_fifo_init_spsc( FIFO_SMALL, FIFO_SMALL_WAKE );
+        job->fifo_sync   = hb_fifo_init_spsc( FIFO_SMALL, FIFO_SMALL_WAKE );
+        job->fifo_mpeg4  = hb_fifo_init_spsc( FIFO_LARGE, FIFO_LARGE_WAKE );
         job->fifo_render = NULL; // Attached to filter chain
     }
 
@@ -997,10 +1298,10 @@ static void do_job(hb_job_t *job)
             audio = hb_list_item(job->list_audio, i);
 
             /* set up the audio work structures */
-            audio->priv.fifo_raw  = hb_fifo_init(FIFO_SMALL, FIFO_SMALL_WAKE);
-            audio->priv.fifo_sync = hb_fifo_init(FIFO_SMALL, FIFO_SMALL_WAKE);
-            audio->priv.fifo_out  = hb_fifo_init(FIFO_LARGE, FIFO_LARGE_WAKE);
-            audio->priv.fifo_in   = hb_fifo_init(FIFO_LARGE, FIFO_LARGE_WAKE);
+            audio->priv.fifo_raw  = hb_fifo_init_spsc(FIFO_SMALL, FIFO_SMALL_WAKE);
+            audio->priv.fifo_sync = hb_fifo_init_spsc(FIFO_SMALL, FIFO_SMALL_WAKE);
+            audio->priv.fifo_out  = hb_fifo_init_spsc(FIFO_LARGE, FIFO_LARGE_WAKE);
+            audio->priv.fifo_in   = hb_fifo_init_spsc(FIFO_LARGE, FIFO_LARGE_WAKE);
 
             /* Passthru audio */
             if (audio->config.out.codec & HB_ACODEC_PASS_FLAG)
@@ -1187,7 +1488,17 @@ static void do_job(hb_job_t *job)
         hb_error("No video decoder set!");
         goto cleanup;
     }
-    hb_list_add(job->list_work, (w = hb_get_work(title->video_codec)));
+    if( job->list_chunk != NULL )
+    {
+        // The segment jobs decode their own video, sync only needs the
+        // time stamps here, see encchunk.c
+        w = hb_get_work( WORK_CHUNKTIMING );
+    }
+    else
+    {
+        w = hb_get_work( title->video_codec );
+    }
+    hb_list_add( job->list_work, w );
     w->codec_param = title->video_codec_param;
     w->fifo_in  = job->fifo_mpeg2;
     w->fifo_out = job->fifo_raw;
@@ -1222,7 +1533,13 @@ static void do_job(hb_job_t *job)
     /* Set up the video filter fifo pipeline */
     if( !job->indepth_scan )
     {
-        if( job->list_filter )
+        if( job->list_chunk != NULL )
+        {
+            // The segment jobs filter their own video, the stand-in
+            // frames that get here only keep the audio in sync
+            job->fifo_render = NULL;
+        }
+        else if( job->list_filter )
         {
             int filter_count = hb_list_count( job->list_filter );
             int i;
@@ -1233,8 +1550,23 @@ static void do_job(hb_job_t *job)
                 hb_filter_object_t * filter = hb_list_item( job->list_filter, i );
 
                 filter->fifo_in = fifo_in;
-                filter->fifo_out = hb_fifo_init( FIFO_MINI, FIFO_MINI_WAKE );
+                filter->fifo_out = hb_fifo_init_spsc( FIFO_MINI, FIFO_MINI_WAKE );
                 fifo_in = filter->fifo_out;
+
+                // Instances of a frame parallel filter take turns on
+                // both fifos under the reorder locks, so the fifos still
+                // see one reader and one writer at a time
+                if( filter->instances != NULL )
+                {
+                    int j;
+                    for( j = 0; j < hb_list_count( filter->instances ); j++ )
+                    {
+                        hb_filter_object_t * instance;
+                        instance = hb_list_item( filter->instances, j );
+                        instance->fifo_in  = filter->fifo_in;
+                        instance->fifo_out = filter->fifo_out;
+                    }
+                }
             }
             job->fifo_render = fifo_in;
         }
@@ -1245,7 +1577,12 @@ static void do_job(hb_job_t *job)
         }
 
         /* Video encoder */
-        switch( job->vcodec )
+        if( job->list_chunk != NULL )
+        {
+            // The segment jobs run the real encoder
+            w = hb_get_work( WORK_ENCCHUNK );
+        }
+        else switch( job->vcodec )
         {
         case HB_VCODEC_FFMPEG_MPEG4:
             w = hb_get_work( WORK_ENCAVCODEC );
@@ -1283,6 +1620,13 @@ static void do_job(hb_job_t *job)
 
         w->fifo_out = job->fifo_mpeg4;
         w->config   = &job->config;
+        if( job->fifo_chunk != NULL )
+        {
+            // Segment of a chunked encode, the encoder runs in place of
+            // the muxer and feeds the parent job's encchunk
+            w->fifo_out = job->fifo_chunk;
+            encoder = w;
+        }
 
         hb_list_add( job->list_work, w );
 
@@ -1344,7 +1688,10 @@ static void do_job(hb_job_t *job)
     }
 
     /* Display settings */
-    hb_display_job_info( job );
+    if( job->fifo_chunk == NULL )
+    {
+        hb_display_job_info( job );
+    }
 
     /* Init read & write threads */
     if ( reader->init( reader, job ) )
@@ -1359,7 +1706,7 @@ static void do_job(hb_job_t *job)
 
     job->done = 0;
 
-    if( job->list_filter && !job->indepth_scan )
+    if( job->list_filter && !job->indepth_scan && job->list_chunk == NULL )
     {
         int filter_count = hb_list_count( job->list_filter );
         int i;
@@ -1373,8 +1720,28 @@ static void do_job(hb_job_t *job)
             // Filters were initialized earlier, so we just need
             // to start the filter's thread
             filter->done = &job->done;
-            filter->thread = hb_thread_init( filter->name, filter_loop, filter,
-                                             HB_LOW_PRIORITY );
+            if( filter->reorder != NULL )
+            {
+                int j;
+                for( j = 0; j < hb_list_count( filter->instances ); j++ )
+                {
+                    hb_filter_object_t * instance;
+                    instance = hb_list_item( filter->instances, j );
+                    instance->done = &job->done;
+                    instance->thread = hb_thread_init( instance->name,
+                                                       filter_parallel_loop,
+                                                       instance,
+                                                       HB_LOW_PRIORITY );
+                }
+                filter->thread = hb_thread_init( filter->name,
+                                                 filter_parallel_loop, filter,
+                                                 HB_LOW_PRIORITY );
+            }
+            else
+            {
+                filter->thread = hb_thread_init( filter->name, filter_loop,
+                                                 filter, HB_LOW_PRIORITY );
+            }
         }
     }
 
@@ -1384,6 +1751,11 @@ static void do_job(hb_job_t *job)
         w = hb_list_item( job->list_work, i );
         w->done = &job->done;
         w->thread_sleep_interval = 10;
+        if( w == encoder )
+        {
+            // Runs in this thread, see below
+            continue;
+        }
         if( w->init( w, job ) )
         {
             hb_error( "Failure to initialise thread '%s'", w->name );
@@ -1415,14 +1787,36 @@ static void do_job(hb_job_t *job)
         sync->thread = hb_thread_init( sync->name, work_loop, sync,
                                     HB_LOW_PRIORITY );
 
-        // The muxer requires track information that's set up by the encoder
-        // init routines so we have to init the muxer last.
-        muxer = hb_muxer_init( job );
-        w = muxer;
+        if( encoder != NULL )
+        {
+            if( encoder->init( encoder, job ) )
+            {
+                hb_error( "Failure to initialise thread '%s'", encoder->name );
+                *job->done_error = HB_ERROR_INIT;
+                *job->die = 1;
+                goto cleanup;
+            }
+            muxer = NULL;
+            w = encoder;
+        }
+        else
+        {
+            // The muxer requires track information that's set up by the
+            // encoder init routines so we have to init the muxer last.
+            muxer = hb_muxer_init( job );
+            w = muxer;
+        }
     }
 
     hb_buffer_t      * buf_in, * buf_out = NULL;
 
+    if( muxer != NULL )
+    {
+        // The muxer waits on the fifos of all tracks at once,
+        // it returns when they're all done
+        hb_muxer_loop( muxer );
+    }
+
     while ( !*job->die && !*w->done && w->status != HB_WORK_DONE )
     {
         buf_in = hb_fifo_get_wait( w->fifo_in );
@@ -1474,11 +1868,13 @@ static void do_job(hb_job_t *job)
     hb_log("work: average encoding speed for job is %f fps", state.param.working.rate_avg);
 
     job->done = 1;
-    if( muxer != NULL )
+    if( encoder != NULL )
+    {
+        // Freed along with the other work objects
+        encoder->close( encoder );
+    }
+    if( muxer != NULL || encoder != NULL )
     {
-        muxer->close( muxer );
-        free( muxer );
-
         if( sync->thread != NULL )
         {
             hb_thread_close( &sync->thread );
@@ -1507,6 +1903,7 @@ cleanup:
             {
                 hb_thread_close( &filter->thread );
             }
+            filter_parallel_close( filter );
             filter->close( filter );
         }
     }
@@ -1533,6 +1930,14 @@ cleanup:
     }
     free( reader );
 
+    /* The muxer's fifo group is woken by every push to the track fifos,
+     * so the muxer is closed once all the threads that push are gone */
+    if( muxer != NULL )
+    {
+        muxer->close( muxer );
+        free( muxer );
+    }
+
     /* Close fifos */
     hb_fifo_close( &job->fifo_mpeg2 );
     hb_fifo_close( &job->fifo_raw );
@@ -1648,15 +2053,28 @@ cleanup:
         }
     }
 
-    hb_buffer_pool_free();
-          
-    /* OpenCL: must be closed *after* freeing the buffer pool */
-    if (job->use_opencl)
+    /* Segment jobs that never got started */
+    if( job->list_chunk != NULL )
     {
-        hb_ocl_close();
+        hb_job_t * segment;
+        while( ( segment = hb_list_item( job->list_chunk, 0 ) ) )
+        {
+            hb_list_rem( job->list_chunk, segment );
+            hb_encchunk_segment_close( &segment );
+        }
+        hb_list_close( &job->list_chunk );
+    }
+
+    hb_job_done( job );
+
+    if( job->fifo_chunk != NULL )
+    {
+        hb_encchunk_segment_close( &job );
+    }
+    else
+    {
+        hb_job_close( &job );
     }
-    
-    hb_job_close( &job );
 }
 
 static inline void copy_chapter( hb_buffer_t * dst, hb_buffer_t * src )
@@ -1842,3 +2260,184 @@ static void filter_loop( void * _f )
     }
 }
 
+/**
+ * Creates job->filter_threads - 1 extra instances of a frame parallel
+ * filter.  Each instance is initialized from the same settings as the
+ * original, so any of them produces the same output for a given frame.
+ * @param job Handle to hb_job_t.
+ * @param filter Filter that has already been initialized.
+ * @param init Init values the filter was initialized with.
+ */
+static void filter_parallel_init( hb_job_t * job, hb_filter_object_t * filter,
+                                  hb_filter_init_t * init )
+{
+    hb_filter_reorder_t * r;
+    int                   i;
+
+    r = calloc( 1, sizeof( hb_filter_reorder_t ) );
+    r->in_lock  = hb_lock_init();
+    r->out_lock = hb_lock_init();
+    r->out_cond = hb_cond_init();
+
+    filter->instances = hb_list_init();
+    for( i = 1; i < job->filter_threads; i++ )
+    {
+        hb_filter_object_t * instance = hb_filter_copy( filter );
+        hb_filter_init_t     instance_init = *init;
+
+        instance->private_data = NULL;
+        instance->instances    = NULL;
+        if( instance->init( instance, &instance_init ) )
+        {
+            hb_log( "Failure to initialise instance %d of filter '%s'",
+                    i, filter->name );
+            hb_filter_close( &instance );
+            break;
+        }
+        instance->reorder = r;
+        hb_list_add( filter->instances, instance );
+    }
+
+    if( hb_list_count( filter->instances ) == 0 )
+    {
+        hb_list_close( &filter->instances );
+        hb_lock_close( &r->in_lock );
+        hb_lock_close( &r->out_lock );
+        hb_cond_close( &r->out_cond );
+        free( r );
+        return;
+    }
+    filter->reorder = r;
+
+    hb_log( "work: running filter '%s' on %d frames in parallel",
+            filter->name, hb_list_count( filter->instances ) + 1 );
+}
+
+static void filter_parallel_close( hb_filter_object_t * filter )
+{
+    hb_filter_object_t  * instance;
+    hb_filter_reorder_t * r = filter->reorder;
+
+    if( filter->instances == NULL )
+    {
+        return;
+    }
+
+    while( ( instance = hb_list_item( filter->instances, 0 ) ) )
+    {
+        hb_list_rem( filter->instances, instance );
+        if( instance->thread != NULL )
+        {
+            hb_thread_close( &instance->thread );
+        }
+        instance->close( instance );
+        hb_filter_close( &instance );
+    }
+    hb_list_close( &filter->instances );
+
+    if( r != NULL )
+    {
+        hb_lock_close( &r->in_lock );
+        hb_lock_close( &r->out_lock );
+        hb_cond_close( &r->out_cond );
+        free( r );
+        filter->reorder = NULL;
+    }
+}
+
+/**
+ * Runs one instance of a frame parallel filter.  Every instance takes the
+ * next frame from the shared input fifo, filters it on its own thread,
+ * then waits for its turn to push the result so that frames leave the
+ * filter in the order they arrived.
+ * @param _f Handle to one hb_filter_object_t instance.
+ */
+static void filter_parallel_loop( void * _f )
+{
+    hb_filter_object_t  * f = _f;
+    hb_filter_reorder_t * r = f->reorder;
+    hb_buffer_t         * buf_in, * buf_out;
+    int64_t               seq;
+    int                   chapter_val;
+    int64_t               chapter_time = 0;
+
+    while( !*f->done && !hb_atomic_load( &r->eof ) )
+    {
+        hb_lock( r->in_lock );
+        buf_in = hb_fifo_get_wait( f->fifo_in );
+        if ( buf_in == NULL )
+        {
+            hb_unlock( r->in_lock );
+            continue;
+        }
+        seq = r->next_in++;
+        hb_unlock( r->in_lock );
+
+        // Remember chapter information here, it is bridged to the
+        // next output buffer in order below
+        chapter_val = buf_in->s.new_chap;
+        if ( chapter_val )
+        {
+            chapter_time = buf_in->s.start;
+            buf_in->s.new_chap = 0;
+        }
+
+        buf_out = NULL;
+        f->status = f->work( f, &buf_in, &buf_out );
+        if( buf_in )
+        {
+            hb_buffer_close( &buf_in );
+        }
+
+        hb_lock( r->out_lock );
+        while ( r->next_out != seq && !*f->done )
+        {
+            // job->done is not signalled on out_cond, so poll for it
+            hb_cond_timedwait( r->out_cond, r->out_lock, 100 );
+        }
+        if ( chapter_val )
+        {
+            r->chapter_time = chapter_time;
+            r->chapter_val = chapter_val;
+        }
+        if ( buf_out && r->chapter_val && r->chapter_time <= buf_out->s.start )
+        {
+            buf_out->s.new_chap = r->chapter_val;
+            r->chapter_val = 0;
+        }
+        if ( buf_out && f->fifo_out == NULL )
+        {
+            hb_buffer_close( &buf_out );
+        }
+        while ( buf_out && !*f->done )
+        {
+            if ( hb_fifo_full_wait( f->fifo_out ) )
+            {
+                hb_fifo_push( f->fifo_out, buf_out );
+                buf_out = NULL;
+            }
+        }
+        if ( buf_out )
+        {
+            hb_buffer_close( &buf_out );
+        }
+        if ( f->status == HB_FILTER_DONE )
+        {
+            hb_atomic_store( &r->eof, 1 );
+        }
+        r->next_out++;
+        hb_cond_broadcast( r->out_cond );
+        hb_unlock( r->out_lock );
+    }
+
+    // Consume data in incoming fifo till job complete so that
+    // residual data does not stall the pipeline
+    while( !*f->done )
+    {
+        hb_lock( r->in_lock );
+        buf_in = hb_fifo_get_wait( f->fifo_in );
+        hb_unlock( r->in_lock );
+        if ( buf_in != NULL )
+            hb_buffer_close( &buf_in );
+    }
+}
@@ -0,0 +1,509 @@
+/* writer.c
+
+   Copyright (c) 2003-2014 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Write-behind output for the muxers.
+ *
+ * Muxers write small pieces (a frame, an atom header) and every one of
+ * them used to go to the file system from the mux thread.  When the
+ * output is on slow or network storage a write that stalls holds up the
+ * muxer, and with it the fifos all the way back to the encoders.
+ *
+ * Writes are gathered into large chunks that end on multiples of the
+ * chunk size in the file, and a thread of its own writes the chunks out.
+ * The muxer only waits when HB_WRITER_QUEUE chunks are already waiting
+ * to be written.  Seeks, which muxers use to patch headers, just start a
+ * new chunk.  Chunks are written in order, so a patch always lands on
+ * top of what it patches.
+ *
+ * Muxers that do their own file I/O through stdio (libmkv) are handed a
+ * stream on top of the writer, see hb_writer_stream().
+ */
+
+#define _GNU_SOURCE
+#include "hb.h"
+
+#define HB_WRITER_CHUNK ( 4 * 1024 * 1024 )
+#define HB_WRITER_QUEUE 8
+
+typedef struct hb_write_chunk_s hb_write_chunk_t;
+
+struct hb_write_chunk_s
+{
+    int64_t            pos;         // where the chunk goes in the file
+    int                size;
+    int                alloc;
+    uint8_t          * data;
+    hb_write_chunk_t * next;
+};
+
+struct hb_writer_s
+{
+    char             * path;
+    FILE             * file;
+    hb_thread_t      * thread;
+    hb_lock_t        * lock;
+    hb_cond_t        * cond_queued;    // a chunk was queued, or done
+    hb_cond_t        * cond_written;   // a chunk was written
+    hb_write_chunk_t * first;          // chunks waiting to be written
+    hb_write_chunk_t * last;
+    hb_write_chunk_t * spare;          // written chunks for reuse
+    int                queued;
+    int                done;
+    int                error;
+    volatile int     * die;            // job->die, the output is abandoned
+
+    hb_write_chunk_t * current;        // chunk being filled
+    int64_t            pos;            // where the muxer writes next
+    int64_t            size;           // end of everything written
+
+    // Statistics
+    uint64_t           bytes;
+    int                chunks;
+    int                max_queued;
+    int                stalls;         // writes that waited for the thread
+    uint64_t           stall_time;     // us the muxer waited
+    uint64_t           write_time;     // us the thread spent writing
+};
+
+static int writer_dying( hb_writer_t * w )
+{
+    return w->die != NULL && *w->die;
+}
+
+static void writer_thread( void * _w )
+{
+    hb_writer_t      * w = _w;
+    hb_write_chunk_t * chunk;
+    uint64_t           start;
+    int                failed;
+
+    hb_lock( w->lock );
+    while( 1 )
+    {
+        while( w->first == NULL && !w->done )
+        {
+            hb_cond_wait( w->cond_queued, w->lock );
+        }
+        chunk = w->first;
+        if( chunk == NULL )
+        {
+            break;
+        }
+        hb_unlock( w->lock );
+
+        // Nothing written after a cancel is of use, just drain the queue
+        start  = hb_get_time_us();
+        failed = !writer_dying( w ) &&
+                 ( w->error ||
+                   fseeko( w->file, chunk->pos, SEEK_SET ) ||
+                   fwrite( chunk->data, chunk->size, 1, w->file ) != 1 );
+        if( failed && !w->error )
+        {
+            hb_error( "writer: write of %d bytes at %"PRId64" to %s failed",
+                      chunk->size, chunk->pos, w->path );
+        }
+
+        hb_lock( w->lock );
+        w->write_time += hb_get_time_us() - start;
+        w->error |= failed;
+        w->first = chunk->next;
+        if( w->first == NULL )
+        {
+            w->last = NULL;
+        }
+        w->queued--;
+        chunk->next = w->spare;
+        w->spare    = chunk;
+        hb_cond_signal( w->cond_written );
+    }
+    hb_unlock( w->lock );
+}
+
+/***********************************************************************
+ * hb_writer_open
+ ***********************************************************************
+ * Creates the file 'path' for writing.  'estimate' is the expected size
+ * of the file, used to have the file system set aside room for it, or 0
+ * when it's unknown.  While '*die' is set the muxer no longer waits for
+ * storage and queued chunks are dropped instead of written.
+ **********************************************************************/
+hb_writer_t * hb_writer_open( const char * path, int64_t estimate,
+                              volatile int * die )
+{
+    hb_writer_t * w = calloc( sizeof( hb_writer_t ), 1 );
+
+    w->file = hb_fopen( path, "wb" );
+    if( w->file == NULL )
+    {
+        hb_error( "writer: could not create %s", path );
+        free( w );
+        return NULL;
+    }
+    // Everything goes out in big chunks already
+    setvbuf( w->file, NULL, _IONBF, 0 );
+    if( estimate > 0 && hb_fpreallocate( w->file, estimate ) == 0 )
+    {
+        hb_deep_log( 2, "writer: preallocated %"PRId64" bytes for %s",
+                     estimate, path );
+    }
+
+    w->path         = strdup( path );
+    w->die          = die;
+    w->lock         = hb_lock_init();
+    w->cond_queued  = hb_cond_init();
+    w->cond_written = hb_cond_init();
+    w->thread       = hb_thread_init( "writer", writer_thread, w,
+                                      HB_NORMAL_PRIORITY );
+    return w;
+}
+
+static void writer_queue( hb_writer_t * w )
+{
+    hb_write_chunk_t * chunk = w->current;
+    uint64_t           start;
+
+    w->current = NULL;
+    if( chunk == NULL )
+    {
+        return;
+    }
+
+    hb_lock( w->lock );
+    if( chunk->size == 0 )
+    {
+        chunk->next = w->spare;
+        w->spare    = chunk;
+        hb_unlock( w->lock );
+        return;
+    }
+    if( w->queued >= HB_WRITER_QUEUE && !w->error )
+    {
+        // Storage can't keep up, back-pressure to the muxer.  Wake up
+        // now and then, a cancel must not wait for a stuck write.
+        start = hb_get_time_us();
+        while( w->queued >= HB_WRITER_QUEUE && !w->error &&
+               !writer_dying( w ) )
+        {
+            hb_cond_timedwait( w->cond_written, w->lock, 100 );
+        }
+        w->stalls++;
+        w->stall_time += hb_get_time_us() - start;
+    }
+    if( writer_dying( w ) )
+    {
+        chunk->next = w->spare;
+        w->spare    = chunk;
+        hb_unlock( w->lock );
+        return;
+    }
+    if( w->last != NULL )
+    {
+        w->last->next = chunk;
+    }
+    else
+    {
+        w->first = chunk;
+    }
+    w->last = chunk;
+    w->queued++;
+    w->max_queued = MAX( w->max_queued, w->queued );
+    w->bytes     += chunk->size;
+    w->chunks++;
+    hb_cond_signal( w->cond_queued );
+    hb_unlock( w->lock );
+}
+
+static hb_write_chunk_t * writer_chunk( hb_writer_t * w )
+{
+    hb_write_chunk_t * chunk;
+
+    hb_lock( w->lock );
+    chunk = w->spare;
+    if( chunk != NULL )
+    {
+        w->spare = chunk->next;
+    }
+    hb_unlock( w->lock );
+
+    if( chunk == NULL )
+    {
+        chunk = calloc( sizeof( hb_write_chunk_t ), 1 );
+        if( chunk == NULL )
+        {
+            return NULL;
+        }
+        chunk->data = malloc( HB_WRITER_CHUNK );
+        if( chunk->data == NULL )
+        {
+            free( chunk );
+            return NULL;
+        }
+        chunk->alloc = HB_WRITER_CHUNK;
+    }
+    chunk->next = NULL;
+    chunk->size = 0;
+    chunk->pos  = w->pos;
+    // End the chunk on a chunk size boundary of the file
+    chunk->alloc = HB_WRITER_CHUNK - w->pos % HB_WRITER_CHUNK;
+
+    return chunk;
+}
+
+/***********************************************************************
+ * hb_writer_write
+ ***********************************************************************
+ * Writes 'size' bytes at the current position.  Returns -1 if writing
+ * failed, now or earlier.
+ **********************************************************************/
+int hb_writer_write( hb_writer_t * w, const uint8_t * data, int size )
+{
+    hb_write_chunk_t * chunk;
+    int                len;
+
+    while( size > 0 )
+    {
+        chunk = w->current;
+        if( chunk != NULL && chunk->pos + chunk->size != w->pos )
+        {
+            // Seeked away from the end of the chunk
+            writer_queue( w );
+            chunk = NULL;
+        }
+        if( chunk == NULL )
+        {
+            chunk = w->current = writer_chunk( w );
+            if( chunk == NULL )
+            {
+                hb_error( "writer: out of memory" );
+                w->error = 1;
+                return -1;
+            }
+        }
+
+        len = MIN( size, chunk->alloc - chunk->size );
+        memcpy( chunk->data + chunk->size, data, len );
+        chunk->size += len;
+        w->pos      += len;
+        w->size      = MAX( w->size, w->pos );
+        data        += len;
+        size        -= len;
+
+        if( chunk->size == chunk->alloc )
+        {
+            writer_queue( w );
+        }
+    }
+    return w->error ? -1 : 0;
+}
+
+int64_t hb_writer_seek( hb_writer_t * w, int64_t pos )
+{
+    if( pos < 0 )
+    {
+        return -1;
+    }
+    w->pos = pos;
+    return pos;
+}
+
+int64_t hb_writer_tell( hb_writer_t * w )
+{
+    return w->pos;
+}
+
+int64_t hb_writer_size( hb_writer_t * w )
+{
+    return w->size;
+}
+
+/***********************************************************************
+ * hb_writer_close
+ ***********************************************************************
+ * Writes out what's left and closes the file.  Returns 0 if all writes
+ * made it to the file.
+ **********************************************************************/
+int hb_writer_close( hb_writer_t ** _w )
+{
+    hb_writer_t      * w = *_w;
+    hb_write_chunk_t * chunk;
+    int                error;
+
+    if( w == NULL )
+    {
+        return 0;
+    }
+
+    writer_queue( w );
+    hb_lock( w->lock );
+    w->done = 1;
+    hb_cond_signal( w->cond_queued );
+    hb_unlock( w->lock );
+    hb_thread_close( &w->thread );
+
+    // Give back what the file system set aside beyond the end
+    if( fflush( w->file ) || hb_ftruncate( w->file, w->size ) )
+    {
+        w->error = 1;
+    }
+    if( fclose( w->file ) )
+    {
+        w->error = 1;
+    }
+    if( w->error )
+    {
+        hb_error( "writer: failed to write %s", w->path );
+    }
+
+    hb_log( "writer: %"PRIu64" bytes in %d chunks, %.2f s writing, "
+            "up to %d chunks queued", w->bytes, w->chunks,
+            w->write_time / 1000000., w->max_queued );
+    if( w->stalls )
+    {
+        hb_log( "writer: muxer waited for storage %d times, %.2f s",
+                w->stalls, w->stall_time / 1000000. );
+    }
+
+    while( ( chunk = w->spare ) != NULL )
+    {
+        w->spare = chunk->next;
+        free( chunk->data );
+        free( chunk );
+    }
+    error = w->error;
+    hb_lock_close( &w->lock );
+    hb_cond_close( &w->cond_queued );
+    hb_cond_close( &w->cond_written );
+    free( w->path );
+    free( w );
+    *_w = NULL;
+
+    return error ? -1 : 0;
+}
+
+static int64_t writer_stream_seek( hb_writer_t * w, int64_t offset,
+                                   int whence )
+{
+    switch( whence )
+    {
+        case SEEK_CUR:
+            offset += w->pos;
+            break;
+        case SEEK_END:
+            offset += w->size;
+            break;
+    }
+    return hb_writer_seek( w, offset );
+}
+
+#if defined(__GLIBC__)
+static ssize_t writer_cookie_write( void * w, const char * data, size_t size )
+{
+    return hb_writer_write( w, (const uint8_t*)data, size ) < 0 ? -1 : size;
+}
+
+static int writer_cookie_seek( void * w, off64_t * offset, int whence )
+{
+    int64_t pos = writer_stream_seek( w, *offset, whence );
+    if( pos < 0 )
+    {
+        return -1;
+    }
+    *offset = pos;
+    return 0;
+}
+
+static int writer_cookie_close( void * w )
+{
+    hb_writer_t * writer = w;
+    return hb_writer_close( &writer );
+}
+#elif defined(SYS_DARWIN) || defined(SYS_FREEBSD) || defined(SYS_OPENBSD)
+static int writer_funopen_write( void * w, const char * data, int size )
+{
+    return hb_writer_write( w, (const uint8_t*)data, size ) < 0 ? -1 : size;
+}
+
+static fpos_t writer_funopen_seek( void * w, fpos_t offset, int whence )
+{
+    return writer_stream_seek( w, offset, whence );
+}
+
+static int writer_funopen_close( void * w )
+{
+    hb_writer_t * writer = w;
+    return hb_writer_close( &writer );
+}
+#endif
+
+/***********************************************************************
+ * hb_writer_stream
+ ***********************************************************************
+ * Wraps the writer in a stdio stream, for muxing libraries that do
+ * their own fwrite/fseeko.  The stream takes the writer over, fclose()
+ * closes it and fails if any write did.  Returns NULL, and leaves the
+ * writer alone, where the C library can't make streams of its own.
+ **********************************************************************/
+FILE * hb_writer_stream( hb_writer_t * w )
+{
+    FILE * stream = NULL;
+
+#if defined(__GLIBC__)
+    cookie_io_functions_t io =
+    {
+        .read  = NULL,
+        .write = writer_cookie_write,
+        .seek  = writer_cookie_seek,
+        .close = writer_cookie_close,
+    };
+    stream = fopencookie( w, "wb", io );
+#elif defined(SYS_DARWIN) || defined(SYS_FREEBSD) || defined(SYS_OPENBSD)
+    stream = funopen( w, NULL, writer_funopen_write, writer_funopen_seek,
+                      writer_funopen_close );
+#endif
+    if( stream != NULL )
+    {
+        // The writer gathers writes already
+        setvbuf( stream, NULL, _IONBF, 0 );
+    }
+    return stream;
+}
+
+/***********************************************************************
+ * hb_writer_estimate
+ ***********************************************************************
+ * Expected size of the job's output in bytes, or 0 if it can't be told
+ * (e.g. constant quality encodes).
+ **********************************************************************/
+int64_t hb_writer_estimate( hb_job_t * job )
+{
+    hb_audio_t * audio;
+    int64_t      kbps;
+    int          ii;
+
+    if( job->vquality >= 0 || job->vbitrate <= 0 )
+    {
+        return 0;
+    }
+    kbps = job->vbitrate;
+    for( ii = 0; ii < hb_list_count( job->list_audio ); ii++ )
+    {
+        audio = hb_list_item( job->list_audio, ii );
+        if( audio->config.out.bitrate > 0 )
+        {
+            kbps += audio->config.out.bitrate;
+        }
+        else if( audio->config.out.codec & HB_ACODEC_PASS_FLAG )
+        {
+            kbps += audio->config.in.bitrate / 1000;
+        }
+    }
+    // Plus a little for the container
+    return kbps * 1000 / 8 * hb_job_duration( job ) / 90000 * 102 / 100;
+}
@@ -146,6 +146,10 @@ static int    stop_at_frame = 0;
 static uint64_t min_title_duration = 10;
 static int use_opencl = 0;
 static int use_hwd = 0;
+static int filter_threads = 0;
+static int fragment_duration = 0;
+static int segment_duration = 0;
+static char * scan_cache = NULL;
 #ifdef USE_QSV
 static int         qsv_async_depth = -1;
 static int         qsv_decode      =  1;
@@ -311,6 +315,7 @@ int main( int argc, char ** argv )
 
     hb_system_sleep_prevent(h);
     hb_gui_use_hwd_flag = use_hwd;
+    hb_scan_set_cache( h, scan_cache );
     hb_scan( h, input, titleindex, preview_count, store_previews, min_title_duration * 90000LL );
 
     /* Wait... */
@@ -432,6 +437,7 @@ int main( int argc, char ** argv )
     free(format);
     free(input);
     free(output);
+    free(scan_cache);
     free(preset_name);
     free(x264_preset);
     free(x264_tune);
@@ -1838,6 +1844,8 @@ static int HandleEvents( hb_handle_t * h )
             {
                 job->ipod_atom = 1;
             }
+            job->fragment_duration = fragment_duration;
+            job->segment_duration  = segment_duration;
 
             if( vquality >= 0.0 )
             {
@@ -2820,6 +2828,8 @@ static int HandleEvents( hb_handle_t * h )
             /* OpenCL */
             job->use_opencl = use_opencl;
 
+            job->filter_threads = filter_threads;
+
             if( subtitle_scan )
             {
                 /*
@@ -3010,6 +3020,8 @@ static void ShowHelp()
     "                            default: 1)\n"
     "        --min-duration      Set the minimum title duration (in seconds). Shorter\n"
     "                            titles will not be scanned (default: 10).\n"
+    "        --scan-cache <dir>  Keep scan results in <dir> and reuse them when\n"
+    "                            the same unchanged file is scanned again.\n"
     "        --scan              Scan selected title only.\n"
     "        --main-feature      Detect and select the main feature title.\n"
     "    -c, --chapters <string> Select chapters (e.g. \"1-3\" for chapters\n"
@@ -3049,8 +3061,17 @@ static void ShowHelp()
     "                            of data. Note: breaks pre-iOS iPod compatibility.\n"
     "    -O, --optimize          Optimize mp4 files for HTTP streaming (\"fast start\")\n"
     "    -I, --ipod-atom         Mark mp4 files so 5.5G iPods will accept them\n"
+    "        --fragment-duration <ms>\n"
+    "                            Write a fragmented mp4 (av_mp4 only), with a\n"
+    "                            moof/mdat pair every <ms> milliseconds\n"
+    "        --segment-duration <ms>\n"
+    "                            Split fragmented mp4 output (av_mp4 only) into\n"
+    "                            <ms> millisecond .m4s files after the first\n"
     "    -P, --use-opencl        Use OpenCL where applicable\n"
     "    -U, --use-hwd           Use DXVA2 hardware decoding\n"
+    "        --filter-threads <number>\n"
+    "                            Number of frames to crop/scale and rotate at\n"
+    "                            once (default: 1)\n"
     "\n"
 
 
@@ -3574,6 +3595,10 @@ static int ParseOptions( int argc, char ** argv )
     #define QSV_IMPLEMENTATION   297
     #define FILTER_NLMEANS       298
     #define FILTER_NLMEANS_TUNE  299
+    #define FILTER_THREADS       300
+    #define SCAN_CACHE           301
+    #define FRAGMENT_DURATION    302
+    #define SEGMENT_DURATION     303
 
     for( ;; )
     {
@@ -3600,9 +3625,13 @@ static int ParseOptions( int argc, char ** argv )
             { "ipod-atom",   no_argument,       NULL,    'I' },
             { "use-opencl",  no_argument,       NULL,    'P' },
             { "use-hwd",     no_argument,       NULL,    'U' },
+            { "filter-threads", required_argument, NULL, FILTER_THREADS },
+            { "fragment-duration", required_argument, NULL, FRAGMENT_DURATION },
+            { "segment-duration", required_argument, NULL, SEGMENT_DURATION },
 
             { "title",       required_argument, NULL,    't' },
             { "min-duration",required_argument, NULL,    MIN_DURATION },
+            { "scan-cache",  required_argument, NULL,    SCAN_CACHE },
             { "scan",        no_argument,       NULL,    SCAN_ONLY },
             { "main-feature",no_argument,       NULL,    MAIN_FEATURE },
             { "chapters",    required_argument, NULL,    'c' },
@@ -4276,6 +4305,19 @@ static int ParseOptions( int argc, char ** argv )
             case MIN_DURATION:
                 min_title_duration = strtol( optarg, NULL, 0 );
                 break;
+            case FILTER_THREADS:
+                filter_threads = atoi( optarg );
+                break;
+            case FRAGMENT_DURATION:
+                fragment_duration = atoi( optarg );
+                break;
+            case SEGMENT_DURATION:
+                segment_duration = atoi( optarg );
+                break;
+            case SCAN_CACHE:
+                free( scan_cache );
+                scan_cache = strdup( optarg );
+                break;
 #ifdef USE_QSV
             case QSV_BASELINE:
                 hb_qsv_force_workarounds();
@@ -176,6 +176,18 @@ namespace HandBrake.Interop.HbLib
 
         public int use_detelecine;
 
+        public int filter_threads;
+
+        public int reader_prefetch;
+
+        public int priority;
+
+        public int chunk_count;
+
+        public int fragment_duration;
+
+        public int segment_duration;
+
         public qsv_s qsv;
 
         // Padding for the part of the struct we don't care about marshaling.